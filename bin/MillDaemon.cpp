@@ -20,6 +20,7 @@
 #include <rapidjson/document.h>
 #include <rapidjson/writer.h>
 
+#include <climits>
 #include <fstream>
 
 #include "utils/utils.hpp"
@@ -57,6 +58,8 @@ static void _ignore_upload(BlobClient *ctx) {
 static int _on_headers_complete_UPLOAD(http_parser *p) {
     auto ctx = reinterpret_cast<BlobClient *>(p->data);
     ctx->Reply100();
+    if (!(p->flags & F_CHUNKED) && p->content_length != ULLONG_MAX)
+        ctx->handler->SetContentLength(p->content_length);
     ctx->upload = ctx->handler->GetUpload();
     auto rc = ctx->upload->Prepare();
     if (rc.Ok()) {
@@ -574,6 +577,7 @@ void BlobClient::Reset() {
     upload.reset(nullptr);
     download.reset(nullptr);
     removal.reset(nullptr);
+    handler->Reset();
 }
 
 void BlobClient::SaveError(SoftError err) {
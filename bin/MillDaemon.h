@@ -57,6 +57,18 @@ class BlobHandler {
 
     virtual SoftError SetHeader(const std::string &k, const std::string &v) = 0;
 
+    /**
+     * Called before GetUpload() when the request announced its length.
+     * Ignored by default.
+     */
+    virtual void SetContentLength(uint64_t len UNUSED) {}
+
+    /**
+     * Called at the start of each request, the handler is reused by the
+     * requests of a keep-alive connection. Ignored by default.
+     */
+    virtual void Reset() {}
+
     virtual std::unique_ptr<oio::api::blob::Upload> GetUpload() = 0;
 
     virtual std::unique_ptr<oio::api::blob::Download> GetDownload() = 0;
@@ -19,6 +19,8 @@
 #include <signal.h>
 
 #include <libmill.h>
+#include <rapidjson/document.h>
+
 #include <cstdlib>
 
 #include "utils/utils.hpp"
@@ -34,10 +36,20 @@ using oio::kinetic::blob::DownloadBuilder;
 using oio::kinetic::blob::UploadBuilder;
 using oio::kinetic::client::ClientFactory;
 using oio::kinetic::client::CoroutineClientFactory;
+using oio::kinetic::client::PlacementPolicy;
+using oio::kinetic::client::RoundRobinPlacement;
+using oio::kinetic::client::TagAlgorithm;
+using oio::kinetic::client::WeightedPlacement;
 
 static volatile bool flag_running{true};
 
-static std::shared_ptr<ClientFactory> factory(nullptr);
+static std::shared_ptr<CoroutineClientFactory> factory(nullptr);
+
+// Shared by all the uploads, so that it accumulates the drives' health
+static std::shared_ptr<PlacementPolicy> placement(nullptr);
+
+// Check the tag of each block downloaded
+static bool verify_tags{false};
 
 static void _sighandler_stop(int s UNUSED) {
     flag_running = 0;
@@ -57,6 +69,7 @@ class KineticHandler : public BlobHandler {
     std::unique_ptr<oio::api::blob::Upload> GetUpload() override {
         auto builder = UploadBuilder(factory);
         builder.BlockSize(1024 * 1024);
+        builder.Placement(placement);
         builder.Name(chunk_id);
         for (const auto &to : targets)
             builder.Target(to);
@@ -69,6 +82,7 @@ class KineticHandler : public BlobHandler {
     std::unique_ptr<oio::api::blob::Download> GetDownload() override {
         DownloadBuilder builder(factory);
         builder.Name(chunk_id);
+        builder.Verify(verify_tags);
         for (const auto to : targets)
             builder.Target(to);
         return builder.Build();
@@ -124,7 +138,79 @@ class KineticRepository : public BlobRepository {
 
     BlobRepository *Clone() override { return new KineticRepository; }
 
-    bool Configure(const std::string &cfg UNUSED) override { return true; }
+    bool Configure(const std::string &cfg) override {
+        rapidjson::Document doc;
+        if (doc.Parse<0>(cfg.c_str()).HasParseError()) {
+            return false;
+        }
+        if (!doc.IsObject()) {
+            LOG(ERROR) << "repository must be an object";
+            return false;
+        }
+
+        if (doc.HasMember("connections")) {
+            if (!doc["connections"].IsUint64()) {
+                LOG(ERROR) << "repository.connections must be integer";
+                return false;
+            }
+            factory->Connections(doc["connections"].GetUint64());
+        }
+        if (doc.HasMember("placement")) {
+            const auto &p = doc["placement"];
+            if (!p.IsString()) {
+                LOG(ERROR) << "repository.placement must be a string";
+                return false;
+            }
+            const std::string name(p.GetString());
+            if (name == "weighted") {
+                placement.reset(new WeightedPlacement);
+            } else if (name == "round-robin") {
+                placement.reset(new RoundRobinPlacement);
+            } else {
+                LOG(ERROR) << "repository.placement: unknown " << name;
+                return false;
+            }
+        }
+        if (doc.HasMember("tag")) {
+            const auto &t = doc["tag"];
+            TagAlgorithm algo;
+            if (!t.IsString() ||
+                    !oio::kinetic::client::tag_parse(t.GetString(), &algo)) {
+                LOG(ERROR) << "repository.tag must be one of "
+                           << "sha1, sha2, crc32c, crc64";
+                return false;
+            }
+            oio::kinetic::client::default_tag = algo;
+        }
+        if (doc.HasMember("verify")) {
+            if (!doc["verify"].IsBool()) {
+                LOG(ERROR) << "repository.verify must be a boolean";
+                return false;
+            }
+            verify_tags = doc["verify"].GetBool();
+        }
+        if (doc.HasMember("drives")) {
+            // Per-drive overrides, e.g. {"127.0.0.1:8123": {"connections": 4}}
+            if (!doc["drives"].IsObject()) {
+                LOG(ERROR) << "repository.drives must be an object";
+                return false;
+            }
+            const auto &drives = doc["drives"];
+            for (auto it = drives.MemberBegin(); it != drives.MemberEnd();
+                    ++it) {
+                const auto &drive = it->value;
+                if (!drive.IsObject() || !drive.HasMember("connections") ||
+                        !drive["connections"].IsUint64()) {
+                    LOG(ERROR) << "repository.drives." << it->name.GetString()
+                               << ".connections must be integer";
+                    return false;
+                }
+                factory->Connections(it->name.GetString(),
+                                     drive["connections"].GetUint64());
+            }
+        }
+        return true;
+    }
 
     BlobHandler *Handler() override { return new KineticHandler(); }
 };
@@ -150,6 +236,8 @@ int main(int argc, char **argv) {
     mill_goprepare(1024, 16384, sizeof(void *));
 
     factory.reset(new CoroutineClientFactory);
+    // Unless a repository opts in the weighted placement
+    placement.reset(new RoundRobinPlacement);
     std::shared_ptr<BlobRepository> repo(new KineticRepository);
     BlobDaemon daemon(repo);
     for (int i = 1; i < argc; ++i) {
@@ -0,0 +1,75 @@
+/**
+ * This file is part of the CLI tools around the OpenIO client libraries
+ * Copyright (C) 2016 OpenIO SAS
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <signal.h>
+
+#include <libmill.h>
+
+#include <memory>
+
+#include "utils/macros.h"
+#include "oio/blob/kinetic/coro/Simulator.h"
+
+using oio::kinetic::sim::Simulator;
+using oio::kinetic::sim::Store;
+using oio::kinetic::sim::store_make_memory;
+using oio::kinetic::sim::store_make_directory;
+
+DEFINE_string(sim_directory, "",
+              "Store the values in that directory instead of in memory");
+DEFINE_int64(sim_latency, 0, "Delay (ms) applied to each reply");
+DEFINE_uint64(sim_bandwidth, 0, "Bytes per second, 0 for unlimited");
+DEFINE_uint64(sim_capacity, 1ULL << 40, "Capacity announced in the GETLOG");
+
+int main(int argc, char **argv) {
+    gflags::ParseCommandLineFlags(&argc, &argv, true);
+    google::InitGoogleLogging(argv[0]);
+    FLAGS_logtostderr = true;
+
+    if (argc != 2) {
+        LOG(ERROR) << "Usage: " << argv[0] << " IP:PORT";
+        return 1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    std::unique_ptr<Store> store;
+    if (FLAGS_sim_directory.empty())
+        store.reset(store_make_memory());
+    else
+        store.reset(store_make_directory(FLAGS_sim_directory));
+    if (!store) {
+        LOG(ERROR) << "Invalid directory " << FLAGS_sim_directory;
+        return 1;
+    }
+
+    Simulator simulator;
+    simulator.Backend(store.release());
+    simulator.Latency(FLAGS_sim_latency);
+    simulator.Bandwidth(FLAGS_sim_bandwidth);
+    simulator.Capacity(FLAGS_sim_capacity);
+    if (!simulator.Start(argv[1])) {
+        LOG(ERROR) << "Bind failed on " << argv[1];
+        return 1;
+    }
+    LOG(INFO) << "Kinetic simulator listening on " << simulator.Url();
+
+    while (true)
+        msleep(mill_now() + 1000);
+    return 0;
+}
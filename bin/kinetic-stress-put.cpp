@@ -19,17 +19,23 @@
 #include <signal.h>
 
 #include <libmill.h>
+#include <rapidjson/writer.h>
+#include <rapidjson/stringbuffer.h>
 
+#include <cmath>
+#include <cstdio>
 #include <cstdlib>
 #include <memory>
-#include <queue>
+#include <random>
+#include <sstream>
 #include <chrono>  // NOLINT
 
 #include "utils/macros.h"
+#include "utils/utils.hpp"
 #include "oio/blob/kinetic/coro/ClientInterface.h"
 #include "oio/blob/kinetic/coro/CoroutineClientFactory.h"
 #include "oio/blob/kinetic/coro/RPC.h"
-#include "oio/blob/kinetic/coro/blob.hpp"
+#include "oio/blob/kinetic/coro/Simulator.h"
 
 using oio::kinetic::client::CoroutineClientFactory;
 using oio::kinetic::client::ClientInterface;
@@ -37,18 +43,36 @@ using oio::kinetic::client::Sync;
 using oio::kinetic::client::Exchange;
 using oio::kinetic::client::Slice;
 using oio::kinetic::client::Put;
-using oio::kinetic::blob::UploadBuilder;
+using oio::kinetic::client::Get;
+using oio::kinetic::client::Delete;
+using oio::kinetic::sim::Simulator;
 
 using Clock = std::chrono::steady_clock;
-using Precision = std::chrono::milliseconds;
+using Precision = std::chrono::microseconds;
 
 static volatile bool flag_runnning{true};
 
 DEFINE_bool(write_through, false, "Sync before reply or not");
-DEFINE_uint64(put_window, 64, "Number of frames in flight");
-DEFINE_uint64(block_size, 1024 * 1024, "Number of bytes in each frame");
-DEFINE_uint64(block_count, 1024, "Number of blacks sent");
+DEFINE_uint64(put_window, 64, "Number of requests in flight");
+DEFINE_uint64(block_size, 1024 * 1024, "Mean number of bytes in each value");
+DEFINE_uint64(block_count, 1024,
+              "Number of requests measured after the warmup, 0 for no limit");
 DEFINE_string(naming, "rand", "Should the number be ");
+DEFINE_string(urls, "",
+              "Comma-separated drives. Default: the [URL] env variable, or "
+              "an in-process simulator");
+DEFINE_int32(connections, 1, "Number of connections toward each drive");
+DEFINE_string(mix, "1:0:0", "Ratio of PUT:GET:DELETE");
+DEFINE_string(size_dist, "fixed",
+              "Value sizes around -block_size (fixed|uniform|exp)");
+DEFINE_uint64(warmup, 0, "Number of requests sent before the measures start");
+DEFINE_uint64(duration, 0, "Stop after that many ms, 0 for no limit");
+DEFINE_double(rate, 0.0,
+              "Requests per second (open loop), 0 for a closed loop");
+DEFINE_int64(report_period, 1000, "Period (ms) of the throughput samples");
+DEFINE_string(report, "", "Path of the JSON report, empty to log it");
+DEFINE_int64(sim_latency, 0, "Reply delay (ms) of the simulator, without URL");
+DEFINE_uint64(sim_bandwidth, 0, "Bandwidth (B/s) of the simulator, 0=none");
 
 
 class NameIterator {
@@ -105,54 +129,330 @@ class BackwardsNameIterator : public NameIterator {
 };
 
 
-static uint64_t push_loop(uint64_t max, const Slice &buf,
-        std::shared_ptr<ClientInterface> client,
-        std::shared_ptr<NameIterator> namer) {
-    std::queue<std::shared_ptr<Exchange>> qops;
-    std::queue<std::shared_ptr<Sync>> qsync;
-    uint64_t count{0};
+/**
+ * Log-linear buckets, in the manner of HdrHistogram: each power of two is
+ * split in 2^SubBits buckets, i.e. a relative error under 1/2^SubBits.
+ */
+class Histogram {
+ public:
+    Histogram() : counts_((64 - SubBits + 1) << SubBits, 0),
+                  total_{0}, max_{0} {}
+
+    void Record(uint64_t v) {
+        ++counts_[index(v)];
+        ++total_;
+        max_ = std::max(max_, v);
+    }
+
+    /**
+     * @param p in ]0,100]
+     * @return the highest value of the bucket holding the percentile
+     */
+    uint64_t Percentile(double p) const {
+        if (total_ == 0)
+            return 0;
+        const auto rank = static_cast<uint64_t>(std::ceil(p * total_ / 100.0));
+        uint64_t seen{0};
+        for (size_t i = 0; i < counts_.size(); ++i) {
+            seen += counts_[i];
+            if (seen >= rank)
+                return std::min(max_, highest(i));
+        }
+        return max_;
+    }
+
+    uint64_t Count() const { return total_; }
+
+    uint64_t Max() const { return max_; }
+
+ private:
+    static constexpr unsigned SubBits = 5;
+
+    static size_t index(uint64_t v) {
+        if (v < (1ULL << SubBits))
+            return v;
+        const unsigned msb = 63 - __builtin_clzll(v);
+        const unsigned shift = msb - SubBits;
+        return ((shift + 1) << SubBits) + ((v >> shift) - (1ULL << SubBits));
+    }
+
+    static uint64_t highest(size_t idx) {
+        if (idx < (1ULL << SubBits))
+            return idx;
+        const unsigned shift = (idx >> SubBits) - 1;
+        const uint64_t sub = idx & ((1ULL << SubBits) - 1);
+        return ((sub + (1ULL << SubBits)) << shift) + (1ULL << shift) - 1;
+    }
+
+ private:
+    std::vector<uint64_t> counts_;
+    uint64_t total_;
+    uint64_t max_;
+};
+
+
+enum class OpType { Put = 0, Get, Delete };
+
+static const char *op_names[] = {"put", "get", "delete"};
+
+struct OpStats {
+    Histogram latency;
+    uint64_t errors;
+    uint64_t bytes;
+
+    OpStats() : latency(), errors{0}, bytes{0} {}
+};
+
+/* Activity during one -report_period */
+struct Sample {
+    int64_t when;
+    uint64_t ops;
+    uint64_t bytes;
+    uint64_t errors;
+};
+
+struct Workload {
+    std::vector<std::shared_ptr<ClientInterface>> clients;
+    // Keys known to exist, per drive, as candidates for GET and DELETE
+    std::vector<std::vector<std::string>> keys;
+    std::shared_ptr<NameIterator> naming;
+    std::mt19937_64 rng;
+    std::discrete_distribution<int> mix;
+    std::vector<uint8_t> buffer;
+
+    Clock::time_point start;
+    // When the first request after the warmup started
+    Clock::time_point measured;
+    bool measuring;
+    uint64_t period_us;
+    uint64_t tickets;
+    uint64_t limit;
+    int64_t deadline;
+    bool finished;
+
+    OpStats stats[3];
+    Sample current;
+    std::vector<Sample> samples;
+
+    Workload() : clients(), keys(), naming(), rng(std::random_device()()),
+                 mix(), buffer(), start(), measured(), measuring{false},
+                 period_us{0}, tickets{0},
+                 limit{0}, deadline{0}, finished{false}, stats(),
+                 current{0, 0, 0, 0}, samples() {}
+
+    size_t valueSize() {
+        const double mean = FLAGS_block_size;
+        double sz = mean;
+        if (FLAGS_size_dist == "uniform") {
+            sz = std::uniform_real_distribution<double>(1.0, 2 * mean)(rng);
+        } else if (FLAGS_size_dist == "exp") {
+            sz = std::exponential_distribution<double>(1.0 / mean)(rng);
+        }
+        return std::max<size_t>(1, std::min<size_t>(sz, buffer.size()));
+    }
+
+    /* Pops a random key of the drive, the caller owns it */
+    bool takeKey(size_t drive, bool remove, std::string *out) {
+        auto &v = keys[drive];
+        if (v.empty())
+            return false;
+        auto i = std::uniform_int_distribution<size_t>(0, v.size() - 1)(rng);
+        out->assign(v[i]);
+        if (remove) {
+            std::swap(v[i], v.back());
+            v.pop_back();
+        }
+        return true;
+    }
+};
+
+static bool parse_mix(const std::string &s, std::vector<double> *out) {
+    double put{0}, get{0}, del{0};
+    if (3 != sscanf(s.c_str(), "%lf:%lf:%lf", &put, &get, &del))
+        return false;
+    if (put < 0 || get < 0 || del < 0 || put + get + del <= 0)
+        return false;
+    out->assign({put, get, del});
+    return true;
+}
+
+/**
+ * Runs the requests one after the other. In open loop, each request waits
+ * for its slot and its latency is counted from that slot, so that a stalled
+ * drive is not hidden by the requests it prevented from starting.
+ */
+static coroutine void worker(Workload *w, chan done) {
     std::string name;
+    std::vector<uint8_t> got;
+
+    while (flag_runnning) {
+        const uint64_t ticket = w->tickets++;
+        if (w->limit > 0 && ticket >= FLAGS_warmup + w->limit)
+            break;
+        if (w->deadline > 0 && mill_now() >= w->deadline)
+            break;
+
+        auto intended = Clock::now();
+        if (w->period_us > 0) {
+            intended = w->start + Precision(w->period_us * ticket);
+            const auto wait = std::chrono::duration_cast<
+                    std::chrono::milliseconds>(intended - Clock::now()).count();
+            if (wait > 0)
+                msleep(mill_now() + wait);
+        }
+
+        if (ticket == FLAGS_warmup) {
+            w->measured = intended;
+            w->measuring = true;
+        }
+
+        const size_t drive = ticket % w->clients.size();
+        auto type = static_cast<OpType>(w->mix(w->rng));
+        if (type != OpType::Put &&
+            !w->takeKey(drive, type == OpType::Delete, &name))
+            type = OpType::Put;
+
+        uint64_t bytes{0};
+        std::unique_ptr<Exchange> op;
+        switch (type) {
+            case OpType::Put: {
+                w->naming->Next(&name);
+                Slice slice;
+                slice.buf = w->buffer.data();
+                slice.len = w->valueSize();
+                auto put = new Put;
+                put->PostVersion("0");
+                put->Key(name);
+                put->Value(slice);
+                if (FLAGS_write_through)
+                    put->Sync(true);
+                op.reset(put);
+                bytes = slice.len;
+                break;
+            }
+            case OpType::Get: {
+                auto get = new Get;
+                get->Key(name);
+                op.reset(get);
+                break;
+            }
+            case OpType::Delete: {
+                auto del = new Delete;
+                del->Key(name);
+                op.reset(del);
+                break;
+            }
+        }
+
+        w->clients[drive]->RPC(op.get())->Wait();
+        const uint64_t spent = std::chrono::duration_cast<Precision>(
+                Clock::now() - intended).count();
 
-    while (flag_runnning && count < max) {
-        if (qops.size() < FLAGS_put_window) {
-            namer->Next(&name);
-            // Start a new upload
-            auto op = new Put;
-            op->PostVersion("0");
-            op->Key(name);
-            op->Value(buf);
-            if (FLAGS_write_through)
-                op->Sync(true);
-            auto syn = client->RPC(op);
-            // And queue it
-            qops.push(std::shared_ptr<Exchange>(op));
-            qsync.push(syn);
-
-            ++count;
-        } else if (!qops.empty()) {
-            // Finish the latest upload
-            auto op = qops.front();
-            auto syn = qsync.front();
-            qops.pop();
-            qsync.pop();
-            syn->Wait();
-            if (!op->Ok()) {
-                flag_runnning = false;
-                LOG(ERROR) << "First put failed";
+        if (op->Ok()) {
+            if (type == OpType::Put) {
+                w->keys[drive].push_back(name);
+            } else if (type == OpType::Get) {
+                static_cast<Get *>(op.get())->Steal(got);
+                bytes = got.size();
             }
         }
+        if (ticket < FLAGS_warmup)
+            continue;
+
+        auto &st = w->stats[static_cast<int>(type)];
+        st.latency.Record(spent);
+        ++w->current.ops;
+        if (op->Ok()) {
+            st.bytes += bytes;
+            w->current.bytes += bytes;
+        } else {
+            ++st.errors;
+            ++w->current.errors;
+        }
     }
+    chs(done, int, 0);
+}
 
-    while (!qops.empty()) {
-        auto op = qops.front();
-        auto syn = qsync.front();
-        qops.pop();
-        qsync.pop();
-        syn->Wait();
-        LOG_IF(ERROR, !op->Ok()) << "tail put failed";
+static coroutine void sampler(Workload *w) {
+    const int64_t t0 = mill_now();
+    int64_t next = t0;
+    while (!w->finished) {
+        next += FLAGS_report_period;
+        while (!w->finished && mill_now() < next)
+            msleep(std::min(next, mill_now() + 100));
+        w->current.when = mill_now() - t0;
+        w->samples.push_back(w->current);
+        w->current = {0, 0, 0, 0};
+    }
+}
+
+static void report(const Workload &w, double seconds, std::string *out) {
+    rapidjson::StringBuffer buf;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(buf);
+
+    writer.StartObject();
+    writer.Key("seconds");
+    writer.Double(seconds);
+    writer.Key("drives");
+    writer.Uint(w.clients.size());
+    writer.Key("connections");
+    writer.Int(FLAGS_connections);
+    writer.Key("window");
+    writer.Uint64(FLAGS_put_window);
+    writer.Key("rate");
+    writer.Double(FLAGS_rate);
+    writer.Key("mix");
+    writer.String(FLAGS_mix.c_str());
+    writer.Key("size_dist");
+    writer.String(FLAGS_size_dist.c_str());
+
+    writer.Key("ops");
+    writer.StartObject();
+    for (int i = 0; i < 3; ++i) {
+        const auto &st = w.stats[i];
+        if (st.latency.Count() == 0)
+            continue;
+        writer.Key(op_names[i]);
+        writer.StartObject();
+        writer.Key("count");
+        writer.Uint64(st.latency.Count());
+        writer.Key("errors");
+        writer.Uint64(st.errors);
+        writer.Key("bytes");
+        writer.Uint64(st.bytes);
+        writer.Key("latency_us");
+        writer.StartObject();
+        writer.Key("p50");
+        writer.Uint64(st.latency.Percentile(50.0));
+        writer.Key("p99");
+        writer.Uint64(st.latency.Percentile(99.0));
+        writer.Key("p999");
+        writer.Uint64(st.latency.Percentile(99.9));
+        writer.Key("max");
+        writer.Uint64(st.latency.Max());
+        writer.EndObject();
+        writer.EndObject();
+    }
+    writer.EndObject();
+
+    writer.Key("samples");
+    writer.StartArray();
+    for (const auto &s : w.samples) {
+        writer.StartObject();
+        writer.Key("t");
+        writer.Int64(s.when);
+        writer.Key("ops");
+        writer.Uint64(s.ops);
+        writer.Key("bytes");
+        writer.Uint64(s.bytes);
+        writer.Key("errors");
+        writer.Uint64(s.errors);
+        writer.EndObject();
     }
+    writer.EndArray();
+    writer.EndObject();
 
-    return count;
+    out->assign(buf.GetString(), buf.GetSize());
 }
 
 int main(int argc, char **argv) {
@@ -166,50 +466,125 @@ int main(int argc, char **argv) {
     signal(SIGPIPE, SIG_IGN);
     stdin = freopen("/dev/null", "r", stdin);
     stdout = freopen("/dev/null", "a", stdout);
-    mill_goprepare(2 + 2 * FLAGS_put_window, 16384, sizeof(void *));
+    mill_goprepare(4 + 2 * FLAGS_put_window, 16384, sizeof(void *));
 
-    std::vector<uint8_t> buf(FLAGS_block_size);
+    Workload w;
 
-    Slice slice;
-    slice.buf = buf.data();
-    slice.len = buf.size();
-
-    CoroutineClientFactory factory;
-
-    const char *url_device = ::getenv("URL");
-    if (url_device == nullptr) {
-        LOG(ERROR) << "Missing env variable [URL]";
+    std::vector<double> ratios;
+    if (!parse_mix(FLAGS_mix, &ratios)) {
+        LOG(ERROR) << "Invalid mix, please use PUT:GET:DELETE";
         return 1;
     }
+    w.mix = std::discrete_distribution<int>(ratios.begin(), ratios.end());
 
-    std::shared_ptr<NameIterator> naming;
+    if (FLAGS_size_dist != "fixed" && FLAGS_size_dist != "uniform" &&
+        FLAGS_size_dist != "exp") {
+        LOG(ERROR) << "Invalid size_dist, please use (fixed|uniform|exp)";
+        return 1;
+    }
+    if (FLAGS_block_size == 0 || FLAGS_put_window == 0 ||
+        FLAGS_connections <= 0 || FLAGS_report_period <= 0) {
+        LOG(ERROR) << "Invalid sizing";
+        return 1;
+    }
+    // Room for the tail of the exponential distribution
+    w.buffer.resize(FLAGS_size_dist == "exp" ? 8 * FLAGS_block_size
+                                             : 2 * FLAGS_block_size);
 
     if (FLAGS_naming == "rand") {
-        naming.reset(new RandomNameIterator);
+        w.naming.reset(new RandomNameIterator);
     } else if (FLAGS_naming == "forward") {
-        naming.reset(new ForwardNameIterator);
+        w.naming.reset(new ForwardNameIterator);
     } else if (FLAGS_naming == "backwards") {
-        naming.reset(new BackwardsNameIterator);
+        w.naming.reset(new BackwardsNameIterator);
     } else {
         LOG(ERROR) << "Invalid naming, please use (rand|forward|backwards)";
         return 1;
     }
 
-    auto client = factory.Get(url_device);
-    LOG(INFO) << "Client ready to " << client->Id();
-
-    auto pre = Clock::now();
-    uint64_t count = push_loop(FLAGS_block_count, slice, client, naming);
-    auto post = Clock::now();
-    auto spent_msec = std::chrono::duration_cast<Precision>(post - pre).count();
-
-    const uint64_t total_bytes = count * uint64_t(buf.size());
-    const uint64_t bytes_per_msec = total_bytes / spent_msec;
-    const double MB_per_sec = static_cast<double>(bytes_per_msec) / 1000.0;
+    std::vector<std::string> urls;
+    do {
+        std::string csv(FLAGS_urls);
+        if (csv.empty() && ::getenv("URL") != nullptr)
+            csv.assign(::getenv("URL"));
+        std::stringstream ss(csv);
+        std::string url;
+        while (std::getline(ss, url, ','))
+            if (!url.empty())
+                urls.push_back(url);
+    } while (0);
+
+    // Without any drive, bench against an in-process simulator
+    Simulator simulator;
+    if (urls.empty()) {
+        simulator.Latency(FLAGS_sim_latency);
+        simulator.Bandwidth(FLAGS_sim_bandwidth);
+        if (!simulator.Start("127.0.0.1:0")) {
+            LOG(ERROR) << "Simulator startup failed";
+            return 1;
+        }
+        urls.push_back(simulator.Url());
+    }
 
-    LOG(INFO) << "Sent " << total_bytes << " in " << double(spent_msec) / 1000.0
-              << " seconds "
+    CoroutineClientFactory factory;
+    factory.Connections(FLAGS_connections);
+    for (const auto &url : urls) {
+        w.clients.push_back(factory.Get(url));
+        LOG(INFO) << "Client ready to " << w.clients.back()->Id();
+    }
+    w.keys.resize(w.clients.size());
+
+    w.limit = FLAGS_block_count;
+    if (FLAGS_duration > 0)
+        w.deadline = mill_now() + FLAGS_duration;
+    if (FLAGS_rate > 0)
+        w.period_us = std::max<uint64_t>(1, 1000000.0 / FLAGS_rate);
+
+    w.start = Clock::now();
+    chan done = chmake(int, FLAGS_put_window);
+    mill_go(sampler(&w));
+    for (uint64_t i = 0; i < FLAGS_put_window; ++i)
+        mill_go(worker(&w, done));
+    for (uint64_t i = 0; i < FLAGS_put_window; ++i)
+        (void) chr(done, int);
+    chclose(done);
+    w.finished = true;
+    // The warmup is excluded from the throughput, as from the counters
+    const auto end = Clock::now();
+    const auto spent = std::chrono::duration_cast<Precision>(
+            end - (w.measuring ? w.measured : end)).count();
+    const double seconds = static_cast<double>(spent) / 1000000.0;
+
+    uint64_t total_bytes{0}, total_ops{0};
+    for (int i = 0; i < 3; ++i) {
+        const auto &st = w.stats[i];
+        total_bytes += st.bytes;
+        total_ops += st.latency.Count();
+        if (st.latency.Count() > 0)
+            LOG(INFO) << op_names[i] << " count=" << st.latency.Count()
+                      << " errors=" << st.errors
+                      << " p50=" << st.latency.Percentile(50.0)
+                      << "us p99=" << st.latency.Percentile(99.0)
+                      << "us p999=" << st.latency.Percentile(99.9) << "us";
+    }
+    const double MB_per_sec =
+            seconds > 0 ? total_bytes / (seconds * 1000000.0) : 0;
+    LOG(INFO) << "Sent " << total_ops << " requests, " << total_bytes
+              << " bytes in " << seconds << " seconds "
               << MB_per_sec << " MB/s or " << (MB_per_sec * 8.0) << " Mb/s";
 
+    std::string json;
+    report(w, seconds, &json);
+    if (FLAGS_report.empty()) {
+        LOG(INFO) << json;
+    } else {
+        FILE *f = ::fopen(FLAGS_report.c_str(), "w");
+        if (f == nullptr) {
+            LOG(ERROR) << "Cannot write the report to " << FLAGS_report;
+            return 1;
+        }
+        ::fwrite(json.data(), 1, json.size(), f);
+        ::fclose(f);
+    }
     return 0;
 }
@@ -19,51 +19,278 @@
 #include <signal.h>
 #include <rapidjson/document.h>
 
+#include <cstdlib>
 #include <string>
 #include <memory>
+#include <utility>
+#include <vector>
 
 #include "utils/utils.hpp"
 #include "oio/blob/local/blob.hpp"
+#include "oio/blob/local/cache.hpp"
+#include "oio/blob/local/volume.hpp"
+#include "oio/blob/packed/blob.hpp"
 
 #include "bin/rawx-server-headers.h"
 #include "bin/MillDaemon.h"
 
 using oio::local::blob::UploadBuilder;
+using oio::local::blob::ChunkCache;
 using oio::local::blob::DownloadBuilder;
 using oio::local::blob::RemovalBuilder;
+using oio::local::blob::Durability;
+using oio::local::blob::XattrLayout;
+using oio::local::blob::Placement;
+using oio::local::blob::Volume;
+using oio::local::blob::VolumeOp;
+using oio::local::blob::VolumeSet;
+using PackedStore = oio::packed::blob::Store;
+using oio::api::Cause;
+using oio::api::Status;
+
+DECLARE_uint64(mode_mkdir);
+DECLARE_string(local_durability);
 
 class RawxRepository;
 
+// The volumes of all the repositories, for the stats
+static std::vector<std::shared_ptr<VolumeSet>> all_volumes;
+
+// The caches of all the repositories, for the stats
+static std::vector<std::shared_ptr<ChunkCache>> all_caches;
+
+// The packed stores of all the repositories, for the compaction and the stats
+static std::vector<std::pair<std::shared_ptr<PackedStore>, int64_t>>
+        all_packed;
+
+/** Refuses a chunk already stored, whichever the store */
+class ExistingUpload : public oio::api::blob::Upload {
+ public:
+    ExistingUpload() {}
+
+    ~ExistingUpload() override {}
+
+    void SetXattr(const std::string &k UNUSED,
+                  const std::string &v UNUSED) override {}
+
+    Status Prepare() override { return Status(Cause::Already); }
+
+    Status Commit() override { return Status(Cause::InternalError); }
+
+    Status Abort() override { return Status(Cause::InternalError); }
+
+    void Write(const uint8_t *buf UNUSED, uint32_t len UNUSED) override {}
+};
+
+/**
+ * A transaction slot of a volume, waited for at the construction and held
+ * until released or destroyed.
+ */
+class VolumeSlot {
+ public:
+    VolumeSlot(std::shared_ptr<Volume> v, VolumeOp op)
+            : vol(std::move(v)), held{true} {
+        vol->Acquire(op);
+    }
+
+    ~VolumeSlot() { Release(); }
+
+    Volume &Get() { return *vol; }
+
+    void Release() {
+        if (held) {
+            held = false;
+            vol->Release();
+        }
+    }
+
+ private:
+    FORBID_COPY_CTOR(VolumeSlot);
+    FORBID_MOVE_CTOR(VolumeSlot);
+
+    std::shared_ptr<Volume> vol;
+    bool held;
+};
+
+/**
+ * Holds the slot of the volume until the upload ends. Also forgets the
+ * directory of the chunk when the upload could not create its file, the
+ * hash tree of the volume may believe it still exists.
+ * When the chunks are scattered, the other volumes are checked once the slot
+ * is held: the upload itself only checks its own volume.
+ */
+class VolumeUpload : public oio::api::blob::Upload {
+ public:
+    VolumeUpload(std::unique_ptr<VolumeSlot> s, const std::string &i,
+                 std::unique_ptr<oio::api::blob::Upload> ul,
+                 std::shared_ptr<VolumeSet> v)
+            : slot(std::move(s)), id(i), inner(std::move(ul)),
+              scan(std::move(v)) {}
+
+    ~VolumeUpload() override {}
+
+    void SetXattr(const std::string &k, const std::string &v) override {
+        inner->SetXattr(k, v);
+    }
+
+    Status Prepare() override {
+        if (scan && scan->Locate(id)) {
+            slot->Release();
+            return Status(Cause::Already);
+        }
+        auto rc = inner->Prepare();
+        if (!rc.Ok()) {
+            if (rc.Why() != Cause::Already)
+                slot->Get().Tree().Forget(id);
+            slot->Release();
+        }
+        return rc;
+    }
+
+    Status Commit() override {
+        auto rc = inner->Commit();
+        slot->Release();
+        return rc;
+    }
+
+    Status Abort() override {
+        auto rc = inner->Abort();
+        slot->Release();
+        return rc;
+    }
+
+    void Write(const uint8_t *buf, uint32_t len) override {
+        inner->Write(buf, len);
+    }
+
+ private:
+    // Destroyed after the upload
+    std::unique_ptr<VolumeSlot> slot;
+    std::string id;
+    std::unique_ptr<oio::api::blob::Upload> inner;
+    std::shared_ptr<VolumeSet> scan;
+};
+
+/** Holds the slot of the volume until the download ends */
+class VolumeDownload : public oio::api::blob::Download {
+ public:
+    VolumeDownload(std::unique_ptr<VolumeSlot> s,
+                   std::unique_ptr<oio::api::blob::Download> dl)
+            : slot(std::move(s)), inner(std::move(dl)) {}
+
+    ~VolumeDownload() override {}
+
+    Status Prepare() override {
+        auto rc = inner->Prepare();
+        if (!rc.Ok())
+            slot->Release();
+        return rc;
+    }
+
+    bool IsEof() override {
+        if (!inner->IsEof())
+            return false;
+        slot->Release();
+        return true;
+    }
+
+    Status SetRange(uint32_t offset, uint32_t size) override {
+        return inner->SetRange(offset, size);
+    }
+
+    int32_t Read(std::vector<uint8_t> *buf) override {
+        return done(inner->Read(buf));
+    }
+
+    int32_t ReadInto(uint8_t *buf, uint32_t len) override {
+        return done(inner->ReadInto(buf, len));
+    }
+
+ private:
+    int32_t done(int32_t rc) {
+        if (inner->IsEof())
+            slot->Release();
+        return rc;
+    }
+
+    std::unique_ptr<VolumeSlot> slot;
+    std::unique_ptr<oio::api::blob::Download> inner;
+};
+
+/** Holds the slot of the volume until the removal ends */
+class VolumeRemoval : public oio::api::blob::Removal {
+ public:
+    VolumeRemoval(std::unique_ptr<VolumeSlot> s,
+                  std::unique_ptr<oio::api::blob::Removal> rem)
+            : slot(std::move(s)), inner(std::move(rem)) {}
+
+    ~VolumeRemoval() override {}
+
+    Status Prepare() override {
+        auto rc = inner->Prepare();
+        if (!rc.Ok())
+            slot->Release();
+        return rc;
+    }
+
+    Status Commit() override {
+        auto rc = inner->Commit();
+        slot->Release();
+        return rc;
+    }
+
+    Status Abort() override {
+        auto rc = inner->Abort();
+        slot->Release();
+        return rc;
+    }
+
+ private:
+    std::unique_ptr<VolumeSlot> slot;
+    std::unique_ptr<oio::api::blob::Removal> inner;
+};
+
+/** How the chunks are written, set by the repository */
+struct RawxWriteOptions {
+    bool durability_set;
+    Durability durability;
+    bool xattr_set;
+    XattrLayout xattr_layout;
+
+    RawxWriteOptions() : durability_set{false},
+                         durability{Durability::None}, xattr_set{false},
+                         xattr_layout{XattrLayout::Split} {}
+};
+
 class RawxHandler : public BlobHandler {
     friend class RawxRepository;
 
  private:
-    std::string basedir;
+    std::shared_ptr<VolumeSet> volumes;
+    std::shared_ptr<PackedStore> packed;
+    uint64_t packed_max;
+    std::shared_ptr<ChunkCache> cache;
     std::string filename;
     std::map<std::string, std::string> xattrs;
-    unsigned int hash_depth, hash_width;
-
- private:
-    std::string path(const std::string &f) {
-        std::stringstream ss;
-        ss << basedir;
-        for (unsigned i = 0; i < hash_depth; ++i) {
-            auto token = f.substr(i * hash_width, hash_width);
-            if (token == "")
-                break;
-            ss << "/" << token;
-        }
-        ss << "/" << f;
-        return ss.str();
-    }
+    RawxWriteOptions defaults;
+    RawxWriteOptions options;
+    uint64_t content_length;
 
  public:
-    explicit RawxHandler(const std::string &r) : basedir{r}, filename(),
-                                                 xattrs(), hash_depth{0},
-                                                 hash_width{0} {}
+    explicit RawxHandler(std::shared_ptr<VolumeSet> v)
+            : volumes(v), packed(), packed_max{0}, cache(),
+              filename(), xattrs(), defaults(), options(),
+              content_length{0} {}
 
     ~RawxHandler() override {}
 
+    void Reset() override {
+        filename.clear();
+        xattrs.clear();
+        options = defaults;
+        content_length = 0;
+    }
+
     SoftError SetUrl(const std::string &u) override {
         // Get the name, this is common to al the requests
         http_parser_url url;
@@ -87,30 +314,123 @@ class RawxHandler : public BlobHandler {
         header.Parse(k);
         if (header.Matched()) {
             xattrs[header.StorageName()] = v;
-        } else {
         }
         return {200, 200, "OK"};
     }
 
-    std::unique_ptr<oio::api::blob::Upload> GetUpload() override {
+    void SetContentLength(uint64_t len) override { content_length = len; }
+
+ private:
+    /** @return true if the chunk is in the packed store */
+    bool isPacked() {
+        PackedStore::Blob b;
+        return packed && packed->Lookup(filename, &b).Ok();
+    }
+
+    std::unique_ptr<oio::api::blob::Upload> upload() {
+        // The chunk size is authoritative, the body may be chunked
+        uint64_t expected = content_length;
+        auto it = xattrs.find("chunk.size");
+        if (it != xattrs.end())
+            expected = ::strtoull(it->second.c_str(), nullptr, 10);
+
+        // Each store only knows its own chunks
+        if (isPacked())
+            return std::unique_ptr<oio::api::blob::Upload>(
+                    new ExistingUpload);
+
+        // Small chunks are appended to the packed store
+        if (packed && expected > 0 && expected <= packed_max) {
+            if (volumes->Locate(filename))
+                return std::unique_ptr<oio::api::blob::Upload>(
+                        new ExistingUpload);
+            oio::packed::blob::UploadBuilder builder(packed);
+            builder.Name(filename);
+            builder.MaxSize(expected);
+            auto ul = builder.Build();
+            for (const auto &e : xattrs)
+                ul->SetXattr(e.first, e.second);
+            return ul;
+        }
+
+        std::unique_ptr<VolumeSlot> slot(
+                new VolumeSlot(volumes->Pick(filename), VolumeOp::Upload));
+        auto &vol = slot->Get();
+
+        // Spare LocalUpload a failed open() on a missing directory
+        const int err = vol.Tree().Ensure(filename, FLAGS_mode_mkdir);
+        if (err != 0)
+            LOG(WARNING) << "mkdir(" << filename << ") failed: (" << err
+                         << ") " << ::strerror(err);
+
         UploadBuilder builder;
-        builder.Path(path(filename));
-        auto ul = builder.Build();
+        builder.Path(vol.Tree().Path(filename));
+        if (options.durability_set)
+            builder.SetDurability(options.durability);
+        if (options.xattr_set)
+            builder.SetXattrLayout(options.xattr_layout);
+        builder.ExpectedSize(expected);
+        // The hashed volume is the picked one, the upload checks it
+        std::shared_ptr<VolumeSet> scan;
+        if (volumes->Scattered() && volumes->Size() > 1)
+            scan = volumes;
+        std::unique_ptr<oio::api::blob::Upload> ul(
+                new VolumeUpload(std::move(slot), filename, builder.Build(),
+                                 std::move(scan)));
         for (const auto &e : xattrs)
             ul->SetXattr(e.first, e.second);
         return ul;
     }
 
-    std::unique_ptr<oio::api::blob::Download> GetDownload() override {
+    std::unique_ptr<oio::api::blob::Download> download() {
+        if (isPacked()) {
+            oio::packed::blob::DownloadBuilder builder(packed);
+            builder.Name(filename);
+            return builder.Build();
+        }
+        std::unique_ptr<VolumeSlot> slot(
+                new VolumeSlot(volumes->Find(filename), VolumeOp::Download));
         DownloadBuilder builder;
-        builder.Path(path(filename));
-        return builder.Build();
+        builder.Path(slot->Get().Tree().Path(filename));
+        return std::unique_ptr<oio::api::blob::Download>(
+                new VolumeDownload(std::move(slot), builder.Build()));
     }
 
-    std::unique_ptr<oio::api::blob::Removal> GetRemoval() override {
+    std::unique_ptr<oio::api::blob::Removal> removal() {
+        if (isPacked()) {
+            oio::packed::blob::RemovalBuilder builder(packed);
+            builder.Name(filename);
+            return builder.Build();
+        }
+        std::unique_ptr<VolumeSlot> slot(
+                new VolumeSlot(volumes->Find(filename), VolumeOp::Removal));
         RemovalBuilder builder;
-        builder.Path(path(filename));
-        return builder.Build();
+        builder.Path(slot->Get().Tree().Path(filename));
+        return std::unique_ptr<oio::api::blob::Removal>(
+                new VolumeRemoval(std::move(slot), builder.Build()));
+    }
+
+ public:
+    std::unique_ptr<oio::api::blob::Upload> GetUpload() override {
+        if (!cache)
+            return upload();
+        return cache->Invalidating(filename, upload());
+    }
+
+    std::unique_ptr<oio::api::blob::Download> GetDownload() override {
+        if (!cache)
+            return download();
+        // A hit neither waits for a slot of the volume, nor touches it
+        auto hit = cache->Lookup(filename);
+        if (hit)
+            return hit;
+        return cache->Fill(filename, download());
+    }
+
+    std::unique_ptr<oio::api::blob::Removal> GetRemoval() override {
+        if (!cache)
+            return removal();
+        return cache->Invalidating(filename, removal());
     }
 };
 
@@ -118,33 +438,177 @@ class RawxRepository : public BlobRepository {
     friend class RawxHandler;
 
  private:
-    std::string repository;
     unsigned int hash_depth, hash_width;
+    std::shared_ptr<VolumeSet> volumes;
+    std::shared_ptr<PackedStore> packed;
+    uint64_t packed_max;
+    std::shared_ptr<ChunkCache> cache;
+    RawxWriteOptions options;
 
  public:
-    RawxRepository() : repository(), hash_depth{0}, hash_width{0} {}
+    RawxRepository() : hash_depth{0}, hash_width{0}, volumes(), packed(),
+                       packed_max{0}, cache(), options() {}
 
     ~RawxRepository() override {}
 
     BlobRepository *Clone() override {
         auto repo = new RawxRepository;
-        repo->repository.assign(repository);
         repo->hash_depth = hash_depth;
         repo->hash_width = hash_width;
+        repo->volumes = volumes;
+        repo->packed = packed;
+        repo->packed_max = packed_max;
+        repo->cache = cache;
+        repo->options = options;
         return repo;
     }
 
-    bool Configure(const std::string &cfg UNUSED) override {
+    /**
+     * The chunks up to "max_size" bytes go to the packed store at "path",
+     * which is compacted every "compact_interval" seconds (0 to never).
+     */
+    bool configurePacked(const rapidjson::Value &p) {
+        if (!p.IsObject() || !p.HasMember("path") || !p["path"].IsString()) {
+            LOG(ERROR) << "repository.packed must be an object with a path";
+            return false;
+        }
+        packed_max = 64 * 1024;
+        if (p.HasMember("max_size")) {
+            if (!p["max_size"].IsUint64()) {
+                LOG(ERROR) << "repository.packed.max_size must be integer";
+                return false;
+            }
+            packed_max = p["max_size"].GetUint64();
+        }
+        int64_t interval{60};
+        if (p.HasMember("compact_interval")) {
+            if (!p["compact_interval"].IsUint()) {
+                LOG(ERROR) << "repository.packed.compact_interval must be "
+                           << "integer";
+                return false;
+            }
+            interval = p["compact_interval"].GetUint();
+        }
+        packed.reset(new PackedStore(p["path"].GetString()));
+        auto rc = packed->Open();
+        if (!rc.Ok()) {
+            LOG(ERROR) << "Packed store " << p["path"].GetString()
+                       << " unusable: " << rc.Message();
+            return false;
+        }
+        // The packed chunks are as durable as the others
+        Durability durability{Durability::None};
+        if (options.durability_set)
+            durability = options.durability;
+        else
+            oio::local::blob::durability_parse(FLAGS_local_durability,
+                                               &durability);
+        packed->SetDurability(durability);
+        all_packed.emplace_back(packed, interval * 1000);
+        LOG(INFO) << "RAWX packed store " << p["path"].GetString()
+                  << " max_size=" << packed_max;
+        return true;
+    }
+
+    /**
+     * Keep up to "size" bytes of the popular chunks in RAM, each chunk
+     * being at most "max_size" bytes.
+     */
+    bool configureCache(const rapidjson::Value &c) {
+        if (!c.IsObject() || !c.HasMember("size") || !c["size"].IsUint64()) {
+            LOG(ERROR) << "repository.cache must be an object with a size";
+            return false;
+        }
+        const uint64_t size = c["size"].GetUint64();
+        uint64_t max_size{1024 * 1024};
+        if (c.HasMember("max_size")) {
+            if (!c["max_size"].IsUint64()) {
+                LOG(ERROR) << "repository.cache.max_size must be integer";
+                return false;
+            }
+            max_size = c["max_size"].GetUint64();
+        }
+        if (size <= 0)
+            return true;
+        cache.reset(new ChunkCache(size, max_size));
+        all_caches.push_back(cache);
+        LOG(INFO) << "RAWX chunk cache size=" << size
+                  << " max_size=" << max_size;
+        return true;
+    }
+
+    bool Configure(const std::string &cfg) override {
         rapidjson::Document doc;
         if (doc.Parse<0>(cfg.c_str()).HasParseError()) {
             return false;
         }
 
-        if (!doc.HasMember("docroot") || !doc["docroot"].IsString()) {
-            LOG(ERROR) << "Missing repository.docroot (string)";
+        // Either a list of volumes, or a single docroot
+        unsigned int concurrency{0};
+        if (doc.HasMember("concurrency")) {
+            if (!doc["concurrency"].IsUint()) {
+                LOG(ERROR) << "repository.concurrency must be integer";
+                return false;
+            }
+            concurrency = doc["concurrency"].GetUint();
+        }
+        std::vector<std::pair<std::string, unsigned int>> roots;
+        if (doc.HasMember("volumes")) {
+            const auto &v = doc["volumes"];
+            if (!v.IsArray() || v.Size() <= 0) {
+                LOG(ERROR) << "repository.volumes must be a non-empty array";
+                return false;
+            }
+            for (rapidjson::SizeType i = 0; i < v.Size(); ++i) {
+                if (v[i].IsString()) {
+                    roots.emplace_back(v[i].GetString(), concurrency);
+                } else if (v[i].IsObject() && v[i].HasMember("path") &&
+                           v[i]["path"].IsString()) {
+                    unsigned int c = concurrency;
+                    if (v[i].HasMember("concurrency")) {
+                        if (!v[i]["concurrency"].IsUint()) {
+                            LOG(ERROR) << "repository.volumes[].concurrency "
+                                       << "must be integer";
+                            return false;
+                        }
+                        c = v[i]["concurrency"].GetUint();
+                    }
+                    roots.emplace_back(v[i]["path"].GetString(), c);
+                } else {
+                    LOG(ERROR) << "repository.volumes[] must be a string or "
+                               << "an object with a path";
+                    return false;
+                }
+            }
+        } else if (doc.HasMember("docroot") && doc["docroot"].IsString()) {
+            roots.emplace_back(doc["docroot"].GetString(), concurrency);
+        } else {
+            LOG(ERROR) << "Missing repository.docroot (string) or "
+                       << "repository.volumes (array)";
             return false;
         }
-        repository.assign(doc["docroot"].GetString());
+        Placement placement{Placement::Hash};
+        if (doc.HasMember("placement")) {
+            const auto &p = doc["placement"];
+            if (!p.IsString() || !oio::local::blob::placement_parse(
+                    p.GetString(), &placement)) {
+                LOG(ERROR) << "repository.placement must be one of "
+                           << "hash, space";
+                return false;
+            }
+        }
+        // Set after the volumes changed, while the chunks are not yet back
+        // on their hashed volume
+        bool scattered{false};
+        if (doc.HasMember("scattered")) {
+            if (!doc["scattered"].IsBool()) {
+                LOG(ERROR) << "repository.scattered must be boolean";
+                return false;
+            }
+            scattered = doc["scattered"].GetBool();
+        }
+
+        bool precreate{false};
         if (doc.HasMember("hash")) {
             if (!doc["hash"].IsObject()) {
                 LOG(ERROR) << "repository.hash must be an object";
@@ -164,29 +628,127 @@ class RawxRepository : public BlobRepository {
                 }
                 hash_width = doc["hash"]["width"].GetUint64();
             }
+            if (doc["hash"].HasMember("precreate")) {
+                if (!doc["hash"]["precreate"].IsBool()) {
+                    LOG(ERROR) << "repository.hash.precreate must be boolean";
+                    return false;
+                }
+                precreate = doc["hash"]["precreate"].GetBool();
+            }
+        }
+        volumes.reset(new VolumeSet(placement));
+        volumes->SetScattered(scattered);
+        for (const auto &r : roots) {
+            std::shared_ptr<Volume> vol(
+                    new Volume(r.first, hash_depth, hash_width, r.second));
+            if (precreate) {
+                LOG(INFO) << "Creating the hash directories of " << r.first;
+                if (!vol->Tree().Precreate(FLAGS_mode_mkdir))
+                    return false;
+            }
+            volumes->Add(vol);
+        }
+        all_volumes.push_back(volumes);
+
+        if (doc.HasMember("durability")) {
+            const auto &d = doc["durability"];
+            if (!d.IsString() || !oio::local::blob::durability_parse(
+                    d.GetString(), &options.durability)) {
+                LOG(ERROR) << "repository.durability must be one of "
+                           << "none, fsync, group";
+                return false;
+            }
+            options.durability_set = true;
+        }
+        if (doc.HasMember("xattr")) {
+            const auto &x = doc["xattr"];
+            if (!x.IsString() || !oio::local::blob::xattr_layout_parse(
+                    x.GetString(), &options.xattr_layout)) {
+                LOG(ERROR) << "repository.xattr must be one of "
+                           << "split, packed, both";
+                return false;
+            }
+            options.xattr_set = true;
+        }
+        if (doc.HasMember("packed")) {
+            if (!configurePacked(doc["packed"]))
+                return false;
+        }
+        if (doc.HasMember("cache")) {
+            if (!configureCache(doc["cache"]))
+                return false;
         }
 
+        for (const auto &r : roots)
+            LOG(INFO) << "RAWX volume " << r.first
+                      << " concurrency=" << r.second;
         LOG(INFO) << "RAWX repository ready with"
-                  << " docroot=" << repository
+                  << " volumes=" << roots.size()
                   << " hash_width=" << hash_width
                   << " hash_depth=" << hash_depth;
         return true;
     }
 
     BlobHandler *Handler() {
-        auto handler = new RawxHandler(repository);
-        handler->hash_width = hash_width;
-        handler->hash_depth = hash_depth;
+        auto handler = new RawxHandler(volumes);
+        handler->packed = packed;
+        handler->packed_max = packed_max;
+        handler->cache = cache;
+        handler->defaults = options;
+        handler->options = options;
         return handler;
     }
 };
 
 static volatile bool flag_running{true};
+static volatile bool flag_stats{false};
 
 static void _sighandler_stop(int s UNUSED) {
     flag_running = 0;
 }
 
+static void _sighandler_stats(int s UNUSED) {
+    flag_stats = true;
+}
+
+/* Log the histograms of the group commits, the counters of the volumes, of
+ * the packed stores and of the caches upon SIGUSR1 */
+static coroutine void _report_stats() {
+    while (flag_running) {
+        msleep(mill_now() + 1000);
+        if (!flag_stats)
+            continue;
+        flag_stats = false;
+        std::string stats;
+        oio::local::blob::group_commit_stats(&stats);
+        LOG(INFO) << "group commit " << stats;
+        for (const auto &v : all_volumes) {
+            v->Stats(&stats);
+            LOG(INFO) << "volumes " << stats;
+        }
+        for (const auto &p : all_packed) {
+            p.first->Stats(&stats);
+            LOG(INFO) << "packed " << stats;
+        }
+        for (const auto &c : all_caches) {
+            c->Stats(&stats);
+            LOG(INFO) << "cache " << stats;
+        }
+    }
+}
+
+/* Compact a packed store in the background, the store lives as long as the
+ * process */
+static coroutine void _compact_packed(PackedStore *store, int64_t interval) {
+    oio::local::blob::DiskIO io;
+    while (flag_running) {
+        msleep(mill_now() + interval);
+        if (!flag_running)
+            break;
+        store->Compact(&io);
+    }
+}
+
 int main(int argc, char **argv) {
     gflags::ParseCommandLineFlags(&argc, &argv, true);
     google::InitGoogleLogging(argv[0]);
@@ -199,7 +761,7 @@ int main(int argc, char **argv) {
 
     signal(SIGINT, _sighandler_stop);
     signal(SIGTERM, _sighandler_stop);
-    signal(SIGUSR1, SIG_IGN);
+    signal(SIGUSR1, _sighandler_stats);
     signal(SIGUSR2, SIG_IGN);
     signal(SIGHUP, SIG_IGN);
     signal(SIGPIPE, SIG_IGN);
@@ -214,6 +776,11 @@ int main(int argc, char **argv) {
             return 1;
     }
     daemon.Start(&flag_running);
+    mill_go(_report_stats());
+    for (const auto &p : all_packed) {
+        if (p.second > 0)
+            mill_go(_compact_packed(p.first.get(), p.second));
+    }
     daemon.Join();
     return 0;
 }
@@ -45,3 +45,7 @@ std::ostream& oio::api::blob::operator<<(std::ostream &out,
 Status Download::SetRange(uint32_t offset UNUSED, uint32_t size UNUSED) {
     return Status(Cause::Unsupported);
 }
+
+int32_t Download::ReadInto(uint8_t *buf UNUSED, uint32_t len UNUSED) {
+    return -1;
+}
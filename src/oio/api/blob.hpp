@@ -180,6 +180,18 @@ class Download {
      * @return the size of the buffer. A negative size means an error occured.
      */
     virtual int32_t Read(std::vector<uint8_t> *buf) = 0;
+
+    /**
+     * Copies the next bytes of the content directly into a buffer owned by
+     * the caller, sparing the intermediate vector of Read().
+     * Returns -1 by default, if not overriden by concrete classes, and the
+     * caller is expected to fall back on Read().
+     * @param buf the destination, cannot be null
+     * @param len the maximum number of bytes to be written in buf
+     * @return the number of bytes written, maybe 0 if no data was available.
+     * A negative size means an error occured.
+     */
+    virtual int32_t ReadInto(uint8_t *buf, uint32_t len);
 };
 
 }  // namespace blob
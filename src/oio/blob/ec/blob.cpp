@@ -35,6 +35,7 @@
 #include "utils/utils.hpp"
 #include "oio/blob/rawx/blob.hpp"
 #include "oio/blob/ec/blob.hpp"
+#include "oio/blob/ec/fragment_pool.hpp"
 #include "oio/blob/http/socket_map.h"
 
 using oio::api::Cause;
@@ -46,19 +47,15 @@ using oio::blob::ec::EcCommand;
 using oio::blob::ec::DownloadBuilder;
 using oio::blob::ec::RemovalBuilder;
 using oio::blob::ec::UploadBuilder;
+using oio::blob::ec::FragmentBuffer;
+using oio::blob::ec::FragmentPool;
 
 namespace blob = ::oio::api::blob;
 
-struct SetOfFragments {
-    unsigned int num_fragments;
-    char **array;
-
-    SetOfFragments() : num_fragments{0}, array{nullptr} {}
-};
-
-
 SocketMap TheScoketMap;
 
+FragmentPool TheFragmentPool;
+
 class EcDownload : public oio::api::blob::Download {
     friend class DownloadBuilder;
 
@@ -74,71 +71,55 @@ class EcDownload : public oio::api::blob::Download {
 
     ~EcDownload() override { DLOG(INFO) << __FUNCTION__; }
 
-    uint64_t add_item_to_missing_mask(uint64_t mask, int pos) {
-        if (pos < 0)
-            return mask;
-        register uint64_t f = 1L << pos;
-        return mask | f;
-    }
-
-    static int create_frags_array_set(struct SetOfFragments *set,
-            char **data,
-            unsigned int num_data_frags,
-            char **parity,
-            unsigned int num_parity_frags,
-            uint64_t missing_mask) {
-        int rc = 0;
-        unsigned int num_frags = 0;
-        fragment_header_t *header = NULL;
-        size_t size = (num_data_frags + num_parity_frags) * sizeof(char *);
-        char **array = reinterpret_cast<char **>(malloc(size));
-
-        if (array == NULL) {
-            rc = -1;
-            goto out;
-        }
-
-        // add data frags
-        memset(array, 0, size);
-        for (unsigned int i = 0; i < num_data_frags; i++) {
-            if ((missing_mask | 1L << i) == 1)
-                continue;
-            header = reinterpret_cast<fragment_header_t *>(data[i]);
-            if (header == NULL ||
-                header->magic != LIBERASURECODE_FRAG_HEADER_MAGIC) {
-                continue;
+    /**
+     * Loads the whole body of the download into a buffer of the pool. The
+     * body is directly read into the buffer when the download permits it,
+     * and the buffer only grows when the hinted size was too short.
+     */
+    static bool loadFragment(blob::Download *dl, size_t hint,
+            FragmentBuffer *frag) {
+        if (!TheFragmentPool.Acquire(hint, frag))
+            return false;
+
+        size_t used = 0;
+        while (!dl->IsEof()) {
+            if (used == frag->capacity()) {
+                FragmentBuffer bigger;
+                if (!TheFragmentPool.Acquire(2 * frag->capacity(), &bigger))
+                    return false;
+                memcpy(bigger.data(), frag->data(), used);
+                *frag = std::move(bigger);
             }
-            array[num_frags++] = data[i];
+            const auto r = dl->ReadInto(frag->data() + used,
+                                        frag->capacity() - used);
+            if (r < 0)
+                goto fallback;
+            used += r;
         }
-
-        // add parity frags
-        for (unsigned int i = 0; i < num_parity_frags; i++) {
-            if ((missing_mask | 1L << (i + num_data_frags)) == 1)
-                continue;
-            header = reinterpret_cast<fragment_header_t *>(parity[i]);
-            if (header == NULL ||
-                header->magic != LIBERASURECODE_FRAG_HEADER_MAGIC) {
-                continue;
-            }
-            array[num_frags++] = parity[i];
+        frag->resize(used);
+        return used > 0;
+
+fallback:
+        std::vector<uint8_t> buf(frag->data(), frag->data() + used);
+        while (!dl->IsEof()) {
+            if (dl->Read(&buf) < 0)
+                return false;
         }
-
-        set->num_fragments = num_frags;
-        set->array = array;
-out:
-        return rc;
+        if (buf.size() > frag->capacity()) {
+            if (!TheFragmentPool.Acquire(buf.size(), frag))
+                return false;
+        }
+        memcpy(frag->data(), buf.data(), buf.size());
+        frag->resize(buf.size());
+        return !buf.empty();
     }
 
     Status Prepare() override {
-        encoded_data = NULL;
-        encoded_parity = NULL;
-        encoded_fragment_len = 0;
+        uint64_t encoded_fragment_len = 0;
         char *out_data = NULL;
         uint64_t out_data_len = 0;
         int rc_decode = 1;
 
-        struct SetOfFragments frags;
-
         done = false;
 
         struct ec_args args;
@@ -154,31 +135,30 @@ out:
             return Status(Cause::InternalError);
         }
 
-        // read data and parity
-        encoded_data =
-                reinterpret_cast<char **>(malloc(sizeof(char *) * param.K()));
-        if (NULL == *encoded_data) {
-            LOG(ERROR) << "LIBERASURECODE: Could not allocate data buffer";
-            return Status(Cause::InternalError);
-        }
-
-        encoded_parity =
-                reinterpret_cast<char **>(malloc(sizeof(char *) * param.M()));
-        if (NULL == *encoded_parity) {
-            LOG(ERROR) << "LIBERASURECODE: Could not allocate parity buffer";
-            return Status(Cause::InternalError);
+        const int nb_fragments = param.K() + param.M();
+        fragments.resize(nb_fragments);
+        available.reserve(nb_fragments);
+
+        // Fragments are all the same size, that we guess from the chunk size
+        // so that the first buffer drawn from the pool is already the good one
+        size_t hint = 0;
+        if (param.ChunkSize() > 0) {
+            const int fs = liberasurecode_get_fragment_size(desc,
+                                                            param.ChunkSize());
+            if (fs > 0)
+                hint = fs + sizeof(fragment_header_t);
         }
 
-        memset(encoded_data, 0, sizeof(char *) * param.K());
-        memset(encoded_parity, 0, sizeof(char *) * param.M());
-
         int nbValid = 0;
 
         // read from rawx
         for (const auto &to : param.Targets()) {
+            if (to.chunk_number < 0 || to.chunk_number >= nb_fragments)
+                continue;
+            FragmentBuffer &frag = fragments[to.chunk_number];
+
             std::shared_ptr<net::Socket> *socket = TheScoketMap.GetSocket(
                     to.Host_Port());
-            char *p = NULL;
             if (socket) {
                 ::oio::blob::rawx::DownloadBuilder builder;
 
@@ -190,14 +170,8 @@ out:
                 auto rc = dl->Prepare();
 
                 if (rc.Ok()) {
-                    std::vector<uint8_t> buf;
-                    while (!dl->IsEof()) {
-                        dl->Read(&buf);
-                    }
-                    int size = buf.size();
-                    encoded_fragment_len = size;
-                    p = reinterpret_cast<char *>(malloc(sizeof(char) * size));
-                    memcpy(p, &buf[0], buf.size());
+                    if (!loadFragment(dl.get(), hint, &frag))
+                        frag.Reset();
                 }
             } else {
                 LOG(ERROR) << "LIBERASURECODE: failed to connect to rawx-"
@@ -205,62 +179,48 @@ out:
             }
 
             // sanity check
-            if (p && is_invalid_fragment(desc, p)) {
-                free(p);
-                p = NULL;
+            if (!frag.empty() && is_invalid_fragment(desc,
+                    reinterpret_cast<char *>(frag.data()))) {
+                frag.Reset();
             }
 
-            if (p) {
-                nbValid++;
-            }
+            if (frag.empty())
+                continue;
 
-            if (to.chunk_number < param.K())
-                encoded_data[to.chunk_number] = p;
-            else
-                encoded_parity[to.chunk_number - param.K()] = p;
+            nbValid++;
+            encoded_fragment_len = frag.size();
+            hint = frag.size();
 
             if (nbValid >= param.K()) {  // give it a try, we have enough data
-                // setup mask ;
-                uint64_t mask = 0;
-
-                for (int i = 0; i < (param.K() + param.M()); i++) {
-                    if (i < param.K()) {
-                        if (!encoded_data[i])
-                            mask = add_item_to_missing_mask(
-                                    mask, param.K() + param.M() - 1 - i);
-                    } else {
-                        if (!encoded_parity[i])
-                            mask = add_item_to_missing_mask(
-                                    mask, param.K() + param.M() - 1 - i);
-                    }
+                // The decoder locates each fragment thanks to its header, the
+                // order of the array doesn't matter.
+                available.clear();
+                for (auto &f : fragments) {
+                    if (!f.empty())
+                        available.push_back(reinterpret_cast<char *>(f.data()));
                 }
 
                 // Run Decode
-                create_frags_array_set(&frags, encoded_data, args.k,
-                                       encoded_parity, args.m, mask);
-                rc_decode = liberasurecode_decode(desc, frags.array,
-                                                  frags.num_fragments,
+                rc_decode = liberasurecode_decode(desc, available.data(),
+                                                  available.size(),
                                                   encoded_fragment_len, 1,
                                                   &out_data, &out_data_len);
 
-                auto range = param.GetRange();
                 if (rc_decode == 0) {  // decode ok we are done!
-                    if (out_data_len < range.Size()) {
-                        buffer.resize(out_data_len);
-                        memcpy(&buffer[0], out_data, out_data_len);
-                    } else {
-                        buffer.resize(range.Size());
-                        memcpy(&buffer[0], out_data + range.Start(),
-                               range.Size());
+                    const auto &range = param.GetRange();
+                    uint64_t start = 0, size = out_data_len;
+                    if (range.Size() > 0 && range.Start() < out_data_len) {
+                        start = range.Start();
+                        size = std::min(range.Size(), out_data_len - start);
                     }
+                    buffer.resize(size);
+                    memcpy(&buffer[0], out_data + start, size);
+                    liberasurecode_decode_cleanup(desc, out_data);
                     break;
                 }
             }
         }
 
-        free(frags.array);
-        free(out_data);
-
         CleanUp();
         liberasurecode_instance_destroy(desc);
 
@@ -285,23 +245,10 @@ out:
     }
 
     void CleanUp() {
-        if (encoded_data) {
-            for (int j = 0; j < param.K(); j++) {
-                if (encoded_data[j])
-                    free(encoded_data[j]);
-            }
-            free(encoded_data);
-            encoded_data = NULL;
-        }
-
-        if (encoded_parity) {
-            for (int j = 0; j < param.M(); j++) {
-                if (encoded_parity[j])
-                    free(encoded_parity[j]);
-            }
-            free(encoded_parity);
-            encoded_parity = NULL;
-        }
+        // Gives the fragments back to the pool
+        for (auto &f : fragments)
+            f.Reset();
+        available.clear();
     }
 
  private:
@@ -314,9 +261,8 @@ out:
     std::vector<uint8_t> buffer;
     std::map<std::string, std::string> xattr;
     EcCommand param;
-    char **encoded_data;
-    char **encoded_parity;
-    uint64_t encoded_fragment_len;
+    std::vector<FragmentBuffer> fragments;
+    std::vector<char *> available;
     bool done;
 };
 
@@ -370,42 +316,44 @@ class EcUpload : public oio::api::blob::Upload {
         encoded_data = NULL;
         encoded_parity = NULL;
         encoded_fragment_len = 0;
-        data = NULL;
-        parity = NULL;
+        desc = -1;
+
+        // The data is directly buffered in the memory given to the encoder
+        if (!TheFragmentPool.Acquire(param.ChunkSize(), &data)) {
+            LOG(ERROR) << "LIBERASURECODE: Could not allocate memory for data";
+            return Status(Cause::InternalError);
+        }
+        data.resize(0);
         return Status(Cause::OK);
     }
 
     Status Commit() override {
-        uint ChunkSize = buffer.size();
+        uint ChunkSize = data.size();
         struct ec_args args;
         args.k = param.K();
         args.m = param.M();
         args.hd = 3;
 
-        int err = ::posix_memalign(
-                reinterpret_cast<void **>(&data), 16, ChunkSize);
-        if (err != 0 || !data) {
-            LOG(ERROR) << "LIBERASURECODE: Could not allocate memory for data";
-            return Status(Cause::InternalError);
-        }
-        memcpy(data, &buffer[0], ChunkSize);
-
         /* Get handle */
 
-        int desc = liberasurecode_instance_create(
+        desc = liberasurecode_instance_create(
                 EC_BACKEND_LIBERASURECODE_RS_VAND, &args);
         if (desc <= 0) {
             LOG(ERROR) << "LIBERASURECODE: Could not create libec descriptor";
+            CleanUp();
             return Status(Cause::InternalError);
         }
 
         /* Get encode */
 
-        int rc = liberasurecode_encode(desc, data, ChunkSize,
+        int rc = liberasurecode_encode(desc,
+                                       reinterpret_cast<char *>(data.data()),
+                                       ChunkSize,
                                        &encoded_data, &encoded_parity,
                                        &encoded_fragment_len);
         if (rc != 0) {
             LOG(ERROR) << "LIBERASURECODE: encode error";
+            CleanUp();
             return Status(Cause::InternalError);
         }
 
@@ -438,8 +386,8 @@ class EcUpload : public oio::api::blob::Upload {
                             ? encoded_data[to.chunk_number]
                             : encoded_parity[to.chunk_number - param.K()];
 
-                    std::string s(tmp, encoded_fragment_len);
-                    ul->Write(s);
+                    // Sent straight from the encoder's output, no copy
+                    ul->Write(tmp, encoded_fragment_len);
                     ul->Commit();
                 } else {
                     ul->Abort();
@@ -452,32 +400,22 @@ class EcUpload : public oio::api::blob::Upload {
 
         CleanUp();
 
-        liberasurecode_instance_destroy(desc);
-
         return Status(Cause::OK);
     }
 
     void CleanUp() {
-        if (encoded_data) {
-            for (int j = 0; j < param.K(); j++) {
-                if (encoded_data[j])
-                    free(encoded_data[j]);
-            }
-            free(encoded_data);
-            encoded_data = NULL;
-        }
-
-        if (encoded_parity) {
-            for (int j = 0; j < param.M(); j++) {
-                if (encoded_parity[j])
-                    free(encoded_parity[j]);
-            }
-            free(encoded_parity);
-            encoded_parity = NULL;
+        if (desc > 0) {
+            if (encoded_data || encoded_parity)
+                liberasurecode_encode_cleanup(desc, encoded_data,
+                                              encoded_parity);
+            liberasurecode_instance_destroy(desc);
         }
+        desc = -1;
+        encoded_data = NULL;
+        encoded_parity = NULL;
 
-        free(data);
-        data = NULL;
+        // Gives the data buffer back to the pool
+        data.Reset();
     }
 
     Status Abort() override {
@@ -509,37 +447,35 @@ class EcUpload : public oio::api::blob::Upload {
     }
 
     void Write(const uint8_t *buf, uint32_t len) override {
-        while (len > 0) {
-            const auto oldsize = buffer.size();
-            const uint32_t avail = param.ChunkSize() - oldsize;
-            const uint32_t local = std::min(avail, len);
-            if (local > 0) {
-                buffer.resize(oldsize + local);
-                memcpy(buffer.data() + oldsize, buf, local);
-                buf += local;
-                len -= local;
-            }
+        const auto oldsize = data.size();
+        const uint32_t avail = data.empty() ? 0 : param.ChunkSize() - oldsize;
+        const uint32_t local = std::min(avail, len);
+        if (local > 0) {
+            memcpy(data.data() + oldsize, buf, local);
+            data.resize(oldsize + local);
         }
+        LOG_IF(WARNING, local < len) << "EC chunk overflow, "
+                                     << (len - local) << " bytes ignored";
         yield();
     }
 
-    ~EcUpload() {}
+    ~EcUpload() { CleanUp(); }
 
  private:
     FORBID_COPY_CTOR(EcUpload);
 
     FORBID_MOVE_CTOR(EcUpload);
 
-    EcUpload() {}
+    EcUpload() : desc{-1} {}
 
  private:
     EcCommand param;
-    std::vector<uint8_t> buffer;
     std::map<std::string, std::string> xattr;
+    FragmentBuffer data;
+    int desc;
     char **encoded_data = NULL;
     char **encoded_parity = NULL;
     uint64_t encoded_fragment_len;
-    char *data, **parity;
 };
 
 UploadBuilder::UploadBuilder() {}
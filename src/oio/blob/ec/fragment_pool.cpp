@@ -0,0 +1,129 @@
+/**
+ * This file is part of the OpenIO client libraries
+ * Copyright (C) 2016 OpenIO SAS
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ */
+
+#include <cstdlib>
+#include <utility>
+
+#include "oio/blob/ec/fragment_pool.hpp"
+
+using oio::blob::ec::FragmentBuffer;
+using oio::blob::ec::FragmentPool;
+
+constexpr size_t FragmentPool::Alignment;
+constexpr unsigned FragmentPool::MinClassShift;
+constexpr unsigned FragmentPool::MaxClassShift;
+
+FragmentBuffer::FragmentBuffer(FragmentBuffer &&o) :
+        pool_{o.pool_}, data_{o.data_}, capacity_{o.capacity_},
+        size_{o.size_} {
+    o.pool_ = nullptr;
+    o.data_ = nullptr;
+    o.capacity_ = o.size_ = 0;
+}
+
+FragmentBuffer& FragmentBuffer::operator=(FragmentBuffer &&o) {
+    if (this != &o) {
+        Reset();
+        std::swap(pool_, o.pool_);
+        std::swap(data_, o.data_);
+        std::swap(capacity_, o.capacity_);
+        std::swap(size_, o.size_);
+    }
+    return *this;
+}
+
+void FragmentBuffer::Reset() {
+    if (data_ != nullptr) {
+        if (pool_ != nullptr)
+            pool_->Release(data_, capacity_);
+        else
+            ::free(data_);
+    }
+    pool_ = nullptr;
+    data_ = nullptr;
+    capacity_ = size_ = 0;
+}
+
+
+FragmentPool::FragmentPool(size_t max_cached) :
+        idle_(MaxClassShift - MinClassShift + 1),
+        max_cached_{max_cached}, cached_{0} {}
+
+FragmentPool::~FragmentPool() { Purge(); }
+
+size_t FragmentPool::Capacity(size_t size) {
+    size_t c = 1UL << MinClassShift;
+    while (c < size && c < (1UL << MaxClassShift))
+        c <<= 1;
+    if (c >= size)
+        return c;
+    // Out of the classes, only padded to the alignment
+    return (size + Alignment - 1) & ~(Alignment - 1);
+}
+
+int FragmentPool::Class(size_t capacity) {
+    for (unsigned shift = MinClassShift; shift <= MaxClassShift; ++shift) {
+        if (capacity == (1UL << shift))
+            return shift - MinClassShift;
+    }
+    return -1;
+}
+
+bool FragmentPool::Acquire(size_t size, FragmentBuffer *out) {
+    out->Reset();
+
+    const size_t capacity = Capacity(size);
+    const int klass = Class(capacity);
+
+    uint8_t *buf = nullptr;
+    if (klass >= 0 && !idle_[klass].empty()) {
+        buf = idle_[klass].back();
+        idle_[klass].pop_back();
+        cached_ -= capacity;
+    } else {
+        void *p = nullptr;
+        if (0 != ::posix_memalign(&p, Alignment, capacity))
+            return false;
+        buf = static_cast<uint8_t*>(p);
+    }
+
+    out->pool_ = this;
+    out->data_ = buf;
+    out->capacity_ = capacity;
+    out->size_ = size;
+    return true;
+}
+
+void FragmentPool::Release(uint8_t *buf, size_t capacity) {
+    const int klass = Class(capacity);
+    if (klass < 0 || cached_ + capacity > max_cached_) {
+        ::free(buf);
+    } else {
+        idle_[klass].push_back(buf);
+        cached_ += capacity;
+    }
+}
+
+void FragmentPool::Purge() {
+    for (auto &bucket : idle_) {
+        for (auto buf : bucket)
+            ::free(buf);
+        bucket.clear();
+    }
+    cached_ = 0;
+}
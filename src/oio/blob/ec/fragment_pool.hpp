@@ -0,0 +1,135 @@
+/**
+ * This file is part of the OpenIO client libraries
+ * Copyright (C) 2016 OpenIO SAS
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ */
+
+#ifndef SRC_OIO_BLOB_EC_FRAGMENT_POOL_HPP_
+#define SRC_OIO_BLOB_EC_FRAGMENT_POOL_HPP_
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include "utils/macros.h"
+
+namespace oio {
+namespace blob {
+namespace ec {
+
+class FragmentPool;
+
+/**
+ * Handle on a 64-bytes aligned buffer borrowed from a FragmentPool. The buffer
+ * goes back to its pool when the handle is reset or destroyed.
+ */
+class FragmentBuffer {
+    friend class FragmentPool;
+
+ public:
+    FragmentBuffer() : pool_{nullptr}, data_{nullptr}, capacity_{0}, size_{0} {}
+
+    FragmentBuffer(FragmentBuffer &&o);
+
+    FragmentBuffer &operator=(FragmentBuffer &&o);
+
+    ~FragmentBuffer() { Reset(); }
+
+    /** Gives the buffer back to its pool. */
+    void Reset();
+
+    uint8_t *data() { return data_; }
+
+    const uint8_t *data() const { return data_; }
+
+    /** Number of meaningful bytes, as set by the application */
+    size_t size() const { return size_; }
+
+    void resize(size_t s) { size_ = s; }
+
+    /** Number of bytes actually allocated */
+    size_t capacity() const { return capacity_; }
+
+    bool empty() const { return data_ == nullptr; }
+
+ private:
+    FORBID_COPY_CTOR(FragmentBuffer);
+
+    FragmentPool *pool_;
+    uint8_t *data_;
+    size_t capacity_;
+    size_t size_;
+};
+
+/**
+ * Recycles the aligned buffers used by the EC transactions, so that the data
+ * and the fragments of a chunk reuse the memory released by the previous
+ * chunk instead of hitting the allocator.
+ * The buffers are grouped in power-of-two classes from 4KiB to 64MiB. Larger
+ * requests are served with an exact allocation that is never cached.
+ * Not thread-safe: the pool is meant to be used by the coroutines of a
+ * single thread.
+ */
+class FragmentPool {
+    friend class FragmentBuffer;
+
+ public:
+    static constexpr size_t Alignment = 64;
+    static constexpr unsigned MinClassShift = 12;
+    static constexpr unsigned MaxClassShift = 26;
+
+    /**
+     * @param max_cached upper bound of the total capacity of the idle buffers
+     * kept for a later reuse.
+     */
+    explicit FragmentPool(size_t max_cached = 256 * 1024 * 1024);
+
+    ~FragmentPool();
+
+    /**
+     * Get a buffer of at least 'size' bytes, aligned on 'Alignment'.
+     * @param size the minimal expected capacity, then used as the initial size
+     * @param out the handle to be filled, its previous buffer is released
+     * @return false if the allocation failed
+     */
+    bool Acquire(size_t size, FragmentBuffer *out);
+
+    /** Frees all the idle buffers */
+    void Purge();
+
+    /** Total capacity of the idle buffers */
+    size_t Cached() const { return cached_; }
+
+ private:
+    FORBID_COPY_CTOR(FragmentPool);
+    FORBID_MOVE_CTOR(FragmentPool);
+
+    static size_t Capacity(size_t size);
+
+    static int Class(size_t capacity);
+
+    void Release(uint8_t *buf, size_t capacity);
+
+ private:
+    std::vector<std::vector<uint8_t*>> idle_;
+    size_t max_cached_;
+    size_t cached_;
+};
+
+}  // namespace ec
+}  // namespace blob
+}  // namespace oio
+
+#endif  // SRC_OIO_BLOB_EC_FRAGMENT_POOL_HPP_
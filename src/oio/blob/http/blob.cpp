@@ -18,6 +18,7 @@
 
 #include <http-parser/http_parser.h>
 
+#include <algorithm>
 #include <iomanip>
 #include <cstring>
 #include <vector>
@@ -315,6 +316,9 @@ class HttpDownload : public Download {
     http::Reply reply;
     Step step_;
 
+    // Tail of the last slice partially consumed by ReadInto()
+    http::Reply::Slice pending;
+
     Status skipAndReturn(Status s) {
         request.Abort();
         reply.Skip();
@@ -322,12 +326,15 @@ class HttpDownload : public Download {
     }
 
  public:
-    HttpDownload() : request(), reply(), step_{Step::Init} { HTTP_LOG(); }
+    HttpDownload() : request(), reply(), step_{Step::Init}, pending() {
+        HTTP_LOG();
+    }
 
     ~HttpDownload() override {}
 
     bool IsEof() override {
-        return reply.Get().step == http::Reply::Step::Done;
+        return pending.len == 0 &&
+               reply.Get().step == http::Reply::Step::Done;
     }
 
     Status Prepare() override  {
@@ -376,9 +383,38 @@ class HttpDownload : public Download {
     int32_t Read(std::vector<uint8_t> *buf) override  {
         if (step_ != Step::Prepared)
             return -1;
+        if (pending.len > 0) {
+            buf->insert(buf->end(), pending.buf, pending.buf + pending.len);
+            pending = http::Reply::Slice();
+            return buf->size();
+        }
         reply.AppendBody(buf);
         return buf->size();
     }
+
+    int32_t ReadInto(uint8_t *buf, uint32_t len) override {
+        if (step_ != Step::Prepared)
+            return -1;
+        if (pending.len == 0) {
+            // Nothing buffered, the body goes straight into the caller's
+            if (reply.Direct()) {
+                uint32_t got = 0;
+                if (reply.ReadBodyInto(buf, len, &got) != Code::OK)
+                    return -1;
+                return got;
+            }
+            auto rc = reply.ReadBody(&pending);
+            if (rc == Code::Done)
+                return 0;
+            if (rc != Code::OK)
+                return -1;
+        }
+        const uint32_t local = std::min(len, pending.len);
+        memcpy(buf, pending.buf, local);
+        pending.buf += local;
+        pending.len -= local;
+        return local;
+    }
 };
 
 DownloadBuilder::DownloadBuilder() {}
@@ -39,12 +39,52 @@ class Sync {
     virtual void Wait() = 0;
 };
 
+/**
+ * What the uploads share about the batches of a drive: the limits the drive
+ * announced in its last GETLOG, and the batches currently open on it.
+ */
+struct BatchQuota {
+    uint32_t max_ops {0};      // 0 when the drive doesn't support batches
+    uint64_t max_bytes {0};
+    uint32_t max_value {0};
+    uint32_t max_batches {0};
+    int64_t fetched {0};       // mill_now() of the last GETLOG, 0 if none
+    uint32_t open {0};
+};
+
 class ClientInterface {
  public:
+    /**
+     * Queue the RPC with the priority it carries.
+     */
     virtual std::shared_ptr<Sync> RPC(
             oio::kinetic::client::Exchange *ex) = 0;
 
+    std::shared_ptr<Sync> RPC(oio::kinetic::client::Exchange *ex,
+            oio::kinetic::client::Priority prio) {
+        ex->SetPriority(prio);
+        return RPC(ex);
+    }
+
+    /**
+     * Allocate a batch ID. All the RPC carrying it will be sent on the same
+     * connection, as required by the drive.
+     */
+    virtual uint32_t NewBatch() = 0;
+
     virtual std::string Id() const = 0;
+
+    /** Count the RPC queued or sent, and not replied yet */
+    virtual size_t Outstanding() const = 0;
+
+    /** Moving average of the RPC round-trip time, in milliseconds */
+    virtual double Latency() const = 0;
+
+    /** The batch limits of the drive, shared by all its uploads */
+    BatchQuota& Quota() { return quota_; }
+
+ private:
+    BatchQuota quota_;
 };
 
 class ClientFactory {
@@ -23,7 +23,7 @@
 #include <libmill.h>
 
 #include <utility>
-#include <algorithm>
+#include <vector>
 
 #include <sstream>
 #include "utils/macros.h"
@@ -36,10 +36,25 @@ using oio::kinetic::client::Exchange;
 using oio::kinetic::client::CoroutineClient;
 using oio::kinetic::client::Sync;
 
+// Granularity of the RPC timeouts, in ms, and span of the timer wheel.
+#define RPC_TIMER_RESOLUTION 100
+#define RPC_TIMER_SLOTS 512
+
+// Share of the RPC sent by each priority, when all of them have RPC waiting
+#define RPC_WEIGHT_HIGH 8
+#define RPC_WEIGHT_NORMAL 4
+#define RPC_WEIGHT_LOW 1
+
+static const unsigned int rpc_weights[RPC_PRIORITY_COUNT] = {
+        RPC_WEIGHT_HIGH, RPC_WEIGHT_NORMAL, RPC_WEIGHT_LOW
+};
 
 CoroutineClient::CoroutineClient(const std::string &u) :
         url_{u}, sock_{nullptr}, ctx(), waiting_(), pending_(),
-        to_agent_{nullptr}, stopped_{nullptr}, running_{false} {
+        timers_(RPC_TIMER_RESOLUTION, RPC_TIMER_SLOTS), expired_(),
+        latency_{0}, to_agent_{nullptr}, stopped_{nullptr}, running_{false} {
+    for (unsigned int i = 0; i < RPC_PRIORITY_COUNT; ++i)
+        credits_[i] = rpc_weights[i];
     to_agent_ = chmake(int, 64);
     stopped_ = chmake(int, 2);
     sock_.reset(new MillSocket());
@@ -67,19 +82,43 @@ std::string CoroutineClient::DebugString() const {
 
 std::shared_ptr<oio::kinetic::client::PendingExchange>
 CoroutineClient::pop_rpc(int64_t seqid) {
-    auto cb = [seqid](const std::shared_ptr<PendingExchange> &ex) -> bool {
-        return seqid == ex->Sequence();
-    };
-    auto it = std::find_if(pending_.begin(), pending_.end(), cb);
+    auto it = pending_.find(seqid);
     if (it == pending_.end()) {
         return std::shared_ptr<oio::kinetic::client::PendingExchange>(nullptr);
     }
 
-    auto pe = *it;
+    auto pe = std::move(it->second);
     pending_.erase(it);
     return pe;
 }
 
+std::shared_ptr<oio::kinetic::client::PendingExchange>
+CoroutineClient::pop_waiting() {
+    for (int round = 0; round < 2; ++round) {
+        for (unsigned int i = 0; i < RPC_PRIORITY_COUNT; ++i) {
+            auto &q = waiting_[i];
+            if (!q.empty() && credits_[i] > 0) {
+                --credits_[i];
+                auto pe = std::move(q.front());
+                q.pop();
+                return pe;
+            }
+        }
+        // The priorities with RPC waiting spent their credits, start a new
+        // round.
+        for (unsigned int i = 0; i < RPC_PRIORITY_COUNT; ++i)
+            credits_[i] = rpc_weights[i];
+    }
+    return std::shared_ptr<oio::kinetic::client::PendingExchange>(nullptr);
+}
+
+size_t CoroutineClient::waiting() const {
+    size_t total{0};
+    for (const auto &q : waiting_)
+        total += q.size();
+    return total;
+}
+
 bool CoroutineClient::manage(oio::kinetic::client::Request *req) {
     const auto id = req->cmd.header().connectionid();
     if (id > 0)
@@ -88,6 +127,8 @@ bool CoroutineClient::manage(oio::kinetic::client::Request *req) {
     auto ack = req->cmd.header().acksequence();
     auto pe = pop_rpc(ack);
     if (pe.get() != nullptr) {
+        const double rtt = mill_now() - pe->Sent();
+        latency_ = latency_ <= 0 ? rtt : (latency_ * 7 + rtt) / 8;
         pe->ManageReply(req);
         pe->Signal();
     } else {
@@ -148,9 +189,9 @@ coroutine void CoroutineClient::run_agent_consumer(chan done) {
         chan from_producer = chmake(int, 0);
         mill_go(run_agent_producer(from_producer));
 
-        // consume frames from the device
+        // consume frames from the device, reusing the same buffers
+        oio::kinetic::client::Request msg;
         while (running_) {
-            oio::kinetic::client::Request msg;
             int err = msg.Read(sock_.get(), mill_now() + 1000);
             if (err == 0) {
                 if (!manage(&msg)) {
@@ -177,22 +218,26 @@ out:
 
 void CoroutineClient::abort_rpc(
         std::shared_ptr<oio::kinetic::client::PendingExchange> pe, int err) {
-    const auto seq = pe->Sequence();
+    pop_rpc(pe->Sequence());
     pe->ManageError(err);
     pe->Signal();
-    pop_rpc(seq);
 }
 
 void CoroutineClient::abort_all_rpc() {
     LOG(INFO) << "Aborting waiting & pending RPC";
-    while (!waiting_.empty()) {
-        auto pe = waiting_.front();
-        waiting_.pop();
-        pending_.push_back(pe);
+    std::vector<std::shared_ptr<PendingExchange>> tmp;
+    tmp.reserve(waiting() + pending_.size());
+    for (auto &q : waiting_) {
+        while (!q.empty()) {
+            tmp.push_back(std::move(q.front()));
+            q.pop();
+        }
     }
+    for (auto &e : pending_)
+        tmp.push_back(std::move(e.second));
+    pending_.clear();
+    timers_.Reset(mill_now());
 
-    decltype(pending_) tmp;
-    tmp.swap(pending_);
     for (auto pe : tmp)
         pe->ManageError(ECONNRESET);
     for (auto pe : tmp)
@@ -201,15 +246,35 @@ void CoroutineClient::abort_all_rpc() {
 }
 
 void CoroutineClient::abort_stalled_rpc(int64_t now) {
-    for (auto pe : pending_) {
-        if (now > pe->Deadline()) {
-            abort_rpc(pe, ETIMEDOUT);
+    expired_.clear();
+    timers_.Expire(now, &expired_);
+    // The RPC already replied are not pending anymore, simply ignored.
+    for (auto seq : expired_) {
+        auto pe = pop_rpc(seq);
+        if (pe.get() != nullptr) {
+            pe->ManageError(ETIMEDOUT);
+            pe->Signal();
         }
     }
 }
 
 bool CoroutineClient::start_rpc(std::shared_ptr<PendingExchange> pe) {
-    pending_.push_back(pe);
+    // The sequence is allocated at the last moment, so that it always matches
+    // the current connection, and the RPC is registered before being sent
+    pe->SetSequence(ctx.sequence_id_++);
+    if (!pe->ExpectsReply()) {
+        // Batched operations are acknowledged by the END_BATCH only, they are
+        // over as soon as sent.
+        int errcode = pe->Write(sock_.get(), &ctx, mill_now() + 1000);
+        if (errcode == 0)
+            pe->ManageSent();
+        else
+            pe->ManageError(errcode);
+        pe->Signal();
+        return errcode == 0;
+    }
+    pending_[pe->Sequence()] = pe;
+    timers_.Add(pe->Deadline(), pe->Sequence());
     int errcode = pe->Write(sock_.get(), &ctx, mill_now() + 1000);
     if (errcode == 0) {
         return true;
@@ -222,7 +287,7 @@ bool CoroutineClient::start_rpc(std::shared_ptr<PendingExchange> pe) {
 coroutine void CoroutineClient::run_agent_producer(chan done) {
     DLOG(INFO) << "K> starting";
 
-    int64_t now = mill_now(), next_check = now + 1000;
+    int64_t now = mill_now(), next_check = now + RPC_TIMER_RESOLUTION;
     while (running_) {
         mill_choose {
                 mill_in(to_agent_, int, sig):
@@ -230,9 +295,8 @@ coroutine void CoroutineClient::run_agent_producer(chan done) {
                         DLOG(INFO) << "K> Explicit shutdown requested";
                         goto out;
                     } else {
-                        if (!waiting_.empty()) {
-                            auto pe = waiting_.front();
-                            waiting_.pop();
+                        auto pe = pop_waiting();
+                        if (pe.get() != nullptr) {
                             if (!start_rpc(pe)) {
                                 DLOG(ERROR) << "K> Failed to send RPC";
                                 goto out;
@@ -246,7 +310,7 @@ coroutine void CoroutineClient::run_agent_producer(chan done) {
         now = mill_now();
         // check for stalled pending jobs
         if (now > next_check) {
-            next_check = now + 1000;
+            next_check = now + RPC_TIMER_RESOLUTION;
             abort_stalled_rpc(now);
         }
     }
@@ -266,6 +330,7 @@ coroutine void CoroutineClient::run_agents() {
 
         // New connection, new sequence ID!
         ctx.Reset();
+        timers_.Reset(mill_now());
 
         chan from_consumer = chmake(int, 0);
         mill_go(run_agent_consumer(from_consumer));
@@ -290,15 +355,18 @@ std::shared_ptr<Sync> CoroutineClient::RPC(Exchange *ei) {
 
     // push the rpc down
     PendingExchange *ex = new PendingExchange(ei);
-    ex->SetSequence(ctx.sequence_id_++);
 
     std::shared_ptr<PendingExchange> shex(ex);
-    waiting_.push(shex);
+    waiting_[static_cast<unsigned int>(ei->GetPriority())].push(shex);
     assert(2 == shex.use_count());
     chs(to_agent_, int, SIGNAL_AGENT_DATA);
     return shex;
 }
 
+uint32_t CoroutineClient::NewBatch() {
+    return ctx.batch_id_++;
+}
+
 void CoroutineClient::Boot() {
     if (!running_) {
         running_ = true;
@@ -25,6 +25,7 @@
 #include <string>
 #include <vector>
 #include <queue>
+#include <unordered_map>
 #include <cassert>
 
 #include "utils/utils.hpp"
@@ -33,6 +34,7 @@
 #include "oio/blob/kinetic/coro/RPC.h"
 #include "ClientInterface.h"
 #include "oio/blob/kinetic/coro/PendingExchange.h"
+#include "oio/blob/kinetic/coro/TimerWheel.h"
 
 #define SIGNAL_AGENT_STOP 0
 #define SIGNAL_AGENT_DATA 1
@@ -51,8 +53,16 @@ class CoroutineClient : public ClientInterface {
     std::shared_ptr<net::Socket> sock_;
     oio::kinetic::client::Context ctx;
 
-    std::queue<std::shared_ptr<PendingExchange>> waiting_;
-    std::vector<std::shared_ptr<PendingExchange>> pending_;
+    // RPC not sent yet, one queue per priority
+    std::queue<std::shared_ptr<PendingExchange>> waiting_[RPC_PRIORITY_COUNT];
+    // What each priority may still send in the current round
+    unsigned int credits_[RPC_PRIORITY_COUNT];
+    // RPC sent and waiting for a reply, indexed by their sequence ID
+    std::unordered_map<int64_t, std::shared_ptr<PendingExchange>> pending_;
+    // Deadlines of the pending RPC
+    TimerWheel timers_;
+    std::vector<int64_t> expired_;
+    double latency_;
     struct mill_chan *to_agent_;  // <int>
     struct mill_chan *stopped_;
     bool running_;
@@ -73,6 +83,11 @@ class CoroutineClient : public ClientInterface {
      */
     std::shared_ptr<Sync> RPC(oio::kinetic::client::Exchange *ex) override;
 
+    /**
+     * @see ClientInterface::NewBatch()
+     */
+    uint32_t NewBatch() override;
+
     /**
      * Manage the frame just received from the socket
      * @param req
@@ -109,6 +124,15 @@ class CoroutineClient : public ClientInterface {
 
     std::shared_ptr<oio::kinetic::client::PendingExchange> pop_rpc(int64_t id);
 
+    /**
+     * Pick the next RPC to be sent, by weighted priority: in each round, a
+     * priority sends at most its weight of RPC before the lower ones.
+     * @return nullptr if no RPC is waiting
+     */
+    std::shared_ptr<oio::kinetic::client::PendingExchange> pop_waiting();
+
+    size_t waiting() const;
+
     NOINLINE void run_agent_consumer(struct mill_chan *done);
 
     NOINLINE void run_agent_producer(struct mill_chan *done);
@@ -123,6 +147,12 @@ class CoroutineClient : public ClientInterface {
     std::string DebugString() const;
 
     void Boot();
+
+    size_t Outstanding() const override {
+        return waiting() + pending_.size();
+    }
+
+    double Latency() const override { return latency_; }
 };
 
 }  // namespace client
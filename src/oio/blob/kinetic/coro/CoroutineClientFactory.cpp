@@ -18,10 +18,35 @@
 
 #include <oio/blob/kinetic/coro/CoroutineClientFactory.h>
 #include <oio/blob/kinetic/coro/CoroutineClient.h>
+#include <oio/blob/kinetic/coro/StripedClient.h>
+
+#include "utils/macros.h"
 
 using oio::kinetic::client::ClientInterface;
 using oio::kinetic::client::CoroutineClient;
 using oio::kinetic::client::CoroutineClientFactory;
+using oio::kinetic::client::StripedClient;
+
+DEFINE_uint32(kinetic_connections, 1,
+              "Default number of connections opened toward each drive");
+
+void CoroutineClientFactory::Connections(const std::string &url,
+        unsigned int count) {
+    if (count > 0)
+        connections[url] = count;
+    else
+        connections.erase(url);
+}
+
+unsigned int CoroutineClientFactory::connectionsFor(
+        const std::string &url) const {
+    auto it = connections.find(url);
+    if (it != connections.end())
+        return it->second;
+    if (default_connections > 0)
+        return default_connections;
+    return FLAGS_kinetic_connections;
+}
 
 std::shared_ptr<ClientInterface>
 CoroutineClientFactory::Get(const std::string &url) {
@@ -29,8 +54,12 @@ CoroutineClientFactory::Get(const std::string &url) {
     if (it != cnx.end())
         return it->second;
 
-    CoroutineClient *client = new CoroutineClient(url);
-    std::shared_ptr<ClientInterface> shared(client);
+    std::shared_ptr<ClientInterface> shared;
+    const auto count = connectionsFor(url);
+    if (count > 1)
+        shared.reset(new StripedClient(url, count));
+    else
+        shared.reset(new CoroutineClient(url));
     cnx[url] = shared;
     return shared;
 }
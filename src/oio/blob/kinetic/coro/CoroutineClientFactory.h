@@ -31,14 +31,35 @@ namespace client {
 
 class CoroutineClientFactory : public ClientFactory {
  public:
-    CoroutineClientFactory() : cnx() {}
+    CoroutineClientFactory() : cnx(), connections(), default_connections{0} {}
 
     ~CoroutineClientFactory() {}
 
     std::shared_ptr<ClientInterface> Get(const std::string &url);
 
+    /**
+     * Set the number of connections opened toward the drives that have no
+     * specific setting. When not set, the -kinetic_connections flag applies.
+     * To be called before the first Get() on the drives concerned.
+     * @param count the number of connections, 0 to reset to the flag's value
+     */
+    void Connections(unsigned int count) { default_connections = count; }
+
+    /**
+     * Set the number of connections opened toward the given drive.
+     * To be called before the first Get() on that drive.
+     * @param url the drive concerned
+     * @param count the number of connections, 0 to reset to the default
+     */
+    void Connections(const std::string &url, unsigned int count);
+
+ private:
+    unsigned int connectionsFor(const std::string &url) const;
+
  private:
     std::map<std::string, std::shared_ptr<ClientInterface>> cnx;
+    std::map<std::string, unsigned int> connections;
+    unsigned int default_connections;
 };
 
 }  // namespace client
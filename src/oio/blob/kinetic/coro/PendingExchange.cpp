@@ -25,7 +25,7 @@ using oio::kinetic::client::PendingExchange;
 int64_t oio::kinetic::client::rpc_default_ttl = OIO_KINETIC_RPC_DEFAULT_TTL;
 
 PendingExchange::PendingExchange(oio::kinetic::client::Exchange *e) :
-        exchange_(e), notification_{nullptr}, sequence_id_{0} {
+        exchange_(e), notification_{nullptr}, sequence_id_{0}, sent_{0} {
     notification_ = chmake(int, 1);
     deadline_ = mill_now() + oio::kinetic::client::rpc_default_ttl;
 }
@@ -68,10 +68,19 @@ void PendingExchange::ManageError(int errcode) {
     return exchange_->ManageError(errcode);
 }
 
+void PendingExchange::ManageSent() {
+    assert(exchange_ != nullptr);
+    return exchange_->ManageSent();
+}
+
+bool PendingExchange::ExpectsReply() const {
+    return exchange_ == nullptr || exchange_->ExpectsReply();
+}
+
 int PendingExchange::Write(net::Channel *chan,
         oio::kinetic::client::Context *ctx, int64_t dl) {
     if (exchange_ == nullptr)
         return ECANCELED;
-    SetSequence(ctx->sequence_id_ ++);
-    return exchange_->Write(chan, *ctx, dl);
+    sent_ = mill_now();
+    return exchange_->Write(chan, ctx, dl);
 }
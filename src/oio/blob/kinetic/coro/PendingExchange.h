@@ -55,6 +55,14 @@ class PendingExchange : public Sync {
 
     inline int64_t Deadline() const { return deadline_; }
 
+    /** When the request has been written, in the mill_now() precision */
+    inline int64_t Sent() const { return sent_; }
+
+    bool ExpectsReply() const;
+
+    /**
+     * Send the request. The sequence ID must have been set before.
+     */
     int Write(net::Channel *chan, oio::kinetic::client::Context *ctx,
             int64_t dl);
 
@@ -71,6 +79,11 @@ class PendingExchange : public Sync {
      */
     void ManageError(int errcode);
 
+    /**
+     * The request has been sent and no reply is expected.
+     */
+    void ManageSent();
+
     void Signal();
 
     void Wait();
@@ -80,6 +93,7 @@ class PendingExchange : public Sync {
     struct mill_chan *notification_;
     int64_t sequence_id_;
     int64_t deadline_;
+    int64_t sent_;
 };
 
 }  // namespace client
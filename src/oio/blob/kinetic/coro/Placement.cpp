@@ -0,0 +1,133 @@
+/**
+ * This file is part of the OpenIO client libraries
+ * Copyright (C) 2016 OpenIO SAS
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ */
+
+#include <oio/blob/kinetic/coro/Placement.h>
+
+#include <libmill.h>
+
+#include <algorithm>
+#include <cassert>
+
+#include "oio/blob/kinetic/coro/RPC.h"
+
+using oio::kinetic::client::ClientInterface;
+using oio::kinetic::client::DriveHealth;
+using oio::kinetic::client::GetLog;
+using oio::kinetic::client::RoundRobinPlacement;
+using oio::kinetic::client::WeightedPlacement;
+
+DEFINE_uint32(kinetic_placement_refresh, 5000,
+              "Period (ms) of the GETLOG refreshing the health of a drive");
+
+DEFINE_double(kinetic_placement_min_space, 5.0,
+              "Drives with less free space (in percents) get no new block");
+
+DEFINE_double(kinetic_placement_latency, 10.0,
+              "Latency (ms) that halves the weight of a drive");
+
+
+unsigned int RoundRobinPlacement::Next(
+        const std::vector<std::shared_ptr<ClientInterface>> &clients) {
+    assert(!clients.empty());
+    return next_++ % clients.size();
+}
+
+
+static coroutine void _refresh(std::shared_ptr<WeightedPlacement::State> st,
+        std::shared_ptr<ClientInterface> client) {
+    GetLog op;
+    client->RPC(&op)->Wait();
+
+    // A figure the drive doesn't report gets the neutral default, so that
+    // missing stats neither exclude the drive nor keep outdated figures.
+    const DriveHealth neutral;
+    const bool ok = op.Ok();
+    auto &h = st->health[client->Id()];
+    h.refreshing = false;
+    h.refreshed = mill_now();
+    h.cpu = ok && op.hasCpu() ? op.getCpu() : neutral.cpu;
+    h.io = ok && op.hasIo() ? op.getIo() : neutral.io;
+    h.space = ok && op.hasSpace() ? op.getSpace() : neutral.space;
+    h.temp = ok && op.hasTemp() ? op.getTemp() : neutral.temp;
+}
+
+WeightedPlacement::WeightedPlacement() : state_(new State), fallback_{0} {}
+
+WeightedPlacement::~WeightedPlacement() {}
+
+void WeightedPlacement::Update(const std::string &id,
+        const DriveHealth &health) {
+    auto &h = state_->health[id];
+    h.cpu = health.cpu;
+    h.io = health.io;
+    h.space = health.space;
+    h.temp = health.temp;
+    h.refreshed = mill_now();
+}
+
+double WeightedPlacement::Weight(const ClientInterface &client) {
+    const auto &h = state_->health[client.Id()];
+    if (h.space < FLAGS_kinetic_placement_min_space)
+        return 0;
+
+    // A busy or hot drive keeps a minimal share
+    const double health = (h.space / 100.0)
+                          * std::max(0.05, h.temp / 100.0)
+                          * std::max(0.05, h.io / 100.0)
+                          * std::max(0.05, h.cpu / 100.0);
+    const double load = 1.0 / (1.0 + client.Outstanding());
+    const double latency =
+            1.0 / (1.0 + client.Latency() / FLAGS_kinetic_placement_latency);
+    return health * load * latency;
+}
+
+unsigned int WeightedPlacement::Next(
+        const std::vector<std::shared_ptr<ClientInterface>> &clients) {
+    assert(!clients.empty());
+    const int64_t now = mill_now();
+
+    int best = -1;
+    double best_current = 0, total = 0;
+    for (unsigned int i = 0; i < clients.size(); ++i) {
+        const auto &client = clients[i];
+        const auto id = client->Id();
+
+        auto &h = state_->health[id];
+        if (!h.refreshing &&
+            now - h.refreshed > FLAGS_kinetic_placement_refresh) {
+            h.refreshing = true;
+            mill_go(_refresh(state_, client));
+        }
+
+        const double w = Weight(*client);
+        auto &current = state_->current[id];
+        current += w;
+        total += w;
+        if (w > 0 && (best < 0 || current > best_current)) {
+            best = i;
+            best_current = current;
+        }
+    }
+
+    // All the drives are full, let them decide
+    if (best < 0)
+        return fallback_++ % clients.size();
+
+    state_->current[clients[best]->Id()] -= total;
+    return best;
+}
@@ -0,0 +1,128 @@
+/**
+ * This file is part of the OpenIO client libraries
+ * Copyright (C) 2016 OpenIO SAS
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ */
+
+#ifndef SRC_OIO_BLOB_KINETIC_CORO_PLACEMENT_H_
+#define SRC_OIO_BLOB_KINETIC_CORO_PLACEMENT_H_
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "utils/macros.h"
+#include "ClientInterface.h"
+
+namespace oio {
+namespace kinetic {
+namespace client {
+
+/**
+ * Chooses the drive that receives the next block of an upload.
+ */
+class PlacementPolicy {
+ public:
+    virtual ~PlacementPolicy() {}
+
+    /**
+     * @param clients the drives of the upload, cannot be empty
+     * @return the index in 'clients' of the drive to be used
+     */
+    virtual unsigned int Next(
+            const std::vector<std::shared_ptr<ClientInterface>> &clients) = 0;
+};
+
+/**
+ * One drive after the other, whatever their state.
+ */
+class RoundRobinPlacement : public PlacementPolicy {
+ public:
+    RoundRobinPlacement() : next_{0} {}
+
+    ~RoundRobinPlacement() {}
+
+    unsigned int Next(
+            const std::vector<std::shared_ptr<ClientInterface>> &clients)
+            override;
+
+ private:
+    unsigned int next_;
+};
+
+/**
+ * Health of a drive, as reported by GETLOG. Each figure is a margin, in
+ * percents: 100 means idle, empty or cold. It is also the neutral value of
+ * a figure not reported, so that the load and the latency alone weight a
+ * drive without stats.
+ */
+struct DriveHealth {
+    double cpu, io, space, temp;
+    int64_t refreshed;
+    bool refreshing;
+
+    DriveHealth() : cpu{100}, io{100}, space{100}, temp{100}, refreshed{0},
+                    refreshing{false} {}
+};
+
+/**
+ * Favors the drives with the most free space, the lowest temperature and
+ * utilization, the fewest outstanding RPC and the shortest latency. The
+ * health of a drive is refreshed in the background with a GETLOG, once it
+ * is older than --kinetic_placement_refresh. The choice is a smooth weighted
+ * round-robin, so that a loaded drive still receives its share.
+ */
+class WeightedPlacement : public PlacementPolicy {
+ public:
+    WeightedPlacement();
+
+    FORBID_COPY_CTOR(WeightedPlacement);
+
+    FORBID_MOVE_CTOR(WeightedPlacement);
+
+    ~WeightedPlacement();
+
+    unsigned int Next(
+            const std::vector<std::shared_ptr<ClientInterface>> &clients)
+            override;
+
+    /**
+     * Feed the policy with stats collected elsewhere.
+     * @param id the ID of the client
+     */
+    void Update(const std::string &id, const DriveHealth &health);
+
+    /**
+     * @return the weight of the drive, 0 if it must be avoided
+     */
+    double Weight(const ClientInterface &client);
+
+    struct State {
+        std::map<std::string, DriveHealth> health;
+        std::map<std::string, double> current;
+    };
+
+ private:
+    std::shared_ptr<State> state_;
+    unsigned int fallback_;
+};
+
+}  // namespace client
+}  // namespace kinetic
+}  // namespace oio
+
+#endif  // SRC_OIO_BLOB_KINETIC_CORO_PLACEMENT_H_
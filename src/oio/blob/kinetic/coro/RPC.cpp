@@ -24,6 +24,7 @@
 #include <libmill/libmill.h>
 
 #include <algorithm>
+#include <cstring>
 
 #include "ClientInterface.h"
 
@@ -33,12 +34,18 @@ using oio::kinetic::client::Context;
 using oio::kinetic::client::Frame;
 using oio::kinetic::client::Exchange;
 
+using oio::kinetic::client::StartBatch;
+using oio::kinetic::client::EndBatch;
+using oio::kinetic::client::AbortBatch;
+
 using oio::kinetic::client::Delete;
 using oio::kinetic::client::Get;
 using oio::kinetic::client::GetKeyRange;
 using oio::kinetic::client::GetLog;
 using oio::kinetic::client::GetNext;
+using oio::kinetic::client::P2PPush;
 using oio::kinetic::client::Put;
+using oio::kinetic::client::TagAlgorithm;
 
 
 DEFINE_bool(dump_frames, false,
@@ -50,17 +57,86 @@ DEFINE_bool(dump_requests, false,
 DEFINE_uint64(max_frame_size, 1024 * 1024,
               "Maximum frame size accepted from a Kinetic drive");
 
+TagAlgorithm oio::kinetic::client::default_tag = TagAlgorithm::SHA1;
+
+static proto::Command_Algorithm _proto_algorithm(TagAlgorithm a) {
+    switch (a) {
+        case TagAlgorithm::SHA2:
+            return proto::Command_Algorithm_SHA2;
+        case TagAlgorithm::CRC32C:
+            return proto::Command_Algorithm_CRC32C;
+        case TagAlgorithm::CRC64:
+            return proto::Command_Algorithm_CRC64;
+        default:
+            return proto::Command_Algorithm_SHA1;
+    }
+}
+
+bool oio::kinetic::client::tag_parse(const std::string &name,
+        TagAlgorithm *out) {
+    assert(out != nullptr);
+    if (name == "sha1")
+        *out = TagAlgorithm::SHA1;
+    else if (name == "sha2")
+        *out = TagAlgorithm::SHA2;
+    else if (name == "crc32c")
+        *out = TagAlgorithm::CRC32C;
+    else if (name == "crc64")
+        *out = TagAlgorithm::CRC64;
+    else
+        return false;
+    return true;
+}
+
+void oio::kinetic::client::tag_compute(TagAlgorithm algo, const void *buf,
+        size_t len, std::string *out) {
+    assert(out != nullptr);
+    switch (algo) {
+        case TagAlgorithm::SHA1: {
+            const auto h = compute_sha1(buf, len);
+            out->assign(h.begin(), h.end());
+            return;
+        }
+        case TagAlgorithm::SHA2: {
+            const auto h = compute_sha256(buf, len);
+            out->assign(h.begin(), h.end());
+            return;
+        }
+        case TagAlgorithm::CRC32C: {
+            const uint32_t crc = ::htonl(compute_crc32c(buf, len));
+            out->assign(reinterpret_cast<const char *>(&crc), sizeof(crc));
+            return;
+        }
+        case TagAlgorithm::CRC64: {
+            const uint64_t crc = compute_crc64(buf, len);
+            out->resize(sizeof(crc));
+            for (unsigned int i = 0; i < sizeof(crc); ++i)
+                (*out)[i] = static_cast<char>(crc >> (56 - 8 * i));
+            return;
+        }
+    }
+}
+
 
 void Context::Reset() {
     cnx_id_ = mill_now();
     sequence_id_ = 1;
 }
 
-Context::Context() : cluster_version_{0}, identity_{1},
-                     sha_salt_{"asdfasdf"} { Reset(); }
+Context::Context() : batch_id_{1}, cluster_version_{0}, identity_{1},
+                     sha_salt_{"asdfasdf"}, hmac_(), msg_(), frame_() {
+    hmac_.reset(hmac_make_SHA1(sha_salt_));
+    Reset();
+}
 
 
-Exchange::Exchange() : cmd(), payload_(), status_{false} {}
+Exchange::Exchange() : cmd(), payload_(), priority_{Priority::Normal},
+                       status_{false}, acked_{true} {}
+
+void Exchange::setBatch(uint32_t id, bool acked) {
+    cmd.mutable_header()->set_batchid(id);
+    acked_ = acked;
+}
 
 void Exchange::SetSequence(int64_t s) {
     cmd.mutable_header()->set_sequence(s);
@@ -77,44 +153,64 @@ void Exchange::ManageError(int errcode) {
     status_ = false;
 }
 
-int Exchange::Write(net::Channel *chan, const Context &ctx, int64_t dl) {
+void Exchange::ManageSent() {
+    assert(!acked_);
+    status_ = true;
+}
+
+int Exchange::Write(net::Channel *chan, Context *ctx, int64_t dl) {
     assert(chan != nullptr);
+    assert(ctx != nullptr);
     auto h = cmd.mutable_header();
-    h->set_priority(proto::Command_Priority::Command_Priority_NORMAL);
-    h->set_clusterversion(ctx.cluster_version_);
-    h->set_connectionid(ctx.cnx_id_);
+    switch (priority_) {
+        case Priority::High:
+            h->set_priority(proto::Command_Priority::Command_Priority_HIGHER);
+            break;
+        case Priority::Normal:
+            h->set_priority(proto::Command_Priority::Command_Priority_NORMAL);
+            break;
+        case Priority::Low:
+            h->set_priority(proto::Command_Priority::Command_Priority_LOWER);
+            break;
+    }
+    h->set_clusterversion(ctx->cluster_version_);
+    h->set_connectionid(ctx->cnx_id_);
     h->set_timeout(1000);
 
-    // Finish the message
-    ::com::seagate::kinetic::proto::Message msg;
-    msg.set_commandbytes(cmd.SerializeAsString());
-    auto hmac = compute_sha1_hmac(ctx.sha_salt_, msg.commandbytes());
+    // Finish the message in the scratch Message of the connection, whose
+    // fields keep their storage from one RPC to the next.
+    auto &msg = ctx->msg_;
+    auto cmdbytes = msg.mutable_commandbytes();
+    cmd.SerializeToString(cmdbytes);
     msg.set_authtype(proto::Message_AuthType::Message_AuthType_HMACAUTH);
-    msg.mutable_hmacauth()->set_identity(ctx.identity_);
-    msg.mutable_hmacauth()->set_hmac(hmac.data(), hmac.size());
-
-    // Serialize the message
-    std::vector<uint64_t> tmp(msg.ByteSize());
-    msg.SerializeToArray(tmp.data(), tmp.size());
+    auto auth = msg.mutable_hmacauth();
+    auth->set_identity(ctx->identity_);
+    ctx->hmac_->Compute(cmdbytes->data(), cmdbytes->size(),
+                        auth->mutable_hmac());
+
+    // Serialize the frame header and the message in the reused buffer
+    const uint32_t msglen = msg.ByteSize();
+    auto &frame = ctx->frame_;
+    frame.resize(9 + msglen);
+    frame[0] = 'F';
+    const uint32_t lenmsg = ::htonl(msglen), lenval = ::htonl(payload_.len);
+    memcpy(frame.data() + 1, &lenmsg, 4);
+    memcpy(frame.data() + 5, &lenval, 4);
+    msg.SerializeWithCachedSizesToArray(frame.data() + 9);
 
     DLOG_IF(INFO, FLAGS_dump_requests) << "Req> "
                                        << " V.size=" << payload_.len
                                        << " M=" << cmd.ShortDebugString();
 
-    uint8_t hdr[9] = {'F', 0, 0, 0, 0, 0, 0, 0, 0};
-    *(reinterpret_cast<uint32_t *>(hdr + 1)) = ::htonl(tmp.size());
-    *(reinterpret_cast<uint32_t *>(hdr + 5)) = ::htonl(payload_.len);
-
     struct iovec iov[] = {
-            BUFLEN_IOV(hdr, 9),
-            BUFLEN_IOV(tmp.data(), tmp.size()),
+            BUFLEN_IOV(frame.data(), frame.size()),
             BUFLEN_IOV(payload_.buf, payload_.len)
     };
-    bool rc = chan->send(iov, payload_.buf ? 3 : 2, dl);
+    bool rc = chan->send(iov, payload_.buf ? 2 : 1, dl);
 
     DLOG_IF(INFO, FLAGS_dump_frames) << "Frame> "
                                      << " V.size=" << payload_.len
-                                     << " M.size=" << tmp.size();
+                                     << " M.size=" << msglen;
 
     return rc ? 0 : errno;
 }
@@ -163,6 +259,8 @@ bool Request::Parse(Frame *f) {
                                 msg.commandbytes().size()))
             return false;
         value.swap(f->val);
+    } else {
+        cmd.Clear();
     }
 
     DLOG_IF(INFO, FLAGS_dump_requests)
@@ -175,7 +273,6 @@ bool Request::Parse(Frame *f) {
 }
 
 int Request::Read(net::Channel *chan, int64_t dl) {
-    Frame frame;
     int rc = frame.Read(chan, dl);
     if (rc != 0)
         return rc;
@@ -185,17 +282,66 @@ int Request::Read(net::Channel *chan, int64_t dl) {
 }
 
 
-Delete::Delete() : Exchange() {
+StartBatch::StartBatch() : Exchange() {
+    auto h = cmd.mutable_header();
+    h->set_messagetype(proto::Command_MessageType_START_BATCH);
+}
+
+StartBatch::~StartBatch() {}
+
+void StartBatch::Batch(uint32_t id) { setBatch(id, true); }
+
+void StartBatch::ManageReply(Request *rep) { checkStatus(rep); }
+
+
+EndBatch::EndBatch() : Exchange(), failed_{-1} {
+    auto h = cmd.mutable_header();
+    h->set_messagetype(proto::Command_MessageType_END_BATCH);
+    cmd.mutable_body()->mutable_batch()->set_count(0);
+}
+
+EndBatch::~EndBatch() {}
+
+void EndBatch::Batch(uint32_t id) { setBatch(id, true); }
+
+void EndBatch::Count(uint32_t count) {
+    cmd.mutable_body()->mutable_batch()->set_count(count);
+}
+
+void EndBatch::ManageReply(Request *rep) {
+    checkStatus(rep);
+    failed_ = -1;
+    if (!status_ && rep->cmd.body().batch().has_failedsequence())
+        failed_ = rep->cmd.body().batch().failedsequence();
+}
+
+
+AbortBatch::AbortBatch() : Exchange() {
+    auto h = cmd.mutable_header();
+    h->set_messagetype(proto::Command_MessageType_ABORT_BATCH);
+}
+
+AbortBatch::~AbortBatch() {}
+
+void AbortBatch::Batch(uint32_t id) { setBatch(id, true); }
+
+void AbortBatch::ManageReply(Request *rep) { checkStatus(rep); }
+
+
+Delete::Delete() : Exchange(), notfound_{false} {
     auto h = cmd.mutable_header();
     h->set_messagetype(proto::Command_MessageType_DELETE);
     auto kv = cmd.mutable_body()->mutable_keyvalue();
     kv->set_synchronization(proto::Command_Synchronization_WRITEBACK);
-    kv->set_algorithm(proto::Command_Algorithm_SHA1);
+    kv->set_algorithm(_proto_algorithm(oio::kinetic::client::default_tag));
 }
 
 Delete::~Delete() {}
 
-void Delete::ManageReply(Request *rep) { checkStatus(rep); }
+void Delete::ManageReply(Request *rep) {
+    checkStatus(rep);
+    notfound_ = rep->cmd.status().code() == proto::Command_Status::NOT_FOUND;
+}
 
 void Delete::Key(const char *k) {
     assert(k != nullptr);
@@ -206,12 +352,14 @@ void Delete::Key(const std::string &k) {
     cmd.mutable_body()->mutable_keyvalue()->set_key(k);
 }
 
+void Delete::Batch(uint32_t id) { setBatch(id, false); }
+
 
-Get::Get() : Exchange(), out_() {
+Get::Get() : Exchange(), out_(), verify_{false} {
     auto h = cmd.mutable_header();
     h->set_messagetype(proto::Command_MessageType_GET);
     auto kv = cmd.mutable_body()->mutable_keyvalue();
-    kv->set_algorithm(proto::Command_Algorithm_SHA1);
+    kv->set_algorithm(_proto_algorithm(oio::kinetic::client::default_tag));
 }
 
 Get::~Get() {}
@@ -222,6 +370,41 @@ void Get::ManageReply(Request *rep) {
         out_.clear();
         out_.swap(rep->value);
     }
+    const auto &kv = rep->cmd.body().keyvalue();
+    if (status_ && verify_ && !kv.has_tag()) {
+        LOG(ERROR) << "No tag to check on " << kv.key();
+        status_ = false;
+        out_.clear();
+        return;
+    }
+    if (status_ && verify_) {
+        TagAlgorithm algo;
+        switch (kv.algorithm()) {
+            case proto::Command_Algorithm_SHA1:
+                algo = TagAlgorithm::SHA1;
+                break;
+            case proto::Command_Algorithm_SHA2:
+                algo = TagAlgorithm::SHA2;
+                break;
+            case proto::Command_Algorithm_CRC32C:
+                algo = TagAlgorithm::CRC32C;
+                break;
+            case proto::Command_Algorithm_CRC64:
+                algo = TagAlgorithm::CRC64;
+                break;
+            default:
+                LOG(WARNING) << "Tag not checked, unsupported algorithm";
+                return;
+        }
+        std::string tag;
+        oio::kinetic::client::tag_compute(algo, out_.data(), out_.size(),
+                                          &tag);
+        if (tag != kv.tag()) {
+            LOG(ERROR) << "Tag mismatch on " << kv.key();
+            status_ = false;
+            out_.clear();
+        }
+    }
 }
 
 void Get::Key(const char *k) {
@@ -286,13 +469,18 @@ void GetKeyRange::Steal(std::vector<std::string> *v) {
 }
 
 
-GetLog::GetLog() : Exchange(), cpu{0}, temp{0}, space{0}, io{0} {
+GetLog::GetLog() : Exchange(), cpu{0}, temp{0}, space{0}, io{0},
+                   has_cpu{false}, has_temp{false}, has_space{false},
+                   has_io{false},
+                   max_value{0}, max_batch_ops{0}, max_batches{0},
+                   max_batch_bytes{0} {
     auto h = cmd.mutable_header();
     h->set_messagetype(proto::Command_MessageType_GETLOG);
     auto types = cmd.mutable_body()->mutable_getlog()->mutable_types();
     types->Add(proto::Command_GetLog_Type::Command_GetLog_Type_CAPACITIES);
     types->Add(proto::Command_GetLog_Type::Command_GetLog_Type_TEMPERATURES);
     types->Add(proto::Command_GetLog_Type::Command_GetLog_Type_UTILIZATIONS);
+    types->Add(proto::Command_GetLog_Type::Command_GetLog_Type_LIMITS);
 }
 
 GetLog::~GetLog() {}
@@ -304,6 +492,7 @@ void GetLog::ManageReply(Request *rep) {
     if (gl.has_capacity()) {
         const double usage = gl.capacity().portionfull();
         space = 100.0 * (1.0 - usage);
+        has_space = true;
     } else {
         LOG(ERROR) << "no capacity returned";
     }
@@ -320,6 +509,7 @@ void GetLog::ManageReply(Request *rep) {
             t0 = std::min(t0, t);
         }
         temp = t0;
+        has_temp = true;
     } else {
         LOG(ERROR) << "no temperature returned";
     }
@@ -329,14 +519,28 @@ void GetLog::ManageReply(Request *rep) {
     if (0 < gl.utilizations().size()) {
         for (const auto &u : gl.utilizations()) {
             const double val = 100.0 * (1.0 - u.value());
-            if (0 == u.name().compare(0, 3, "CPU"))
+            if (0 == u.name().compare(0, 3, "CPU")) {
                 cpu = val;
-            if (0 == u.name().compare(0, 2, "HD"))
+                has_cpu = true;
+            }
+            if (0 == u.name().compare(0, 2, "HD")) {
                 io = val;
+                has_io = true;
+            }
         }
     } else {
         LOG(ERROR) << "no cpu/disk utilization returned";
     }
+
+    // Optional, the drives that don't tell their limits are assumed not to
+    // accept batches
+    if (gl.has_limits()) {
+        const auto &l = gl.limits();
+        max_value = l.maxvaluesize();
+        max_batch_ops = l.maxoperationcountperbatch();
+        max_batches = l.maxbatchcountperdevice();
+        max_batch_bytes = l.maxbatchsize();
+    }
 }
 
 double GetLog::getCpu() const { return cpu; }
@@ -347,12 +551,20 @@ double GetLog::getSpace() const { return space; }
 
 double GetLog::getIo() const { return io; }
 
+uint32_t GetLog::getMaxValueSize() const { return max_value; }
+
+uint32_t GetLog::getMaxBatchOps() const { return max_batch_ops; }
+
+uint64_t GetLog::getMaxBatchBytes() const { return max_batch_bytes; }
+
+uint32_t GetLog::getMaxBatches() const { return max_batches; }
+
 
 GetNext::GetNext() : Exchange(), out_() {
     auto h = cmd.mutable_header();
     h->set_messagetype(proto::Command_MessageType_GETNEXT);
     auto kv = cmd.mutable_body()->mutable_keyvalue();
-    kv->set_algorithm(proto::Command_Algorithm_SHA1);
+    kv->set_algorithm(_proto_algorithm(oio::kinetic::client::default_tag));
 }
 
 GetNext::~GetNext() {}
@@ -372,13 +584,72 @@ void GetNext::Steal(std::string *v) {
 
 void GetNext::ManageReply(Request *rep) { checkStatus(rep); }
 
-Put::Put() : Exchange() {
+
+P2PPush::P2PPush() : Exchange(), pushed_() {
+    auto h = cmd.mutable_header();
+    h->set_messagetype(proto::Command_MessageType_PEER2PEERPUSH);
+    cmd.mutable_body()->mutable_p2poperation();
+}
+
+P2PPush::~P2PPush() {}
+
+bool P2PPush::Peer(const std::string &url) {
+    const auto colon = url.rfind(':');
+    if (colon == std::string::npos || colon == 0 || colon + 1 >= url.size())
+        return false;
+    char *end = nullptr;
+    const auto port = ::strtol(url.c_str() + colon + 1, &end, 10);
+    if (*end != 0 || port <= 0 || port > 65535)
+        return false;
+    auto peer = cmd.mutable_body()->mutable_p2poperation()->mutable_peer();
+    peer->set_hostname(url.substr(0, colon));
+    peer->set_port(port);
+    peer->set_tls(false);
+    return true;
+}
+
+void P2PPush::Add(const std::string &key) {
+    auto op = cmd.mutable_body()->mutable_p2poperation()->add_operation();
+    op->set_key(key);
+    op->set_force(true);
+}
+
+void P2PPush::Add(const std::string &key, const std::string &newkey) {
+    auto op = cmd.mutable_body()->mutable_p2poperation()->add_operation();
+    op->set_key(key);
+    op->set_newkey(newkey);
+    op->set_force(true);
+}
+
+size_t P2PPush::Count() const {
+    return cmd.body().p2poperation().operation_size();
+}
+
+bool P2PPush::Pushed(size_t i) const {
+    return i < pushed_.size() && pushed_[i];
+}
+
+void P2PPush::ManageReply(Request *rep) {
+    checkStatus(rep);
+    const auto &p2p = rep->cmd.body().p2poperation();
+    pushed_.assign(Count(), false);
+    const size_t max = std::min<size_t>(p2p.operation_size(), Count());
+    for (size_t i = 0; i < max; ++i)
+        pushed_[i] = p2p.operation(i).status().code() ==
+                     proto::Command_Status::SUCCESS;
+    // A drive may report a global success with failed children
+    for (bool ok : pushed_)
+        status_ = status_ && ok;
+}
+
+Put::Put() : Exchange(), value_copy(),
+             algorithm_{oio::kinetic::client::default_tag} {
     auto h = cmd.mutable_header();
     h->set_messagetype(proto::Command_MessageType_PUT);
     auto kv = cmd.mutable_body()->mutable_keyvalue();
     kv->set_synchronization(proto::Command_Synchronization_WRITEBACK);
-    kv->set_algorithm(proto::Command_Algorithm_SHA1);
     kv->set_force(true);
+    Algorithm(oio::kinetic::client::default_tag);
 }
 
 Put::~Put() {}
@@ -436,9 +707,16 @@ void Put::Value(const Slice &v) {
     rehash();
 }
 
+void Put::Algorithm(TagAlgorithm a) {
+    algorithm_ = a;
+    cmd.mutable_body()->mutable_keyvalue()->set_algorithm(_proto_algorithm(a));
+    rehash();
+}
+
 void Put::rehash() {
-    auto sha1 = compute_sha1(payload_.buf, payload_.len);
-    cmd.mutable_body()->mutable_keyvalue()->set_tag(sha1.data(), sha1.size());
+    oio::kinetic::client::tag_compute(
+            algorithm_, payload_.buf, payload_.len,
+            cmd.mutable_body()->mutable_keyvalue()->mutable_tag());
 }
 
 void Put::Sync(bool on) {
@@ -446,3 +724,5 @@ void Put::Sync(bool on) {
             on ? proto::Command_Synchronization_WRITETHROUGH
                : proto::Command_Synchronization_WRITEBACK);
 }
+
+void Put::Batch(uint32_t id) { setBatch(id, false); }
@@ -40,10 +40,20 @@ struct Context {
     int64_t cnx_id_;
     int64_t sequence_id_;
 
+    /* Next batch ID. Not reset with the connection, so that a late END_BATCH
+     * of a batch started on a former connection cannot commit a newer one. */
+    uint32_t batch_id_;
+
     int64_t cluster_version_;
     int64_t identity_;
     const char *sha_salt_;
 
+    /* Scratch state reused by every RPC sent on the connection, so that the
+     * steady state does no allocation. */
+    std::unique_ptr<Hmac> hmac_;
+    ::com::seagate::kinetic::proto::Message msg_;
+    std::vector<uint8_t> frame_;
+
     Context();
 
     ~Context() {}
@@ -86,16 +96,18 @@ struct Frame {
 
 /**
  * Unpacked form of a received frame.
- * Only used when reading from the channel.
+ * Only used when reading from the channel, and meant to be reused for the
+ * successive frames of a connection.
  */
 struct Request {
     ::com::seagate::kinetic::proto::Command cmd;
     ::com::seagate::kinetic::proto::Message msg;
     std::vector<uint8_t> value;
+    Frame frame;
 
     ~Request() {}
 
-    Request() : cmd(), msg(), value() {}
+    Request() : cmd(), msg(), value(), frame() {}
 
     Request(Request &o) = delete;  // NOLINT
 
@@ -108,6 +120,44 @@ struct Request {
     int Read(net::Channel *chan, int64_t dl);
 };
 
+/**
+ * Algorithms of the integrity tag attached to the values.
+ */
+enum class TagAlgorithm {
+    SHA1, SHA2, CRC32C, CRC64
+};
+
+/**
+ * Algorithm used by the PUT that don't pick one. Default: SHA1.
+ */
+extern TagAlgorithm default_tag;
+
+/**
+ * @param name one of "sha1", "sha2", "crc32c", "crc64"
+ * @return false if the name is unknown, and then 'out' is untouched
+ */
+bool tag_parse(const std::string &name, TagAlgorithm *out);
+
+/**
+ * The CRC are encoded in network order, SHA2 is SHA-256.
+ * @param out resized to the length of the tag
+ */
+void tag_compute(TagAlgorithm algo, const void *buf, size_t len,
+        std::string *out);
+
+/**
+ * Service classes of the RPC, from the most to the least urgent. They order
+ * the RPC queued in the client and are forwarded to the drive. All the RPC
+ * of a batch must share the same priority, to keep their order.
+ */
+enum class Priority : unsigned int {
+    High = 0,
+    Normal,
+    Low
+};
+
+#define RPC_PRIORITY_COUNT 3
+
 /**
  * Represents any RPC to a kinetic drive
  */
@@ -120,25 +170,113 @@ class Exchange {
 
     virtual ~Exchange() {}
 
-    int Write(net::Channel *chan, const Context &ctx, int64_t dl);
+    int Write(net::Channel *chan, Context *ctx, int64_t dl);
 
     void SetSequence(int64_t s);
 
+    void SetPriority(Priority p) { priority_ = p; }
+
+    Priority GetPriority() const { return priority_; }
+
     bool Ok() const {
         return status_;
     }
 
+    bool Batched() const { return cmd.header().has_batchid(); }
+
+    uint32_t BatchId() const { return cmd.header().batchid(); }
+
+    /**
+     * Tells if the drive acknowledges the command. The operations that belong
+     * to a batch are only acknowledged by the END_BATCH.
+     */
+    bool ExpectsReply() const { return acked_; }
+
     virtual void ManageReply(oio::kinetic::client::Request *rep) = 0;
 
     void ManageError(int errcode);
 
+    /**
+     * The command has been sent and no reply is expected.
+     */
+    void ManageSent();
+
  protected:
     void checkStatus(const oio::kinetic::client::Request *rep);
 
+    void setBatch(uint32_t id, bool acked);
+
  protected:
     ::com::seagate::kinetic::proto::Command cmd;
     Slice payload_;
+    Priority priority_;
     bool status_;
+    bool acked_;
+};
+
+/**
+ * Opens a batch on the drive. All the commands of the batch must then be sent
+ * on the same connection, until the END_BATCH or the ABORT_BATCH.
+ */
+class StartBatch : public oio::kinetic::client::Exchange {
+ public:
+    StartBatch();
+
+    FORBID_MOVE_CTOR(StartBatch);
+    FORBID_COPY_CTOR(StartBatch);
+
+    ~StartBatch();
+
+    void Batch(uint32_t id);
+
+    void ManageReply(oio::kinetic::client::Request *rep) override;
+};
+
+/**
+ * Atomically commits all the operations of a batch.
+ */
+class EndBatch : public oio::kinetic::client::Exchange {
+ public:
+    EndBatch();
+
+    FORBID_MOVE_CTOR(EndBatch);
+    FORBID_COPY_CTOR(EndBatch);
+
+    ~EndBatch();
+
+    void Batch(uint32_t id);
+
+    /**
+     * @param count the number of operations sent in the batch
+     */
+    void Count(uint32_t count);
+
+    /**
+     * @return the sequence of the operation that made the batch fail, or -1
+     */
+    int64_t FailedSequence() const { return failed_; }
+
+    void ManageReply(oio::kinetic::client::Request *rep) override;
+
+ private:
+    int64_t failed_;
+};
+
+/**
+ * Drops all the operations of a batch.
+ */
+class AbortBatch : public oio::kinetic::client::Exchange {
+ public:
+    AbortBatch();
+
+    FORBID_MOVE_CTOR(AbortBatch);
+    FORBID_COPY_CTOR(AbortBatch);
+
+    ~AbortBatch();
+
+    void Batch(uint32_t id);
+
+    void ManageReply(oio::kinetic::client::Request *rep) override;
 };
 
 
@@ -156,6 +294,18 @@ class Delete : public oio::kinetic::client::Exchange {
     void Key(const char *k);
 
     void Key(const std::string &k);
+
+    /**
+     * Make the DELETE part of a batch already started on the drive.
+     * @param id the batch ID
+     */
+    void Batch(uint32_t id);
+
+    /** @return if the drive replied the key didn't exist */
+    bool NotFound() const { return notfound_; }
+
+ private:
+    bool notfound_;
 };
 
 class Get : public oio::kinetic::client::Exchange {
@@ -173,10 +323,17 @@ class Get : public oio::kinetic::client::Exchange {
 
     void Steal(std::vector<uint8_t> &v) { v.swap(out_); }
 
+    /**
+     * Check the value against the tag returned by the drive. A mismatch, or
+     * a reply without tag, fails the RPC. Default: false.
+     */
+    void Verify(bool on) { verify_ = on; }
+
     void ManageReply(oio::kinetic::client::Request *rep) override;
 
  private:
     std::vector<uint8_t> out_;
+    bool verify_;
 };
 
 class GetKeyRange : public oio::kinetic::client::Exchange {
@@ -229,8 +386,35 @@ class GetLog : public oio::kinetic::client::Exchange {
 
     double getIo() const;
 
+    /**
+     * The figures the drive didn't report are left to 0.
+     * @return if the drive reported the figure of the same name
+     */
+    bool hasCpu() const { return has_cpu; }
+
+    bool hasTemp() const { return has_temp; }
+
+    bool hasSpace() const { return has_space; }
+
+    bool hasIo() const { return has_io; }
+
+    /** @return the largest value accepted by the drive, 0 if unknown */
+    uint32_t getMaxValueSize() const;
+
+    /** @return the maximum number of operations per batch, 0 if unknown */
+    uint32_t getMaxBatchOps() const;
+
+    /** @return the maximum amount of bytes per batch, 0 if unknown */
+    uint64_t getMaxBatchBytes() const;
+
+    /** @return the maximum number of batches open at once, 0 if unknown */
+    uint32_t getMaxBatches() const;
+
  private:
     double cpu, temp, space, io;
+    bool has_cpu, has_temp, has_space, has_io;
+    uint32_t max_value, max_batch_ops, max_batches;
+    uint64_t max_batch_bytes;
 };
 
 class GetNext : public oio::kinetic::client::Exchange {
@@ -253,6 +437,50 @@ class GetNext : public oio::kinetic::client::Exchange {
     std::string out_;
 };
 
+/**
+ * Asks the drive to push some of its keys to a peer drive. The values go
+ * straight from one drive to the other, not through the client.
+ * Ok() is true only if every key has been pushed.
+ */
+class P2PPush : public oio::kinetic::client::Exchange {
+ public:
+    P2PPush();
+
+    FORBID_MOVE_CTOR(P2PPush);
+    FORBID_COPY_CTOR(P2PPush);
+
+    ~P2PPush();
+
+    /**
+     * @param url the "host:port" of the peer drive
+     * @return false if the URL is malformed
+     */
+    bool Peer(const std::string &url);
+
+    /**
+     * Push 'key' under the same name on the peer
+     */
+    void Add(const std::string &key);
+
+    /**
+     * Push 'key' under a new name on the peer
+     */
+    void Add(const std::string &key, const std::string &newkey);
+
+    size_t Count() const;
+
+    /**
+     * To be called once replied.
+     * @return if the i-th key has been pushed
+     */
+    bool Pushed(size_t i) const;
+
+    void ManageReply(oio::kinetic::client::Request *rep) override;
+
+ private:
+    std::vector<bool> pushed_;
+};
+
 class Put : public oio::kinetic::client::Exchange {
  public:
     Put();
@@ -294,6 +522,12 @@ class Put : public oio::kinetic::client::Exchange {
      */
     void Value(std::vector<uint8_t> *v);
 
+    /**
+     * Default: default_tag
+     * @param a the algorithm of the integrity tag sent along the value
+     */
+    void Algorithm(TagAlgorithm a);
+
     void ManageReply(oio::kinetic::client::Request *rep) override;
 
     /**
@@ -302,11 +536,18 @@ class Put : public oio::kinetic::client::Exchange {
      */
     void Sync(bool on);
 
+    /**
+     * Make the PUT part of a batch already started on the drive.
+     * @param id the batch ID
+     */
+    void Batch(uint32_t id);
+
  private:
     void rehash();
 
  private:
     std::vector<uint8_t> value_copy;
+    TagAlgorithm algorithm_;
 };
 
 }  // namespace client
@@ -0,0 +1,787 @@
+/**
+ * This file is part of the OpenIO client libraries
+ * Copyright (C) 2016 OpenIO SAS
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ */
+
+#include <oio/blob/kinetic/coro/Simulator.h>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <libmill.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <utility>
+
+#include "utils/utils.hpp"
+#include "oio/blob/kinetic/coro/RPC.h"
+#include "oio/blob/kinetic/coro/CoroutineClientFactory.h"
+
+namespace proto = ::com::seagate::kinetic::proto;
+using oio::kinetic::client::Request;
+using oio::kinetic::client::CoroutineClientFactory;
+using oio::kinetic::client::Put;
+using oio::kinetic::client::Sync;
+using oio::kinetic::sim::Simulator;
+using oio::kinetic::sim::Store;
+
+#define SIM_RANGE_MAX 200
+
+class MemoryStore : public Store {
+ public:
+    MemoryStore() : items_(), bytes_{0} {}
+
+    ~MemoryStore() override {}
+
+    bool Get(const std::string &k, std::string *value,
+            std::string *version, std::string *tag) override {
+        auto it = items_.find(k);
+        if (it == items_.end())
+            return false;
+        value->assign(it->second.value);
+        version->assign(it->second.version);
+        tag->assign(it->second.tag);
+        return true;
+    }
+
+    bool Put(const std::string &k, const std::string &value,
+            const std::string &version, const std::string &tag) override {
+        auto &item = items_[k];
+        bytes_ -= item.value.size();
+        bytes_ += value.size();
+        item.value.assign(value);
+        item.version.assign(version);
+        item.tag.assign(tag);
+        return true;
+    }
+
+    bool Delete(const std::string &k) override {
+        auto it = items_.find(k);
+        if (it == items_.end())
+            return false;
+        bytes_ -= it->second.value.size();
+        items_.erase(it);
+        return true;
+    }
+
+    bool Version(const std::string &k, std::string *version) override {
+        auto it = items_.find(k);
+        if (it == items_.end())
+            return false;
+        version->assign(it->second.version);
+        return true;
+    }
+
+    void Range(const std::string &start, bool start_inclusive,
+            const std::string &end, bool end_inclusive, unsigned int max,
+            std::vector<std::string> *out) override {
+        auto it = start_inclusive ? items_.lower_bound(start)
+                                  : items_.upper_bound(start);
+        for (; it != items_.end() && out->size() < max; ++it) {
+            const int cmp = it->first.compare(end);
+            if (cmp > 0 || (cmp == 0 && !end_inclusive))
+                break;
+            out->push_back(it->first);
+        }
+    }
+
+    bool Next(const std::string &k, std::string *next) override {
+        auto it = items_.upper_bound(k);
+        if (it == items_.end())
+            return false;
+        next->assign(it->first);
+        return true;
+    }
+
+    size_t Count() const override { return items_.size(); }
+
+    uint64_t Bytes() const override { return bytes_; }
+
+ private:
+    struct Item {
+        std::string value, version, tag;
+    };
+
+    std::map<std::string, Item> items_;
+    uint64_t bytes_;
+};
+
+/**
+ * Each file holds the lengths of the version and of the tag (4 bytes each,
+ * network order), the version, the tag then the value. The file name is the
+ * hexadecimal form of the key.
+ */
+class DirectoryStore : public Store {
+ public:
+    explicit DirectoryStore(const std::string &path) : path_(path), index_(),
+                                                       bytes_{0} {}
+
+    ~DirectoryStore() override {}
+
+    bool Load() {
+        DIR *dir = ::opendir(path_.c_str());
+        if (dir == nullptr)
+            return false;
+        while (struct dirent *de = ::readdir(dir)) {
+            std::string key;
+            if (!hex2key(de->d_name, &key))
+                continue;
+            std::string value, version, tag;
+            if (read(key, &value, &version, &tag)) {
+                index_[key] = std::make_pair(version, value.size());
+                bytes_ += value.size();
+            }
+        }
+        ::closedir(dir);
+        return true;
+    }
+
+    bool Get(const std::string &k, std::string *value,
+            std::string *version, std::string *tag) override {
+        if (index_.find(k) == index_.end())
+            return false;
+        return read(k, value, version, tag);
+    }
+
+    bool Put(const std::string &k, const std::string &value,
+            const std::string &version, const std::string &tag) override {
+        const std::string tmp(pathOf(k) + ".tmp");
+        int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+            return false;
+        const uint32_t lens[2] = {::htonl(version.size()),
+                                  ::htonl(tag.size())};
+        bool ok = writeAll(fd, lens, sizeof(lens))
+                  && writeAll(fd, version.data(), version.size())
+                  && writeAll(fd, tag.data(), tag.size())
+                  && writeAll(fd, value.data(), value.size());
+        ::close(fd);
+        if (!ok || 0 != ::rename(tmp.c_str(), pathOf(k).c_str())) {
+            ::unlink(tmp.c_str());
+            return false;
+        }
+        auto &entry = index_[k];
+        bytes_ -= entry.second;
+        bytes_ += value.size();
+        entry = std::make_pair(version, value.size());
+        return true;
+    }
+
+    bool Delete(const std::string &k) override {
+        auto it = index_.find(k);
+        if (it == index_.end())
+            return false;
+        ::unlink(pathOf(k).c_str());
+        bytes_ -= it->second.second;
+        index_.erase(it);
+        return true;
+    }
+
+    bool Version(const std::string &k, std::string *version) override {
+        auto it = index_.find(k);
+        if (it == index_.end())
+            return false;
+        version->assign(it->second.first);
+        return true;
+    }
+
+    void Range(const std::string &start, bool start_inclusive,
+            const std::string &end, bool end_inclusive, unsigned int max,
+            std::vector<std::string> *out) override {
+        auto it = start_inclusive ? index_.lower_bound(start)
+                                  : index_.upper_bound(start);
+        for (; it != index_.end() && out->size() < max; ++it) {
+            const int cmp = it->first.compare(end);
+            if (cmp > 0 || (cmp == 0 && !end_inclusive))
+                break;
+            out->push_back(it->first);
+        }
+    }
+
+    bool Next(const std::string &k, std::string *next) override {
+        auto it = index_.upper_bound(k);
+        if (it == index_.end())
+            return false;
+        next->assign(it->first);
+        return true;
+    }
+
+    size_t Count() const override { return index_.size(); }
+
+    uint64_t Bytes() const override { return bytes_; }
+
+ private:
+    std::string pathOf(const std::string &k) const {
+        return path_ + "/" + bin2hex(
+                reinterpret_cast<const uint8_t *>(k.data()), k.size());
+    }
+
+    static bool hex2key(const char *name, std::string *key) {
+        const size_t len = ::strlen(name);
+        if (len == 0 || len % 2 != 0)
+            return false;
+        for (size_t i = 0; i < len; i += 2) {
+            char tmp[3] = {name[i], name[i + 1], 0};
+            char *end = nullptr;
+            const auto c = ::strtoul(tmp, &end, 16);
+            if (end != tmp + 2)
+                return false;
+            key->push_back(static_cast<char>(c));
+        }
+        return true;
+    }
+
+    static bool writeAll(int fd, const void *buf, size_t len) {
+        auto b = static_cast<const uint8_t *>(buf);
+        while (len > 0) {
+            const ssize_t w = ::write(fd, b, len);
+            if (w < 0 && errno == EINTR)
+                continue;
+            if (w <= 0)
+                return false;
+            b += w;
+            len -= w;
+        }
+        return true;
+    }
+
+    static bool readAll(int fd, void *buf, size_t len) {
+        auto b = static_cast<uint8_t *>(buf);
+        while (len > 0) {
+            const ssize_t r = ::read(fd, b, len);
+            if (r < 0 && errno == EINTR)
+                continue;
+            if (r <= 0)
+                return false;
+            b += r;
+            len -= r;
+        }
+        return true;
+    }
+
+    bool read(const std::string &k, std::string *value,
+            std::string *version, std::string *tag) const {
+        int fd = ::open(pathOf(k).c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        uint32_t lens[2] = {0, 0};
+        bool ok = 0 == ::fstat(fd, &st) && readAll(fd, lens, sizeof(lens));
+        const size_t head = sizeof(lens) + ::ntohl(lens[0]) + ::ntohl(lens[1]);
+        ok = ok && head <= static_cast<size_t>(st.st_size);
+        if (ok) {
+            version->resize(::ntohl(lens[0]));
+            tag->resize(::ntohl(lens[1]));
+            value->resize(st.st_size - head);
+            ok = readAll(fd, &(*version)[0], version->size())
+                 && readAll(fd, &(*tag)[0], tag->size())
+                 && readAll(fd, &(*value)[0], value->size());
+        }
+        ::close(fd);
+        return ok;
+    }
+
+ private:
+    std::string path_;
+    // key -> <version,size>
+    std::map<std::string, std::pair<std::string, size_t>> index_;
+    uint64_t bytes_;
+};
+
+Store *oio::kinetic::sim::store_make_memory() { return new MemoryStore; }
+
+Store *oio::kinetic::sim::store_make_directory(const std::string &path) {
+    std::unique_ptr<DirectoryStore> store(new DirectoryStore(path));
+    if (!store->Load())
+        return nullptr;
+    return store.release();
+}
+
+
+/* A PUT or a DELETE held until the end of its batch */
+struct Simulator::Op {
+    proto::Command cmd;
+    std::string value;
+};
+
+/* The operations of a batch, applied at once by the END_BATCH */
+struct Simulator::Batch {
+    std::vector<Op> ops;
+    uint64_t bytes;
+    // The batch went over the limits of the drive
+    bool overflow;
+
+    Batch() : ops(), bytes{0}, overflow{false} {}
+};
+
+/* A frame ready to be sent, once its due time is reached */
+struct Simulator::Reply {
+    int64_t due;
+    std::vector<uint8_t> frame;
+};
+
+struct Simulator::Connection {
+    std::unique_ptr<net::Socket> sock;
+    int64_t id;
+    std::map<uint32_t, Batch> batches;
+};
+
+static void _pack(const proto::Command &cmd, const std::string &value,
+        proto::Message_AuthType auth, std::vector<uint8_t> *out) {
+    proto::Message msg;
+    msg.set_authtype(auth);
+    cmd.SerializeToString(msg.mutable_commandbytes());
+    if (auth == proto::Message_AuthType_HMACAUTH)
+        msg.mutable_hmacauth()->set_identity(1);
+
+    const uint32_t msglen = msg.ByteSize();
+    out->resize(9 + msglen + value.size());
+    (*out)[0] = 'F';
+    const uint32_t lenmsg = ::htonl(msglen), lenval = ::htonl(value.size());
+    memcpy(out->data() + 1, &lenmsg, 4);
+    memcpy(out->data() + 5, &lenval, 4);
+    msg.SerializeWithCachedSizesToArray(out->data() + 9);
+    if (!value.empty())
+        memcpy(out->data() + 9 + msglen, value.data(), value.size());
+}
+
+Simulator::Simulator() : store_(store_make_memory()),
+                         peers_(new CoroutineClientFactory), front_(), url_(),
+                         latency_{0}, bandwidth_{0},
+                         capacity_{1ULL << 40}, max_value_{1024 * 1024},
+                         max_batch_ops_{64},
+                         max_batch_bytes_{32 * 1024 * 1024},
+                         max_batches_{16}, open_batches_{0},
+                         batch_bytes_{0}, peak_batch_bytes_{0},
+                         read_only_{false},
+                         next_free_{0}, next_cnx_{1},
+                         running_{false} {}
+
+Simulator::~Simulator() {
+    Stop();
+    front_.close();
+}
+
+void Simulator::Backend(Store *store) {
+    assert(store != nullptr);
+    store_.reset(store);
+}
+
+void Simulator::Latency(int64_t ms) { latency_ = ms; }
+
+void Simulator::Bandwidth(uint64_t bps) { bandwidth_ = bps; }
+
+void Simulator::Capacity(uint64_t bytes) { capacity_ = bytes; }
+
+void Simulator::Limits(uint32_t value, uint32_t batch_ops,
+        uint64_t batch_bytes, uint32_t batches) {
+    max_value_ = value;
+    max_batch_ops_ = batch_ops;
+    max_batch_bytes_ = batch_bytes;
+    max_batches_ = batches;
+}
+
+void Simulator::ReadOnly(bool on) { read_only_ = on; }
+
+std::string Simulator::Url() const { return url_; }
+
+uint64_t Simulator::PeakBatchBytes() {
+    const auto peak = peak_batch_bytes_;
+    peak_batch_bytes_ = batch_bytes_;
+    return peak;
+}
+
+void Simulator::Stop() { running_ = false; }
+
+bool Simulator::Start(const std::string &url) {
+    if (!front_.bind(url.c_str()) || !front_.listen(1024))
+        return false;
+
+    // Learn the actual port when an ephemeral one was requested
+    struct sockaddr_in sin;
+    socklen_t len = sizeof(sin);
+    if (0 != ::getsockname(front_.fileno(),
+                           reinterpret_cast<struct sockaddr *>(&sin), &len))
+        return false;
+    url_.assign(url, 0, url.rfind(':'));
+    url_ += ':' + std::to_string(::ntohs(sin.sin_port));
+
+    running_ = true;
+    mill_go(run_accept());
+    return true;
+}
+
+void Simulator::throttle(uint64_t bytes) {
+    if (bandwidth_ == 0 || bytes == 0)
+        return;
+    const int64_t now = mill_now();
+    next_free_ = std::max(now, next_free_) + (bytes * 1000) / bandwidth_;
+    if (next_free_ > now)
+        msleep(next_free_);
+}
+
+NOINLINE void Simulator::run_accept() {
+    bool input_ready = true;
+    while (running_) {
+        if (input_ready) {
+            auto s = front_.accept();
+            if (s != nullptr) {
+                auto cnx = new Connection;
+                cnx->sock.reset(s);
+                cnx->id = next_cnx_++;
+                mill_go(run_connection(cnx));
+                continue;
+            }
+        }
+        auto events = front_.PollIn(mill_now() + 1000);
+        if (events & MILLSOCKET_ERROR)
+            break;
+        input_ready = 0 != (events & MILLSOCKET_EVENT);
+    }
+}
+
+NOINLINE void Simulator::run_replies(Connection *cnx, chan done) {
+    chan replies = chr(done, chan);
+    while (true) {
+        Reply *r = chr(replies, Reply *);
+        if (r == nullptr)
+            break;
+        if (r->due > mill_now())
+            msleep(r->due);
+        throttle(r->frame.size());
+        cnx->sock->send(r->frame.data(), r->frame.size(), mill_now() + 5000);
+        delete r;
+    }
+    chs(done, chan, nullptr);
+}
+
+NOINLINE void Simulator::run_connection(Connection *cnx) {
+    std::unique_ptr<Connection> holder(cnx);
+    chan replies = chmake(Reply *, 1024);
+    chan done = chmake(chan, 1);
+    mill_go(run_replies(cnx, done));
+    chs(done, chan, replies);
+
+    // The banner tells the client its connection ID
+    auto banner = new Reply;
+    banner->due = mill_now();
+    do {
+        proto::Command cmd;
+        cmd.mutable_header()->set_connectionid(cnx->id);
+        cmd.mutable_status()->set_code(proto::Command_Status::SUCCESS);
+        _pack(cmd, std::string(), proto::Message_AuthType_UNSOLICITEDSTATUS,
+              &banner->frame);
+    } while (0);
+    chs(replies, Reply *, banner);
+
+    Request req;
+    while (running_) {
+        int err = req.Read(cnx->sock.get(), mill_now() + 1000);
+        if (err == EAGAIN || err == ETIMEDOUT)
+            continue;
+        if (err != 0)
+            break;
+        throttle(req.frame.msg.size() + req.value.size());
+
+        proto::Command rep;
+        std::string value;
+        if (handle(cnx, &req, &rep, &value)) {
+            auto r = new Reply;
+            r->due = mill_now() + latency_;
+            _pack(rep, value, proto::Message_AuthType_HMACAUTH, &r->frame);
+            chs(replies, Reply *, r);
+        }
+    }
+
+    // The batches left open by the client are dropped
+    open_batches_ -= cnx->batches.size();
+    for (const auto &b : cnx->batches)
+        batch_bytes_ -= b.second.bytes;
+
+    chs(replies, Reply *, nullptr);
+    (void) chr(done, chan);
+    cnx->sock->close();
+    chclose(done);
+    chclose(replies);
+}
+
+bool Simulator::versionOk(const proto::Command_KeyValue &kv) {
+    if (kv.force())
+        return true;
+    std::string current;
+    if (store_->Version(kv.key(), &current))
+        return current == kv.dbversion();
+    return kv.dbversion().empty();
+}
+
+void Simulator::apply(const Op &op) {
+    const auto &kv = op.cmd.body().keyvalue();
+    if (op.cmd.header().messagetype() == proto::Command_MessageType_PUT) {
+        // The tag is kept as sent, prefixed with its algorithm
+        std::string tag;
+        if (kv.has_tag()) {
+            tag.push_back(static_cast<char>(kv.algorithm()));
+            tag.append(kv.tag());
+        }
+        store_->Put(kv.key(), op.value, kv.newversion(), tag);
+    } else {
+        store_->Delete(kv.key());
+    }
+}
+
+void Simulator::endBatch(Connection *cnx, uint32_t id, proto::Command *rep) {
+    auto status = rep->mutable_status();
+    auto it = cnx->batches.find(id);
+    if (it == cnx->batches.end()) {
+        status->set_code(proto::Command_Status::INVALID_BATCH);
+        return;
+    }
+    std::vector<Op> ops;
+    ops.swap(it->second.ops);
+    const bool overflow = it->second.overflow;
+    batch_bytes_ -= it->second.bytes;
+    cnx->batches.erase(it);
+    open_batches_--;
+
+    const auto count = rep->body().batch().count();
+    rep->mutable_body()->clear_batch();
+    if (read_only_ && !ops.empty()) {
+        status->set_code(proto::Command_Status::NOT_AUTHORIZED);
+        return;
+    }
+    if (overflow || count != static_cast<int64_t>(ops.size())) {
+        status->set_code(proto::Command_Status::INVALID_BATCH);
+        return;
+    }
+    // All or nothing
+    for (const auto &op : ops) {
+        if (!versionOk(op.cmd.body().keyvalue())) {
+            status->set_code(proto::Command_Status::VERSION_MISMATCH);
+            rep->mutable_body()->mutable_batch()->set_failedsequence(
+                    op.cmd.header().sequence());
+            return;
+        }
+    }
+    for (const auto &op : ops) {
+        apply(op);
+        rep->mutable_body()->mutable_batch()->add_sequence(
+                op.cmd.header().sequence());
+    }
+}
+
+void Simulator::push(const proto::Command_P2POperation &in,
+        proto::Command *rep) {
+    auto out = rep->mutable_body()->mutable_p2poperation();
+    const auto url = in.peer().hostname() + ':' +
+                     std::to_string(in.peer().port());
+    auto client = peers_->Get(url);
+
+    std::vector<std::unique_ptr<Put>> puts(in.operation_size());
+    std::vector<std::shared_ptr<Sync>> syncs(in.operation_size());
+    for (int i = 0; i < in.operation_size(); ++i) {
+        const auto &op = in.operation(i);
+        std::string value, version, tag;
+        if (!store_->Get(op.key(), &value, &version, &tag))
+            continue;
+        puts[i].reset(new Put);
+        puts[i]->Key(op.newkey().empty() ? op.key() : op.newkey());
+        puts[i]->Value(value);
+        syncs[i] = client->RPC(puts[i].get());
+    }
+
+    bool all = true;
+    for (int i = 0; i < in.operation_size(); ++i) {
+        auto o = out->add_operation();
+        o->set_key(in.operation(i).key());
+        auto code = proto::Command_Status::NOT_FOUND;
+        if (puts[i]) {
+            syncs[i]->Wait();
+            if (puts[i]->Ok())
+                code = proto::Command_Status::SUCCESS;
+            else
+                code = proto::Command_Status::REMOTE_CONNECTION_ERROR;
+        }
+        o->mutable_status()->set_code(code);
+        all = all && code == proto::Command_Status::SUCCESS;
+    }
+    out->set_allchildoperationssucceeded(all);
+    if (!all)
+        rep->mutable_status()->set_code(
+                proto::Command_Status::NESTED_OPERATION_ERRORS);
+}
+
+void Simulator::tag(const std::string &stored, proto::Command_KeyValue *out) {
+    if (stored.empty())
+        return;
+    out->set_algorithm(static_cast<proto::Command_Algorithm>(
+            static_cast<uint8_t>(stored[0])));
+    out->set_tag(stored.substr(1));
+}
+
+bool Simulator::handle(Connection *cnx, Request *req, proto::Command *rep,
+        std::string *value) {
+    const auto &cmd = req->cmd;
+    const auto &h = cmd.header();
+    const auto type = h.messagetype();
+    const auto &kv = cmd.body().keyvalue();
+
+    auto rh = rep->mutable_header();
+    rh->set_acksequence(h.sequence());
+    rh->set_connectionid(cnx->id);
+    rh->set_messagetype(static_cast<proto::Command_MessageType>(type - 1));
+    auto status = rep->mutable_status();
+    status->set_code(proto::Command_Status::SUCCESS);
+
+    const bool batched = h.has_batchid() &&
+            (type == proto::Command_MessageType_PUT ||
+             type == proto::Command_MessageType_DELETE);
+    if (batched) {
+        auto it = cnx->batches.find(h.batchid());
+        if (it == cnx->batches.end()) {
+            status->set_code(proto::Command_Status::INVALID_BATCH);
+            return true;
+        }
+        auto &batch = it->second;
+        batch.bytes += req->value.size();
+        batch_bytes_ += req->value.size();
+        peak_batch_bytes_ = std::max(peak_batch_bytes_, batch_bytes_);
+        batch.overflow = batch.overflow
+                || batch.ops.size() >= max_batch_ops_
+                || batch.bytes > max_batch_bytes_
+                || req->value.size() > max_value_;
+        batch.ops.emplace_back();
+        batch.ops.back().cmd = cmd;
+        batch.ops.back().value.assign(req->value.begin(), req->value.end());
+        return false;
+    }
+
+    switch (type) {
+        case proto::Command_MessageType_NOOP:
+            break;
+        case proto::Command_MessageType_PUT:
+        case proto::Command_MessageType_DELETE:
+            if (read_only_) {
+                status->set_code(proto::Command_Status::NOT_AUTHORIZED);
+            } else if (req->value.size() > max_value_) {
+                status->set_code(proto::Command_Status::INVALID_REQUEST);
+            } else if (!versionOk(kv)) {
+                status->set_code(proto::Command_Status::VERSION_MISMATCH);
+            } else {
+                Op op;
+                op.cmd = cmd;
+                op.value.assign(req->value.begin(), req->value.end());
+                apply(op);
+            }
+            break;
+        case proto::Command_MessageType_GET: {
+            std::string version, stored;
+            if (!store_->Get(kv.key(), value, &version, &stored)) {
+                status->set_code(proto::Command_Status::NOT_FOUND);
+            } else {
+                auto out = rep->mutable_body()->mutable_keyvalue();
+                out->set_key(kv.key());
+                out->set_dbversion(version);
+                tag(stored, out);
+            }
+            break;
+        }
+        case proto::Command_MessageType_GETNEXT: {
+            std::string next, version, stored;
+            if (!store_->Next(kv.key(), &next) ||
+                !store_->Get(next, value, &version, &stored)) {
+                status->set_code(proto::Command_Status::NOT_FOUND);
+            } else {
+                auto out = rep->mutable_body()->mutable_keyvalue();
+                out->set_key(next);
+                out->set_dbversion(version);
+                tag(stored, out);
+            }
+            break;
+        }
+        case proto::Command_MessageType_GETKEYRANGE: {
+            const auto &r = cmd.body().range();
+            unsigned int max = r.maxreturned() > 0 ? r.maxreturned()
+                                                   : SIM_RANGE_MAX;
+            std::vector<std::string> keys;
+            store_->Range(r.startkey(), r.startkeyinclusive(), r.endkey(),
+                          r.endkeyinclusive(), max, &keys);
+            auto out = rep->mutable_body()->mutable_range();
+            for (auto &k : keys)
+                out->add_keys()->swap(k);
+            break;
+        }
+        case proto::Command_MessageType_GETLOG: {
+            auto gl = rep->mutable_body()->mutable_getlog();
+            auto c = gl->mutable_capacity();
+            c->set_nominalcapacityinbytes(capacity_);
+            c->set_portionfull(
+                    static_cast<double>(store_->Bytes()) / capacity_);
+            auto t = gl->add_temperatures();
+            t->set_name("HDA");
+            t->set_current(30);
+            t->set_minimum(5);
+            t->set_maximum(70);
+            auto u = gl->add_utilizations();
+            u->set_name("CPU");
+            u->set_value(0.1);
+            u = gl->add_utilizations();
+            u->set_name("HDA");
+            u->set_value(0.1);
+            auto l = gl->mutable_limits();
+            l->set_maxvaluesize(max_value_);
+            l->set_maxoperationcountperbatch(max_batch_ops_);
+            l->set_maxbatchsize(max_batch_bytes_);
+            l->set_maxbatchcountperdevice(max_batches_);
+            l->set_maxkeyrangecount(SIM_RANGE_MAX);
+            break;
+        }
+        case proto::Command_MessageType_PEER2PEERPUSH:
+            push(cmd.body().p2poperation(), rep);
+            break;
+        case proto::Command_MessageType_START_BATCH:
+            if (cnx->batches.find(h.batchid()) != cnx->batches.end() ||
+                open_batches_ >= max_batches_) {
+                status->set_code(proto::Command_Status::INVALID_BATCH);
+            } else {
+                cnx->batches[h.batchid()];
+                open_batches_++;
+            }
+            break;
+        case proto::Command_MessageType_END_BATCH:
+            rep->mutable_body()->mutable_batch()->set_count(
+                    cmd.body().batch().count());
+            endBatch(cnx, h.batchid(), rep);
+            break;
+        case proto::Command_MessageType_ABORT_BATCH: {
+            auto it = cnx->batches.find(h.batchid());
+            if (it != cnx->batches.end()) {
+                batch_bytes_ -= it->second.bytes;
+                cnx->batches.erase(it);
+                open_batches_--;
+            }
+            break;
+        }
+        default:
+            status->set_code(proto::Command_Status::INVALID_REQUEST);
+    }
+    return true;
+}
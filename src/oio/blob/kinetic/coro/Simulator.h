@@ -0,0 +1,226 @@
+/**
+ * This file is part of the OpenIO client libraries
+ * Copyright (C) 2016 OpenIO SAS
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ */
+
+#ifndef SRC_OIO_BLOB_KINETIC_CORO_SIMULATOR_H_
+#define SRC_OIO_BLOB_KINETIC_CORO_SIMULATOR_H_
+
+#include <src/kinetic.pb.h>
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "utils/macros.h"
+#include "utils/net.hpp"
+
+struct mill_chan;
+
+namespace oio {
+namespace kinetic {
+namespace client {
+struct Request;
+class ClientFactory;
+}  // namespace client
+
+namespace sim {
+
+/**
+ * Key/value storage behind a simulated drive.
+ */
+class Store {
+ public:
+    virtual ~Store() {}
+
+    /**
+     * @param tag filled with the integrity tag stored with the value, as
+     *        given to Put()
+     * @return false if the key doesn't exist
+     */
+    virtual bool Get(const std::string &k, std::string *value,
+            std::string *version, std::string *tag) = 0;
+
+    virtual bool Put(const std::string &k, const std::string &value,
+            const std::string &version, const std::string &tag) = 0;
+
+    /**
+     * @return false if the key doesn't exist
+     */
+    virtual bool Delete(const std::string &k) = 0;
+
+    /**
+     * @return false if the key doesn't exist, and then 'version' is untouched
+     */
+    virtual bool Version(const std::string &k, std::string *version) = 0;
+
+    /**
+     * Collect the keys between 'start' and 'end', in the lexical order.
+     */
+    virtual void Range(const std::string &start, bool start_inclusive,
+            const std::string &end, bool end_inclusive, unsigned int max,
+            std::vector<std::string> *out) = 0;
+
+    /**
+     * @return false if there is no key after 'k'
+     */
+    virtual bool Next(const std::string &k, std::string *next) = 0;
+
+    virtual size_t Count() const = 0;
+
+    virtual uint64_t Bytes() const = 0;
+};
+
+/**
+ * Keeps everything in an ordered map.
+ */
+Store *store_make_memory();
+
+/**
+ * One file per key, under 'path', with an in-memory index of the keys.
+ * @return nullptr if the directory cannot be loaded
+ */
+Store *store_make_directory(const std::string &path);
+
+/**
+ * A Kinetic drive served by coroutines, in the current process. It
+ * understands PUT, GET, GETNEXT, DELETE, GETKEYRANGE, GETLOG, NOOP,
+ * PEER2PEERPUSH and the batches. The HMAC are not checked. An artificial
+ * latency and bandwidth can be applied, the bandwidth being shared by all the
+ * connections.
+ */
+class Simulator {
+ public:
+    Simulator();
+
+    FORBID_COPY_CTOR(Simulator);
+
+    FORBID_MOVE_CTOR(Simulator);
+
+    ~Simulator();
+
+    /** Takes the ownership of the store. Default: store_make_memory() */
+    void Backend(Store *store);
+
+    /** Delay (ms) applied to each reply. Default: 0 */
+    void Latency(int64_t ms);
+
+    /** Bytes per second, in both directions. Default: 0, i.e. unlimited */
+    void Bandwidth(uint64_t bps);
+
+    /** Size announced in the GETLOG. Default: 1TiB */
+    void Capacity(uint64_t bytes);
+
+    /**
+     * Limits announced in the GETLOG and enforced: a larger PUT is refused
+     * and a batch that exceeds them fails at its END_BATCH.
+     * Default: 1MiB values, 64 operations and 32MiB per batch, 16 batches
+     * open at once.
+     */
+    void Limits(uint32_t value, uint32_t batch_ops, uint64_t batch_bytes,
+            uint32_t batches);
+
+    /** Refuse the PUT and the DELETE, as a locked drive. Default: false */
+    void ReadOnly(bool on);
+
+    /**
+     * Bind then start accepting connections in a background coroutine.
+     * @param url e.g. "127.0.0.1:0" for an ephemeral port
+     */
+    bool Start(const std::string &url);
+
+    /** Let the coroutines exit at their next wake up */
+    void Stop();
+
+    /** @return the address actually bound */
+    std::string Url() const;
+
+    /**
+     * @return the most bytes held at once by the open batches since the
+     *         previous call
+     */
+    uint64_t PeakBatchBytes();
+
+    Store *Backend() { return store_.get(); }
+
+ private:
+    struct Op;
+    struct Batch;
+    struct Reply;
+    struct Connection;
+
+    NOINLINE void run_accept();
+
+    NOINLINE void run_connection(Connection *cnx);
+
+    NOINLINE void run_replies(Connection *cnx, struct mill_chan *done);
+
+    /**
+     * @return false if no reply is due
+     */
+    bool handle(Connection *cnx, oio::kinetic::client::Request *req,
+            ::com::seagate::kinetic::proto::Command *rep, std::string *value);
+
+    void endBatch(Connection *cnx, uint32_t id,
+            ::com::seagate::kinetic::proto::Command *rep);
+
+    bool versionOk(const ::com::seagate::kinetic::proto::Command_KeyValue &kv);
+
+    void apply(const Op &op);
+
+    /**
+     * PUT the keys on the peer, as a client, and wait for the replies.
+     */
+    void push(const ::com::seagate::kinetic::proto::Command_P2POperation &in,
+            ::com::seagate::kinetic::proto::Command *rep);
+
+    /**
+     * Fill the GET reply with the tag stored along the value, as the drive
+     * doesn't recompute it.
+     */
+    void tag(const std::string &stored,
+            ::com::seagate::kinetic::proto::Command_KeyValue *out);
+
+    void throttle(uint64_t bytes);
+
+ private:
+    std::unique_ptr<Store> store_;
+    std::shared_ptr<oio::kinetic::client::ClientFactory> peers_;
+    net::MillSocket front_;
+    std::string url_;
+    int64_t latency_;
+    uint64_t bandwidth_;
+    uint64_t capacity_;
+    uint32_t max_value_;
+    uint32_t max_batch_ops_;
+    uint64_t max_batch_bytes_;
+    uint32_t max_batches_;
+    uint32_t open_batches_;
+    uint64_t batch_bytes_;
+    uint64_t peak_batch_bytes_;
+    bool read_only_;
+    int64_t next_free_;
+    int64_t next_cnx_;
+    bool running_;
+};
+
+}  // namespace sim
+}  // namespace kinetic
+}  // namespace oio
+
+#endif  // SRC_OIO_BLOB_KINETIC_CORO_SIMULATOR_H_
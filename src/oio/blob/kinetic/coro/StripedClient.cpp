@@ -0,0 +1,93 @@
+/**
+ * This file is part of the OpenIO client libraries
+ * Copyright (C) 2016 OpenIO SAS
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ */
+
+#include <oio/blob/kinetic/coro/StripedClient.h>
+
+#include <cassert>
+#include <cstdint>
+#include <sstream>
+
+using oio::kinetic::client::ClientInterface;
+using oio::kinetic::client::CoroutineClient;
+using oio::kinetic::client::Exchange;
+using oio::kinetic::client::StripedClient;
+using oio::kinetic::client::Sync;
+
+StripedClient::StripedClient(const std::string &url, unsigned int count) :
+        url_{url}, stripes_(), next_{0} {
+    assert(count > 0);
+    for (unsigned int i = 0; i < count; ++i)
+        stripes_.emplace_back(new CoroutineClient(url));
+}
+
+StripedClient::~StripedClient() {}
+
+std::string StripedClient::Id() const {
+    return url_;
+}
+
+size_t StripedClient::Outstanding() const {
+    size_t total = 0;
+    for (const auto &s : stripes_)
+        total += s->Outstanding();
+    return total;
+}
+
+double StripedClient::Latency() const {
+    double total = 0;
+    for (const auto &s : stripes_)
+        total += s->Latency();
+    return total / stripes_.size();
+}
+
+std::string StripedClient::DebugString() const {
+    std::stringstream ss;
+    ss << "StripedKC{url:" << url_ << ",cnx:" << stripes_.size() << '}';
+    return ss.str();
+}
+
+unsigned int StripedClient::pick() {
+    const auto count = stripes_.size();
+    auto best = next_ % count;
+    auto best_load = stripes_[best]->Outstanding();
+    for (size_t i = 1; i < count && best_load > 0; ++i) {
+        const auto idx = (next_ + i) % count;
+        const auto load = stripes_[idx]->Outstanding();
+        if (load < best_load) {
+            best = idx;
+            best_load = load;
+        }
+    }
+    next_ = (best + 1) % count;
+    return best;
+}
+
+uint32_t StripedClient::NewBatch() {
+    const uint32_t count = stripes_.size();
+    const auto idx = pick();
+    ClientInterface *client = stripes_[idx].get();
+    const uint32_t span = UINT32_MAX / count;
+    return (client->NewBatch() % span) * count + idx;
+}
+
+std::shared_ptr<Sync> StripedClient::RPC(Exchange *ex) {
+    assert(ex != nullptr);
+    const auto idx = ex->Batched() ? ex->BatchId() % stripes_.size() : pick();
+    ClientInterface *client = stripes_[idx].get();
+    return client->RPC(ex);
+}
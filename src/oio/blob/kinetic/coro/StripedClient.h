@@ -0,0 +1,80 @@
+/**
+ * This file is part of the OpenIO client libraries
+ * Copyright (C) 2016 OpenIO SAS
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ */
+
+#ifndef SRC_OIO_BLOB_KINETIC_CORO_STRIPEDCLIENT_H_
+#define SRC_OIO_BLOB_KINETIC_CORO_STRIPEDCLIENT_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ClientInterface.h"
+#include "oio/blob/kinetic/coro/CoroutineClient.h"
+
+namespace oio {
+namespace kinetic {
+namespace client {
+
+/**
+ * Spreads the RPC toward a single drive on several connections. Each
+ * connection is a CoroutineClient, with its own socket, its own agents and
+ * its own sequence space. A new RPC goes to the connection with the fewest
+ * outstanding RPC, the ties being broken in a round-robin fashion.
+ * The batch IDs embed the index of their connection, so that all the RPC of a
+ * batch follow the START_BATCH.
+ */
+class StripedClient : public ClientInterface {
+ public:
+    StripedClient(const std::string &url, unsigned int count);
+
+    ~StripedClient();
+
+    std::shared_ptr<Sync> RPC(oio::kinetic::client::Exchange *ex) override;
+
+    uint32_t NewBatch() override;
+
+    std::string Id() const override;
+
+    size_t Outstanding() const override;
+
+    double Latency() const override;
+
+    std::string DebugString() const;
+
+ private:
+    StripedClient() = delete;
+
+    StripedClient(StripedClient &o) = delete;  // NOLINT
+
+    StripedClient(const StripedClient &o) = delete;
+
+    StripedClient(const StripedClient &&o) = delete;
+
+    unsigned int pick();
+
+ private:
+    std::string url_;
+    std::vector<std::shared_ptr<CoroutineClient>> stripes_;
+    unsigned int next_;
+};
+
+}  // namespace client
+}  // namespace kinetic
+}  // namespace oio
+
+#endif  // SRC_OIO_BLOB_KINETIC_CORO_STRIPEDCLIENT_H_
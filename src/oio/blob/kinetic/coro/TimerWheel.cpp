@@ -0,0 +1,74 @@
+/**
+ * This file is part of the OpenIO client libraries
+ * Copyright (C) 2016 OpenIO SAS
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ */
+
+#include <cassert>
+
+#include "oio/blob/kinetic/coro/TimerWheel.h"
+
+using oio::kinetic::client::TimerWheel;
+
+TimerWheel::TimerWheel(int64_t resolution, unsigned int nb_slots) :
+        slots_(nb_slots), resolution_{resolution}, tick_{0}, count_{0} {
+    assert(resolution > 0);
+    assert(nb_slots > 0);
+}
+
+void TimerWheel::Reset(int64_t now) {
+    for (auto &slot : slots_)
+        slot.clear();
+    tick_ = now / resolution_;
+    count_ = 0;
+}
+
+void TimerWheel::Add(int64_t deadline, int64_t id) {
+    // Hashed in the first slot whose start is beyond the deadline, and a
+    // timer in the past goes in the next slot to be checked.
+    int64_t tick = (deadline + resolution_ - 1) / resolution_;
+    if (tick <= tick_)
+        tick = tick_ + 1;
+    slots_[tick % slots_.size()].push_back({deadline, id});
+    ++count_;
+}
+
+void TimerWheel::Expire(int64_t now, std::vector<int64_t> *out) {
+    assert(out != nullptr);
+    const int64_t target = now / resolution_;
+    if (target <= tick_)
+        return;
+
+    // After a long sleep, a single turn is enough to check all the slots
+    int64_t steps = target - tick_;
+    if (steps > static_cast<int64_t>(slots_.size()))
+        steps = slots_.size();
+
+    for (int64_t t = target - steps + 1; t <= target; ++t) {
+        auto &slot = slots_[t % slots_.size()];
+        // Timers beyond the current turn stay in place
+        size_t kept = 0;
+        for (size_t i = 0; i < slot.size(); ++i) {
+            if (slot[i].deadline <= now) {
+                out->push_back(slot[i].id);
+                --count_;
+            } else {
+                slot[kept++] = slot[i];
+            }
+        }
+        slot.resize(kept);
+    }
+    tick_ = target;
+}
@@ -0,0 +1,83 @@
+/**
+ * This file is part of the OpenIO client libraries
+ * Copyright (C) 2016 OpenIO SAS
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ */
+
+#ifndef SRC_OIO_BLOB_KINETIC_CORO_TIMERWHEEL_H_
+#define SRC_OIO_BLOB_KINETIC_CORO_TIMERWHEEL_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace oio {
+namespace kinetic {
+namespace client {
+
+/**
+ * Hashed timer wheel, tracking the deadlines of the pending RPC.
+ * Timers are hashed in a slot by their deadline, so that both the arming and
+ * the expiration cost O(1) per timer. Timers are never cancelled: the caller
+ * is expected to ignore the expired IDs that are not pending anymore.
+ */
+class TimerWheel {
+ public:
+    /**
+     * @param resolution the width of a slot, in the unit of the deadlines
+     * @param nb_slots the number of slots of the wheel
+     */
+    TimerWheel(int64_t resolution, unsigned int nb_slots);
+
+    /**
+     * Forget all the timers and set the current position of the wheel
+     * @param now the current time
+     */
+    void Reset(int64_t now);
+
+    /**
+     * Arm a timer
+     * @param deadline when the timer expires
+     * @param id the identifier to be reported at the expiration
+     */
+    void Add(int64_t deadline, int64_t id);
+
+    /**
+     * Move the wheel forward, up to 'now'
+     * @param now the current time
+     * @param out filled with the IDs of the expired timers, cannot be null
+     */
+    void Expire(int64_t now, std::vector<int64_t> *out);
+
+    /** Number of timers armed */
+    size_t Size() const { return count_; }
+
+ private:
+    struct Timer {
+        int64_t deadline;
+        int64_t id;
+    };
+
+    std::vector<std::vector<Timer>> slots_;
+    int64_t resolution_;
+    int64_t tick_;
+    size_t count_;
+};
+
+}  // namespace client
+}  // namespace kinetic
+}  // namespace oio
+
+#endif  // SRC_OIO_BLOB_KINETIC_CORO_TIMERWHEEL_H_
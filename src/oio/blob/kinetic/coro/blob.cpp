@@ -29,6 +29,7 @@
 #include <algorithm>
 #include <forward_list>
 #include <queue>
+#include <deque>
 
 #include "utils/macros.h"
 #include "oio/api/blob.hpp"
@@ -40,6 +41,7 @@ using oio::kinetic::blob::ListingBuilder;
 using oio::kinetic::blob::DownloadBuilder;
 using oio::kinetic::blob::RemovalBuilder;
 using oio::kinetic::blob::UploadBuilder;
+using oio::kinetic::blob::CopyBuilder;
 using oio::kinetic::client::ClientInterface;
 using oio::kinetic::client::ClientFactory;
 using oio::kinetic::client::Sync;
@@ -47,19 +49,61 @@ using oio::kinetic::client::Put;
 using oio::kinetic::client::Get;
 using oio::kinetic::client::Delete;
 using oio::kinetic::client::GetKeyRange;
+using oio::kinetic::client::GetLog;
+using oio::kinetic::client::BatchQuota;
+using oio::kinetic::client::Exchange;
+using oio::kinetic::client::Priority;
+using oio::kinetic::client::StartBatch;
+using oio::kinetic::client::EndBatch;
+using oio::kinetic::client::TagAlgorithm;
+using oio::kinetic::client::AbortBatch;
+using oio::kinetic::client::P2PPush;
+using oio::kinetic::client::PlacementPolicy;
+using oio::kinetic::client::RoundRobinPlacement;
 
 namespace blob = ::oio::api::blob;
 using Step = blob::TransactionStep;
 
+DEFINE_uint64(kinetic_readahead_budget, 64 * 1024 * 1024,
+              "Maximum amount of bytes prefetched by a Kinetic download");
+
+DEFINE_uint32(kinetic_readahead_per_drive, 2,
+              "Maximum number of GET in flight toward a single drive, "
+              "for a Kinetic download (0 for no per-drive limit)");
+
+DEFINE_uint32(kinetic_removal_parallelism, 8,
+              "Maximum number of DELETE in flight toward a single drive, "
+              "for a Kinetic removal");
+
+DEFINE_uint32(kinetic_removal_page, 200,
+              "Number of keys listed at once on each drive, "
+              "for a Kinetic removal");
+
+DEFINE_uint32(kinetic_upload_window, 16,
+              "Maximum number of PUT in flight for a Kinetic upload");
+
+DEFINE_uint64(kinetic_upload_window_bytes, 32 * 1024 * 1024,
+              "Maximum amount of bytes in flight for a Kinetic upload");
+
+DEFINE_uint32(kinetic_limits_refresh, 300,
+              "Seconds the limits told by a drive are kept before the next "
+              "GETLOG, by the Kinetic uploads");
+
+DEFINE_uint32(kinetic_p2p_batch, 128,
+              "Maximum number of keys pushed by a single PEER2PEERPUSH "
+              "(at least 1)");
+
 struct PendingGet {
     uint32_t sequence;
     uint32_t size;
+    int64_t started;
     std::shared_ptr<ClientInterface> client;
     std::shared_ptr<Get> op;
     std::shared_ptr<Sync> sync;
 
     PendingGet(std::shared_ptr<ClientInterface> c, const std::string &k)
-            : sequence{0}, size{0}, client{c}, op(new Get), sync(nullptr) {
+            : sequence{0}, size{0}, started{0}, client{c}, op(new Get),
+              sync(nullptr) {
         op->Key(k);
     }
 };
@@ -70,6 +114,132 @@ struct PendingGetSorter {
     }
 };
 
+/* Location of a block, as recorded in the manifest of the chunk */
+struct BlockRef {
+    std::string key;
+    std::string drive;
+    uint32_t size;
+    uint32_t sequence;
+};
+
+/**
+ * Ask all the drives for the manifest of the chunk, in parallel. The first
+ * manifest describing the layout of the blocks wins.
+ * @param blocks filled with the layout of the chunk
+ * @param drive set to the ID of the drive holding the manifest
+ * @param prio the priority of the GET
+ * @param xattr if not null, filled with the xattr of the chunk
+ * @return false if no drive returned a manifest with a valid layout
+ */
+static bool _load_manifest(std::shared_ptr<ClientFactory> factory,
+        const std::vector<std::string> &targets, const std::string &chunkid,
+        std::vector<BlockRef> *blocks, std::string *drive, Priority prio,
+        std::map<std::string, std::string> *xattr = nullptr) {
+    assert(blocks != nullptr);
+    assert(drive != nullptr);
+    const std::string key(chunkid + "-#");
+
+    std::vector<std::shared_ptr<ClientInterface>> clients;
+    std::vector<std::shared_ptr<Get>> ops;
+    std::vector<std::shared_ptr<Sync>> syncs;
+    for (const auto &to : targets) {
+        auto client = factory->Get(to);
+        std::shared_ptr<Get> op(new Get);
+        op->Key(key);
+        syncs.push_back(client->RPC(op.get(), prio));
+        clients.push_back(client);
+        ops.push_back(op);
+    }
+    for (auto &s : syncs)
+        s->Wait();
+
+    for (unsigned int i = 0; i < ops.size(); ++i) {
+        if (!ops[i]->Ok())
+            continue;
+        std::vector<uint8_t> raw;
+        ops[i]->Steal(raw);
+        const std::string json(raw.begin(), raw.end());
+        rapidjson::Document doc;
+        doc.Parse(json.c_str());
+        if (doc.HasParseError() || !doc.IsObject() ||
+            !doc.HasMember("blocks") || !doc["blocks"].IsArray())
+            continue;
+
+        const auto &jblocks = doc["blocks"];
+        std::vector<BlockRef> layout;
+        bool valid = true;
+        for (rapidjson::SizeType j = 0; valid && j < jblocks.Size(); ++j) {
+            const auto &b = jblocks[j];
+            valid = b.IsObject()
+                    && b.HasMember("key") && b["key"].IsString()
+                    && b.HasMember("drive") && b["drive"].IsString()
+                    && b.HasMember("size") && b["size"].IsUint()
+                    && b.HasMember("seq") && b["seq"].IsUint();
+            if (valid)
+                layout.push_back(BlockRef{
+                        b["key"].GetString(), b["drive"].GetString(),
+                        b["size"].GetUint(), b["seq"].GetUint()});
+        }
+        if (!valid) {
+            LOG(WARNING) << "Malformed manifest [" << key << "] on "
+                         << clients[i]->Id();
+            continue;
+        }
+        blocks->swap(layout);
+        drive->assign(clients[i]->Id());
+        if (xattr != nullptr && doc.HasMember("xattr") &&
+            doc["xattr"].IsObject()) {
+            const auto &jx = doc["xattr"];
+            for (auto it = jx.MemberBegin(); it != jx.MemberEnd(); ++it) {
+                if (it->value.IsString())
+                    (*xattr)[it->name.GetString()] = it->value.GetString();
+            }
+        }
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Serialize the manifest of a chunk: its xattr and the layout of its blocks.
+ * @param layout nullptr to let the readers list the blocks
+ */
+static void _pack_manifest(const std::map<std::string, std::string> &xattr,
+        const std::vector<BlockRef> *layout, std::string *out) {
+    rapidjson::StringBuffer buf;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(buf);
+    writer.StartObject();
+    writer.Key("xattr");
+    writer.StartObject();
+    for (const auto &e : xattr) {
+        writer.Key(e.first.c_str());
+        writer.String(e.second.c_str());
+    }
+    writer.EndObject();
+    if (layout == nullptr) {
+        writer.EndObject();
+        out->assign(buf.GetString(), buf.GetSize());
+        return;
+    }
+    writer.Key("blocks");
+    writer.StartArray();
+    for (const auto &b : *layout) {
+        writer.StartObject();
+        writer.Key("key");
+        writer.String(b.key.c_str());
+        writer.Key("drive");
+        writer.String(b.drive.c_str());
+        writer.Key("size");
+        writer.Uint(b.size);
+        writer.Key("seq");
+        writer.Uint(b.sequence);
+        writer.EndObject();
+    }
+    writer.EndArray();
+    writer.EndObject();
+    out->assign(buf.GetString(), buf.GetSize());
+}
+
 class KineticDownload : public blob::Download {
     friend class DownloadBuilder;
 
@@ -77,7 +247,8 @@ class KineticDownload : public blob::Download {
     KineticDownload(const std::string &n, std::shared_ptr<ClientFactory> f,
             std::vector<std::string> t)
             : chunkid{n}, targets(), factory(f), running(), waiting(), done(),
-              parallel_factor{4} {
+              inflight(), running_bytes{0}, window{2}, max_window{2},
+              latency{0}, rate{0}, last_read{0}, verify{false} {
         assert(factory.get() != nullptr);
         targets.swap(t);
     };
@@ -85,9 +256,90 @@ class KineticDownload : public blob::Download {
     virtual ~KineticDownload() {}
 
     Status Prepare() override {
+        std::forward_list<PendingGet> chunks;
+        std::vector<BlockRef> blocks;
+        std::string drive;
+        if (_load_manifest(factory, targets, chunkid, &blocks, &drive,
+                           Priority::Normal)) {
+            for (const auto &b : blocks) {
+                PendingGet pg(factory->Get(b.drive), b.key);
+                pg.size = b.size;
+                pg.sequence = b.sequence;
+                chunks.push_front(pg);
+            }
+        } else {
+            auto rc = listBlocks(&chunks);
+            if (!rc.Ok())
+                return rc;
+        }
+        chunks.sort([](const PendingGet &p0, const PendingGet &p1) -> bool {
+            return p0.sequence < p1.sequence;
+        });
+
+        uint64_t total = 0, count = 0;
+        for (auto &p : chunks) {
+            total += p.size;
+            count++;
+            p.op->Verify(verify);
+            waiting.push(p);
+        }
+
+        // The window may cover all the drives, within the memory budget
+        const uint64_t avg = count > 0 ? std::max<uint64_t>(1, total / count)
+                                       : 1;
+        uint64_t bound = FLAGS_kinetic_readahead_budget / avg;
+        if (FLAGS_kinetic_readahead_per_drive > 0)
+            bound = std::min<uint64_t>(bound,
+                    targets.size() * FLAGS_kinetic_readahead_per_drive);
+        max_window = std::min<uint64_t>(bound, count);
+        max_window = std::max(1u, max_window);
+        window = std::min(window, max_window);
+        return Status();
+    }
+
+    bool IsEof() override { return waiting.empty() && running.empty(); }
+
+    int32_t Read(std::vector<uint8_t> *buf) override {
+        DLOG(INFO) << "Currently " << running.size() <<
+                   " chunks downbloads running";
+        prefetch();
+
+        if (running.empty())
+            return 0;
+
+        auto pg = running.front();
+        running.pop();
+        const int64_t before = mill_now();
+        pg.sync->Wait();
+        const int64_t now = mill_now();
+        inflight[pg.client->Id()]--;
+        running_bytes -= pg.size;
+        if (verify && !pg.op->Ok())
+            return -1;
+        pg.op->Steal(*buf);
+
+        adjust(pg, now > before, now);
+        return buf->size();
+    }
+
+ private:
+    std::string chunkid;
+    std::vector<std::string> targets;
+    std::shared_ptr<ClientFactory> factory;
+
+    std::queue<PendingGet> running;
+    std::queue<PendingGet> waiting;
+    std::queue<PendingGet> done;
+
+    /**
+     * Fallback when the manifest has no layout: scan the keys of the chunk
+     * on all the drives.
+     */
+    Status listBlocks(std::forward_list<PendingGet> *chunks) {
         // List the chunks
         ListingBuilder builder(factory);
         builder.Name(chunkid);
+        builder.SetPriority(Priority::Normal);
         for (const auto &to : targets)
             builder.Target(to);
 
@@ -101,7 +353,6 @@ class KineticDownload : public blob::Download {
         }
 
         std::string id, key;
-        std::forward_list<PendingGet> chunks;
         while (listing->Next(&id, &key)) {
             std::string k(key);
             auto dash = k.rfind('-');
@@ -126,62 +377,79 @@ class KineticDownload : public blob::Download {
                     pg.sequence = seq;
                     DLOG(INFO) << "Chunk [" << key << "] seq=" << pg.sequence <<
                                " size=" << pg.size;
-                    chunks.push_front(pg);
+                    chunks->push_front(pg);
                 }
             }
         }
-        chunks.sort([](const PendingGet &p0, const PendingGet &p1) -> bool {
-            return p0.sequence < p1.sequence;
-        });
-
-        for (auto &p : chunks)
-            waiting.push(p);
-
         return Status();
     }
 
-    bool IsEof() override { return waiting.empty() && running.empty(); }
-
-    int32_t Read(std::vector<uint8_t> *buf) override {
-        DLOG(INFO) << "Currently " << running.size() <<
-                   " chunks downbloads running";
-        while (running.size() < parallel_factor) {
-            if (waiting.empty()) {
-                DLOG(INFO) << "No chunks in the waiting queue";
+    /**
+     * Start the next GET, in the order of the blocks, as long as the window,
+     * the memory budget and the per-drive limit allow it.
+     */
+    void prefetch() {
+        while (running.size() < window && !waiting.empty()) {
+            auto &pg = waiting.front();
+            auto &count = inflight[pg.client->Id()];
+            if (FLAGS_kinetic_readahead_per_drive > 0 &&
+                count >= FLAGS_kinetic_readahead_per_drive)
                 break;
-            } else {
-                auto pg = waiting.front();
-                waiting.pop();
-                pg.sync = pg.client->RPC(pg.op.get());
-                running.push(pg);
-                DLOG(INFO) << "chunk download started";
-            }
+            if (!running.empty() &&
+                running_bytes + pg.size > FLAGS_kinetic_readahead_budget)
+                break;
+            pg.started = mill_now();
+            pg.sync = pg.client->RPC(pg.op.get());
+            count++;
+            running_bytes += pg.size;
+            running.push(pg);
+            waiting.pop();
         }
-
-        if (running.empty())
-            return 0;
-
-        auto pg = running.front();
-        running.pop();
-        pg.sync->Wait();
-        pg.op->Steal(*buf);
-        return buf->size();
     }
 
- private:
-    std::string chunkid;
-    std::vector<std::string> targets;
-    std::shared_ptr<ClientFactory> factory;
+    /**
+     * Resize the window so that it covers the bandwidth-delay product, i.e.
+     * the bytes consumed during the latency of a GET.
+     * @param pg the block just consumed
+     * @param stalled if the consumer had to wait for the block
+     * @param now the current time (in ms)
+     */
+    void adjust(const PendingGet &pg, bool stalled, int64_t now) {
+        // A block already there only gives an upper bound of the latency
+        const double elapsed = std::max<int64_t>(1, now - pg.started);
+        if (stalled || latency <= 0)
+            latency = latency <= 0 ? elapsed : (latency * 7 + elapsed) / 8;
+        if (last_read > 0) {
+            const double sample =
+                    pg.size / static_cast<double>(
+                            std::max<int64_t>(1, now - last_read));
+            rate = rate <= 0 ? sample : (rate * 7 + sample) / 8;
+        }
+        last_read = now;
+
+        const double bdp = rate * latency;
+        const unsigned int wanted = 1 + bdp / std::max(1u, pg.size);
+        if (stalled)
+            window = std::max(window + 1, wanted);
+        else if (wanted < window)
+            window--;
+        window = std::max(1u, std::min(window, max_window));
+    }
 
-    std::queue<PendingGet> running;
-    std::queue<PendingGet> waiting;
-    std::queue<PendingGet> done;
+    // Number of GET in flight, per drive
+    std::map<std::string, unsigned int> inflight;
+    uint64_t running_bytes;
 
-    unsigned int parallel_factor;
+    unsigned int window;
+    unsigned int max_window;
+    double latency;  // ms
+    double rate;  // bytes/ms
+    int64_t last_read;
+    bool verify;
 };
 
 DownloadBuilder::DownloadBuilder(std::shared_ptr<ClientFactory> f) :
-        factory(f), targets(), name() {
+        factory(f), targets(), name(), verify{false} {
     assert(factory.get() != nullptr);
 }
 
@@ -207,6 +475,10 @@ bool DownloadBuilder::Target(const char *to) {
     return Target(std::string(to));
 }
 
+void DownloadBuilder::Verify(bool on) {
+    verify = on;
+}
+
 std::unique_ptr<blob::Download> DownloadBuilder::Build() {
     assert(!targets.empty());
     assert(!name.empty());
@@ -214,8 +486,9 @@ std::unique_ptr<blob::Download> DownloadBuilder::Build() {
     std::vector<std::string> v;
     for (const auto &t : targets)
         v.emplace_back(t);
-    return std::unique_ptr<KineticDownload>(
-            new KineticDownload(name, factory, std::move(v)));
+    auto dl = new KineticDownload(name, factory, std::move(v));
+    dl->verify = verify;
+    return std::unique_ptr<KineticDownload>(dl);
 }
 
 
@@ -223,7 +496,8 @@ class KineticListing : public blob::Listing {
     friend class ListingBuilder;
 
  public:
-    KineticListing() : clients(), name(), items(), next_item{0} {}
+    KineticListing() : clients(), name(), priority{Priority::Low}, items(),
+                       next_item{0} {}
 
     ~KineticListing() {}
 
@@ -263,7 +537,7 @@ class KineticListing : public blob::Listing {
                 gkr->IncludeStart(false);
                 gkr->IncludeEnd(false);
                 ops[i].reset(gkr);
-                syncs.emplace_back(clients[i]->RPC(gkr));
+                syncs.emplace_back(clients[i]->RPC(gkr, priority));
             }
             for (auto sync : syncs)
                 sync->Wait();
@@ -308,6 +582,7 @@ class KineticListing : public blob::Listing {
  private:
     std::vector<std::shared_ptr<ClientInterface>> clients;
     std::string name;
+    Priority priority;
 
     std::vector<std::pair<int, std::string>> items;
     unsigned int next_item;
@@ -316,7 +591,7 @@ class KineticListing : public blob::Listing {
 ListingBuilder::~ListingBuilder() {}
 
 ListingBuilder::ListingBuilder(std::shared_ptr<ClientFactory> f)
-        : factory(f), targets(), name() {
+        : factory(f), targets(), name(), priority{Priority::Low} {
     assert(factory.get() != nullptr);
 }
 
@@ -340,6 +615,10 @@ bool ListingBuilder::Target(const char *to) {
     return Target(std::string(to));
 }
 
+void ListingBuilder::SetPriority(Priority p) {
+    priority = p;
+}
+
 std::unique_ptr<blob::Listing> ListingBuilder::Build() {
     assert(factory.get() != nullptr);
     assert(!targets.empty());
@@ -347,6 +626,7 @@ std::unique_ptr<blob::Listing> ListingBuilder::Build() {
 
     auto listing = new KineticListing;
     listing->name.assign(name);
+    listing->priority = priority;
     for (auto to : targets)
         listing->clients.emplace_back(factory->Get(to));
     return std::unique_ptr<KineticListing>(listing);
@@ -369,7 +649,11 @@ struct PendingDelete {
     }
 };
 
-static void _rolling_delete(unsigned int parallelism_factor,
+/**
+ * @return the number of DELETE that failed, a key already absent being
+ *         considered as deleted
+ */
+static unsigned int _rolling_delete(unsigned int parallelism_factor,
         std::vector<PendingDelete> *ops) {
     DLOG(INFO) << __FUNCTION__ << " of " << ops->size() << " ops";
 
@@ -377,12 +661,120 @@ static void _rolling_delete(unsigned int parallelism_factor,
     for (unsigned int i = 0; i < parallelism_factor && i < ops->size(); ++i)
         ops->at(i).Start();
 
+    unsigned int errors{0};
     for (unsigned int i = 0; i < ops->size(); ++i) {
-        ops->at(i).sync->Wait();
+        auto &op = ops->at(i);
+        op.sync->Wait();
+        if (!op.op->Ok() && !op.op->NotFound())
+            errors++;
         // an operation finished, pre-start another one
         if (i + parallelism_factor < ops->size())
             ops->at(i + parallelism_factor).Start();
     }
+    return errors;
+}
+
+/**
+ * The keys of a chunk held by one drive. They are deleted page by page, each
+ * page being deleted while the next one is listed.
+ */
+struct PurgeCursor {
+    std::shared_ptr<ClientInterface> client;
+    std::string name;
+    Priority priority;
+    unsigned int parallelism;
+
+    // Last key listed, the next page starts after it
+    std::string marker;
+    // No more page to list
+    bool listed;
+    std::vector<std::string> page;
+    // The manifests are deleted last, so that an interrupted removal leaves
+    // a chunk that can still be listed.
+    std::vector<std::string> manifests;
+
+    std::shared_ptr<GetKeyRange> next;
+    std::shared_ptr<Sync> next_sync;
+
+    PurgeCursor(std::shared_ptr<ClientInterface> c, const std::string &n,
+            Priority prio, unsigned int par)
+            : client(c), name(n), priority{prio}, parallelism{par},
+              marker(n + "-"), listed{false}, page(), manifests(),
+              next(), next_sync() {}
+
+    /* Start listing the page after the marker */
+    void List() {
+        assert(!listed);
+        next.reset(new GetKeyRange);
+        next->Start(marker);
+        next->End(name + "-X");
+        next->IncludeStart(false);
+        next->IncludeEnd(false);
+        next->MaxItems(FLAGS_kinetic_removal_page);
+        next_sync = client->RPC(next.get(), priority);
+    }
+
+    /* Wait for the page being listed, then make it the current page */
+    bool Collect() {
+        assert(next.get() != nullptr);
+        next_sync->Wait();
+        const bool ok = next->Ok();
+        std::vector<std::string> keys;
+        if (ok)
+            next->Steal(&keys);
+        next.reset();
+        next_sync.reset();
+
+        // The drive may return less keys than asked, only an empty page
+        // tells the range is over
+        listed = !ok || keys.empty();
+        if (!keys.empty())
+            marker.assign(keys.back());
+        for (auto &k : keys) {
+            if (k.size() > 2 && k.compare(k.size() - 2, 2, "-#") == 0)
+                manifests.push_back(std::move(k));
+            else
+                page.push_back(std::move(k));
+        }
+        return ok;
+    }
+
+    /**
+     * @return false if a key could not be deleted
+     */
+    bool Delete(const std::vector<std::string> &keys) {
+        std::vector<PendingDelete> ops;
+        ops.reserve(keys.size());
+        for (const auto &k : keys) {
+            ops.emplace_back(client, k);
+            ops.back().op->SetPriority(priority);
+        }
+        const auto errors = _rolling_delete(parallelism, &ops);
+        if (errors > 0)
+            LOG(WARNING) << errors << " DELETE failed on " << client->Id();
+        return errors == 0;
+    }
+};
+
+/* Delete all the blocks held by a drive, the manifests excepted */
+static coroutine void _purge_drive(PurgeCursor *c, chan done) {
+    bool ok = true;
+    while (true) {
+        std::vector<std::string> page;
+        page.swap(c->page);
+        const bool more = !c->listed;
+        if (more)
+            c->List();
+        ok = c->Delete(page) && ok;
+        if (!more)
+            break;
+        if (!c->Collect()) {
+            LOG(WARNING) << "Listing failed on " << c->client->Id();
+            ok = false;
+            break;
+        }
+    }
+    chs(done, int, ok ? 0 : 1);
 }
 
 class KineticRemoval : public blob::Removal {
@@ -391,42 +783,80 @@ class KineticRemoval : public blob::Removal {
  public:
     KineticRemoval(std::shared_ptr<ClientFactory> f,
             std::vector<std::string> tv)
-            : parallelism_factor{8}, chunkid(), targets(), factory(f), ops(),
-              step{Step::Init} {
+            : chunkid(), targets(), factory(f), priority{Priority::Low},
+              parallelism(), cursors(), step{Step::Init} {
         targets.swap(tv);
     }
 
     ~KineticRemoval() override {}
 
+    /**
+     * Locate the keys of the chunk: the manifest gives them all, otherwise
+     * only the first page of each drive is listed.
+     */
     Status Prepare() override {
         if (step != Step::Init)
             return Status(Cause::InternalError);
 
-        ListingBuilder builder(factory);
-        builder.Name(chunkid);
-        for (const auto &to : targets)
-            builder.Target(to);
-        auto listing = builder.Build();
-
-        auto rc = listing->Prepare();
-        if (rc.Ok()) {
-            std::string id, key;
-            while (listing->Next(&id, &key)) {
-                PendingDelete del(factory->Get(id), key);
-                DLOG(INFO) << "rem(" << id << "," << key << ")";
-                ops.push_back(del);
+        std::vector<BlockRef> blocks;
+        std::string drive;
+        if (_load_manifest(factory, targets, chunkid, &blocks, &drive,
+                           priority)) {
+            for (const auto &b : blocks) {
+                auto c = cursor(b.drive);
+                c->page.push_back(b.key);
             }
+            // A copied chunk has a manifest on each of its drives
+            for (const auto &to : targets)
+                cursor(to)->manifests.push_back(chunkid + "-#");
+            for (auto &c : cursors)
+                c->listed = true;
             step = Step::Prepared;
+            return Status();
         }
-        return rc;
+
+        // No layout available, scan the drives
+        for (const auto &to : targets)
+            cursor(to)->List();
+        bool ok = true, any = false;
+        for (auto &c : cursors) {
+            ok = c->Collect() && ok;
+            any = any || !c->page.empty() || !c->manifests.empty();
+        }
+        if (!ok)
+            return Status(Cause::NetworkError);
+        if (!any)
+            return Status(Cause::NotFound);
+        step = Step::Prepared;
+        return Status();
     }
 
+    /**
+     * Purge the drives in parallel, each one deleting a page of keys while
+     * listing the next one. The manifests are deleted once all the drives
+     * are purged, so that a failure leaves a chunk that can be removed
+     * again.
+     */
     Status Commit() override {
         if (step != Step::Prepared)
             return Status(Cause::InternalError);
 
-        _rolling_delete(parallelism_factor, &ops);
+        chan done = chmake(int, cursors.size());
+        for (auto &c : cursors)
+            mill_go(_purge_drive(c.get(), done));
+        int errors{0};
+        for (unsigned int i = 0; i < cursors.size(); ++i)
+            errors += chr(done, int);
+        chclose(done);
+
+        if (errors == 0) {
+            for (auto &c : cursors)
+                errors += c->Delete(c->manifests) ? 0 : 1;
+        }
+
         step = Step::Done;
+        if (errors > 0)
+            return Status(Cause::NetworkError);
         return Status();
     }
 
@@ -439,17 +869,33 @@ class KineticRemoval : public blob::Removal {
     }
 
  private:
-    unsigned int parallelism_factor;
+    PurgeCursor *cursor(const std::string &to) {
+        for (auto &c : cursors) {
+            if (c->client->Id() == to)
+                return c.get();
+        }
+        auto it = parallelism.find(to);
+        const auto par = it != parallelism.end()
+                         ? it->second : FLAGS_kinetic_removal_parallelism;
+        cursors.emplace_back(new PurgeCursor(factory->Get(to), chunkid,
+                                             priority, std::max(1U, par)));
+        return cursors.back().get();
+    }
+
+ private:
     std::string chunkid;
     std::vector<std::string> targets;
     std::shared_ptr<ClientFactory> factory;
+    Priority priority;
+    std::map<std::string, unsigned int> parallelism;
 
-    std::vector<PendingDelete> ops;
+    std::vector<std::unique_ptr<PurgeCursor>> cursors;
     Step step;
 };
 
 RemovalBuilder::RemovalBuilder(std::shared_ptr<ClientFactory> f)
-        : factory(f), targets(), name() {
+        : factory(f), targets(), name(), priority{Priority::Low},
+          parallelism() {
 }
 
 bool RemovalBuilder::Name(const std::string &n) {
@@ -472,6 +918,17 @@ bool RemovalBuilder::Target(const char *to) {
     return Target(std::string(to));
 }
 
+void RemovalBuilder::SetPriority(Priority p) {
+    priority = p;
+}
+
+void RemovalBuilder::Parallelism(const std::string &to, unsigned int n) {
+    if (n > 0)
+        parallelism[to] = n;
+    else
+        parallelism.erase(to);
+}
+
 std::unique_ptr<blob::Removal> RemovalBuilder::Build() {
     assert(!targets.empty());
     assert(!name.empty());
@@ -481,6 +938,8 @@ std::unique_ptr<blob::Removal> RemovalBuilder::Build() {
         tv.push_back(t);
     auto rem = new KineticRemoval(factory, std::move(tv));
     rem->chunkid.assign(name);
+    rem->priority = priority;
+    rem->parallelism = parallelism;
     return std::unique_ptr<KineticRemoval>(rem);
 }
 
@@ -489,10 +948,13 @@ struct PendingPut {
     std::shared_ptr<ClientInterface> client;
     std::shared_ptr<Put> put;
     std::shared_ptr<Sync> sync;
-    std::string key;
+    uint32_t size;
+    bool batched;  // then accounted with its batch
 
     PendingPut(std::shared_ptr<ClientInterface> c, const std::string &k):
-            client(c), put(new Put), key(k) { put->Key(k); }
+            client(c), put(new Put), sync(), size{0}, batched{false} {
+        put->Key(k);
+    }
 
     void Start() {
         assert(put.get() != nullptr);
@@ -505,9 +967,121 @@ struct PendingPut {
         assert(sync.get() != nullptr);
         sync->Wait();
     }
+};
 
-    PendingDelete Delete() const {
-        return PendingDelete(client, key);
+/**
+ * What a drive accepts in a single batch, as told by its last GETLOG. A drive
+ * that tells nothing gets its PUT out of any batch.
+ */
+struct BatchLimits {
+    uint32_t ops;
+    uint64_t bytes;    // 0 if unbounded
+    uint32_t value;    // 0 if unknown
+    uint32_t batches;  // 0 if unbounded
+
+    BatchLimits() : ops{0}, bytes{0}, value{0}, batches{0} {}
+
+    explicit BatchLimits(const BatchQuota &q)
+            : ops{q.max_ops}, bytes{q.max_bytes}, value{q.max_value},
+              batches{q.max_batches} {}
+
+    bool Fits(uint32_t count, uint64_t total) const {
+        return count <= ops && (bytes == 0 || total <= bytes);
+    }
+};
+
+/**
+ * Tells if the limits of the drive must be asked again, and then consider
+ * them as asked: the concurrent uploads keep the limits already known.
+ */
+static bool _quota_expired(BatchQuota *q) {
+    const int64_t now = mill_now();
+    if (q->fetched > 0 &&
+        now - q->fetched < 1000 * int64_t{FLAGS_kinetic_limits_refresh})
+        return false;
+    q->fetched = now;
+    return true;
+}
+
+static void _quota_update(BatchQuota *q, const GetLog &log) {
+    q->max_value = log.getMaxValueSize();
+    q->max_batches = log.getMaxBatches();
+    q->max_bytes = log.getMaxBatchBytes();
+    // A drive that doesn't tell how many batches it keeps open might not
+    // support them at all.
+    q->max_ops = q->max_batches > 0 ? log.getMaxBatchOps() : 0;
+}
+
+/**
+ * A batch opened on a drive. The PUT it contains won't be acknowledged one by
+ * one, they will all be committed (or dropped) at once by the END_BATCH.
+ * The batch is accounted on the drive it is opened on, until the drive
+ * replied to its END_BATCH (or ABORT_BATCH).
+ */
+struct PendingBatch {
+    std::shared_ptr<ClientInterface> client;
+    uint32_t id;
+    uint32_t count;
+    uint64_t bytes;
+    std::shared_ptr<StartBatch> start;
+    std::shared_ptr<Exchange> end;
+    std::vector<std::shared_ptr<Sync>> syncs;
+    bool held;
+
+    explicit PendingBatch(std::shared_ptr<ClientInterface> c):
+            client(c), id{0}, count{0}, bytes{0}, start(new StartBatch),
+            end(), syncs(), held{false} {}
+
+    ~PendingBatch() { release(); }
+
+    PendingBatch(const PendingBatch &o) = delete;
+
+    void Start() {
+        id = client->NewBatch();
+        start->Batch(id);
+        client->Quota().open++;
+        held = true;
+        syncs.push_back(client->RPC(start.get()));
+    }
+
+    void Add(Put *put, uint32_t size) {
+        put->Batch(id);
+        count++;
+        bytes += size;
+    }
+
+    void Commit() {
+        auto eb = new EndBatch;
+        eb->Batch(id);
+        eb->Count(count);
+        end.reset(eb);
+        syncs.push_back(client->RPC(eb));
+    }
+
+    void Abort() {
+        auto ab = new AbortBatch;
+        ab->Batch(id);
+        end.reset(ab);
+        syncs.push_back(client->RPC(ab));
+    }
+
+    bool Wait() {
+        for (auto &s : syncs)
+            s->Wait();
+        syncs.clear();
+        if (end.get() != nullptr)
+            release();
+        return start->Ok() && end.get() != nullptr && end->Ok();
+    }
+
+ private:
+    void release() {
+        if (!held)
+            return;
+        held = false;
+        auto &q = client->Quota();
+        assert(q.open > 0);
+        q.open--;
     }
 };
 
@@ -517,7 +1091,13 @@ class KineticUpload : public blob::Upload {
  public:
     ~KineticUpload() override {}
 
-    KineticUpload() : clients(), next_client{0}, ops(), step{Step::Init} {}
+    KineticUpload() : clients(), placement(), next_client{0}, batches(),
+                      open(), limits(), drained{0}, spilled{false},
+                      ops(), window_blocks{0}, window_bytes{0},
+                      inflight_blocks{0}, inflight_bytes{0}, failed{false},
+                      layout(),
+                      manifest{0}, tag{TagAlgorithm::SHA1},
+                      step{Step::Init} {}
 
     Status Prepare() override;
 
@@ -533,25 +1113,45 @@ class KineticUpload : public blob::Upload {
         if (buffer.size() > 0)
             TriggerUpload();
 
-        // Pack then send the xattr
-        rapidjson::StringBuffer buf;
-        rapidjson::Writer<rapidjson::StringBuffer> writer(buf);
-        writer.StartObject();
-        for (const auto &e : xattr) {
-            writer.Key(e.first.c_str());
-            writer.String(e.second.c_str());
+        // Pack then send the manifest, i.e. the xattr and the layout of the
+        // blocks, as a single value. A layout too large for the drive is
+        // left out, the readers then list the blocks.
+        std::string manifest_json;
+        manifest = placement->Next(clients);
+        _pack_manifest(xattr, &layout, &manifest_json);
+        const auto max_value = limits[manifest].value;
+        if (max_value > 0 && manifest_json.size() > max_value) {
+            LOG(WARNING) << "Manifest of " << chunkid << " too large ("
+                         << manifest_json.size() << "), layout dropped";
+            _pack_manifest(xattr, nullptr, &manifest_json);
         }
-        writer.EndObject();
-        this->Write(reinterpret_cast<const uint8_t *>(buf.GetString()),
-                    buf.GetSize());
-        TriggerUpload("#");
-
-        // Wait for all the single PUT to finish
-        for (auto &s : ops)
-            s.Wait();
+        buffer.assign(manifest_json.begin(), manifest_json.end());
+        TriggerUpload("#", manifest);
+
+        // The batched PUT are over as soon as sent, then each drive commits
+        // the blocks of its last batch at once.
+        while (!ops.empty())
+            reap();
+        bool ok = !failed;
+        for (auto b : open) {
+            if (b == nullptr)
+                continue;
+            if (ok)
+                b->Commit();
+            else
+                b->Abort();
+        }
+        for (auto &b : batches)
+            ok = b.Wait() && ok;
 
         step = Step::Done;
-        return Status();
+        if (ok)
+            return Status();
+
+        // Some drives might have committed their batch, remove what they hold
+        LOG(ERROR) << "Batch commit failed for " << chunkid;
+        purge(true);
+        return Status(Cause::NetworkError);
     }
 
     Status Abort() override {
@@ -559,14 +1159,19 @@ class KineticUpload : public blob::Upload {
             return Status(Cause::InternalError);
         step = Step::Done;
 
-        // send all the removal orders, try to parallelize a bit
+        // Dropping the open batches is enough, unless some blocks have
+        // already been committed
         DLOG(INFO) << ops.size() << " PUT to abort";
-        if (!ops.empty()) {
-            std::vector<PendingDelete> deletes;
-            for (const auto &put : ops)
-                deletes.push_back(put.Delete());
-            _rolling_delete(8, &deletes);
+        while (!ops.empty())
+            reap();
+        for (auto b : open) {
+            if (b != nullptr)
+                b->Abort();
         }
+        for (auto &b : batches)
+            b.Wait();
+        if (spilled)
+            purge(false);
 
         return Status();
     }
@@ -602,36 +1207,167 @@ class KineticUpload : public blob::Upload {
         ss << next_client;
         ss << '-';
         ss << buffer.size();
-        return TriggerUpload(ss.str());
+        const auto idx = placement->Next(clients);
+        layout.push_back(BlockRef{chunkid + '-' + ss.str(), clients[idx]->Id(),
+                                  static_cast<uint32_t>(buffer.size()),
+                                  next_client});
+        return TriggerUpload(ss.str(), idx);
     }
 
-    void TriggerUpload(const std::string &suffix) {
+    void TriggerUpload(const std::string &suffix, unsigned int idx) {
         assert(!chunkid.empty());
-        assert(clients.size() > 0);
+        assert(idx < clients.size());
 
-        auto client = clients[next_client % clients.size()];
         std::stringstream ss;
         ss << chunkid;
         ss << '-';
         ss << suffix;
         next_client++;
 
-        PendingPut p(client, ss.str());
+        // Back-pressure: the oldest PUT must complete before a new block
+        // exceeds the window. The block being sent is always accepted.
+        // A batched PUT only completes with the END_BATCH of its batch, the
+        // drive holds it until then.
+        const uint32_t size = buffer.size();
+        while (inflight_blocks > 0 && (inflight_blocks >= window_blocks ||
+                                       inflight_bytes + size > window_bytes)) {
+            if (!ops.empty())
+                reap();
+            else
+                drain();
+        }
+
+        PendingPut p(clients[idx], ss.str());
+        auto batch = batchFor(idx, size);
+        if (batch != nullptr)
+            batch->Add(p.put.get(), size);
+        else
+            spilled = true;
+        p.put->Algorithm(tag);
         p.put->Value(&buffer);
         assert(buffer.size() == 0);
+        p.size = size;
+        p.batched = batch != nullptr;
         p.Start();
+        inflight_blocks++;
+        inflight_bytes += size;
         ops.push_back(p);
     }
 
+    /**
+     * Get the batch of the drive that accepts one more PUT of 'size' bytes.
+     * The batches are opened on demand, and a full batch is committed at
+     * once, so that no drive holds an open batch longer than needed.
+     * @return nullptr if the PUT must be sent out of any batch
+     */
+    PendingBatch *batchFor(unsigned int idx, uint32_t size) {
+        const auto &lim = limits[idx];
+        auto &cur = open[idx];
+        if (cur != nullptr && lim.Fits(cur->count + 1, cur->bytes + size))
+            return cur;
+        if (cur != nullptr) {
+            cur->Commit();
+            cur = nullptr;
+            spilled = true;
+        }
+        if (!lim.Fits(1, size))
+            return nullptr;
+        // The drive keeps a bounded number of batches open, for all the
+        // uploads at once: beyond, the PUT go out of any batch.
+        if (lim.batches > 0 && clients[idx]->Quota().open >= lim.batches)
+            return nullptr;
+        batches.emplace_back(clients[idx]);
+        batches.back().Start();
+        cur = &batches.back();
+        return cur;
+    }
+
+    /**
+     * Delete the blocks (and the manifest) that might have been committed.
+     */
+    void purge(bool with_manifest) {
+        std::vector<PendingDelete> deletes;
+        for (const auto &b : layout) {
+            for (const auto &cli : clients) {
+                if (cli->Id() == b.drive)
+                    deletes.emplace_back(cli, b.key);
+            }
+        }
+        if (with_manifest)
+            deletes.emplace_back(clients[manifest], chunkid + "-#");
+        _rolling_delete(8, &deletes);
+    }
+
+    /**
+     * Wait for the oldest PUT then release it, with its value. A batched
+     * PUT remains in the window until its batch ends.
+     */
+    void reap() {
+        assert(!ops.empty());
+        auto &p = ops.front();
+        p.Wait();
+        failed = failed || !p.put->Ok();
+        if (!p.batched) {
+            inflight_blocks--;
+            inflight_bytes -= p.size;
+        }
+        ops.pop_front();
+    }
+
+    /**
+     * End the oldest batch still in the window, committing it if it is
+     * still open, then release its PUT from the window.
+     */
+    void drain() {
+        assert(drained < batches.size());
+        auto &b = batches[drained++];
+        for (auto &cur : open) {
+            if (cur == &b) {
+                b.Commit();
+                cur = nullptr;
+                spilled = true;
+            }
+        }
+        failed = !b.Wait() || failed;
+        assert(inflight_blocks >= b.count);
+        inflight_blocks -= b.count;
+        inflight_bytes -= b.bytes;
+    }
+
  private:
     std::vector<std::shared_ptr<ClientInterface>> clients;
+    std::shared_ptr<PlacementPolicy> placement;
     uint32_t next_client;
-    std::vector<PendingPut> ops;
+
+    // All the batches opened, the oldest first, and the batch still open on
+    // each drive.
+    std::deque<PendingBatch> batches;
+    std::vector<PendingBatch*> open;
+    // The limits of each drive
+    std::vector<BatchLimits> limits;
+    // The oldest batches already out of the window
+    size_t drained;
+    // Some blocks might already be committed: they left a full batch or
+    // went out of any batch.
+    bool spilled;
+
+    // The PUT in flight, the oldest first
+    std::deque<PendingPut> ops;
+    uint32_t window_blocks;
+    uint64_t window_bytes;
+    // Including the batched PUT whose batch hasn't ended yet
+    uint32_t inflight_blocks;
+    uint64_t inflight_bytes;
+    bool failed;
+
+    std::vector<BlockRef> layout;
+    unsigned int manifest;
 
     std::vector<uint8_t> buffer;
     uint32_t buffer_limit;
     std::string chunkid;
     std::map<std::string, std::string> xattr;
+    TagAlgorithm tag;
     Step step;
 };
 
@@ -643,7 +1379,10 @@ Status KineticUpload::Prepare() {
     // even if it won't cleanly manage mixed errors and successes
     const std::string key_manifest(chunkid + "-#");
 
+    // The limits of the drives are shared by all the uploads, and asked only
+    // from time to time.
     std::vector<std::shared_ptr<GetKeyRange>> ops;
+    std::vector<std::shared_ptr<GetLog>> logs;
     std::vector<std::shared_ptr<Sync>> syncs;
     for (auto cli : clients) {
         std::shared_ptr<GetKeyRange> gkr(new GetKeyRange);
@@ -653,14 +1392,32 @@ Status KineticUpload::Prepare() {
         gkr->IncludeEnd(true);
         gkr->MaxItems(1);
         ops.push_back(gkr);
+        if (_quota_expired(&cli->Quota()))
+            logs.emplace_back(new GetLog);
+        else
+            logs.emplace_back();
     }
     int i = 0;
     for (auto cli : clients) {
-        auto op = ops[i];
-        syncs.push_back(cli->RPC(op.get()));
+        syncs.push_back(cli->RPC(ops[i].get()));
+        if (logs[i].get() != nullptr)
+            syncs.push_back(cli->RPC(logs[i].get()));
+        i++;
     }
     for (auto sync : syncs)
         sync->Wait();
+    for (unsigned int j = 0; j < clients.size(); ++j) {
+        if (logs[j].get() == nullptr)
+            continue;
+        auto &q = clients[j]->Quota();
+        if (logs[j]->Ok()) {
+            _quota_update(&q, *logs[j]);
+        } else {
+            LOG(WARNING) << "No limits known for " << clients[j]->Id()
+                         << ", PUT without batch";
+            q.fetched = 0;
+        }
+    }
     for (auto op : ops) {
         if (!op->Ok())
             return Status(Cause::NetworkError);
@@ -672,6 +1429,12 @@ Status KineticUpload::Prepare() {
             return Status(Cause::Already);
     }
 
+    // The blocks and the manifest are committed with a batch per drive,
+    // split when they exceed what the drive accepts in a batch.
+    for (auto cli : clients)
+        limits.emplace_back(cli->Quota());
+    open.assign(clients.size(), nullptr);
+
     step = Step::Prepared;
     return Status();
 }
@@ -679,7 +1442,10 @@ Status KineticUpload::Prepare() {
 UploadBuilder::~UploadBuilder() {}
 
 UploadBuilder::UploadBuilder(std::shared_ptr<ClientFactory> f) :
-        factory(f), targets(), block_size{1024 * 1024} {}
+        factory(f), targets(), block_size{1024 * 1024}, placement(),
+        window_blocks{FLAGS_kinetic_upload_window},
+        window_bytes{FLAGS_kinetic_upload_window_bytes},
+        tag{oio::kinetic::client::default_tag} {}
 
 bool UploadBuilder::Target(const std::string &to) {
     targets.insert(to);
@@ -705,12 +1471,234 @@ void UploadBuilder::BlockSize(uint32_t s) {
     block_size = s;
 }
 
+void UploadBuilder::Placement(std::shared_ptr<PlacementPolicy> p) {
+    placement = p;
+}
+
+void UploadBuilder::Window(uint32_t blocks, uint64_t bytes) {
+    window_blocks = std::max(1U, blocks);
+    window_bytes = bytes;
+}
+
+void UploadBuilder::Tag(TagAlgorithm a) {
+    tag = a;
+}
+
 std::unique_ptr<blob::Upload> UploadBuilder::Build() {
     assert(!name.empty());
     auto ul = new KineticUpload();
     ul->buffer_limit = block_size;
+    ul->window_blocks = std::max(1U, window_blocks);
+    ul->window_bytes = window_bytes;
+    ul->tag = tag;
     ul->chunkid.assign(name);
+    if (placement)
+        ul->placement = placement;
+    else
+        ul->placement.reset(new RoundRobinPlacement);
     for (const auto &to : targets)
         ul->clients.emplace_back(factory->Get(to.c_str()));
     return std::unique_ptr<KineticUpload>(ul);
 }
+
+
+class KineticCopy : public oio::kinetic::blob::Copy {
+    friend class CopyBuilder;
+
+ public:
+    explicit KineticCopy(std::shared_ptr<ClientFactory> f)
+            : factory(f), targets(), destinations(), chunkid(), blocks(),
+              xattr(), step{Step::Init} {}
+
+    ~KineticCopy() override {}
+
+    Status Prepare() override {
+        if (step != Step::Init)
+            return Status(Cause::InternalError);
+        std::string drive;
+        if (!_load_manifest(factory, targets, chunkid, &blocks, &drive,
+                            Priority::Low, &xattr))
+            return Status(Cause::NotFound);
+        step = Step::Prepared;
+        return Status();
+    }
+
+    Status Commit() override {
+        if (step != Step::Prepared)
+            return Status(Cause::InternalError);
+        step = Step::Done;
+
+        // Spread the blocks on the destinations, then group them by pair of
+        // drives so that each PEER2PEERPUSH carries as many keys as allowed.
+        // A drive cannot push to itself.
+        std::vector<BlockRef> layout;
+        std::map<std::pair<std::string, std::string>,
+                std::vector<std::string>> pairs;
+        for (unsigned int i = 0; i < blocks.size(); ++i) {
+            const auto &b = blocks[i];
+            const auto &to = destinations[i % destinations.size()];
+            if (b.drive == to) {
+                LOG(ERROR) << "Copy of " << chunkid << " onto its source "
+                           << to;
+                return Status(Cause::Forbidden);
+            }
+            pairs[std::make_pair(b.drive, to)].push_back(b.key);
+            layout.push_back(BlockRef{b.key, to, b.size, b.sequence});
+        }
+
+        // The manifest is rewritten on each destination, the blocks changed
+        // of drives. A layout too large for a destination is left out, the
+        // readers then list the blocks.
+        const std::set<std::string> drives(destinations.begin(),
+                                           destinations.end());
+        std::string json;
+        _pack_manifest(xattr, &layout, &json);
+        const uint32_t max_value = maxValue(drives);
+        if (max_value > 0 && json.size() > max_value) {
+            LOG(WARNING) << "Manifest of " << chunkid << " too large ("
+                         << json.size() << "), layout dropped";
+            _pack_manifest(xattr, nullptr, &json);
+        }
+
+        // All the pushes are built, and their peers checked, before any is
+        // sent: nothing is in flight when a peer is rejected.
+        const uint32_t per_push = std::max(1U, FLAGS_kinetic_p2p_batch);
+        std::vector<std::unique_ptr<P2PPush>> ops;
+        std::vector<std::shared_ptr<ClientInterface>> senders;
+        for (const auto &e : pairs) {
+            auto client = factory->Get(e.first.first);
+            const auto &keys = e.second;
+            for (size_t i = 0; i < keys.size(); ++i) {
+                if (i % per_push == 0) {
+                    ops.emplace_back(new P2PPush);
+                    senders.push_back(client);
+                    if (!ops.back()->Peer(e.first.second))
+                        return Status(Cause::InternalError);
+                    ops.back()->SetPriority(Priority::Low);
+                }
+                ops.back()->Add(keys[i]);
+            }
+        }
+        std::vector<std::shared_ptr<Sync>> syncs;
+        for (size_t i = 0; i < ops.size(); ++i)
+            syncs.push_back(senders[i]->RPC(ops[i].get()));
+        for (auto &sync : syncs)
+            sync->Wait();
+        for (const auto &op : ops) {
+            if (!op->Ok()) {
+                LOG(ERROR) << "P2P push failed for " << chunkid;
+                return Status(Cause::NetworkError);
+            }
+        }
+
+        std::vector<std::unique_ptr<Put>> puts;
+        syncs.clear();
+        for (const auto &to : drives) {
+            puts.emplace_back(new Put);
+            puts.back()->Key(chunkid + "-#");
+            puts.back()->Value(json);
+            puts.back()->SetPriority(Priority::Low);
+            syncs.push_back(factory->Get(to)->RPC(puts.back().get()));
+        }
+        for (auto &sync : syncs)
+            sync->Wait();
+        for (const auto &put : puts) {
+            if (!put->Ok())
+                return Status(Cause::NetworkError);
+        }
+        return Status();
+    }
+
+ private:
+    /**
+     * @return the largest value all the drives accept, as told by their
+     *         GETLOG, 0 if none told
+     */
+    uint32_t maxValue(const std::set<std::string> &drives) {
+        std::vector<std::shared_ptr<ClientInterface>> clients;
+        std::vector<std::unique_ptr<GetLog>> logs;
+        std::vector<std::shared_ptr<Sync>> syncs;
+        for (const auto &to : drives) {
+            auto client = factory->Get(to);
+            if (!_quota_expired(&client->Quota()))
+                continue;
+            clients.push_back(client);
+            logs.emplace_back(new GetLog);
+            logs.back()->SetPriority(Priority::Low);
+            syncs.push_back(client->RPC(logs.back().get()));
+        }
+        for (auto &sync : syncs)
+            sync->Wait();
+        for (size_t i = 0; i < logs.size(); ++i) {
+            if (logs[i]->Ok())
+                _quota_update(&clients[i]->Quota(), *logs[i]);
+            else
+                clients[i]->Quota().fetched = 0;
+        }
+
+        uint32_t max_value{0};
+        for (const auto &to : drives) {
+            const auto v = factory->Get(to)->Quota().max_value;
+            if (v > 0 && (max_value == 0 || v < max_value))
+                max_value = v;
+        }
+        return max_value;
+    }
+
+ private:
+    std::shared_ptr<ClientFactory> factory;
+    std::vector<std::string> targets;
+    std::vector<std::string> destinations;
+    std::string chunkid;
+    std::vector<BlockRef> blocks;
+    std::map<std::string, std::string> xattr;
+    Step step;
+};
+
+CopyBuilder::CopyBuilder(std::shared_ptr<ClientFactory> f)
+        : factory(f), targets(), destinations(), name() {}
+
+CopyBuilder::~CopyBuilder() {}
+
+bool CopyBuilder::Name(const std::string &n) {
+    name.assign(n);
+    return true;
+}
+
+bool CopyBuilder::Name(const char *n) {
+    assert(n != nullptr);
+    return Name(std::string(n));
+}
+
+bool CopyBuilder::Target(const std::string &from) {
+    targets.insert(from);
+    return true;
+}
+
+bool CopyBuilder::Target(const char *from) {
+    assert(from != nullptr);
+    return Target(std::string(from));
+}
+
+bool CopyBuilder::Destination(const std::string &to) {
+    destinations.push_back(to);
+    return true;
+}
+
+bool CopyBuilder::Destination(const char *to) {
+    assert(to != nullptr);
+    return Destination(std::string(to));
+}
+
+std::unique_ptr<oio::kinetic::blob::Copy> CopyBuilder::Build() {
+    assert(!targets.empty());
+    assert(!destinations.empty());
+    assert(!name.empty());
+
+    auto cp = new KineticCopy(factory);
+    cp->chunkid.assign(name);
+    for (const auto &t : targets)
+        cp->targets.push_back(t);
+    cp->destinations = destinations;
+    return std::unique_ptr<oio::kinetic::blob::Copy>(cp);
+}
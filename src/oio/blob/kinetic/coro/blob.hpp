@@ -23,9 +23,11 @@
 #include <map>
 #include <set>
 #include <memory>
+#include <vector>
 
 #include "oio/api/blob.hpp"
 #include "ClientInterface.h"
+#include "Placement.h"
 
 namespace oio {
 namespace kinetic {
@@ -48,6 +50,27 @@ class UploadBuilder {
 
     void BlockSize(uint32_t s);
 
+    /**
+     * Default: a RoundRobinPlacement for each upload.
+     * @param p the policy spreading the blocks on the targets
+     */
+    void Placement(std::shared_ptr<oio::kinetic::client::PlacementPolicy> p);
+
+    /**
+     * Bound the PUT in flight. When the window is full, the upload waits for
+     * the oldest PUT before sending another block.
+     * Default: the -kinetic_upload_window* flags.
+     * @param blocks the maximum number of blocks in flight
+     * @param bytes the maximum amount of bytes in flight
+     */
+    void Window(uint32_t blocks, uint64_t bytes);
+
+    /**
+     * Default: oio::kinetic::client::default_tag
+     * @param a the algorithm of the integrity tag of each block
+     */
+    void Tag(oio::kinetic::client::TagAlgorithm a);
+
     std::unique_ptr<oio::api::blob::Upload> Build();
 
  private:
@@ -55,6 +78,10 @@ class UploadBuilder {
     std::set<std::string> targets;
     std::string name;
     uint32_t block_size;
+    std::shared_ptr<oio::kinetic::client::PlacementPolicy> placement;
+    uint32_t window_blocks;
+    uint64_t window_bytes;
+    oio::kinetic::client::TagAlgorithm tag;
 };
 
 class DownloadBuilder {
@@ -72,12 +99,19 @@ class DownloadBuilder {
 
     bool Target(const std::string &to);
 
+    /**
+     * Check each block against the tag stored by the drive. A corrupted
+     * block fails the Read(). Default: false.
+     */
+    void Verify(bool on);
+
     std::unique_ptr<oio::api::blob::Download> Build();
 
  private:
     std::shared_ptr<oio::kinetic::client::ClientFactory> factory;
     std::set<std::string> targets;
     std::string name;
+    bool verify;
 };
 
 class RemovalBuilder {
@@ -93,12 +127,28 @@ class RemovalBuilder {
 
     bool Target(const char *to);
 
+    /**
+     * Default: Priority::Low, as a background task.
+     * @param p the priority of the RPC sent to the drives
+     */
+    void SetPriority(oio::kinetic::client::Priority p);
+
+    /**
+     * Default: -kinetic_removal_parallelism.
+     * @param to the drive concerned
+     * @param n the maximum number of DELETE in flight toward the drive, 0 to
+     *        reset to the default
+     */
+    void Parallelism(const std::string &to, unsigned int n);
+
     std::unique_ptr<oio::api::blob::Removal> Build();
 
  private:
     std::shared_ptr<oio::kinetic::client::ClientFactory> factory;
     std::set<std::string> targets;
     std::string name;
+    oio::kinetic::client::Priority priority;
+    std::map<std::string, unsigned int> parallelism;
 };
 
 class ListingBuilder {
@@ -116,12 +166,67 @@ class ListingBuilder {
 
     bool Target(const char *to);
 
+    /**
+     * Default: Priority::Low, as a background task.
+     * @param p the priority of the RPC sent to the drives
+     */
+    void SetPriority(oio::kinetic::client::Priority p);
+
     std::unique_ptr<oio::api::blob::Listing> Build();
 
  private:
     std::shared_ptr<oio::kinetic::client::ClientFactory> factory;
     std::set<std::string> targets;
     std::string name;
+    oio::kinetic::client::Priority priority;
+};
+
+/**
+ * Copies a chunk toward other drives. The source drives push the blocks
+ * themselves (PEER2PEERPUSH), then a manifest describing the new layout is
+ * written on each destination. The source chunk is left untouched, as the
+ * caller may still serve it: once the copy is committed, a Removal on the
+ * source drives drops it, unless they are also destinations since the keys
+ * are kept. A chunk whose manifest was too large to keep the layout cannot
+ * be copied.
+ */
+class Copy {
+ public:
+    virtual ~Copy() {}
+
+    virtual oio::api::Status Prepare() = 0;
+
+    virtual oio::api::Status Commit() = 0;
+};
+
+class CopyBuilder {
+ public:
+    explicit CopyBuilder(
+            std::shared_ptr<oio::kinetic::client::ClientFactory> f);
+
+    ~CopyBuilder();
+
+    bool Name(const std::string &n);
+
+    bool Name(const char *n);
+
+    /** Add a drive that may hold the chunk */
+    bool Target(const std::string &from);
+
+    bool Target(const char *from);
+
+    /** Add a drive the blocks are spread on, in a round-robin fashion */
+    bool Destination(const std::string &to);
+
+    bool Destination(const char *to);
+
+    std::unique_ptr<Copy> Build();
+
+ private:
+    std::shared_ptr<oio::kinetic::client::ClientFactory> factory;
+    std::set<std::string> targets;
+    std::vector<std::string> destinations;
+    std::string name;
 };
 
 }  // namespace blob
@@ -25,24 +25,56 @@
 
 #include <libmill.h>
 
+#include <algorithm>
 #include <cassert>
+#include <cstring>
 #include <map>
 #include <vector>
 
 #include "utils/macros.h"
+#include "oio/blob/local/disk_io.hpp"
+#include "oio/blob/local/group_commit.hpp"
+#include "oio/blob/local/xattr.hpp"
 
 using oio::api::Status;
 using oio::api::Errno;
 using oio::api::Cause;
+using oio::local::blob::AlignedBuffer;
+using oio::local::blob::DiskIO;
 using oio::local::blob::DownloadBuilder;
+using oio::local::blob::Durability;
 using oio::local::blob::RemovalBuilder;
 using oio::local::blob::UploadBuilder;
+using oio::local::blob::XattrLayout;
 using Step = oio::api::blob::TransactionStep;
 
 DEFINE_uint64(mode_mkdir, 0755, "Mode for freshly create directories");
 DEFINE_uint64(mode_create, 0644, "Mode for freshly created files");
 DEFINE_uint64(read_batch_size, 1024 * 1024, "Default size of the read buffer");
 DEFINE_uint64(read_eintr_attempts, 5, "Number of attempts when interrupted");
+DEFINE_string(local_durability, "none",
+              "What a commit waits for: 'none' (the rename only), 'fsync' "
+              "(each upload flushed alone), 'group' (the concurrent uploads "
+              "flushed together)");
+DEFINE_string(local_xattr, "split",
+              "How the attributes are stored: 'split' (one xattr each), "
+              "'packed' (a single xattr), 'both'");
+DEFINE_bool(local_fallocate, false,
+            "Preallocate the expected size of the uploads");
+DEFINE_bool(local_direct, false,
+            "Bypass the page cache (O_DIRECT) for the uploads and downloads");
+DEFINE_uint64(local_direct_align, 4096,
+              "Alignment of the O_DIRECT buffers, offsets and lengths");
+DEFINE_uint64(local_direct_buffer, 1024 * 1024,
+              "Size of the O_DIRECT buffer of an upload");
+DEFINE_bool(local_readahead, true,
+            "Read the next batch of a download while the current is sent");
+DEFINE_bool(local_fadvise, true,
+            "Hint the kernel about the sequential reads of the downloads");
+DEFINE_bool(local_dontneed, false,
+            "Drop the pages of the large downloads from the page cache");
+DEFINE_uint64(local_dontneed_size, 8 * 1024 * 1024,
+              "Minimal size of a download -local_dontneed applies to");
 
 /**
  *
@@ -53,57 +85,167 @@ class LocalDownload : public oio::api::blob::Download {
  private:
     std::string path;
     std::vector<uint8_t> buffer;
+    std::vector<uint8_t> ahead;
     off64_t offset_, size_expected_, size_read_;
+    off64_t cursor_;
     int fd_;
+    DiskIO io;
+    bool direct;
+    bool readahead;
+    bool fadvise;
+    bool dontneed;
+    bool cold;
+    bool dropped_;
+    off64_t size_file_;
+    AlignedBuffer aligned;
     Step step;
 
+    // The batch being read, in the background when read ahead
+    uint64_t batch_pos_;
+    size_t batch_skip_;
+    size_t batch_want_;
+    bool batch_last_;
+
  private:
     FORBID_MOVE_CTOR(LocalDownload);
     FORBID_COPY_CTOR(LocalDownload);
 
-    LocalDownload() : path(), buffer(), offset_{0}, size_expected_{0},
-                      size_read_{0}, fd_{-1}, step{Step::Init} {}
+    LocalDownload() : path(), buffer(), ahead(), offset_{0},
+                      size_expected_{0}, size_read_{0}, cursor_{0}, fd_{-1},
+                      io(), direct{false}, readahead{false}, fadvise{false},
+                      dontneed{false}, cold{false}, dropped_{false},
+                      size_file_{0}, aligned(), step{Step::Init},
+                      batch_pos_{0}, batch_skip_{0}, batch_want_{0},
+                      batch_last_{false} {}
+
+    /**
+     * Queue the read of the batch following the bytes already requested.
+     * With O_DIRECT, the aligned block around those bytes is read, then only
+     * the expected bytes will be copied.
+     * @return false if there is nothing left to read
+     */
+    bool issue() {
+        assert(fd_ >= 0);
+        assert(!io.Pending());
+
+        uint64_t want = FLAGS_read_batch_size;
+        batch_last_ = false;
+        if (size_expected_ > 0) {
+            const auto remaining = offset_ + size_expected_ - cursor_;
+            if (remaining <= 0)
+                return false;
+            if (static_cast<uint64_t>(remaining) <= want) {
+                want = remaining;
+                batch_last_ = true;
+            }
+        }
+
+        const int fd = fd_;
+        uint64_t pos = cursor_;
+        size_t len = want;
+        uint8_t *data{nullptr};
+        if (direct) {
+            pos = aligned.Down(cursor_);
+            len = std::min(aligned.capacity(),
+                           aligned.Up(cursor_ - pos + want));
+            data = aligned.data();
+        } else {
+            ahead.resize(want);
+            data = ahead.data();
+        }
+        batch_pos_ = pos;
+        batch_skip_ = cursor_ - pos;
+        batch_want_ = want;
+        cursor_ += want;
+
+        // Let the kernel prefetch the batch after this one, while this one
+        // is read then sent.
+        const bool hint = fadvise && !direct && !batch_last_;
+        const off64_t next = cursor_;
+        const off64_t next_len = size_expected_ > 0
+                ? std::min<off64_t>(FLAGS_read_batch_size,
+                                    offset_ + size_expected_ - cursor_)
+                : FLAGS_read_batch_size;
+        io.Start([fd, data, len, pos, hint, next, next_len]() -> ssize_t {
+            if (hint)
+                ::posix_fadvise(fd, next, next_len, POSIX_FADV_WILLNEED);
+            ssize_t r;
+            do {
+                r = ::pread64(fd, data, len, pos);
+            } while (r < 0 && errno == EINTR);
+            return r;
+        });
+        return true;
+    }
 
-    unsigned int loadBufferAndRetry(int nb_attempts) {
-        ssize_t rc = ::read(fd_, buffer.data(), buffer.size());
+    /**
+     * Wait for the pending batch and move its bytes to the buffer.
+     * @return false at the end of the file or on error
+     */
+    bool collect(int nb_attempts) {
+        assert(io.Pending());
+        ssize_t rc = io.Wait();
         if (rc < 0) {
-            if (errno == EAGAIN) {
-                int evt = fdwait(fd_, FDW_IN, mill_now() + 1000);
-                if (evt & FDW_IN) {
-                    if (nb_attempts > 0)
-                        return loadBufferAndRetry(nb_attempts - 1);
-                    return 0;
-                }
-                return 0;
+            if (errno == EAGAIN && nb_attempts > 0) {
+                cursor_ = batch_pos_ + batch_skip_;
+                if (issue())
+                    return collect(nb_attempts - 1);
             }
-            return 0;
+            return false;
+        }
+        if (static_cast<size_t>(rc) <= batch_skip_) {
+            done();
+            return false;
+        }
+        const size_t n = std::min<uint64_t>(rc - batch_skip_, batch_want_);
+        if (direct) {
+            const uint8_t *data = aligned.data() + batch_skip_;
+            buffer.assign(data, data + n);
         } else {
-            if (rc == 0)
-                step = Step::Done;
-            else
-                size_read_ += rc;
-            return rc;
+            buffer.swap(ahead);
+            buffer.resize(n);
         }
+        size_read_ += n;
+        // A short read means the end of the file, no need to read ahead
+        if (n < batch_want_) {
+            cursor_ = offset_ + size_read_;
+            batch_last_ = true;
+        }
+        return true;
     }
 
     bool loadBuffer() {
         assert(fd_ >= 0);
         assert(step == Step::Prepared);
-
-        // Bound the buffer size to both the expected size and the general
-        // batch size.
-        buffer.resize(FLAGS_read_batch_size);
-        if (size_expected_ > 0) {
-            const auto remaining = size_expected_ - size_read_;
-            if (remaining > 0 &&
-                static_cast<uint64_t>(remaining) < FLAGS_read_batch_size)
-                buffer.resize(remaining);
+        if (!io.Pending() && !issue()) {
+            done();
+            return false;
         }
+        return collect(FLAGS_read_eintr_attempts);
+    }
+
+    void done() {
+        step = Step::Done;
+        dropCache();
+    }
 
-        auto rc = loadBufferAndRetry(FLAGS_read_eintr_attempts);
-        if (rc > 0)
-            buffer.resize(rc);
-        return rc > 0;
+    /**
+     * A cold or large chunk must not evict hotter pages, whether it was
+     * read till the end or not. The batch hinted to the kernel is dropped
+     * too.
+     */
+    void dropCache() {
+        if (direct || dropped_ || fd_ < 0 || cursor_ <= offset_)
+            return;
+        const off64_t total = size_expected_ > 0 ? size_expected_
+                                                 : size_file_ - offset_;
+        if (!cold && !(dontneed && total >= static_cast<off64_t>(
+                FLAGS_local_dontneed_size)))
+            return;
+        dropped_ = true;
+        const off64_t len = cursor_ - offset_ +
+                            (fadvise ? FLAGS_read_batch_size : 0);
+        ::posix_fadvise(fd_, offset_, len, POSIX_FADV_DONTNEED);
     }
 
     Status closeAndErrno() { return closeAndErrno(errno); }
@@ -118,6 +260,10 @@ class LocalDownload : public oio::api::blob::Download {
  public:
     ~LocalDownload() {
         if (fd_ >= 0) {
+            // The read ahead still refers to the fd and the buffers
+            if (io.Pending())
+                io.Wait();
+            dropCache();
             ::close(fd_);
             fd_ = -1;
         }
@@ -127,30 +273,43 @@ class LocalDownload : public oio::api::blob::Download {
         if (fd_ >= 0 || step != Step::Init)
             return Status(Cause::InternalError);
 
-        fd_ = ::open(path.c_str(), O_RDONLY | O_NONBLOCK);
+        if (direct) {
+            // The file is read with pread() at aligned offsets
+            direct = aligned.Allocate(
+                    FLAGS_read_batch_size + FLAGS_local_direct_align,
+                    FLAGS_local_direct_align);
+            if (direct) {
+                fd_ = ::open(path.c_str(), O_RDONLY | O_DIRECT);
+                // Not all the filesystems support O_DIRECT
+                direct = fd_ >= 0 || errno != EINVAL;
+            }
+        }
+        if (!direct)
+            fd_ = ::open(path.c_str(), O_RDONLY);
         if (0 > fd_) {
             if (errno == ENOENT)
                 return Status(Cause::NotFound);
             return Status(Cause::InternalError);
         }
+        io.Bind(fd_);
 
-        // Seek at the expected range
-        if (offset_ > 0) {
-            int rc = ::lseek64(fd_, offset_, SEEK_SET);
-            if (rc != 0)
-                closeAndErrno();
-        }
+        // Doubles the readahead window of the kernel
+        if (fadvise && !direct)
+            ::posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
 
         // If a particular size has been configured, then check it is available.
         // If the offset is too big, the previous check should already have
         // reported it.
-        if (size_expected_ > 0) {
+        // The size also tells if the download is large enough to be dropped
+        // from the page cache.
+        if (size_expected_ > 0 || (dontneed && !direct)) {
             struct stat64 st;
             int rc = ::fstat64(fd_, &st);
             if (rc != 0)
                 return closeAndErrno();
             if (st.st_size < size_expected_ + offset_)
                 return closeAndErrno(ENXIO);
+            size_file_ = st.st_size;
         }
 
         step = Step::Prepared;
@@ -169,27 +328,51 @@ class LocalDownload : public oio::api::blob::Download {
         }
         buf->swap(buffer);
         buffer.resize(0);
+        // The next batch is read while the caller sends this one
+        if (readahead && !batch_last_ && !io.Pending())
+            issue();
         return buf->size();
     }
 
     Status SetRange(uint32_t offset, uint32_t size) override {
-        if (step != Step::Prepared)
+        if (step != Step::Prepared || io.Pending() || size_read_ > 0)
             return Status(Cause::Forbidden);
         offset_ = offset;
         size_expected_ = size;
+        cursor_ = offset;
+        if (fadvise && !direct && size > 0)
+            ::posix_fadvise(fd_, offset, std::min<uint64_t>(
+                    size, FLAGS_read_batch_size), POSIX_FADV_WILLNEED);
         return Status();
     }
 };
 
-DownloadBuilder::DownloadBuilder() {}
+DownloadBuilder::DownloadBuilder() : path(), direct{FLAGS_local_direct},
+                                     readahead{FLAGS_local_readahead},
+                                     fadvise{FLAGS_local_fadvise},
+                                     dontneed{FLAGS_local_dontneed},
+                                     cold{false} {}
 
 DownloadBuilder::~DownloadBuilder() {}
 
 void DownloadBuilder::Path(const std::string &p) { path.assign(p); }
 
+void DownloadBuilder::Direct(bool on) { direct = on; }
+
+void DownloadBuilder::ReadAhead(bool on) { readahead = on; }
+
+void DownloadBuilder::Fadvise(bool on) { fadvise = on; }
+
+void DownloadBuilder::DropCache(bool on) { cold = on; }
+
 std::unique_ptr<oio::api::blob::Download> DownloadBuilder::Build() {
     auto dl = new LocalDownload;
     dl->path.assign(path);
+    dl->direct = direct;
+    dl->readahead = readahead;
+    dl->fadvise = fadvise;
+    dl->dontneed = dontneed;
+    dl->cold = cold;
     return std::unique_ptr<LocalDownload>(dl);
 }
 
@@ -261,7 +444,17 @@ class LocalUpload : public oio::api::blob::Upload {
     std::string path_temp;
     std::map<std::string, std::string> attributes;
     int fd;
+    DiskIO io;
     mode_t fmode, dmode;
+    Durability durability;
+    XattrLayout xattr_layout;
+    uint64_t expected_size;
+    bool preallocate;
+    bool direct;
+    AlignedBuffer aligned;
+    size_t aligned_used;
+    uint64_t written;
+    int write_error;  // errno of the first failed write, 0 if none
     Step step_;
 
  private:
@@ -269,11 +462,13 @@ class LocalUpload : public oio::api::blob::Upload {
 
     FORBID_MOVE_CTOR(LocalUpload);
 
-    explicit LocalUpload(const std::string &p) : path_final(p), path_temp(),
-                                                 fd{-1},
-                                                 fmode(FLAGS_mode_create),
-                                                 dmode(FLAGS_mode_mkdir),
-                                                 step_{Step::Init} {
+    explicit LocalUpload(const std::string &p)
+            : path_final(p), path_temp(), fd{-1}, io(),
+              fmode(FLAGS_mode_create), dmode(FLAGS_mode_mkdir),
+              durability{Durability::None}, xattr_layout{XattrLayout::Split},
+              expected_size{0}, preallocate{false}, direct{false}, aligned(),
+              aligned_used{0}, written{0}, write_error{0},
+              step_{Step::Init} {
         path_temp = path_final + ".pending";
     }
 
@@ -315,9 +510,7 @@ class LocalUpload : public oio::api::blob::Upload {
         if (fd >= 0)
             return Status(Cause::InternalError);
 retry:
-        fd = ::open(path_temp.c_str(),
-                    O_WRONLY | O_CREAT | O_EXCL | O_NONBLOCK,
-                    fmode);
+        fd = ::open(path_temp.c_str(), O_WRONLY | O_CREAT | O_EXCL, fmode);
         if (fd < 0) {
             if (errno == ENOENT) {
                 // TODO(jfs) Lazy directory creation
@@ -337,39 +530,123 @@ retry:
                 return Status(Cause::InternalError);
             }
         } else {
+            io.Bind(fd);
             int rc = ::stat(path_final.c_str(), &st);
             if (rc != 0) {
-                if (errno == ENOENT)
+                if (errno == ENOENT) {
+                    setupFile();
                     return Status(Cause::OK);
+                }
                 return unlinkTempAndReset(Errno());
             }
             return unlinkTempAndReset(Status(Cause::Already));
         }
     }
 
+    /**
+     * Both are best effort: not all the filesystems support fallocate()
+     * and O_DIRECT, and the upload then goes on without them.
+     */
+    void setupFile() {
+        if (preallocate && expected_size > 0) {
+            // KEEP_SIZE so that the commit truncates what remains unused
+            if (0 != ::fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, expected_size))
+                DLOG(INFO) << "fallocate(" << path_temp << ") failed: ("
+                           << errno << ") " << ::strerror(errno);
+        }
+        if (direct) {
+            direct = aligned.Allocate(FLAGS_local_direct_buffer,
+                                      FLAGS_local_direct_align);
+            if (direct) {
+                const int flags = ::fcntl(fd, F_GETFL);
+                direct = flags >= 0 &&
+                         0 == ::fcntl(fd, F_SETFL, flags | O_DIRECT);
+            }
+        }
+    }
+
+    /**
+     * Keep the first error only: the upload is then doomed, the remaining
+     * writes are skipped and the commit fails.
+     */
+    void writeFile(const uint8_t *buf, size_t len) {
+        if (write_error != 0)
+            return;
+        if (io.Write(fd, buf, len) < 0) {
+            write_error = errno;
+            LOG(ERROR) << "write(" << len << ") error: (" << errno << ") "
+                       << ::strerror(errno);
+        }
+    }
+
+    void flushAligned(size_t len) {
+        assert(len % aligned.Up(1) == 0);
+        writeFile(aligned.data(), len);
+        aligned_used = 0;
+    }
+
+    /**
+     * Write the tail of an O_DIRECT upload, padded up to the alignment, and
+     * drop the padding as well as the unused preallocation.
+     */
+    bool finishFile() {
+        const bool trim = (direct && aligned_used > 0) ||
+                              (preallocate && expected_size > 0);
+        if (direct && aligned_used > 0) {
+            const size_t len = aligned.Up(aligned_used);
+            ::memset(aligned.data() + aligned_used, 0, len - aligned_used);
+            flushAligned(len);
+        }
+        if (!trim)
+            return true;
+        const int f = fd;
+        const uint64_t size = written;
+        return 0 == io.Run([f, size]() -> ssize_t {
+            return ::ftruncate(f, size);
+        });
+    }
+
     Status commit_without_check_on_step() {
         if (fd < 0)
             return Status(Cause::InternalError);
 
-        // TODO(jfs) allow seeting all the xattr in a single record
-        for (auto e : attributes) {
-            std::string k = "user.grid." + e.first;
-            int rc = ::fsetxattr(fd, k.c_str(),
-                                 e.second.data(), e.second.size(), 0);
-            if (0 != rc) {
-                LOG(ERROR) << "fsetxattr(" << path_temp.c_str() << ") failed: ("
-                           << errno << ") " << ::strerror(errno);
-            }
+        if (!finishFile()) {
+            LOG(ERROR) << "ftruncate(" << path_temp << ") failed: ("
+                       << errno << ") " << ::strerror(errno);
+            return unlinkTempAndReset(Errno());
+        }
+        // A failed write left a hole, that the truncation filled with zeros
+        if (write_error != 0)
+            return unlinkTempAndReset(Errno(write_error));
+
+        const int f = fd;
+        const auto l = xattr_layout;
+        const auto &attrs = attributes;
+        const int xerr = io.Run([f, l, &attrs]() -> ssize_t {
+            return oio::local::blob::xattr_save(f, attrs, l);
+        });
+        if (xerr != 0) {
+            LOG(ERROR) << "fsetxattr(" << path_temp.c_str() << ") failed: ("
+                       << xerr << ") " << ::strerror(xerr);
         }
 
-        if (!resetFD())
-            return Status(Cause::InternalError);
-        if (0 == ::rename(path_temp.c_str(), path_final.c_str()))
+        bool renamed{false};
+        int err = oio::local::blob::durable_rename(
+                &io, fd, path_temp, path_final, durability, &renamed);
+        if (err == 0) {
+            resetFD();
             return Status();
+        }
 
-        LOG(ERROR) << "rename(" << path_final << ") failed: (" << errno <<
-                   ") " << ::strerror(errno);
-        return unlinkTempAndReset(Errno());
+        LOG(ERROR) << "commit(" << path_final << ") failed: (" << err <<
+                   ") " << ::strerror(err);
+        if (!renamed)
+            return unlinkTempAndReset(Errno(err));
+        // Not durable, then not acknowledged: the client will retry
+        if (0 != ::unlink(path_final.c_str()))
+            LOG(ERROR) << "Leaving unsynced file " << path_final;
+        resetFD();
+        return Errno(err);
     }
 
     Status abort_without_check_on_step() {
@@ -414,33 +691,41 @@ retry:
         assert(step_ == Step::Prepared);
         assert(fd >= 0);
 
-        ssize_t rc;
-retry:
-        rc = ::write(fd, buf, len);
-        if (rc < 0) {
-            if (errno == EINTR)
-                goto retry;
-            if (errno == EAGAIN) {
-                int evt = fdwait(fd, FDW_OUT, mill_now() + 1000);
-                if (evt & FDW_OUT)
-                    goto retry;
-                LOG(ERROR) << "write failed, polled mentions an error";
-            } else {
-                LOG(ERROR) << "write(" << len << ") error: (" << errno << ") "
-                           <<
-                           ::strerror(errno);
-            }
-        } else if (rc < len) {
-            buf += rc;
-            len -= rc;
-            goto retry;
+        written += len;
+        if (!direct) {
+            writeFile(buf, len);
+            return;
+        }
+
+        // O_DIRECT needs aligned buffers, the data is staged
+        while (len > 0) {
+            const size_t n = std::min<size_t>(
+                    len, aligned.capacity() - aligned_used);
+            ::memcpy(aligned.data() + aligned_used, buf, n);
+            aligned_used += n;
+            buf += n;
+            len -= n;
+            if (aligned_used == aligned.capacity())
+                flushAligned(aligned_used);
         }
     }
 };
 
 UploadBuilder::UploadBuilder() : path(),
                                  fmode(FLAGS_mode_create),
-                                 dmode(FLAGS_mode_mkdir) {}
+                                 dmode(FLAGS_mode_mkdir),
+                                 durability{Durability::None},
+                                 xattr_layout{XattrLayout::Split},
+                                 expected_size{0},
+                                 preallocate{FLAGS_local_fallocate},
+                                 direct{FLAGS_local_direct} {
+    if (!oio::local::blob::durability_parse(FLAGS_local_durability,
+                                            &durability))
+        LOG(WARNING) << "Unknown -local_durability, fallback on 'none'";
+    if (!oio::local::blob::xattr_layout_parse(FLAGS_local_xattr,
+                                              &xattr_layout))
+        LOG(WARNING) << "Unknown -local_xattr, fallback on 'split'";
+}
 
 UploadBuilder::~UploadBuilder() {}
 
@@ -450,9 +735,24 @@ void UploadBuilder::FileMode(unsigned int mode) { fmode = mode; }
 
 void UploadBuilder::DirMode(unsigned int mode) { dmode = mode; }
 
+void UploadBuilder::SetDurability(Durability d) { durability = d; }
+
+void UploadBuilder::SetXattrLayout(XattrLayout l) { xattr_layout = l; }
+
+void UploadBuilder::ExpectedSize(uint64_t size) { expected_size = size; }
+
+void UploadBuilder::Preallocate(bool on) { preallocate = on; }
+
+void UploadBuilder::Direct(bool on) { direct = on; }
+
 std::unique_ptr<oio::api::blob::Upload> UploadBuilder::Build() {
     auto ul = new LocalUpload(path);
     ul->fmode = fmode;
     ul->dmode = dmode;
+    ul->durability = durability;
+    ul->xattr_layout = xattr_layout;
+    ul->expected_size = expected_size;
+    ul->preallocate = preallocate;
+    ul->direct = direct;
     return std::unique_ptr<LocalUpload>(ul);
 }
@@ -19,10 +19,13 @@
 #ifndef SRC_OIO_BLOB_LOCAL_BLOB_HPP_
 #define SRC_OIO_BLOB_LOCAL_BLOB_HPP_
 
+#include <cstdint>
 #include <string>
 #include <memory>
 
 #include "oio/api/blob.hpp"
+#include "oio/blob/local/group_commit.hpp"
+#include "oio/blob/local/xattr.hpp"
 
 namespace oio {
 namespace local {
@@ -52,11 +55,46 @@ class UploadBuilder {
      */
     void DirMode(unsigned int mode);
 
+    /**
+     * Optional, defaults to -local_durability
+     * @param d what the Commit() waits for before returning
+     */
+    void SetDurability(Durability d);
+
+    /**
+     * Optional, defaults to -local_xattr
+     * @param l how the attributes are stored in the xattr of the file
+     */
+    void SetXattrLayout(XattrLayout l);
+
+    /**
+     * Optional, the size announced by the client, 0 if unknown
+     * @param size the expected size of the blob
+     */
+    void ExpectedSize(uint64_t size);
+
+    /**
+     * Optional, defaults to -local_fallocate
+     * @param on preallocate the expected size, if known
+     */
+    void Preallocate(bool on);
+
+    /**
+     * Optional, defaults to -local_direct
+     * @param on bypass the page cache, if the filesystem allows it
+     */
+    void Direct(bool on);
+
     std::unique_ptr<oio::api::blob::Upload> Build();
 
  private:
     std::string path;
     unsigned int fmode, dmode;
+    Durability durability;
+    XattrLayout xattr_layout;
+    uint64_t expected_size;
+    bool preallocate;
+    bool direct;
 };
 
 class DownloadBuilder {
@@ -67,10 +105,40 @@ class DownloadBuilder {
 
     void Path(const std::string &path);
 
+    /**
+     * Optional, defaults to -local_direct
+     * @param on bypass the page cache, if the filesystem allows it
+     */
+    void Direct(bool on);
+
+    /**
+     * Optional, defaults to -local_readahead
+     * @param on read the next batch while the current one is consumed
+     */
+    void ReadAhead(bool on);
+
+    /**
+     * Optional, defaults to -local_fadvise
+     * @param on give the kernel sequential and prefetch hints
+     */
+    void Fadvise(bool on);
+
+    /**
+     * Optional. Without it, only the downloads of at least
+     * -local_dontneed_size bytes are dropped, if -local_dontneed is set.
+     * @param on the chunk is cold, drop its pages once it has been read
+     */
+    void DropCache(bool on);
+
     std::unique_ptr<oio::api::blob::Download> Build();
 
  private:
     std::string path;
+    bool direct;
+    bool readahead;
+    bool fadvise;
+    bool dontneed;
+    bool cold;
 };
 
 class RemovalBuilder {
@@ -0,0 +1,405 @@
+/**
+ * This file is part of the OpenIO client libraries
+ * Copyright (C) 2016 OpenIO SAS
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ */
+
+#include "oio/blob/local/cache.hpp"
+
+#include <gflags/gflags.h>
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <functional>
+#include <utility>
+
+using oio::api::Cause;
+using oio::api::Status;
+using oio::local::blob::ChunkCache;
+using oio::local::blob::FrequencySketch;
+using Step = oio::api::blob::TransactionStep;
+
+DECLARE_uint64(read_batch_size);
+
+#define SKETCH_ROWS 4
+#define CACHE_STAMPS 4096
+
+static uint64_t _mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+FrequencySketch::FrequencySketch(size_t width)
+        : table_(), mask_{0}, samples_{0}, period_{0} {
+    size_t w = 64;
+    while (w < width)
+        w <<= 1;
+    mask_ = w - 1;
+    // Two 4-bit counters per byte
+    table_.resize(SKETCH_ROWS * w / 2, 0);
+    period_ = 10 * w;
+}
+
+size_t FrequencySketch::index(uint64_t h, unsigned int row) const {
+    const uint64_t seeded = _mix(h + row * 0x9e3779b97f4a7c15ULL);
+    return row * (mask_ + 1) + (seeded & mask_);
+}
+
+void FrequencySketch::Increment(const std::string &key) {
+    const uint64_t h = std::hash<std::string>()(key);
+    for (unsigned int row = 0; row < SKETCH_ROWS; ++row) {
+        const size_t i = index(h, row);
+        uint8_t &b = table_[i / 2];
+        const unsigned int shift = (i & 1) * 4;
+        if (((b >> shift) & 0x0F) < 15)
+            b += 1 << shift;
+    }
+    if (++samples_ >= period_)
+        reset();
+}
+
+unsigned int FrequencySketch::Estimate(const std::string &key) const {
+    const uint64_t h = std::hash<std::string>()(key);
+    unsigned int freq = 15;
+    for (unsigned int row = 0; row < SKETCH_ROWS; ++row) {
+        const size_t i = index(h, row);
+        const unsigned int c = (table_[i / 2] >> ((i & 1) * 4)) & 0x0F;
+        freq = std::min(freq, c);
+    }
+    return freq;
+}
+
+void FrequencySketch::reset() {
+    for (auto &b : table_)
+        b = (b >> 1) & 0x77;
+    samples_ /= 2;
+}
+
+
+namespace {
+
+/** Serves a cached chunk, the content stays alive even if evicted */
+class CachedDownload : public oio::api::blob::Download {
+ public:
+    explicit CachedDownload(std::shared_ptr<const std::vector<uint8_t>> d)
+            : data(std::move(d)), offset{0}, end{0}, step{Step::Init} {}
+
+    ~CachedDownload() override {}
+
+    Status Prepare() override {
+        if (step != Step::Init)
+            return Status(Cause::InternalError);
+        offset = 0;
+        end = data->size();
+        step = Step::Prepared;
+        return Status();
+    }
+
+    bool IsEof() override { return step == Step::Done; }
+
+    int32_t Read(std::vector<uint8_t> *buf) override {
+        assert(buf != nullptr);
+        if (step != Step::Prepared)
+            return 0;
+        const size_t len = std::min<uint64_t>(end - offset,
+                                              FLAGS_read_batch_size);
+        buf->assign(data->begin() + offset, data->begin() + offset + len);
+        advance(len);
+        return len;
+    }
+
+    int32_t ReadInto(uint8_t *buf, uint32_t len) override {
+        assert(buf != nullptr);
+        if (step != Step::Prepared)
+            return 0;
+        const size_t n = std::min<uint64_t>(end - offset, len);
+        ::memcpy(buf, data->data() + offset, n);
+        advance(n);
+        return n;
+    }
+
+    Status SetRange(uint32_t o, uint32_t size) override {
+        if (step != Step::Prepared || offset > 0)
+            return Status(Cause::Forbidden);
+        if (static_cast<uint64_t>(o) + size > data->size())
+            return oio::api::Errno(ENXIO);
+        offset = o;
+        end = o + size;
+        return Status();
+    }
+
+ private:
+    void advance(size_t n) {
+        offset += n;
+        if (offset >= end)
+            step = Step::Done;
+    }
+
+    std::shared_ptr<const std::vector<uint8_t>> data;
+    size_t offset, end;
+    Step step;
+};
+
+/** Keeps a copy of the chunk read, then offers it to the cache */
+class FillingDownload : public oio::api::blob::Download {
+ public:
+    FillingDownload(ChunkCache *c, const std::string &i, uint64_t max,
+                    std::unique_ptr<oio::api::blob::Download> dl)
+            : cache(c), id(i), max_entry{max},
+              generation{c->Generation()}, inner(std::move(dl)),
+              copy(new std::vector<uint8_t>), filling{true} {}
+
+    ~FillingDownload() override {}
+
+    Status Prepare() override { return inner->Prepare(); }
+
+    bool IsEof() override { return inner->IsEof(); }
+
+    int32_t Read(std::vector<uint8_t> *buf) override {
+        const int32_t rc = inner->Read(buf);
+        if (!filling)
+            return rc;
+        if (rc < 0 || copy->size() + buf->size() > max_entry) {
+            stop();
+        } else {
+            copy->insert(copy->end(), buf->begin(), buf->end());
+            if (inner->IsEof()) {
+                cache->Insert(id, std::move(copy), generation);
+                stop();
+            }
+        }
+        return rc;
+    }
+
+    Status SetRange(uint32_t offset, uint32_t size) override {
+        // Only whole chunks are cached
+        stop();
+        return inner->SetRange(offset, size);
+    }
+
+ private:
+    void stop() {
+        filling = false;
+        copy.reset();
+    }
+
+    ChunkCache *cache;
+    std::string id;
+    uint64_t max_entry;
+    uint64_t generation;
+    std::unique_ptr<oio::api::blob::Download> inner;
+    std::shared_ptr<std::vector<uint8_t>> copy;
+    bool filling;
+};
+
+class InvalidatingUpload : public oio::api::blob::Upload {
+ public:
+    InvalidatingUpload(ChunkCache *c, const std::string &i,
+                       std::unique_ptr<oio::api::blob::Upload> ul)
+            : cache(c), id(i), inner(std::move(ul)) {}
+
+    ~InvalidatingUpload() override {}
+
+    void SetXattr(const std::string &k, const std::string &v) override {
+        inner->SetXattr(k, v);
+    }
+
+    Status Prepare() override { return inner->Prepare(); }
+
+    Status Commit() override {
+        auto rc = inner->Commit();
+        cache->Invalidate(id);
+        return rc;
+    }
+
+    Status Abort() override { return inner->Abort(); }
+
+    void Write(const uint8_t *buf, uint32_t len) override {
+        inner->Write(buf, len);
+    }
+
+ private:
+    ChunkCache *cache;
+    std::string id;
+    std::unique_ptr<oio::api::blob::Upload> inner;
+};
+
+class InvalidatingRemoval : public oio::api::blob::Removal {
+ public:
+    InvalidatingRemoval(ChunkCache *c, const std::string &i,
+                        std::unique_ptr<oio::api::blob::Removal> rem)
+            : cache(c), id(i), inner(std::move(rem)) {}
+
+    ~InvalidatingRemoval() override {}
+
+    Status Prepare() override { return inner->Prepare(); }
+
+    Status Commit() override {
+        auto rc = inner->Commit();
+        cache->Invalidate(id);
+        return rc;
+    }
+
+    Status Abort() override { return inner->Abort(); }
+
+ private:
+    ChunkCache *cache;
+    std::string id;
+    std::unique_ptr<oio::api::blob::Removal> inner;
+};
+
+}  // namespace
+
+
+ChunkCache::ChunkCache(uint64_t budget, uint64_t max_entry)
+        : budget_{budget}, max_entry_{std::min(budget, max_entry)},
+          used_{0}, generation_{0}, stamps_(CACHE_STAMPS, 0),
+          // Sized for chunks of 16 KiB on average
+          sketch_(std::min<uint64_t>(std::max<uint64_t>(budget / 16384, 1024),
+                                     1 << 24)),
+          lru_(), items_(), hits_{0}, misses_{0}, inserts_{0}, rejects_{0},
+          evictions_{0}, invalidations_{0} {}
+
+ChunkCache::~ChunkCache() {}
+
+uint64_t &ChunkCache::stamp(const std::string &id) {
+    return stamps_[std::hash<std::string>()(id) % stamps_.size()];
+}
+
+void ChunkCache::evict(std::unordered_map<std::string, Item>::iterator it) {
+    used_ -= it->second.data->size();
+    lru_.erase(it->second.lru);
+    items_.erase(it);
+}
+
+std::unique_ptr<oio::api::blob::Download> ChunkCache::Lookup(
+        const std::string &id) {
+    sketch_.Increment(id);
+    auto it = items_.find(id);
+    if (it == items_.end()) {
+        misses_++;
+        return nullptr;
+    }
+    hits_++;
+    lru_.splice(lru_.begin(), lru_, it->second.lru);
+    return std::unique_ptr<oio::api::blob::Download>(
+            new CachedDownload(it->second.data));
+}
+
+std::unique_ptr<oio::api::blob::Download> ChunkCache::Fill(
+        const std::string &id, std::unique_ptr<oio::api::blob::Download> dl) {
+    return std::unique_ptr<oio::api::blob::Download>(
+            new FillingDownload(this, id, max_entry_, std::move(dl)));
+}
+
+std::unique_ptr<oio::api::blob::Upload> ChunkCache::Invalidating(
+        const std::string &id, std::unique_ptr<oio::api::blob::Upload> ul) {
+    return std::unique_ptr<oio::api::blob::Upload>(
+            new InvalidatingUpload(this, id, std::move(ul)));
+}
+
+std::unique_ptr<oio::api::blob::Removal> ChunkCache::Invalidating(
+        const std::string &id,
+        std::unique_ptr<oio::api::blob::Removal> rem) {
+    return std::unique_ptr<oio::api::blob::Removal>(
+            new InvalidatingRemoval(this, id, std::move(rem)));
+}
+
+void ChunkCache::Invalidate(const std::string &id) {
+    stamp(id) = ++generation_;
+    auto it = items_.find(id);
+    if (it != items_.end()) {
+        evict(it);
+        invalidations_++;
+    }
+}
+
+bool ChunkCache::Insert(const std::string &id,
+                        std::shared_ptr<const std::vector<uint8_t>> data,
+                        uint64_t generation) {
+    assert(data != nullptr);
+    const uint64_t size = data->size();
+    // Stale, or already filled by a concurrent download
+    if (stamp(id) > generation || items_.count(id) > 0)
+        return false;
+    if (size > max_entry_) {
+        rejects_++;
+        return false;
+    }
+
+    // The LRU victims making room must all be less popular
+    std::vector<std::string> victims;
+    if (used_ + size > budget_) {
+        const unsigned int freq = sketch_.Estimate(id);
+        uint64_t freed = 0;
+        for (auto it = lru_.rbegin(); it != lru_.rend(); ++it) {
+            if (sketch_.Estimate(*it) >= freq) {
+                rejects_++;
+                return false;
+            }
+            victims.push_back(*it);
+            freed += items_[*it].data->size();
+            if (used_ - freed + size <= budget_)
+                break;
+        }
+    }
+    for (const auto &v : victims) {
+        evict(items_.find(v));
+        evictions_++;
+    }
+
+    lru_.push_front(id);
+    items_[id] = Item{std::move(data), lru_.begin()};
+    used_ += size;
+    inserts_++;
+    return true;
+}
+
+void ChunkCache::Stats(std::string *out) const {
+    assert(out != nullptr);
+    rapidjson::StringBuffer buf;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(buf);
+    writer.StartObject();
+    writer.Key("bytes");
+    writer.Uint64(used_);
+    writer.Key("budget");
+    writer.Uint64(budget_);
+    writer.Key("entries");
+    writer.Uint64(items_.size());
+    writer.Key("hits");
+    writer.Uint64(hits_);
+    writer.Key("misses");
+    writer.Uint64(misses_);
+    writer.Key("hit_ratio");
+    writer.Double(hits_ + misses_ > 0
+                  ? static_cast<double>(hits_) / (hits_ + misses_) : 0.0);
+    writer.Key("inserts");
+    writer.Uint64(inserts_);
+    writer.Key("rejects");
+    writer.Uint64(rejects_);
+    writer.Key("evictions");
+    writer.Uint64(evictions_);
+    writer.Key("invalidations");
+    writer.Uint64(invalidations_);
+    writer.EndObject();
+    out->assign(buf.GetString(), buf.GetSize());
+}
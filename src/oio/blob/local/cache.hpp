@@ -0,0 +1,151 @@
+/**
+ * This file is part of the OpenIO client libraries
+ * Copyright (C) 2016 OpenIO SAS
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ */
+
+#ifndef SRC_OIO_BLOB_LOCAL_CACHE_HPP_
+#define SRC_OIO_BLOB_LOCAL_CACHE_HPP_
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "utils/macros.h"
+#include "oio/api/blob.hpp"
+
+namespace oio {
+namespace local {
+namespace blob {
+
+/**
+ * Approximate the recent access frequency of the keys in a few bits each:
+ * a count-min sketch of 4-bit counters, all halved after a sample period so
+ * that the old popularity fades.
+ */
+class FrequencySketch {
+ public:
+    /** @param width the number of counters per row, rounded to a power of 2 */
+    explicit FrequencySketch(size_t width);
+
+    void Increment(const std::string &key);
+
+    /** @return the estimated frequency, between 0 and 15 */
+    unsigned int Estimate(const std::string &key) const;
+
+ private:
+    void reset();
+
+    size_t index(uint64_t h, unsigned int row) const;
+
+    std::vector<uint8_t> table_;
+    size_t mask_;
+    uint64_t samples_, period_;
+};
+
+/**
+ * A byte-budgeted cache of whole chunks, in RAM.
+ *
+ * The entries are evicted in LRU order, but a new chunk only gets in if it
+ * is more frequently accessed than the ones it would evict (TinyLFU), so
+ * that a scan of cold chunks cannot flush the hot ones.
+ *
+ * Not thread-safe: it is meant to be shared by the coroutines of a thread.
+ */
+class ChunkCache {
+ public:
+    /**
+     * @param budget the maximum number of bytes cached
+     * @param max_entry the size of the largest chunk cached
+     */
+    ChunkCache(uint64_t budget, uint64_t max_entry);
+
+    ~ChunkCache();
+
+    /**
+     * Count an access to the chunk.
+     * @return a download served from memory, or nullptr on a miss
+     */
+    std::unique_ptr<oio::api::blob::Download> Lookup(const std::string &id);
+
+    /**
+     * Decorate the download of a missed chunk, so that the content read is
+     * offered to the cache. Range downloads are not.
+     */
+    std::unique_ptr<oio::api::blob::Download> Fill(
+            const std::string &id,
+            std::unique_ptr<oio::api::blob::Download> dl);
+
+    /** Decorate an upload so that its commit invalidates the chunk */
+    std::unique_ptr<oio::api::blob::Upload> Invalidating(
+            const std::string &id, std::unique_ptr<oio::api::blob::Upload> ul);
+
+    /** Decorate a removal so that its commit invalidates the chunk */
+    std::unique_ptr<oio::api::blob::Removal> Invalidating(
+            const std::string &id,
+            std::unique_ptr<oio::api::blob::Removal> rem);
+
+    /**
+     * Forget the chunk. The fills of the chunk started before are then
+     * dropped, they may carry the previous content.
+     */
+    void Invalidate(const std::string &id);
+
+    /**
+     * Offer a chunk to the cache
+     * @param generation as returned by Generation() when the read started
+     * @return true if the chunk has been admitted
+     */
+    bool Insert(const std::string &id,
+                std::shared_ptr<const std::vector<uint8_t>> data,
+                uint64_t generation);
+
+    uint64_t Generation() const { return generation_; }
+
+    /** Dump the counters as a JSON object */
+    void Stats(std::string *out) const;
+
+ private:
+    FORBID_COPY_CTOR(ChunkCache);
+    FORBID_MOVE_CTOR(ChunkCache);
+
+    struct Item {
+        std::shared_ptr<const std::vector<uint8_t>> data;
+        std::list<std::string>::iterator lru;
+    };
+
+    void evict(std::unordered_map<std::string, Item>::iterator it);
+
+    /** @return the slot holding the last invalidation of the chunk */
+    uint64_t &stamp(const std::string &id);
+
+    uint64_t budget_, max_entry_, used_;
+    uint64_t generation_;
+    std::vector<uint64_t> stamps_;
+    FrequencySketch sketch_;
+    std::list<std::string> lru_;  // the most recent first
+    std::unordered_map<std::string, Item> items_;
+
+    uint64_t hits_, misses_, inserts_, rejects_, evictions_, invalidations_;
+};
+
+}  // namespace blob
+}  // namespace local
+}  // namespace oio
+
+#endif  // SRC_OIO_BLOB_LOCAL_CACHE_HPP_
@@ -0,0 +1,220 @@
+/**
+ * This file is part of the OpenIO client libraries
+ * Copyright (C) 2016 OpenIO SAS
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ */
+
+#include "oio/blob/local/disk_io.hpp"
+
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <libmill.h>
+
+#include <cassert>
+#include <cerrno>
+#include <cstdlib>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+using oio::local::blob::AlignedBuffer;
+using oio::local::blob::DiskIO;
+
+DEFINE_uint32(local_io_threads, 4,
+              "Threads per disk running the blocking file I/O, 0 to run the "
+              "I/O in the calling coroutine");
+
+struct DiskIO::Job {
+    std::function<ssize_t()> fn;
+    ssize_t rc;
+    int err;
+    int efd;
+};
+
+namespace {
+
+using Job = DiskIO::Job;
+
+/**
+ * The pool of threads of a disk. Never destroyed, the threads are detached
+ * and live as long as the process.
+ */
+struct Disk {
+    std::mutex lock;
+    std::condition_variable cond;
+    std::deque<Job *> queue;
+
+    explicit Disk(unsigned int nb) : lock(), cond(), queue() {
+        for (unsigned int i = 0; i < nb; ++i)
+            std::thread([this]() { loop(); }).detach();
+    }
+
+    void Push(Job *job) {
+        std::unique_lock<std::mutex> guard(lock);
+        queue.push_back(job);
+        cond.notify_one();
+    }
+
+    void loop() {
+        for (;;) {
+            Job *job{nullptr};
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                cond.wait(guard, [this]() { return !queue.empty(); });
+                job = queue.front();
+                queue.pop_front();
+            }
+            job->rc = job->fn();
+            job->err = errno;
+            // The job belongs to the waiting coroutine as soon as the event
+            // is posted, it must not be touched afterwards.
+            const int efd = job->efd;
+            const uint64_t one{1};
+            while (::write(efd, &one, sizeof(one)) < 0 && errno == EINTR) {}
+        }
+    }
+};
+
+std::mutex disks_lock;
+std::map<dev_t, Disk *> disks;
+
+Disk *_disk(dev_t dev) {
+    std::unique_lock<std::mutex> guard(disks_lock);
+    auto it = disks.find(dev);
+    if (it != disks.end())
+        return it->second;
+    auto disk = new Disk(FLAGS_local_io_threads);
+    disks[dev] = disk;
+    return disk;
+}
+
+}  // namespace
+
+AlignedBuffer::~AlignedBuffer() {
+    ::free(data_);
+}
+
+bool AlignedBuffer::Allocate(size_t capacity, size_t align) {
+    assert(align > 0 && (align & (align - 1)) == 0);
+    ::free(data_);
+    data_ = nullptr;
+    align_ = align;
+    capacity_ = Up(capacity);
+    void *p{nullptr};
+    if (0 != ::posix_memalign(&p, align_, capacity_)) {
+        capacity_ = 0;
+        return false;
+    }
+    data_ = static_cast<uint8_t *>(p);
+    return true;
+}
+
+DiskIO::DiskIO() : job_(), efd_{-1}, dev_{0}, bound_{false},
+                   pending_{false} {}
+
+DiskIO::~DiskIO() {
+    // The thread still refers to the job and the eventfd
+    if (pending_)
+        Wait();
+    if (efd_ >= 0) {
+        ::fdclean(efd_);
+        ::close(efd_);
+        efd_ = -1;
+    }
+}
+
+void DiskIO::Bind(int fd) {
+    struct stat st;
+    if (0 != ::fstat(fd, &st)) {
+        bound_ = false;
+        return;
+    }
+    dev_ = st.st_dev;
+    bound_ = true;
+}
+
+ssize_t DiskIO::Run(std::function<ssize_t()> fn) {
+    Start(std::move(fn));
+    return Wait();
+}
+
+void DiskIO::Start(std::function<ssize_t()> fn) {
+    assert(!pending_);
+    if (!job_)
+        job_.reset(new Job);
+    job_->fn = std::move(fn);
+    job_->rc = -1;
+    job_->err = 0;
+    pending_ = true;
+
+    if (bound_ && FLAGS_local_io_threads > 0 && efd_ < 0)
+        efd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    job_->efd = efd_;
+    if (!bound_ || FLAGS_local_io_threads <= 0 || efd_ < 0) {
+        // Inline, Wait() only collects the result
+        job_->rc = job_->fn();
+        job_->err = errno;
+        job_->efd = -1;
+        return;
+    }
+    _disk(dev_)->Push(job_.get());
+}
+
+ssize_t DiskIO::Wait() {
+    assert(pending_);
+    if (job_->efd >= 0) {
+        uint64_t evt{0};
+        while (::read(efd_, &evt, sizeof(evt)) != sizeof(evt)) {
+            if (errno == EAGAIN)
+                fdwait(efd_, FDW_IN, -1);
+        }
+    }
+    pending_ = false;
+    job_->fn = nullptr;
+    errno = job_->err;
+    return job_->rc;
+}
+
+ssize_t DiskIO::Read(int fd, void *buf, size_t len) {
+    return Run([fd, buf, len]() -> ssize_t {
+        ssize_t rc;
+        do {
+            rc = ::read(fd, buf, len);
+        } while (rc < 0 && errno == EINTR);
+        return rc;
+    });
+}
+
+ssize_t DiskIO::Write(int fd, const void *buf, size_t len) {
+    return Run([fd, buf, len]() -> ssize_t {
+        auto p = static_cast<const uint8_t *>(buf);
+        size_t done = 0;
+        while (done < len) {
+            ssize_t rc = ::write(fd, p + done, len - done);
+            if (rc < 0) {
+                if (errno == EINTR)
+                    continue;
+                return -1;
+            }
+            done += rc;
+        }
+        return static_cast<ssize_t>(len);
+    });
+}
@@ -0,0 +1,151 @@
+/**
+ * This file is part of the OpenIO client libraries
+ * Copyright (C) 2016 OpenIO SAS
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ */
+
+#ifndef SRC_OIO_BLOB_LOCAL_DISK_IO_HPP_
+#define SRC_OIO_BLOB_LOCAL_DISK_IO_HPP_
+
+#include <sys/types.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+#include "utils/macros.h"
+
+namespace oio {
+namespace local {
+namespace blob {
+
+/**
+ * A buffer suitable for O_DIRECT transfers: its address is aligned, and so
+ * must be the offsets and the lengths of the I/O using it.
+ */
+class AlignedBuffer {
+ public:
+    AlignedBuffer() : data_{nullptr}, capacity_{0}, align_{0} {}
+
+    ~AlignedBuffer();
+
+    /**
+     * @param capacity rounded up to a multiple of the alignment
+     * @param align a power of two
+     * @return false if the allocation failed
+     */
+    bool Allocate(size_t capacity, size_t align);
+
+    uint8_t *data() { return data_; }
+
+    size_t capacity() const { return capacity_; }
+
+    /** @return the lowest multiple of the alignment above or equal to 'n' */
+    size_t Up(size_t n) const { return (n + align_ - 1) & ~(align_ - 1); }
+
+    /** @return the highest multiple of the alignment below or equal to 'n' */
+    uint64_t Down(uint64_t n) const { return n & ~(align_ - 1); }
+
+ private:
+    FORBID_COPY_CTOR(AlignedBuffer);
+    FORBID_MOVE_CTOR(AlignedBuffer);
+
+    uint8_t *data_;
+    size_t capacity_;
+    size_t align_;
+};
+
+/**
+ * Runs the blocking syscalls on regular files out of the libmill scheduler.
+ * O_NONBLOCK has no effect on disk files, so a read missing the page cache
+ * would otherwise freeze every coroutine of the thread.
+ *
+ * Each disk (i.e. each st_dev) has its own pool of threads, so that a slow
+ * disk only delays the transactions on it. The calling coroutine parks on an
+ * eventfd until a thread of the pool ran the syscall.
+ *
+ * One DiskIO serves one coroutine at once, it is meant to be owned by a
+ * transaction, and runs at most one syscall at once. With
+ * -local_io_threads=0 the syscalls run inline.
+ */
+class DiskIO {
+ public:
+    DiskIO();
+
+    ~DiskIO();
+
+    /**
+     * Associate the DiskIO with the disk holding the file.
+     * @param fd an open file descriptor
+     */
+    void Bind(int fd);
+
+    /** @return the st_dev of the disk, meaningful once bound */
+    dev_t Dev() const { return dev_; }
+
+    /**
+     * Run fn in a thread of the disk, the calling coroutine waits meanwhile.
+     * @return the value returned by fn, and errno as set by fn
+     */
+    ssize_t Run(std::function<ssize_t()> fn);
+
+    /**
+     * Queue fn in a thread of the disk and return immediately, so that the
+     * coroutine may work meanwhile. The memory fn touches must stay valid
+     * until Wait() returned. Nothing may be started while a job is pending.
+     */
+    void Start(std::function<ssize_t()> fn);
+
+    /**
+     * Wait for the job queued by Start().
+     * @return the value returned by fn, and errno as set by fn
+     */
+    ssize_t Wait();
+
+    /** @return true if a job has been started and not waited for yet */
+    bool Pending() const { return pending_; }
+
+    /** Opaque, handed to the threads of the disk */
+    struct Job;
+
+    /**
+     * Retries when interrupted.
+     * @return the number of bytes read, 0 at the end of the file, or -1
+     */
+    ssize_t Read(int fd, void *buf, size_t len);
+
+    /**
+     * Retries on partial writes and interruptions.
+     * @return len if the whole buffer has been written, or -1
+     */
+    ssize_t Write(int fd, const void *buf, size_t len);
+
+ private:
+    FORBID_COPY_CTOR(DiskIO);
+    FORBID_MOVE_CTOR(DiskIO);
+
+    std::unique_ptr<Job> job_;
+    int efd_;
+    dev_t dev_;
+    bool bound_;
+    bool pending_;
+};
+
+}  // namespace blob
+}  // namespace local
+}  // namespace oio
+
+#endif  // SRC_OIO_BLOB_LOCAL_DISK_IO_HPP_
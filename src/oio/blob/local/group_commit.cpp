@@ -0,0 +1,256 @@
+/**
+ * This file is part of the OpenIO client libraries
+ * Copyright (C) 2016 OpenIO SAS
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ */
+
+#include "oio/blob/local/group_commit.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <libmill.h>
+#include <rapidjson/writer.h>
+#include <rapidjson/stringbuffer.h>
+
+#include <array>
+#include <cassert>
+#include <cerrno>
+#include <map>
+#include <set>
+#include <vector>
+
+using oio::local::blob::DiskIO;
+using oio::local::blob::Durability;
+
+DEFINE_int32(local_group_commit_delay, 2,
+             "Maximum time (ms) a group commit waits for more uploads");
+DEFINE_uint32(local_group_commit_max, 32,
+              "Maximum number of uploads in a group commit");
+DEFINE_uint32(local_group_commit_syncfs, 0,
+              "Number of directories in a group commit beyond which a "
+              "syncfs() replaces their fsync(), 0 to never call syncfs()");
+
+namespace {
+
+/** Buckets of powers of two, the last one catches everything beyond */
+class Histogram {
+ public:
+    Histogram() : counts_() { counts_.fill(0); }
+
+    void Add(uint64_t v) {
+        unsigned int i = 0;
+        while (v > 0 && i < counts_.size() - 1) {
+            v >>= 1;
+            ++i;
+        }
+        counts_[i]++;
+    }
+
+    void Dump(rapidjson::Writer<rapidjson::StringBuffer> *w) const {
+        w->StartArray();
+        for (auto c : counts_)
+            w->Uint64(c);
+        w->EndArray();
+    }
+
+ private:
+    std::array<uint64_t, 20> counts_;
+};
+
+Histogram stats_batch;
+Histogram stats_latency;
+
+struct Member {
+    int fd;
+    const std::string *from;
+    const std::string *to;
+    int err;
+    bool renamed;
+    int64_t started;
+    chan done;
+};
+
+struct Batch {
+    std::vector<Member *> members;
+    chan full;
+};
+
+// The batch open on each disk. libmill runs all the coroutines in the same
+// thread, so no lock is needed.
+std::map<dev_t, Batch *> batches;
+
+std::string _dirname(const std::string &path) {
+    auto slash = path.rfind('/');
+    if (slash == std::string::npos)
+        return ".";
+    if (slash == 0)
+        return "/";
+    return path.substr(0, slash);
+}
+
+int _fsync_dir(const std::string &path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0)
+        return errno;
+    int err = 0;
+    if (0 != ::fsync(fd))
+        err = errno;
+    ::close(fd);
+    return err;
+}
+
+/**
+ * Runs in a thread of the disk. The xattr are metadata, so the files need
+ * a fsync() and not a fdatasync().
+ */
+void _flush(const std::vector<Member *> &members, bool sync) {
+    std::map<std::string, std::vector<Member *>> dirs;
+    for (auto m : members) {
+        if (sync && 0 != ::fsync(m->fd)) {
+            m->err = errno;
+            continue;
+        }
+        if (0 != ::rename(m->from->c_str(), m->to->c_str())) {
+            m->err = errno;
+            continue;
+        }
+        m->renamed = true;
+        dirs[_dirname(*m->to)].push_back(m);
+    }
+    if (!sync || dirs.empty())
+        return;
+
+    if (FLAGS_local_group_commit_syncfs > 0 &&
+            dirs.size() > FLAGS_local_group_commit_syncfs) {
+        if (0 == ::syncfs(dirs.begin()->second.front()->fd))
+            return;
+        const int err = errno;
+        for (auto &d : dirs) {
+            for (auto m : d.second)
+                m->err = err;
+        }
+        return;
+    }
+    for (auto &d : dirs) {
+        const int err = _fsync_dir(d.first);
+        if (err != 0) {
+            for (auto m : d.second)
+                m->err = err;
+        }
+    }
+}
+
+int _group(DiskIO *io, Member *me) {
+    const dev_t dev = io->Dev();
+    auto it = batches.find(dev);
+    if (it != batches.end()) {
+        // A batch is open on the disk, join it and wait for its leader
+        auto batch = it->second;
+        me->done = chmake(int, 1);
+        batch->members.push_back(me);
+        if (batch->members.size() == FLAGS_local_group_commit_max)
+            chs(batch->full, int, 0);
+        (void) chr(me->done, int);
+        chclose(me->done);
+        return me->err;
+    }
+
+    // Open a batch and lead it
+    Batch batch;
+    batch.members.push_back(me);
+    if (FLAGS_local_group_commit_max > 1) {
+        batch.full = chmake(int, 1);
+        batches[dev] = &batch;
+        mill_choose {
+            mill_in(batch.full, int, v):
+                (void) v;
+            mill_deadline(mill_now() + FLAGS_local_group_commit_delay):
+        mill_end
+        }
+        batches.erase(dev);
+        chclose(batch.full);
+    }
+
+    io->Run([&batch]() -> ssize_t {
+        _flush(batch.members, true);
+        return 0;
+    });
+
+    const int64_t now = mill_now();
+    stats_batch.Add(batch.members.size());
+    for (auto m : batch.members) {
+        stats_latency.Add(now - m->started);
+        if (m != me)
+            chs(m->done, int, 0);
+    }
+    return me->err;
+}
+
+}  // namespace
+
+bool oio::local::blob::durability_parse(const std::string &name,
+        Durability *out) {
+    assert(out != nullptr);
+    if (name == "none")
+        *out = Durability::None;
+    else if (name == "fsync")
+        *out = Durability::Sync;
+    else if (name == "group")
+        *out = Durability::Group;
+    else
+        return false;
+    return true;
+}
+
+int oio::local::blob::durable_rename(DiskIO *io, int fd,
+        const std::string &from, const std::string &to, Durability mode,
+        bool *renamed) {
+    assert(io != nullptr);
+    assert(renamed != nullptr);
+    Member me{fd, &from, &to, 0, false, mill_now(), nullptr};
+
+    switch (mode) {
+        case Durability::None:
+            _flush({&me}, false);
+            break;
+        case Durability::Sync:
+            io->Run([&me]() -> ssize_t {
+                _flush({&me}, true);
+                return 0;
+            });
+            stats_batch.Add(1);
+            stats_latency.Add(mill_now() - me.started);
+            break;
+        case Durability::Group:
+            _group(io, &me);
+            break;
+    }
+    *renamed = me.renamed;
+    return me.err;
+}
+
+void oio::local::blob::group_commit_stats(std::string *out) {
+    assert(out != nullptr);
+    rapidjson::StringBuffer buf;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(buf);
+    writer.StartObject();
+    writer.Key("batch");
+    stats_batch.Dump(&writer);
+    writer.Key("latency_ms");
+    stats_latency.Dump(&writer);
+    writer.EndObject();
+    out->assign(buf.GetString(), buf.GetSize());
+}
@@ -0,0 +1,72 @@
+/**
+ * This file is part of the OpenIO client libraries
+ * Copyright (C) 2016 OpenIO SAS
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ */
+
+#ifndef SRC_OIO_BLOB_LOCAL_GROUP_COMMIT_HPP_
+#define SRC_OIO_BLOB_LOCAL_GROUP_COMMIT_HPP_
+
+#include <string>
+
+#include "oio/blob/local/disk_io.hpp"
+
+namespace oio {
+namespace local {
+namespace blob {
+
+enum class Durability {
+    None,  // rename only, the page cache is flushed whenever the kernel wants
+    Sync,  // fsync the file and its directory, for each upload
+    Group  // same as Sync, but shared by the concurrent uploads of a disk
+};
+
+/**
+ * @param name one of "none", "fsync", "group"
+ * @return false if the name is unknown, and then 'out' is untouched
+ */
+bool durability_parse(const std::string &name, Durability *out);
+
+/**
+ * Rename the file to its final name, and make both the content and the name
+ * durable according to the mode.
+ *
+ * With Durability::Group, the first upload committing on a disk opens a batch
+ * that the next ones join, for -local_group_commit_delay milliseconds or
+ * -local_group_commit_max uploads. The whole batch is then flushed at once by
+ * the threads of the disk: a fsync() for each file, then a fsync() for each
+ * parent directory, or a single syncfs() when the batch spans more than
+ * -local_group_commit_syncfs directories.
+ *
+ * @param io bound to the disk of the file
+ * @param fd the open file, still open on return
+ * @param renamed set to true if the file is at its final name, even if the
+ *        flush failed
+ * @return 0 or the errno of the first failure
+ */
+int durable_rename(DiskIO *io, int fd, const std::string &from,
+        const std::string &to, Durability mode, bool *renamed);
+
+/**
+ * JSON snapshot of the histograms of the group commits: the size of the
+ * batches, and the time spent by the uploads in durable_rename().
+ */
+void group_commit_stats(std::string *out);
+
+}  // namespace blob
+}  // namespace local
+}  // namespace oio
+
+#endif  // SRC_OIO_BLOB_LOCAL_GROUP_COMMIT_HPP_
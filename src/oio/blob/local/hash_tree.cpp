@@ -0,0 +1,159 @@
+/**
+ * This file is part of the OpenIO client libraries
+ * Copyright (C) 2016 OpenIO SAS
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ */
+
+#include "oio/blob/local/hash_tree.hpp"
+
+#include <sys/stat.h>
+
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+
+#include "utils/macros.h"
+
+using oio::local::blob::HashTree;
+
+#define HASH_TREE_MAX_BITS 24
+
+// The directories known outside of the bitmap, the set is emptied when full
+#define HASH_TREE_MAX_KNOWN 65536
+
+static const char hex_digits[] = "0123456789ABCDEF";
+
+HashTree::HashTree(const std::string &basedir, unsigned int depth,
+                   unsigned int width)
+        : basedir_(basedir), depth_{depth}, width_{width}, bits_(),
+          known_() {
+    const unsigned int nbits = 4 * depth * width;
+    if (nbits > 0 && nbits <= HASH_TREE_MAX_BITS)
+        bits_.resize(((1ULL << nbits) + 63) / 64, 0);
+}
+
+std::string HashTree::dir(const std::string &id) const {
+    std::stringstream ss;
+    ss << basedir_;
+    for (unsigned i = 0; i < depth_; ++i) {
+        auto token = id.substr(i * width_, width_);
+        if (token == "")
+            break;
+        ss << "/" << token;
+    }
+    return ss.str();
+}
+
+std::string HashTree::Path(const std::string &id) const {
+    return dir(id) + "/" + id;
+}
+
+bool HashTree::index(const std::string &id, uint64_t *idx) const {
+    const size_t len = depth_ * width_;
+    if (bits_.empty() || id.size() < len)
+        return false;
+    uint64_t v = 0;
+    for (size_t i = 0; i < len; ++i) {
+        const char c = id[i];
+        if (c >= '0' && c <= '9')
+            v = (v << 4) | (c - '0');
+        else if (c >= 'A' && c <= 'F')
+            v = (v << 4) | (c - 'A' + 10);
+        else
+            return false;
+    }
+    *idx = v;
+    return true;
+}
+
+int HashTree::mkdirs(const std::string &dir, mode_t mode) {
+    if (0 == ::mkdir(dir.c_str(), mode) || errno == EEXIST)
+        return 0;
+    if (errno != ENOENT)
+        return errno;
+    auto slash = dir.rfind('/');
+    if (slash == std::string::npos || slash == 0)
+        return ENOENT;
+    int err = mkdirs(dir.substr(0, slash), mode);
+    if (err != 0)
+        return err;
+    if (0 == ::mkdir(dir.c_str(), mode) || errno == EEXIST)
+        return 0;
+    return errno;
+}
+
+int HashTree::Ensure(const std::string &id, mode_t mode) {
+    uint64_t idx{0};
+    const bool cached = index(id, &idx);
+    if (cached && test(idx))
+        return 0;
+    auto path = dir(id);
+    if (!cached && known_.count(path) > 0)
+        return 0;
+    int err = mkdirs(path, mode);
+    if (err != 0)
+        return err;
+    if (cached) {
+        set(idx);
+    } else {
+        if (known_.size() >= HASH_TREE_MAX_KNOWN)
+            known_.clear();
+        known_.insert(std::move(path));
+    }
+    return 0;
+}
+
+void HashTree::Forget(const std::string &id) {
+    uint64_t idx{0};
+    if (index(id, &idx))
+        clear(idx);
+    else
+        known_.erase(dir(id));
+}
+
+bool HashTree::precreate(const std::string &dir, unsigned int level,
+                         mode_t mode) {
+    if (level == depth_)
+        return true;
+    std::string token(width_, '0');
+    const uint64_t count = 1ULL << (4 * width_);
+    for (uint64_t i = 0; i < count; ++i) {
+        for (unsigned int c = 0; c < width_; ++c)
+            token[width_ - 1 - c] = hex_digits[(i >> (4 * c)) & 0xF];
+        const std::string sub = dir + "/" + token;
+        if (0 != ::mkdir(sub.c_str(), mode) && errno != EEXIST) {
+            LOG(ERROR) << "mkdir(" << sub << ") failed: (" << errno << ") "
+                       << ::strerror(errno);
+            return false;
+        }
+        if (!precreate(sub, level + 1, mode))
+            return false;
+    }
+    return true;
+}
+
+bool HashTree::Precreate(mode_t mode) {
+    if (depth_ == 0 || width_ == 0)
+        return true;
+    if (bits_.empty()) {
+        LOG(ERROR) << "Hash tree too large to be precreated";
+        return false;
+    }
+    if (0 != mkdirs(basedir_, mode) || !precreate(basedir_, 0, mode))
+        return false;
+    for (auto &w : bits_)
+        w = ~0ULL;
+    return true;
+}
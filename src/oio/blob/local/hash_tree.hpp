@@ -0,0 +1,100 @@
+/**
+ * This file is part of the OpenIO client libraries
+ * Copyright (C) 2016 OpenIO SAS
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ */
+
+#ifndef SRC_OIO_BLOB_LOCAL_HASH_TREE_HPP_
+#define SRC_OIO_BLOB_LOCAL_HASH_TREE_HPP_
+
+#include <sys/types.h>
+
+#include <cstdint>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace oio {
+namespace local {
+namespace blob {
+
+/**
+ * The tree of directories spreading the chunks of a docroot: the first
+ * depth x width characters of the chunk ID name the directories leading to
+ * the chunk.
+ *
+ * A bitmap of the leaf directories known to exist spares the failed open()
+ * and the mkdir() retries on the upload path. It covers the uppercase
+ * hexadecimal IDs when the tree has at most 2^24 leaves, a bounded set of
+ * paths covers the other IDs, e.g. the lowercase ones whose directories
+ * differ.
+ */
+class HashTree {
+ public:
+    HashTree(const std::string &basedir, unsigned int depth,
+             unsigned int width);
+
+    /** @return the path of the chunk */
+    std::string Path(const std::string &id) const;
+
+    /**
+     * Create all the directories of the tree, then mark them as existing.
+     * @return false if the tree is too large, or upon a mkdir() failure
+     */
+    bool Precreate(mode_t mode);
+
+    /**
+     * Make sure the directory of the chunk exists.
+     * @return 0 or the errno of the mkdir() that failed
+     */
+    int Ensure(const std::string &id, mode_t mode);
+
+    /**
+     * Forget the directory of the chunk, e.g. when an open() in it failed
+     * with ENOENT. The next Ensure() creates it again.
+     */
+    void Forget(const std::string &id);
+
+ private:
+    /** @return false if the ID cannot be mapped to a bit */
+    bool index(const std::string &id, uint64_t *idx) const;
+
+    bool test(uint64_t idx) const {
+        return bits_[idx / 64] & (1ULL << (idx % 64));
+    }
+
+    void set(uint64_t idx) { bits_[idx / 64] |= 1ULL << (idx % 64); }
+
+    void clear(uint64_t idx) { bits_[idx / 64] &= ~(1ULL << (idx % 64)); }
+
+    /** @return the directory holding the chunk */
+    std::string dir(const std::string &id) const;
+
+    int mkdirs(const std::string &dir, mode_t mode);
+
+    bool precreate(const std::string &dir, unsigned int level, mode_t mode);
+
+ private:
+    std::string basedir_;
+    unsigned int depth_, width_;
+    std::vector<uint64_t> bits_;
+    std::unordered_set<std::string> known_;
+};
+
+}  // namespace blob
+}  // namespace local
+}  // namespace oio
+
+#endif  // SRC_OIO_BLOB_LOCAL_HASH_TREE_HPP_
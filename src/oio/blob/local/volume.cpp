@@ -0,0 +1,236 @@
+/**
+ * This file is part of the OpenIO client libraries
+ * Copyright (C) 2016 OpenIO SAS
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ */
+
+#include "oio/blob/local/volume.hpp"
+
+#include <sys/statvfs.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+
+#include <cassert>
+#include <cmath>
+#include <utility>
+
+#include "oio/blob/local/disk_io.hpp"
+
+using oio::local::blob::DiskIO;
+using oio::local::blob::Placement;
+using oio::local::blob::Volume;
+using oio::local::blob::VolumeOp;
+using oio::local::blob::VolumeSet;
+
+static uint64_t _fnv1a(const std::string &s, uint64_t h) {
+    for (auto c : s) {
+        h ^= static_cast<uint8_t>(c);
+        h *= 0x100000001b3ULL;
+    }
+    // Final avalanche, the IDs often share their prefix
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+}
+
+bool oio::local::blob::placement_parse(const std::string &s,
+                                       Placement *out) {
+    assert(out != nullptr);
+    if (s == "hash")
+        *out = Placement::Hash;
+    else if (s == "space")
+        *out = Placement::Space;
+    else
+        return false;
+    return true;
+}
+
+Volume::Volume(const std::string &root, unsigned int depth,
+               unsigned int width, unsigned int concurrency)
+        : root_(root), tree_(root, depth, width), root_fd_{-1},
+          concurrency_{concurrency},
+          slots_{nullptr}, free_{0}, free_checked_{0}, inflight_{0},
+          waiting_{0}, waited_{0}, ops_{0, 0, 0} {
+    if (concurrency_ > 0) {
+        // A token per slot, taken by Acquire() and given back by Release()
+        slots_ = chmake(bool, concurrency_);
+        for (unsigned int i = 0; i < concurrency_; ++i)
+            chs(slots_, bool, true);
+    }
+}
+
+Volume::~Volume() {
+    if (slots_ != nullptr)
+        chclose(slots_);
+    if (root_fd_ >= 0)
+        ::close(root_fd_);
+}
+
+uint64_t Volume::FreeBytes() {
+    const int64_t now = mill_now();
+    if (free_checked_ == 0 || now - free_checked_ >= 1000) {
+        struct statvfs st;
+        if (0 == ::statvfs(root_.c_str(), &st))
+            free_ = static_cast<uint64_t>(st.f_bavail) * st.f_frsize;
+        free_checked_ = now;
+    }
+    return free_;
+}
+
+bool Volume::Holds(const std::string &id) {
+    // The root may only exist once the hash tree has been created
+    if (root_fd_ < 0)
+        root_fd_ = ::open(root_.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    DiskIO io;
+    if (root_fd_ >= 0)
+        io.Bind(root_fd_);
+    const auto path = tree_.Path(id);
+    return 0 == io.Run([&path]() -> ssize_t {
+        return ::access(path.c_str(), F_OK);
+    });
+}
+
+void Volume::Acquire(VolumeOp op) {
+    ops_[static_cast<int>(op)]++;
+    if (slots_ != nullptr) {
+        if (inflight_ >= concurrency_)
+            waited_++;
+        waiting_++;
+        bool token = chr(slots_, bool);
+        (void) token;
+        waiting_--;
+    }
+    inflight_++;
+}
+
+void Volume::Release() {
+    assert(inflight_ > 0);
+    inflight_--;
+    if (slots_ != nullptr)
+        chs(slots_, bool, true);
+}
+
+VolumeSet::VolumeSet(Placement placement)
+        : placement_{placement}, scattered_{false}, volumes_() {}
+
+void VolumeSet::Add(std::shared_ptr<Volume> vol) {
+    volumes_.emplace_back(std::move(vol));
+}
+
+size_t VolumeSet::hashed(const std::string &id) const {
+    // Rendezvous hashing: adding a volume only moves the chunks it wins
+    const uint64_t h = _fnv1a(id, 0xcbf29ce484222325ULL);
+    size_t best = 0;
+    uint64_t best_score = 0;
+    for (size_t i = 0; i < volumes_.size(); ++i) {
+        const uint64_t score = _fnv1a(volumes_[i]->Root(), h);
+        if (i == 0 || score > best_score) {
+            best = i;
+            best_score = score;
+        }
+    }
+    return best;
+}
+
+std::shared_ptr<Volume> VolumeSet::Pick(const std::string &id) {
+    assert(!volumes_.empty());
+    if (volumes_.size() == 1 || placement_ == Placement::Hash)
+        return volumes_[hashed(id)];
+
+    // Weighted rendezvous hashing, the weight being the free space. The
+    // uploads are spread in proportion, instead of all rushing to the
+    // emptiest volume until its free space is checked again.
+    const uint64_t h = _fnv1a(id, 0xcbf29ce484222325ULL);
+    size_t best = 0;
+    double best_score = -1.0;
+    for (size_t i = 0; i < volumes_.size(); ++i) {
+        const double weight = volumes_[i]->FreeBytes();
+        if (weight <= 0)
+            continue;
+        const uint64_t r = _fnv1a(volumes_[i]->Root(), h);
+        // Uniform in (0,1), never 0 nor 1
+        const double u = (static_cast<double>(r >> 11) + 0.5) / (1ULL << 53);
+        const double score = -weight / std::log(u);
+        if (score > best_score) {
+            best = i;
+            best_score = score;
+        }
+    }
+    if (best_score < 0)
+        return volumes_[hashed(id)];
+    return volumes_[best];
+}
+
+std::shared_ptr<Volume> VolumeSet::Find(const std::string &id) {
+    assert(!volumes_.empty());
+    if (volumes_.size() == 1)
+        return volumes_[0];
+    if (!Scattered())
+        return volumes_[hashed(id)];
+    auto vol = Locate(id);
+    return vol ? vol : volumes_[hashed(id)];
+}
+
+std::shared_ptr<Volume> VolumeSet::Locate(const std::string &id) {
+    assert(!volumes_.empty());
+    // The chunk is most likely where the hash puts it, unless it has been
+    // placed by the free space or before a volume has been added.
+    const size_t first = hashed(id);
+    if (volumes_[first]->Holds(id))
+        return volumes_[first];
+    if (!Scattered())
+        return nullptr;
+    for (size_t i = 0; i < volumes_.size(); ++i) {
+        if (i == first)
+            continue;
+        if (volumes_[i]->Holds(id))
+            return volumes_[i];
+    }
+    return nullptr;
+}
+
+void VolumeSet::Stats(std::string *out) {
+    assert(out != nullptr);
+    rapidjson::StringBuffer buf;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(buf);
+    writer.StartObject();
+    for (const auto &vol : volumes_) {
+        writer.Key(vol->root_.c_str());
+        writer.StartObject();
+        writer.Key("free");
+        writer.Uint64(vol->FreeBytes());
+        writer.Key("concurrency");
+        writer.Uint(vol->concurrency_);
+        writer.Key("inflight");
+        writer.Uint64(vol->inflight_);
+        writer.Key("waiting");
+        writer.Uint64(vol->waiting_);
+        writer.Key("waited");
+        writer.Uint64(vol->waited_);
+        writer.Key("upload");
+        writer.Uint64(vol->ops_[static_cast<int>(VolumeOp::Upload)]);
+        writer.Key("download");
+        writer.Uint64(vol->ops_[static_cast<int>(VolumeOp::Download)]);
+        writer.Key("removal");
+        writer.Uint64(vol->ops_[static_cast<int>(VolumeOp::Removal)]);
+        writer.EndObject();
+    }
+    writer.EndObject();
+    out->assign(buf.GetString(), buf.GetSize());
+}
@@ -0,0 +1,161 @@
+/**
+ * This file is part of the OpenIO client libraries
+ * Copyright (C) 2016 OpenIO SAS
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ */
+
+#ifndef SRC_OIO_BLOB_LOCAL_VOLUME_HPP_
+#define SRC_OIO_BLOB_LOCAL_VOLUME_HPP_
+
+#include <libmill.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "utils/macros.h"
+#include "oio/blob/local/hash_tree.hpp"
+
+namespace oio {
+namespace local {
+namespace blob {
+
+enum class Placement {
+    Hash,  // the chunk ID alone decides, the volumes are evenly filled
+    Space  // the free space weighs the choice
+};
+
+/**
+ * @param s 'hash' or 'space'
+ * @return false if 's' is not a placement
+ */
+bool placement_parse(const std::string &s, Placement *out);
+
+enum class VolumeOp { Upload, Download, Removal };
+
+/**
+ * A filesystem holding chunks, with its own hash tree and its own limit of
+ * concurrent transactions. The file I/O of the volume run in the threads of
+ * its disk (see DiskIO), so that a slow volume only delays its own
+ * transactions.
+ */
+class Volume {
+ public:
+    /**
+     * @param concurrency the maximum number of transactions at once, 0 for
+     *                    no limit
+     */
+    Volume(const std::string &root, unsigned int depth, unsigned int width,
+           unsigned int concurrency);
+
+    ~Volume();
+
+    const std::string &Root() const { return root_; }
+
+    HashTree &Tree() { return tree_; }
+
+    /** @return the space available, refreshed at most once per second */
+    uint64_t FreeBytes();
+
+    /**
+     * Check the chunk is present, in a thread of the disk.
+     * @return true if the volume holds the chunk
+     */
+    bool Holds(const std::string &id);
+
+    /**
+     * Park the calling coroutine until the volume accepts one more
+     * transaction. Each Acquire() must be followed by a Release().
+     */
+    void Acquire(VolumeOp op);
+
+    void Release();
+
+ private:
+    friend class VolumeSet;
+
+    FORBID_COPY_CTOR(Volume);
+    FORBID_MOVE_CTOR(Volume);
+
+    std::string root_;
+    HashTree tree_;
+    int root_fd_;
+    unsigned int concurrency_;
+    chan slots_;
+    uint64_t free_;
+    int64_t free_checked_;
+    uint64_t inflight_;
+    uint64_t waiting_;
+    uint64_t waited_;
+    uint64_t ops_[3];
+};
+
+/**
+ * The volumes of a repository, and the placement of the chunks on them.
+ */
+class VolumeSet {
+ public:
+    explicit VolumeSet(Placement placement);
+
+    void Add(std::shared_ptr<Volume> vol);
+
+    size_t Size() const { return volumes_.size(); }
+
+    std::shared_ptr<Volume> At(size_t i) const { return volumes_[i]; }
+
+    /** @return the volume that should receive a new chunk */
+    std::shared_ptr<Volume> Pick(const std::string &id);
+
+    /**
+     * @return the volume holding the chunk, the one it would be hashed on
+     *         if none holds it
+     */
+    std::shared_ptr<Volume> Find(const std::string &id);
+
+    /**
+     * Only the hashed volume is checked, unless the chunks are scattered.
+     * @return the volume holding the chunk, nullptr if none holds it
+     */
+    std::shared_ptr<Volume> Locate(const std::string &id);
+
+    /**
+     * Tell the chunks might lie elsewhere than on their hashed volume, e.g.
+     * the volumes changed since they have been placed.
+     */
+    void SetScattered(bool on) { scattered_ = on; }
+
+    /** @return true if a chunk might lie on any volume */
+    bool Scattered() const {
+        return scattered_ || placement_ == Placement::Space;
+    }
+
+    /** Dump the counters of all the volumes as a JSON object */
+    void Stats(std::string *out);
+
+ private:
+    /** @return the index of the volume with the highest score for 'id' */
+    size_t hashed(const std::string &id) const;
+
+    Placement placement_;
+    bool scattered_;
+    std::vector<std::shared_ptr<Volume>> volumes_;
+};
+
+}  // namespace blob
+}  // namespace local
+}  // namespace oio
+
+#endif  // SRC_OIO_BLOB_LOCAL_VOLUME_HPP_
@@ -0,0 +1,215 @@
+/**
+ * This file is part of the OpenIO client libraries
+ * Copyright (C) 2016 OpenIO SAS
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ */
+
+#include "oio/blob/local/xattr.hpp"
+
+#include <sys/types.h>
+#include <attr/xattr.h>
+
+#include <cassert>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+using oio::local::blob::XattrLayout;
+
+#define XATTR_PREFIX "user.grid."
+#define XATTR_PACKED XATTR_PREFIX "packed"
+#define XATTR_VERSION 1
+
+namespace {
+
+// The attributes set by oio-rawx, their tag is their index + 1
+const char *known_keys[] = {
+    "container.id", "content.id", "content.path", "content.hash",
+    "content.size", "chunk.id", "chunk.hash", "chunk.size", "chunk.pos",
+};
+
+const unsigned int nb_known_keys = sizeof(known_keys) / sizeof(known_keys[0]);
+
+uint8_t _tag(const std::string &k) {
+    for (unsigned int i = 0; i < nb_known_keys; ++i) {
+        if (k == known_keys[i])
+            return i + 1;
+    }
+    return 0;
+}
+
+void _put_varint(std::string *out, uint64_t v) {
+    while (v >= 0x80) {
+        out->push_back(static_cast<char>((v & 0x7F) | 0x80));
+        v >>= 7;
+    }
+    out->push_back(static_cast<char>(v));
+}
+
+bool _get_varint(const std::string &in, size_t *pos, uint64_t *v) {
+    *v = 0;
+    for (unsigned int shift = 0; shift < 64; shift += 7) {
+        if (*pos >= in.size())
+            return false;
+        const uint8_t b = in[(*pos)++];
+        *v |= static_cast<uint64_t>(b & 0x7F) << shift;
+        if (!(b & 0x80))
+            return true;
+    }
+    return false;
+}
+
+bool _get_string(const std::string &in, size_t *pos, std::string *s) {
+    uint64_t len;
+    if (!_get_varint(in, pos, &len) || len > in.size() - *pos)
+        return false;
+    s->assign(in, *pos, len);
+    *pos += len;
+    return true;
+}
+
+int _load_packed(int fd, std::string *raw) {
+    raw->resize(4096);
+    for (;;) {
+        ssize_t rc = ::fgetxattr(fd, XATTR_PACKED, &(*raw)[0], raw->size());
+        if (rc >= 0) {
+            raw->resize(rc);
+            return 0;
+        }
+        if (errno != ERANGE)
+            return errno;
+        rc = ::fgetxattr(fd, XATTR_PACKED, nullptr, 0);
+        if (rc < 0)
+            return errno;
+        raw->resize(rc);
+    }
+}
+
+int _load_split(int fd, std::map<std::string, std::string> *out) {
+    ssize_t rc = ::flistxattr(fd, nullptr, 0);
+    if (rc < 0)
+        return errno;
+    std::vector<char> names(rc + 1, 0);
+    rc = ::flistxattr(fd, names.data(), rc);
+    if (rc < 0)
+        return errno;
+
+    const size_t plen = sizeof(XATTR_PREFIX) - 1;
+    for (const char *n = names.data(); n < names.data() + rc;
+            n += ::strlen(n) + 1) {
+        if (0 != ::strncmp(n, XATTR_PREFIX, plen) ||
+                0 == ::strcmp(n, XATTR_PACKED))
+            continue;
+        ssize_t len = ::fgetxattr(fd, n, nullptr, 0);
+        if (len < 0)
+            return errno;
+        std::string v(len, '\0');
+        len = ::fgetxattr(fd, n, &v[0], v.size());
+        if (len < 0)
+            return errno;
+        v.resize(len);
+        (*out)[std::string(n + plen)] = std::move(v);
+    }
+    return 0;
+}
+
+}  // namespace
+
+bool oio::local::blob::xattr_layout_parse(const std::string &name,
+        XattrLayout *out) {
+    assert(out != nullptr);
+    if (name == "split")
+        *out = XattrLayout::Split;
+    else if (name == "packed")
+        *out = XattrLayout::Packed;
+    else if (name == "both")
+        *out = XattrLayout::Both;
+    else
+        return false;
+    return true;
+}
+
+void oio::local::blob::xattr_pack(
+        const std::map<std::string, std::string> &attrs, std::string *out) {
+    assert(out != nullptr);
+    out->clear();
+    out->push_back(XATTR_VERSION);
+    for (const auto &e : attrs) {
+        const uint8_t tag = _tag(e.first);
+        out->push_back(static_cast<char>(tag));
+        if (tag == 0) {
+            _put_varint(out, e.first.size());
+            out->append(e.first);
+        }
+        _put_varint(out, e.second.size());
+        out->append(e.second);
+    }
+}
+
+bool oio::local::blob::xattr_unpack(const std::string &in,
+        std::map<std::string, std::string> *out) {
+    assert(out != nullptr);
+    if (in.empty() || in[0] != XATTR_VERSION)
+        return false;
+    size_t pos = 1;
+    while (pos < in.size()) {
+        const uint8_t tag = in[pos++];
+        std::string k, v;
+        if (tag > nb_known_keys)
+            return false;
+        if (tag > 0)
+            k.assign(known_keys[tag - 1]);
+        else if (!_get_string(in, &pos, &k))
+            return false;
+        if (!_get_string(in, &pos, &v))
+            return false;
+        (*out)[k] = std::move(v);
+    }
+    return true;
+}
+
+int oio::local::blob::xattr_save(int fd,
+        const std::map<std::string, std::string> &attrs, XattrLayout layout) {
+    int err = 0;
+    if (layout != XattrLayout::Packed) {
+        for (const auto &e : attrs) {
+            const std::string k = XATTR_PREFIX + e.first;
+            if (0 != ::fsetxattr(fd, k.c_str(), e.second.data(),
+                                 e.second.size(), 0) && err == 0)
+                err = errno;
+        }
+    }
+    if (layout != XattrLayout::Split) {
+        std::string packed;
+        xattr_pack(attrs, &packed);
+        if (0 != ::fsetxattr(fd, XATTR_PACKED, packed.data(), packed.size(),
+                             0) && err == 0)
+            err = errno;
+    }
+    return err;
+}
+
+int oio::local::blob::xattr_load(int fd,
+        std::map<std::string, std::string> *out) {
+    assert(out != nullptr);
+    std::string raw;
+    int err = _load_packed(fd, &raw);
+    if (err == ENODATA)
+        return _load_split(fd, out);
+    if (err != 0)
+        return err;
+    return xattr_unpack(raw, out) ? 0 : EINVAL;
+}
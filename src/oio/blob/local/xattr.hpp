@@ -0,0 +1,76 @@
+/**
+ * This file is part of the OpenIO client libraries
+ * Copyright (C) 2016 OpenIO SAS
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ */
+
+#ifndef SRC_OIO_BLOB_LOCAL_XATTR_HPP_
+#define SRC_OIO_BLOB_LOCAL_XATTR_HPP_
+
+#include <map>
+#include <string>
+
+namespace oio {
+namespace local {
+namespace blob {
+
+/**
+ * How the attributes of a blob are stored in the xattr of its file.
+ */
+enum class XattrLayout {
+    Split,   // one "user.grid.<key>" xattr per attribute
+    Packed,  // a single "user.grid.packed" xattr holding all of them
+    Both     // both layouts, for readers still expecting the split one
+};
+
+/**
+ * @param name one of "split", "packed", "both"
+ * @return false if the name is unknown, and then 'out' is untouched
+ */
+bool xattr_layout_parse(const std::string &name, XattrLayout *out);
+
+/**
+ * Encode the attributes as a version byte followed by TLV records: a tag,
+ * the key itself if the tag is 0 (the well-known chunk attributes have their
+ * own tag), then the length of the value as a varint, then the value.
+ */
+void xattr_pack(const std::map<std::string, std::string> &attrs,
+        std::string *out);
+
+/**
+ * @return false if the record is malformed, 'out' then holds the attributes
+ *         decoded before the error
+ */
+bool xattr_unpack(const std::string &in,
+        std::map<std::string, std::string> *out);
+
+/**
+ * @return 0 or the errno of the first failure
+ */
+int xattr_save(int fd, const std::map<std::string, std::string> &attrs,
+        XattrLayout layout);
+
+/**
+ * Load the packed record with a single syscall, or the split layout if the
+ * file has no packed record.
+ * @return 0 or an errno
+ */
+int xattr_load(int fd, std::map<std::string, std::string> *out);
+
+}  // namespace blob
+}  // namespace local
+}  // namespace oio
+
+#endif  // SRC_OIO_BLOB_LOCAL_XATTR_HPP_
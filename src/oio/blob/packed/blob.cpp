@@ -0,0 +1,963 @@
+/**
+ * This file is part of the OpenIO client libraries
+ * Copyright (C) 2016 OpenIO SAS
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ */
+
+#include "oio/blob/packed/blob.hpp"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <libmill.h>
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+
+#include "utils/utils.hpp"
+#include "oio/blob/local/xattr.hpp"
+
+using oio::api::Cause;
+using oio::api::Errno;
+using oio::api::Status;
+using oio::local::blob::DiskIO;
+using oio::packed::blob::DownloadBuilder;
+using oio::packed::blob::RemovalBuilder;
+using oio::packed::blob::Store;
+using oio::packed::blob::UploadBuilder;
+using Step = oio::api::blob::TransactionStep;
+
+DECLARE_uint64(mode_create);
+DECLARE_uint64(read_batch_size);
+
+DEFINE_uint64(packed_segment_size, 256 * 1024 * 1024,
+              "Size beyond which a new segment is started");
+DEFINE_double(packed_compact_ratio, 0.5,
+              "Share of dead bytes from which a segment is compacted");
+DEFINE_bool(packed_fsync, false,
+            "Flush the blob then its index entry before acknowledging");
+
+#define ENTRY_PUT 1
+#define ENTRY_TOMBSTONE 2
+
+struct Store::Segment {
+    uint64_t id;
+    std::string path_seg, path_idx;
+    int fd_seg, fd_idx;
+    uint64_t size;      // bytes reserved in the segment
+    uint64_t idx_size;  // bytes written in the index log
+    uint64_t live;      // bytes of the blobs indexed in the segment
+    uint64_t count;     // blobs indexed in the segment
+    bool sealed;        // a write failed, nothing is appended anymore
+    chan idx_lock;      // a token, held while the index log is written
+    // The writes completed on the segment and on its log, and how many of
+    // them are known durable.
+    uint64_t seg_writes, seg_synced;
+    uint64_t idx_writes, idx_synced;
+    bool dir_synced;    // the directory entries of the files are durable
+    chan flush_lock;    // a token, held while a file is flushed
+
+    Segment() : id{0}, path_seg(), path_idx(), fd_seg{-1}, fd_idx{-1},
+                size{0}, idx_size{0}, live{0}, count{0}, sealed{false},
+                idx_lock{chmake(bool, 1)}, seg_writes{0}, seg_synced{0},
+                idx_writes{0}, idx_synced{0}, dir_synced{true},
+                flush_lock{chmake(bool, 1)} {
+        chs(idx_lock, bool, true);
+        chs(flush_lock, bool, true);
+    }
+
+    ~Segment() {
+        chclose(flush_lock);
+        chclose(idx_lock);
+        if (fd_seg >= 0)
+            ::close(fd_seg);
+        if (fd_idx >= 0)
+            ::close(fd_idx);
+    }
+
+    void Lock() {
+        bool token = chr(idx_lock, bool);
+        (void) token;
+    }
+
+    void Unlock() { chs(idx_lock, bool, true); }
+
+    void LockFlush() {
+        bool token = chr(flush_lock, bool);
+        (void) token;
+    }
+
+    void UnlockFlush() { chs(flush_lock, bool, true); }
+};
+
+namespace {
+
+/** A record of the index log, stored in the byte order of the host */
+struct Entry {
+    uint8_t kind;
+    uint64_t segment;
+    uint64_t offset;
+    uint32_t length;
+    uint32_t crc;
+    std::string id;
+    std::string attrs;
+};
+
+template<typename T>
+void _put(std::string *out, T v) {
+    out->append(reinterpret_cast<const char *>(&v), sizeof(v));
+}
+
+template<typename T>
+bool _get(const std::string &in, size_t *pos, T *v) {
+    if (in.size() - *pos < sizeof(T))
+        return false;
+    ::memcpy(v, in.data() + *pos, sizeof(T));
+    *pos += sizeof(T);
+    return true;
+}
+
+bool _get_str(const std::string &in, size_t *pos, size_t len,
+              std::string *out) {
+    if (in.size() - *pos < len)
+        return false;
+    out->assign(in, *pos, len);
+    *pos += len;
+    return true;
+}
+
+/** [u32 len][kind, segment, offset, length, crc, id, attrs][u32 crc] */
+void _encode(const Entry &e, std::string *out) {
+    std::string body;
+    _put(&body, e.kind);
+    _put(&body, e.segment);
+    _put(&body, e.offset);
+    _put(&body, e.length);
+    _put(&body, e.crc);
+    _put(&body, static_cast<uint16_t>(e.id.size()));
+    body.append(e.id);
+    _put(&body, static_cast<uint32_t>(e.attrs.size()));
+    body.append(e.attrs);
+
+    out->clear();
+    _put(out, static_cast<uint32_t>(body.size()));
+    out->append(body);
+    _put(out, compute_crc32c(body.data(), body.size()));
+}
+
+/**
+ * @return false if the log is truncated or corrupted at 'pos'
+ */
+bool _decode(const std::string &in, size_t *pos, Entry *e) {
+    size_t p = *pos;
+    uint32_t len{0}, crc{0};
+    if (!_get(in, &p, &len) || in.size() - p < len + sizeof(crc))
+        return false;
+    std::string body(in, p, len);
+    p += len;
+    _get(in, &p, &crc);
+    if (crc != compute_crc32c(body.data(), body.size()))
+        return false;
+
+    size_t b = 0;
+    uint16_t idlen{0};
+    uint32_t attrlen{0};
+    if (!_get(body, &b, &e->kind) || !_get(body, &b, &e->segment) ||
+        !_get(body, &b, &e->offset) || !_get(body, &b, &e->length) ||
+        !_get(body, &b, &e->crc) || !_get(body, &b, &idlen) ||
+        !_get_str(body, &b, idlen, &e->id) || !_get(body, &b, &attrlen) ||
+        !_get_str(body, &b, attrlen, &e->attrs))
+        return false;
+    *pos = p;
+    return true;
+}
+
+std::string _name(const std::string &dir, uint64_t id, const char *ext) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "/%016" PRIX64 ".%s", id, ext);
+    return dir + buf;
+}
+
+/** pwrite() the whole buffer, retrying on partial writes */
+ssize_t _pwrite(DiskIO *io, int fd, const void *buf, size_t len,
+                uint64_t offset) {
+    return io->Run([fd, buf, len, offset]() -> ssize_t {
+        auto p = static_cast<const uint8_t *>(buf);
+        size_t done = 0;
+        while (done < len) {
+            ssize_t rc = ::pwrite64(fd, p + done, len - done, offset + done);
+            if (rc < 0) {
+                if (errno == EINTR)
+                    continue;
+                return -1;
+            }
+            done += rc;
+        }
+        return static_cast<ssize_t>(len);
+    });
+}
+
+ssize_t _pread(DiskIO *io, int fd, void *buf, size_t len, uint64_t offset) {
+    return io->Run([fd, buf, len, offset]() -> ssize_t {
+        auto p = static_cast<uint8_t *>(buf);
+        size_t done = 0;
+        while (done < len) {
+            ssize_t rc = ::pread64(fd, p + done, len - done, offset + done);
+            if (rc < 0) {
+                if (errno == EINTR)
+                    continue;
+                return -1;
+            }
+            if (rc == 0)
+                break;
+            done += rc;
+        }
+        return static_cast<ssize_t>(done);
+    });
+}
+
+int _fdatasync(DiskIO *io, int fd) {
+    return io->Run([fd]() -> ssize_t { return ::fdatasync(fd); });
+}
+
+/** Flush the entries of the directory, i.e. the files created there */
+int _fsync_dir(DiskIO *io, const std::string &dir) {
+    const int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    io->Bind(fd);
+    const int rc = io->Run([fd]() -> ssize_t { return ::fsync(fd); });
+    const int err = errno;
+    ::close(fd);
+    errno = err;
+    return rc;
+}
+
+}  // namespace
+
+Store::Store(const std::string &dir)
+        : dir_(dir), segments_(), index_(), reserved_(),
+          compacting_{false},
+          durability_{oio::local::blob::Durability::None} {}
+
+Store::~Store() {}
+
+Status Store::openSegment(uint64_t id, bool create,
+                          std::shared_ptr<Segment> *out) {
+    std::shared_ptr<Segment> seg(new Segment);
+    seg->id = id;
+    seg->path_seg = _name(dir_, id, "seg");
+    seg->path_idx = _name(dir_, id, "idx");
+    const int flags = O_RDWR | O_CLOEXEC | (create ? O_CREAT | O_EXCL : 0);
+    seg->fd_seg = ::open(seg->path_seg.c_str(), flags, FLAGS_mode_create);
+    if (seg->fd_seg < 0)
+        return Errno();
+    seg->fd_idx = ::open(seg->path_idx.c_str(), O_RDWR | O_CLOEXEC | O_CREAT,
+                         FLAGS_mode_create);
+    if (seg->fd_idx < 0)
+        return Errno();
+
+    struct stat64 st;
+    if (0 != ::fstat64(seg->fd_seg, &st))
+        return Errno();
+    seg->size = st.st_size;
+    if (0 != ::fstat64(seg->fd_idx, &st))
+        return Errno();
+    seg->idx_size = st.st_size;
+    *out = seg;
+    return Status();
+}
+
+Status Store::replay(const std::shared_ptr<Segment> &seg) {
+    std::string log(seg->idx_size, '\0');
+    ssize_t rc = ::pread64(seg->fd_idx, &log[0], log.size(), 0);
+    if (rc < 0)
+        return Errno();
+    log.resize(rc);
+
+    size_t pos = 0;
+    Entry e;
+    while (pos < log.size()) {
+        if (!_decode(log, &pos, &e))
+            break;
+        if (e.kind == ENTRY_PUT) {
+            // The blob itself may have been lost with the tail of the segment
+            if (e.offset + e.length > seg->size)
+                continue;
+            forget(e.id);
+            Blob b{seg, e.offset, e.length, e.crc, {}};
+            if (!oio::local::blob::xattr_unpack(e.attrs, &b.attrs))
+                LOG(WARNING) << "Invalid attributes of " << e.id << " in "
+                             << seg->path_idx;
+            index_[e.id] = std::move(b);
+            seg->live += e.length;
+            seg->count++;
+        } else if (e.kind == ENTRY_TOMBSTONE) {
+            // Only the incarnation it targets is removed
+            auto it = index_.find(e.id);
+            if (it != index_.end() && it->second.segment->id == e.segment &&
+                it->second.offset == e.offset)
+                forget(e.id);
+        }
+    }
+
+    // Drop the torn tail, so that the next entries are reachable
+    if (pos < seg->idx_size) {
+        LOG(WARNING) << "Truncating " << seg->path_idx << " from "
+                     << seg->idx_size << " to " << pos;
+        if (0 != ::ftruncate(seg->fd_idx, pos))
+            return Errno();
+        seg->idx_size = pos;
+    }
+    return Status();
+}
+
+Status Store::Open() {
+    if (0 != ::mkdir(dir_.c_str(), 0755) && errno != EEXIST)
+        return Errno();
+    DIR *d = ::opendir(dir_.c_str());
+    if (d == nullptr)
+        return Errno();
+    std::vector<uint64_t> ids;
+    while (struct dirent *de = ::readdir(d)) {
+        uint64_t id{0};
+        char ext[8];
+        if (2 == sscanf(de->d_name, "%16" SCNx64 ".%3s", &id, ext) &&
+            0 == ::strcmp(ext, "seg") && ::strlen(de->d_name) == 20)
+            ids.push_back(id);
+    }
+    ::closedir(d);
+    std::sort(ids.begin(), ids.end());
+
+    for (auto id : ids) {
+        std::shared_ptr<Segment> seg;
+        auto rc = openSegment(id, false, &seg);
+        if (!rc.Ok())
+            return rc;
+        rc = replay(seg);
+        if (!rc.Ok())
+            return rc;
+        segments_[id] = seg;
+    }
+    LOG(INFO) << "Packed store " << dir_ << " loaded with "
+              << segments_.size() << " segments and " << index_.size()
+              << " blobs";
+    return Status();
+}
+
+Status Store::current(std::shared_ptr<Segment> *out) {
+    if (!segments_.empty()) {
+        auto last = segments_.rbegin()->second;
+        if (!last->sealed && last->size < FLAGS_packed_segment_size) {
+            *out = last;
+            return Status();
+        }
+    }
+    const uint64_t id = segments_.empty() ? 1 : segments_.rbegin()->first + 1;
+    std::shared_ptr<Segment> seg;
+    auto rc = openSegment(id, true, &seg);
+    if (!rc.Ok())
+        return rc;
+    seg->dir_synced = false;
+    segments_[id] = seg;
+    *out = seg;
+    return Status();
+}
+
+Status Store::Reserve(const std::string &id) {
+    if (index_.count(id) > 0 || reserved_.count(id) > 0)
+        return Status(Cause::Already);
+    reserved_.insert(id);
+    return Status();
+}
+
+void Store::Release(const std::string &id) {
+    reserved_.erase(id);
+}
+
+void Store::forget(const std::string &id) {
+    auto it = index_.find(id);
+    if (it == index_.end())
+        return;
+    auto &seg = it->second.segment;
+    seg->live -= it->second.length;
+    seg->count--;
+    index_.erase(it);
+}
+
+Status Store::seal(const std::shared_ptr<Segment> &seg, Status rc) {
+    if (!seg->sealed)
+        LOG(ERROR) << "Sealing " << seg->path_seg << ": " << rc.Message();
+    seg->sealed = true;
+    return rc;
+}
+
+Status Store::appendEntry(DiskIO *io, const std::shared_ptr<Segment> &seg,
+                          const std::string &entry) {
+    // One write at once: a failed write must not leave a hole before the
+    // entries appended after it, the replay would stop at the hole.
+    seg->Lock();
+    if (seg->sealed) {
+        seg->Unlock();
+        return Status(Cause::Already);
+    }
+    io->Bind(seg->fd_idx);
+    if (0 > _pwrite(io, seg->fd_idx, entry.data(), entry.size(),
+                    seg->idx_size)) {
+        auto rc = seal(seg, Errno());
+        seg->Unlock();
+        return rc;
+    }
+    seg->idx_size += entry.size();
+    const uint64_t ticket = ++seg->idx_writes;
+    seg->Unlock();
+    if (syncing())
+        return flush(io, seg, true, ticket);
+    return Status();
+}
+
+bool Store::syncing() const {
+    return FLAGS_packed_fsync ||
+           durability_ != oio::local::blob::Durability::None;
+}
+
+Status Store::flush(DiskIO *io, const std::shared_ptr<Segment> &seg,
+                    bool idx, uint64_t ticket) {
+    // One flush at once per segment: the appends queued meanwhile are all
+    // covered by the next one.
+    seg->LockFlush();
+    uint64_t *synced = idx ? &seg->idx_synced : &seg->seg_synced;
+    if (*synced >= ticket) {
+        seg->UnlockFlush();
+        return Status();
+    }
+    const uint64_t upto = idx ? seg->idx_writes : seg->seg_writes;
+    const int fd = idx ? seg->fd_idx : seg->fd_seg;
+    io->Bind(fd);
+    int rc = _fdatasync(io, fd);
+    if (rc == 0 && !seg->dir_synced) {
+        rc = _fsync_dir(io, dir_);
+        seg->dir_synced = (rc == 0);
+    }
+    if (rc != 0) {
+        auto st = seal(seg, Errno());
+        seg->UnlockFlush();
+        return st;
+    }
+    *synced = upto;
+    seg->UnlockFlush();
+    return Status();
+}
+
+Status Store::appendBlob(DiskIO *io, const std::string &id, const Blob &b,
+                         const uint8_t *data, Blob *out) {
+    for (;;) {
+        std::shared_ptr<Segment> seg;
+        auto rc = current(&seg);
+        if (!rc.Ok())
+            return rc;
+
+        const uint64_t offset = seg->size;
+        seg->size += b.length;
+        io->Bind(seg->fd_seg);
+        if (b.length > 0 &&
+            0 > _pwrite(io, seg->fd_seg, data, b.length, offset))
+            return seal(seg, Errno());
+        const uint64_t ticket = ++seg->seg_writes;
+        // The blob must be there before the entry pointing to it
+        if (syncing()) {
+            rc = flush(io, seg, false, ticket);
+            if (!rc.Ok())
+                return rc;
+        }
+
+        Entry e{ENTRY_PUT, seg->id, offset, b.length, b.crc, id, {}};
+        oio::local::blob::xattr_pack(b.attrs, &e.attrs);
+        std::string encoded;
+        _encode(e, &encoded);
+        rc = appendEntry(io, seg, encoded);
+        // Sealed meanwhile by another write, the blob goes to the next one
+        if (rc.Why() == Cause::Already)
+            continue;
+        if (!rc.Ok())
+            return rc;
+
+        *out = b;
+        out->segment = seg;
+        out->offset = offset;
+        return Status();
+    }
+}
+
+Status Store::Append(DiskIO *io, const std::string &id,
+                     const std::map<std::string, std::string> &attrs,
+                     const std::vector<uint8_t> &data) {
+    assert(io != nullptr);
+    assert(reserved_.count(id) > 0);
+    if (data.size() > UINT32_MAX) {
+        Release(id);
+        return Status(Cause::Forbidden);
+    }
+
+    Blob b{nullptr, 0, static_cast<uint32_t>(data.size()),
+           compute_crc32c(data.data(), data.size()), attrs};
+    Blob placed;
+    auto rc = appendBlob(io, id, b, data.data(), &placed);
+    Release(id);
+    if (!rc.Ok()) {
+        LOG(ERROR) << "Packed append(" << id << ") failed: " << rc.Message();
+        return rc;
+    }
+    placed.segment->live += placed.length;
+    placed.segment->count++;
+    index_[id] = std::move(placed);
+    return Status();
+}
+
+Status Store::Lookup(const std::string &id, Blob *out) const {
+    assert(out != nullptr);
+    auto it = index_.find(id);
+    if (it == index_.end())
+        return Status(Cause::NotFound);
+    *out = it->second;
+    return Status();
+}
+
+ssize_t Store::Read(DiskIO *io, const Blob &b, uint64_t offset, uint32_t len,
+                    uint8_t *dst) {
+    assert(io != nullptr);
+    assert(offset + len <= b.length);
+    io->Bind(b.segment->fd_seg);
+    return _pread(io, b.segment->fd_seg, dst, len, b.offset + offset);
+}
+
+Status Store::appendLast(DiskIO *io, const std::string &entry) {
+    for (;;) {
+        std::shared_ptr<Segment> seg;
+        auto rc = current(&seg);
+        if (!rc.Ok())
+            return rc;
+        rc = appendEntry(io, seg, entry);
+        if (rc.Why() != Cause::Already)
+            return rc;
+    }
+}
+
+Status Store::tombstone(DiskIO *io, const std::string &id, const Blob &b) {
+    Entry e{ENTRY_TOMBSTONE, b.segment->id, b.offset, b.length, 0, id, {}};
+    std::string encoded;
+    _encode(e, &encoded);
+    return appendLast(io, encoded);
+}
+
+Status Store::Erase(DiskIO *io, const std::string &id) {
+    assert(io != nullptr);
+    Blob b;
+    auto rc = Lookup(id, &b);
+    if (!rc.Ok())
+        return rc;
+
+    // A compaction may move the blob while the tombstone is written, the
+    // new location then needs its own tombstone.
+    for (;;) {
+        rc = tombstone(io, id, b);
+        if (!rc.Ok())
+            return rc;
+        Blob now;
+        if (!Lookup(id, &now).Ok())
+            return Status();
+        if (now.segment == b.segment && now.offset == b.offset) {
+            forget(id);
+            return Status();
+        }
+        b = now;
+    }
+}
+
+Status Store::compact(DiskIO *io, std::shared_ptr<Segment> seg) {
+    LOG(INFO) << "Compacting " << seg->path_seg << " size=" << seg->size
+              << " live=" << seg->live;
+
+    // The blobs and the tombstones go to this segment and the next ones
+    const uint64_t first_dest = segments_.rbegin()->first;
+
+    // Move the live blobs
+    std::vector<std::string> ids;
+    for (const auto &e : index_) {
+        if (e.second.segment == seg)
+            ids.push_back(e.first);
+    }
+    std::vector<uint8_t> data;
+    for (const auto &id : ids) {
+        Blob b;
+        if (!Lookup(id, &b).Ok() || b.segment != seg)
+            continue;
+        data.resize(b.length);
+        if (b.length != Read(io, b, 0, b.length, data.data()))
+            return Errno();
+        Blob moved;
+        auto rc = appendBlob(io, id, b, data.data(), &moved);
+        if (!rc.Ok())
+            return rc;
+        // Removed meanwhile, the copy must not come back at the next replay
+        auto it = index_.find(id);
+        if (it == index_.end() || it->second.segment != seg ||
+            it->second.offset != b.offset) {
+            rc = tombstone(io, id, moved);
+            if (!rc.Ok())
+                return rc;
+            continue;
+        }
+        forget(id);
+        moved.segment->live += moved.length;
+        moved.segment->count++;
+        index_[id] = std::move(moved);
+    }
+
+    // Carry the tombstones still targeting the older segments, or the
+    // blobs they removed would come back at the next replay.
+    // The entries still being written are waited for
+    seg->Lock();
+    std::string log(seg->idx_size, '\0');
+    io->Bind(seg->fd_idx);
+    ssize_t r = _pread(io, seg->fd_idx, &log[0], log.size(), 0);
+    seg->Unlock();
+    if (r < 0)
+        return Errno();
+    log.resize(r);
+    size_t pos = 0;
+    Entry e;
+    while (pos < log.size() && _decode(log, &pos, &e)) {
+        if (e.kind != ENTRY_TOMBSTONE || e.segment == seg->id ||
+            segments_.count(e.segment) <= 0)
+            continue;
+        std::string encoded;
+        _encode(e, &encoded);
+        auto rc = appendLast(io, encoded);
+        if (!rc.Ok())
+            return rc;
+    }
+
+    // Whatever -packed_fsync says, the copies must be durable before the
+    // originals disappear.
+    for (auto it = segments_.lower_bound(first_dest); it != segments_.end();
+         ++it) {
+        const auto &dest = it->second;
+        io->Bind(dest->fd_seg);
+        if (0 != _fdatasync(io, dest->fd_seg))
+            return seal(dest, Errno());
+        if (0 != _fdatasync(io, dest->fd_idx))
+            return seal(dest, Errno());
+    }
+    if (0 != _fsync_dir(io, dir_))
+        return Errno();
+
+    // Readers still holding the segment keep it open
+    segments_.erase(seg->id);
+    if (0 != ::unlink(seg->path_idx.c_str()) ||
+        0 != ::unlink(seg->path_seg.c_str()))
+        LOG(ERROR) << "Leaving segment " << seg->path_seg << ": ("
+                   << errno << ") " << ::strerror(errno);
+    return Status();
+}
+
+Status Store::Compact(DiskIO *io) {
+    assert(io != nullptr);
+    if (compacting_)
+        return Status(Cause::Already);
+    if (segments_.size() < 2)
+        return Status();
+    compacting_ = true;
+
+    // Never the last one, it is being appended
+    std::vector<std::shared_ptr<Segment>> eligible;
+    for (auto it = segments_.begin(); it != segments_.end(); ++it) {
+        if (std::next(it) == segments_.end())
+            break;
+        const auto &seg = it->second;
+        if (seg->size <= 0)
+            continue;
+        const double dead = seg->size - seg->live;
+        if (dead / seg->size >= FLAGS_packed_compact_ratio)
+            eligible.push_back(seg);
+    }
+
+    Status rc;
+    for (const auto &seg : eligible) {
+        rc = compact(io, seg);
+        if (!rc.Ok()) {
+            LOG(ERROR) << "Compaction of " << seg->path_seg << " failed: "
+                       << rc.Message();
+            break;
+        }
+    }
+    compacting_ = false;
+    return rc;
+}
+
+void Store::Stats(std::string *out) const {
+    assert(out != nullptr);
+    uint64_t size{0}, live{0};
+    for (const auto &e : segments_) {
+        size += e.second->size;
+        live += e.second->live;
+    }
+    rapidjson::StringBuffer buf;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(buf);
+    writer.StartObject();
+    writer.Key("segments");
+    writer.Uint64(segments_.size());
+    writer.Key("blobs");
+    writer.Uint64(index_.size());
+    writer.Key("size");
+    writer.Uint64(size);
+    writer.Key("live");
+    writer.Uint64(live);
+    writer.EndObject();
+    out->assign(buf.GetString(), buf.GetSize());
+}
+
+
+/**
+ *
+ */
+class PackedUpload : public oio::api::blob::Upload {
+ private:
+    std::shared_ptr<Store> store;
+    std::string name;
+    std::map<std::string, std::string> attributes;
+    std::vector<uint8_t> data;
+    uint64_t max_size;
+    bool overflow;
+    DiskIO io;
+    Step step_;
+
+ private:
+    FORBID_COPY_CTOR(PackedUpload);
+    FORBID_MOVE_CTOR(PackedUpload);
+
+ public:
+    PackedUpload(std::shared_ptr<Store> s, const std::string &n,
+                 uint64_t max)
+            : store(s), name(n), attributes(), data(), max_size{max},
+              overflow{false}, io(), step_{Step::Init} {}
+
+    ~PackedUpload() override {
+        if (step_ == Step::Prepared)
+            store->Release(name);
+    }
+
+    void SetXattr(const std::string &k, const std::string &v) override {
+        attributes[k] = v;
+    }
+
+    Status Prepare() override {
+        if (step_ != Step::Init)
+            return Status(Cause::InternalError);
+        auto rc = store->Reserve(name);
+        if (rc.Ok())
+            step_ = Step::Prepared;
+        return rc;
+    }
+
+    Status Commit() override {
+        if (step_ != Step::Prepared)
+            return Status(Cause::InternalError);
+        step_ = Step::Done;
+        if (overflow) {
+            store->Release(name);
+            LOG(ERROR) << "Packed upload(" << name << ") exceeds "
+                       << max_size << " bytes";
+            return Status(Cause::Forbidden);
+        }
+        return store->Append(&io, name, attributes, data);
+    }
+
+    Status Abort() override {
+        if (step_ != Step::Prepared)
+            return Status(Cause::InternalError);
+        step_ = Step::Done;
+        store->Release(name);
+        return Status();
+    }
+
+    void Write(const uint8_t *buf, uint32_t len) override {
+        if (overflow)
+            return;
+        // Nothing more is buffered, the commit will fail
+        if (max_size > 0 && data.size() + len > max_size) {
+            overflow = true;
+            std::vector<uint8_t>().swap(data);
+            return;
+        }
+        data.insert(data.end(), buf, buf + len);
+    }
+};
+
+std::unique_ptr<oio::api::blob::Upload> UploadBuilder::Build() {
+    return std::unique_ptr<PackedUpload>(
+            new PackedUpload(store_, name_, max_size_));
+}
+
+
+/**
+ *
+ */
+class PackedDownload : public oio::api::blob::Download {
+ private:
+    std::shared_ptr<Store> store;
+    std::string name;
+    Store::Blob blob;
+    DiskIO io;
+    uint64_t offset_, size_expected_, size_read_;
+    uint32_t crc;
+    Step step;
+
+ private:
+    FORBID_COPY_CTOR(PackedDownload);
+    FORBID_MOVE_CTOR(PackedDownload);
+
+ public:
+    PackedDownload(std::shared_ptr<Store> s, const std::string &n)
+            : store(s), name(n), blob(), io(), offset_{0}, size_expected_{0},
+              size_read_{0}, crc{0}, step{Step::Init} {}
+
+    ~PackedDownload() override {}
+
+    Status Prepare() override {
+        if (step != Step::Init)
+            return Status(Cause::InternalError);
+        auto rc = store->Lookup(name, &blob);
+        if (!rc.Ok())
+            return rc;
+        size_expected_ = blob.length;
+        step = Step::Prepared;
+        return Status();
+    }
+
+    bool IsEof() override { return step == Step::Done; }
+
+    int32_t Read(std::vector<uint8_t> *buf) override {
+        assert(buf != nullptr);
+        if (step != Step::Prepared)
+            return 0;
+        const uint64_t remaining = size_expected_ - size_read_;
+        if (remaining <= 0) {
+            step = Step::Done;
+            buf->resize(0);
+            return 0;
+        }
+        const uint32_t len = std::min<uint64_t>(remaining,
+                                                FLAGS_read_batch_size);
+        buf->resize(len);
+        ssize_t rc = store->Read(&io, blob, offset_ + size_read_, len,
+                                 buf->data());
+        if (rc != static_cast<ssize_t>(len)) {
+            LOG(ERROR) << "Packed read(" << name << ") failed: (" << errno
+                       << ") " << ::strerror(errno);
+            step = Step::Done;
+            return -1;
+        }
+        size_read_ += len;
+
+        // Whole reads are checked against the CRC of the upload
+        if (offset_ == 0 && size_expected_ == blob.length) {
+            crc = compute_crc32c(buf->data(), len, crc);
+            if (size_read_ == size_expected_ && crc != blob.crc) {
+                LOG(ERROR) << "Packed blob " << name << " corrupted";
+                step = Step::Done;
+                return -1;
+            }
+        }
+        if (size_read_ >= size_expected_)
+            step = Step::Done;
+        return len;
+    }
+
+    Status SetRange(uint32_t offset, uint32_t size) override {
+        if (step != Step::Prepared || size_read_ > 0)
+            return Status(Cause::Forbidden);
+        if (static_cast<uint64_t>(offset) + size > blob.length)
+            return Errno(ENXIO);
+        offset_ = offset;
+        size_expected_ = size;
+        return Status();
+    }
+};
+
+std::unique_ptr<oio::api::blob::Download> DownloadBuilder::Build() {
+    return std::unique_ptr<PackedDownload>(new PackedDownload(store_, name_));
+}
+
+
+/**
+ *
+ */
+class PackedRemoval : public oio::api::blob::Removal {
+ private:
+    std::shared_ptr<Store> store;
+    std::string name;
+    DiskIO io;
+    Step step_;
+
+ private:
+    FORBID_COPY_CTOR(PackedRemoval);
+    FORBID_MOVE_CTOR(PackedRemoval);
+
+ public:
+    PackedRemoval(std::shared_ptr<Store> s, const std::string &n)
+            : store(s), name(n), io(), step_{Step::Init} {}
+
+    ~PackedRemoval() override {}
+
+    Status Prepare() override {
+        if (step_ != Step::Init)
+            return Status(Cause::InternalError);
+        Store::Blob b;
+        auto rc = store->Lookup(name, &b);
+        if (rc.Ok())
+            step_ = Step::Prepared;
+        return rc;
+    }
+
+    Status Commit() override {
+        if (step_ != Step::Prepared)
+            return Status(Cause::InternalError);
+        step_ = Step::Done;
+        return store->Erase(&io, name);
+    }
+
+    Status Abort() override {
+        if (step_ != Step::Prepared)
+            return Status(Cause::InternalError);
+        step_ = Step::Done;
+        return Status();
+    }
+};
+
+std::unique_ptr<oio::api::blob::Removal> RemovalBuilder::Build() {
+    return std::unique_ptr<PackedRemoval>(new PackedRemoval(store_, name_));
+}
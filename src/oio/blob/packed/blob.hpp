@@ -0,0 +1,239 @@
+/**
+ * This file is part of the OpenIO client libraries
+ * Copyright (C) 2016 OpenIO SAS
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ */
+
+#ifndef SRC_OIO_BLOB_PACKED_BLOB_HPP_
+#define SRC_OIO_BLOB_PACKED_BLOB_HPP_
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "utils/macros.h"
+#include "oio/api/blob.hpp"
+#include "oio/blob/local/disk_io.hpp"
+#include "oio/blob/local/group_commit.hpp"
+
+/**
+ * Small blobs appended to large segment files, to spare them the inode, the
+ * directory entry, the xattr and the rename of oio::local::blob.
+ *
+ * Each segment NNNNNNNNNNNNNNNN.seg comes with a NNNNNNNNNNNNNNNN.idx log of
+ * the puts and the tombstones of the blobs written in that segment. The logs
+ * are replayed in the order of the segments to rebuild the in-memory index.
+ * The entries of a log are written one at a time, and a segment whose write
+ * failed is sealed: the next blobs and tombstones go to a new segment.
+ * Unless the durability is none, a blob then its entry are flushed before
+ * the append returns, the concurrent appends sharing their fdatasync().
+ * A removal appends a tombstone, and the segments mostly made of dead bytes
+ * are compacted: their live blobs are appended again, then they are deleted.
+ *
+ * The uploads are buffered in memory until their commit. Not thread-safe:
+ * the store is meant to be shared by the coroutines of one thread.
+ */
+
+namespace oio {
+namespace packed {
+namespace blob {
+
+class Store {
+ public:
+    struct Segment;
+
+    /** Where a blob lives */
+    struct Blob {
+        std::shared_ptr<Segment> segment;
+        uint64_t offset;
+        uint32_t length;
+        uint32_t crc;
+        std::map<std::string, std::string> attrs;
+    };
+
+    /** @param dir the directory of the segments, created if missing */
+    explicit Store(const std::string &dir);
+
+    ~Store();
+
+    /** Load the index from the segments of the directory */
+    oio::api::Status Open();
+
+    /** fsync and group both flush the appends before they return */
+    void SetDurability(oio::local::blob::Durability d) { durability_ = d; }
+
+    /**
+     * Reserve the ID for an upload.
+     * @return Cause::Already if the blob exists or is being uploaded
+     */
+    oio::api::Status Reserve(const std::string &id);
+
+    /** Release the reservation of an upload */
+    void Release(const std::string &id);
+
+    /**
+     * Append a blob and index it. The ID must have been reserved, and is
+     * released.
+     */
+    oio::api::Status Append(oio::local::blob::DiskIO *io,
+                            const std::string &id,
+                            const std::map<std::string, std::string> &attrs,
+                            const std::vector<uint8_t> &data);
+
+    /** @return Cause::NotFound if the blob is not indexed */
+    oio::api::Status Lookup(const std::string &id, Blob *out) const;
+
+    /**
+     * Read a part of a blob, the segment is kept open while 'b' is.
+     * @return the number of bytes read, or -1
+     */
+    ssize_t Read(oio::local::blob::DiskIO *io, const Blob &b, uint64_t offset,
+                 uint32_t len, uint8_t *dst);
+
+    /** Append a tombstone, then forget the blob */
+    oio::api::Status Erase(oio::local::blob::DiskIO *io,
+                           const std::string &id);
+
+    /**
+     * Compact the segments whose share of dead bytes is at least
+     * -packed_compact_ratio, except the one being appended.
+     */
+    oio::api::Status Compact(oio::local::blob::DiskIO *io);
+
+    /** Dump the counters of the segments as a JSON object */
+    void Stats(std::string *out) const;
+
+ private:
+    FORBID_COPY_CTOR(Store);
+    FORBID_MOVE_CTOR(Store);
+
+    oio::api::Status openSegment(uint64_t id, bool create,
+                                 std::shared_ptr<Segment> *out);
+
+    oio::api::Status replay(const std::shared_ptr<Segment> &seg);
+
+    /** @return the segment to append to, rotated when full or sealed */
+    oio::api::Status current(std::shared_ptr<Segment> *out);
+
+    /** Stop appending to the segment, then return 'rc' */
+    oio::api::Status seal(const std::shared_ptr<Segment> &seg,
+                          oio::api::Status rc);
+
+    /** @return Cause::Already if the segment has been sealed meanwhile */
+    oio::api::Status appendEntry(oio::local::blob::DiskIO *io,
+                                 const std::shared_ptr<Segment> &seg,
+                                 const std::string &entry);
+
+    /**
+     * Make durable the writes of the segment (or of its log) up to the
+     * 'ticket'-th, as well as all the writes completed meanwhile.
+     */
+    oio::api::Status flush(oio::local::blob::DiskIO *io,
+                           const std::shared_ptr<Segment> &seg, bool idx,
+                           uint64_t ticket);
+
+    bool syncing() const;
+
+    /** Append an entry to the log of the segment being appended */
+    oio::api::Status appendLast(oio::local::blob::DiskIO *io,
+                                const std::string &entry);
+
+    oio::api::Status appendBlob(oio::local::blob::DiskIO *io,
+                                const std::string &id, const Blob &b,
+                                const uint8_t *data, Blob *out);
+
+    oio::api::Status tombstone(oio::local::blob::DiskIO *io,
+                               const std::string &id, const Blob &b);
+
+    oio::api::Status compact(oio::local::blob::DiskIO *io,
+                             std::shared_ptr<Segment> seg);
+
+    void forget(const std::string &id);
+
+ private:
+    std::string dir_;
+    std::map<uint64_t, std::shared_ptr<Segment>> segments_;
+    std::unordered_map<std::string, Blob> index_;
+    std::set<std::string> reserved_;
+    bool compacting_;
+    oio::local::blob::Durability durability_;
+};
+
+class UploadBuilder {
+ public:
+    explicit UploadBuilder(std::shared_ptr<Store> s)
+            : store_(s), name_(), max_size_{0} {}
+
+    ~UploadBuilder() {}
+
+    /**
+     * Mandatory
+     * @param name the ID of the blob
+     */
+    void Name(const std::string &name) { name_.assign(name); }
+
+    /**
+     * Optional, the upload buffers the blob in RAM until its commit.
+     * @param size the bytes beyond which the commit fails, 0 for no limit
+     */
+    void MaxSize(uint64_t size) { max_size_ = size; }
+
+    std::unique_ptr<oio::api::blob::Upload> Build();
+
+ private:
+    std::shared_ptr<Store> store_;
+    std::string name_;
+    uint64_t max_size_;
+};
+
+class DownloadBuilder {
+ public:
+    explicit DownloadBuilder(std::shared_ptr<Store> s) : store_(s), name_() {}
+
+    ~DownloadBuilder() {}
+
+    void Name(const std::string &name) { name_.assign(name); }
+
+    std::unique_ptr<oio::api::blob::Download> Build();
+
+ private:
+    std::shared_ptr<Store> store_;
+    std::string name_;
+};
+
+class RemovalBuilder {
+ public:
+    explicit RemovalBuilder(std::shared_ptr<Store> s) : store_(s), name_() {}
+
+    ~RemovalBuilder() {}
+
+    void Name(const std::string &name) { name_.assign(name); }
+
+    std::unique_ptr<oio::api::blob::Removal> Build();
+
+ private:
+    std::shared_ptr<Store> store_;
+    std::string name_;
+};
+
+}  // namespace blob
+}  // namespace packed
+}  // namespace oio
+
+#endif  // SRC_OIO_BLOB_PACKED_BLOB_HPP_
@@ -241,13 +241,22 @@ class RawxDownload : public Download {
         if (step_ != Step::Prepared)
             return -1;
 
+        auto range = rawx_param.GetRange();
+        if (range.Size() == 0) {
+            // No range to apply, the body is directly appended
+            while (!IsEof()) {
+                if (inner->Read(buf) < 0)
+                    return -1;
+            }
+            return buf->size();
+        }
+
         std::vector<uint8_t> temp_buf;
 
         while (!IsEof()) {
             inner->Read(&temp_buf);
         }
 
-        auto range = rawx_param.GetRange();
         if (temp_buf.size() > range.Size()) {
             buf->resize(range.Size());
             memcpy(buf->data(), temp_buf.data() + range.Start(), range.Size());
@@ -257,6 +266,15 @@ class RawxDownload : public Download {
 
         return buf->size();
     }
+
+    int32_t ReadInto(uint8_t *buf, uint32_t len) override {
+        if (step_ != Step::Prepared)
+            return -1;
+        // Ranges are applied on the whole body, only in Read()
+        if (rawx_param.GetRange().Size() != 0)
+            return -1;
+        return inner->ReadInto(buf, len);
+    }
 };
 
 DownloadBuilder::DownloadBuilder() {}
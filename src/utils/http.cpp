@@ -23,6 +23,8 @@
 #include <libmill.h>
 #include <gflags/gflags.h>
 
+#include <algorithm>
+#include <climits>
 #include <iomanip>
 #include <cstring>
 #include <cassert>
@@ -454,6 +456,42 @@ Code Reply::AppendBody(std::vector<uint8_t> *out) {
     return Code::OK;
 }
 
+bool Reply::Direct() const {
+    return ctx.step == Step::Body && ctx.body_bytes.empty() &&
+           ctx.buffer_offset >= ctx.buffer_length &&
+           !(ctx.parser.flags & F_CHUNKED) &&
+           ctx.parser.content_length != ULLONG_MAX &&
+           ctx.parser.content_length > 0;
+}
+
+Code Reply::ReadBodyInto(uint8_t *buf, uint32_t len, uint32_t *got) {
+    assert(buf != nullptr);
+    assert(got != nullptr);
+    assert(Direct());
+    *got = 0;
+
+    // Never beyond the body, the bytes of the next reply would be lost
+    const size_t max = std::min<uint64_t>(len, ctx.parser.content_length);
+    ssize_t rc = socket->read(buf, max, mill_now() + 8000);
+    if (rc <= 0)
+        return Code::NetworkError;
+
+    // The parser still accounts the body, its slices point into 'buf' and
+    // are already where they belong.
+    http_parser_pause(&ctx.parser, 0);
+    const ssize_t done = http_parser_execute(
+            &ctx.parser, &settings, reinterpret_cast<const char *>(buf), rc);
+    while (!ctx.body_bytes.empty())
+        ctx.body_bytes.pop();
+    if (done <= 0) {
+        LOG(INFO) << "Unexpected http error " << ctx.parser.http_errno
+                  << " (" << ::strerror(ctx.parser.http_errno) << ")";
+        return Code::ServerError;
+    }
+    *got = static_cast<uint32_t>(rc);
+    return Code::OK;
+}
+
 void Reply::Skip() {
     HTTP_LOG();
     while (ctx.step < Step::Done) {
@@ -272,6 +272,21 @@ class Reply {
      */
     Code AppendBody(std::vector<uint8_t> *out);
 
+    /**
+     * @return true if the next bytes of the body can be read straight into
+     *         the buffer of the application, i.e. the body has a known
+     *         length and none of its bytes is buffered.
+     */
+    bool Direct() const;
+
+    /**
+     * Read a part of the body straight from the socket into 'buf', sparing
+     * the copy from the internal buffer. Only valid when Direct().
+     * @param got set to the number of bytes written into 'buf'
+     * @return a status code indicating if iteratiosn might continue.
+     */
+    Code ReadBodyInto(uint8_t *buf, uint32_t len, uint32_t *got);
+
     /**
      * Get a read-only access on the internal state of the reply.
      * @return the reply context
@@ -24,6 +24,11 @@
 #include <openssl/sha.h>
 #include <openssl/md5.h>
 
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+#include <cstring>
 #include <random>
 #include <iomanip>
 
@@ -71,10 +76,39 @@ class ChecksumSHA1 : public Checksum {
     SHA_CTX ctx;
 };
 
+class HmacSHA1 : public Hmac {
+ public:
+    explicit HmacSHA1(const std::string &key) {
+        HMAC_CTX_init(&ctx);
+        HMAC_Init_ex(&ctx, key.data(), key.length(), EVP_sha1(), NULL);
+    }
+
+    virtual ~HmacSHA1() { HMAC_CTX_cleanup(&ctx); }
+
+    void Compute(const void *b, size_t l, std::string *out) override {
+        // NULL key and digest: restart with the key already set
+        HMAC_Init_ex(&ctx, NULL, 0, NULL, NULL);
+        if (l > 0) {
+            uint32_t be = ::htonl(l);
+            HMAC_Update(&ctx, reinterpret_cast<unsigned char *>(&be),
+                        sizeof(uint32_t));
+            HMAC_Update(&ctx, static_cast<const unsigned char *>(b), l);
+        }
+        unsigned int len = SHA_DIGEST_LENGTH;
+        out->resize(len);
+        HMAC_Final(&ctx, reinterpret_cast<unsigned char *>(&(*out)[0]), &len);
+    }
+
+ private:
+    HMAC_CTX ctx;
+};
+
 Checksum *checksum_make_MD5() { return new ChecksumMD5; }
 
 Checksum *checksum_make_SHA1() { return new ChecksumSHA1; }
 
+Hmac *hmac_make_SHA1(const std::string &key) { return new HmacSHA1(key); }
+
 std::string bin2hex(const uint8_t *b, size_t l) {
     std::stringstream ss;
     for (; l > 0; --l, ++b) {
@@ -119,6 +153,85 @@ compute_sha1_hmac(const std::string &key, const std::string &val) {
     return result;
 }
 
+std::vector<uint8_t> compute_sha256(const void *buf, size_t buflen) {
+    std::vector<uint8_t> result(SHA256_DIGEST_LENGTH);
+    SHA256(static_cast<const unsigned char *>(buf), buflen, result.data());
+    return result;
+}
+
+// Slicing-by-8 tables of a reflected CRC, built once
+template <typename T, T Poly>
+struct CrcTables {
+    T t[8][256];
+
+    CrcTables() {
+        for (unsigned int i = 0; i < 256; ++i) {
+            T c = i;
+            for (int k = 0; k < 8; ++k)
+                c = (c & 1) ? (c >> 1) ^ Poly : (c >> 1);
+            t[0][i] = c;
+        }
+        for (unsigned int i = 0; i < 256; ++i) {
+            for (int j = 1; j < 8; ++j)
+                t[j][i] = (t[j - 1][i] >> 8) ^ t[0][t[j - 1][i] & 0xFF];
+        }
+    }
+
+    T Update(T c, const uint8_t *p, size_t len) const {
+        while (len >= 8) {
+            uint64_t v;
+            memcpy(&v, p, 8);
+            v ^= c;
+            c = t[7][v & 0xFF] ^ t[6][(v >> 8) & 0xFF] ^
+                t[5][(v >> 16) & 0xFF] ^ t[4][(v >> 24) & 0xFF] ^
+                t[3][(v >> 32) & 0xFF] ^ t[2][(v >> 40) & 0xFF] ^
+                t[1][(v >> 48) & 0xFF] ^ t[0][v >> 56];
+            p += 8;
+            len -= 8;
+        }
+        while (len-- > 0)
+            c = (c >> 8) ^ t[0][(c ^ *p++) & 0xFF];
+        return c;
+    }
+};
+
+using Crc32cTables = CrcTables<uint32_t, 0x82F63B78U>;
+using Crc64Tables = CrcTables<uint64_t, 0xC96C5795D7870F42ULL>;
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+static uint32_t _crc32c_sse42(uint32_t crc, const uint8_t *p, size_t len) {
+    uint64_t c = crc;
+    while (len >= 8) {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        c = _mm_crc32_u64(c, v);
+        p += 8;
+        len -= 8;
+    }
+    uint32_t c32 = c;
+    while (len-- > 0)
+        c32 = _mm_crc32_u8(c32, *p++);
+    return c32;
+}
+#endif
+
+uint32_t compute_crc32c(const void *buf, size_t len, uint32_t crc) {
+    auto p = static_cast<const uint8_t *>(buf);
+#if defined(__x86_64__)
+    static const bool sse42 = __builtin_cpu_supports("sse4.2");
+    if (sse42)
+        return ~_crc32c_sse42(~crc, p, len);
+#endif
+    static const Crc32cTables tables;
+    return ~tables.Update(~crc, p, len);
+}
+
+uint64_t compute_crc64(const void *buf, size_t len, uint64_t crc) {
+    static const Crc64Tables tables;
+    return ~tables.Update(~crc, static_cast<const uint8_t *>(buf), len);
+}
+
 void append_string_random(std::string *dst, unsigned int len,
         const std::string &chars) {
     static std::random_device rand_dev;
@@ -49,6 +49,22 @@ class Checksum {
 Checksum* checksum_make_MD5();
 Checksum* checksum_make_SHA1();
 
+/**
+ * HMAC whose key is set once, then reused for every message. The value is
+ * prefixed with its length, as in compute_sha1_hmac().
+ */
+class Hmac {
+ public:
+    virtual ~Hmac() {}
+
+    /**
+     * @param out resized to the digest length, its storage is reused
+     */
+    virtual void Compute(const void *b, size_t l, std::string *out) = 0;
+};
+
+Hmac* hmac_make_SHA1(const std::string &key);
+
 std::string bin2hex(const uint8_t *b, size_t l);
 
 std::vector<uint8_t> compute_sha1(const std::vector<uint8_t> &val);
@@ -58,6 +74,20 @@ std::vector<uint8_t> compute_sha1(const void *buf, size_t len);
 std::vector<uint8_t> compute_sha1_hmac(const std::string &key,
                                        const std::string &val);
 
+std::vector<uint8_t> compute_sha256(const void *buf, size_t len);
+
+/**
+ * CRC-32C (Castagnoli), with the SSE4.2 instruction when the CPU has it.
+ * @param crc the CRC of the previous bytes, to chain the calls
+ */
+uint32_t compute_crc32c(const void *buf, size_t len, uint32_t crc = 0);
+
+/**
+ * CRC-64 with the ECMA-182 polynomial, in its reflected form (as in XZ).
+ * @param crc the CRC of the previous bytes, to chain the calls
+ */
+uint64_t compute_crc64(const void *buf, size_t len, uint64_t crc = 0);
+
 /**
  * Appends 'len' characters to the string pointed by 'dst'
  * @param dst cannot be null
@@ -0,0 +1,312 @@
+/**
+ * This file is part of the test tools for the OpenIO client libraries
+ * Copyright (C) 2016 OpenIO SAS
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ */
+
+/**
+ * Measures the throughput and the latency of the erasure codes used by
+ * oio-data-ec, for several (k,m) pairs, several payload sizes and all the
+ * backends available on the host. Everything happens in memory, neither
+ * rawx nor network is involved.
+ */
+
+#include <liberasurecode/erasurecode.h>
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "utils/macros.h"
+#include "oio/blob/ec/fragment_pool.hpp"
+
+using oio::blob::ec::FragmentBuffer;
+using oio::blob::ec::FragmentPool;
+
+DEFINE_string(bench_backends, "",
+              "Comma-separated list of EC backends to be measured. "
+              "All the available backends when empty");
+DEFINE_uint64(bench_min_size, 4 * 1024, "Smallest payload size (bytes)");
+DEFINE_uint64(bench_max_size, 64 * 1024 * 1024, "Largest payload size (bytes)");
+DEFINE_uint64(bench_volume, 256 * 1024 * 1024,
+              "Amount of payload processed by each measure (bytes)");
+DEFINE_uint64(bench_min_rounds, 5, "Minimal number of operations per measure");
+DEFINE_string(bench_output, "", "Path of the JSON report, stdout when empty");
+
+static std::vector<std::pair<std::string, ec_backend_id_t>> TheBackends = {
+        {"jerasure_rs_vand",       EC_BACKEND_JERASURE_RS_VAND},
+        {"jerasure_rs_cauchy",     EC_BACKEND_JERASURE_RS_CAUCHY},
+        {"flat_xor_hd",            EC_BACKEND_FLAT_XOR_HD},
+        {"isa_l_rs_vand",          EC_BACKEND_ISA_L_RS_VAND},
+        {"shss",                   EC_BACKEND_SHSS},
+        {"liberasurecode_rs_vand", EC_BACKEND_LIBERASURECODE_RS_VAND}
+};
+
+static std::vector<std::pair<int, int>> TheSchemes = {
+        {4, 2}, {6, 3}, {8, 4}, {12, 4}
+};
+
+typedef std::chrono::steady_clock Clock;
+
+static FragmentPool pool;
+
+/** Latencies of one measure, in microseconds */
+class Sample {
+ public:
+    void Add(Clock::duration d) {
+        lat.push_back(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(d).count()
+            / 1000.0);
+    }
+
+    double Total() const {
+        double t = 0;
+        for (auto l : lat)
+            t += l;
+        return t;
+    }
+
+    double Percentile(double p) {
+        if (lat.empty())
+            return 0;
+        std::sort(lat.begin(), lat.end());
+        size_t idx = static_cast<size_t>(p * (lat.size() - 1));
+        return lat[idx];
+    }
+
+    size_t Count() const { return lat.size(); }
+
+ private:
+    std::vector<double> lat;
+};
+
+class Report {
+ public:
+    Report() : buf(), writer(buf) {
+        writer.StartObject();
+        writer.Key("results");
+        writer.StartArray();
+    }
+
+    void Skip(const std::string &backend, int k, int m, const char *why) {
+        writer.StartObject();
+        writer.Key("backend"); writer.String(backend.c_str());
+        writer.Key("k"); writer.Int(k);
+        writer.Key("m"); writer.Int(m);
+        writer.Key("skipped"); writer.String(why);
+        writer.EndObject();
+    }
+
+    void Add(const std::string &backend, int k, int m, uint64_t size,
+             const char *op, int missing, uint64_t fragment_len,
+             bool ok, Sample *sample) {
+        const double total_us = sample->Total();
+        const double mbps = total_us <= 0 ? 0.0 :
+                (static_cast<double>(size) * sample->Count()) / total_us;
+        writer.StartObject();
+        writer.Key("backend"); writer.String(backend.c_str());
+        writer.Key("k"); writer.Int(k);
+        writer.Key("m"); writer.Int(m);
+        writer.Key("size"); writer.Uint64(size);
+        writer.Key("op"); writer.String(op);
+        writer.Key("missing"); writer.Int(missing);
+        writer.Key("fragment"); writer.Uint64(fragment_len);
+        writer.Key("ok"); writer.Bool(ok);
+        writer.Key("rounds"); writer.Uint64(sample->Count());
+        writer.Key("mbps"); writer.Double(mbps);
+        writer.Key("us_p50"); writer.Double(sample->Percentile(0.50));
+        writer.Key("us_p99"); writer.Double(sample->Percentile(0.99));
+        writer.Key("us_max"); writer.Double(sample->Percentile(1.0));
+        writer.EndObject();
+        LOG(INFO) << backend << " k=" << k << " m=" << m << " size=" << size
+                  << " " << op << " missing=" << missing
+                  << " ok=" << ok << " " << mbps << " MB/s";
+    }
+
+    std::string Finish() {
+        writer.EndArray();
+        writer.EndObject();
+        return std::string(buf.GetString(), buf.GetSize());
+    }
+
+ private:
+    rapidjson::StringBuffer buf;
+    rapidjson::Writer<rapidjson::StringBuffer> writer;
+};
+
+static bool selected(const std::string &name) {
+    if (FLAGS_bench_backends.empty())
+        return true;
+    std::stringstream ss(FLAGS_bench_backends);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (item == name)
+            return true;
+    }
+    return false;
+}
+
+static uint64_t rounds(uint64_t size) {
+    return std::max(FLAGS_bench_min_rounds, FLAGS_bench_volume / size);
+}
+
+static void bench_scheme(Report *report, const std::string &name,
+        ec_backend_id_t id, int k, int m, const FragmentBuffer &payload) {
+    struct ec_args args;
+    memset(&args, 0, sizeof(args));
+    args.k = k;
+    args.m = m;
+    args.w = 16;
+    args.hd = m;
+    args.ct = CHKSUM_NONE;
+
+    int desc = liberasurecode_instance_create(id, &args);
+    if (desc <= 0) {
+        report->Skip(name, k, m, "unsupported scheme");
+        return;
+    }
+
+    for (uint64_t size = FLAGS_bench_min_size; size <= FLAGS_bench_max_size;
+            size *= 4) {
+        const char *data = reinterpret_cast<const char *>(payload.data());
+        char **frag_data = nullptr, **frag_parity = nullptr;
+        uint64_t fragment_len = 0;
+
+        // Encode
+        Sample enc;
+        for (uint64_t i = 0, max = rounds(size); i < max; ++i) {
+            auto pre = Clock::now();
+            int rc = liberasurecode_encode(desc, data, size, &frag_data,
+                                           &frag_parity, &fragment_len);
+            enc.Add(Clock::now() - pre);
+            if (rc != 0) {
+                report->Skip(name, k, m, "encode error");
+                goto out;
+            }
+            if (i + 1 < max)
+                liberasurecode_encode_cleanup(desc, frag_data, frag_parity);
+        }
+        report->Add(name, k, m, size, "encode", 0, fragment_len, true, &enc);
+
+        {
+            std::vector<char *> all;
+            for (int i = 0; i < k; ++i)
+                all.push_back(frag_data[i]);
+            for (int i = 0; i < m; ++i)
+                all.push_back(frag_parity[i]);
+
+            // Decode, with the first data fragments missing
+            for (int missing = 0; missing <= m; ++missing) {
+                std::vector<char *> avail(all.begin() + missing, all.end());
+                Sample dec;
+                bool ok = true;
+                for (uint64_t i = 0, max = rounds(size); i < max; ++i) {
+                    char *out = nullptr;
+                    uint64_t out_len = 0;
+                    auto pre = Clock::now();
+                    int rc = liberasurecode_decode(desc, avail.data(),
+                                                   avail.size(), fragment_len,
+                                                   0, &out, &out_len);
+                    dec.Add(Clock::now() - pre);
+                    if (i == 0) {
+                        ok = rc == 0 && out_len == size &&
+                             0 == memcmp(out, data, size);
+                    }
+                    if (rc == 0)
+                        liberasurecode_decode_cleanup(desc, out);
+                }
+                report->Add(name, k, m, size, "decode", missing, fragment_len,
+                            ok, &dec);
+            }
+
+            // Reconstruct the first data fragment
+            FragmentBuffer rebuilt;
+            if (pool.Acquire(fragment_len, &rebuilt)) {
+                std::vector<char *> avail(all.begin() + 1, all.end());
+                Sample rec;
+                bool ok = true;
+                for (uint64_t i = 0, max = rounds(size); i < max; ++i) {
+                    auto pre = Clock::now();
+                    int rc = liberasurecode_reconstruct_fragment(desc,
+                            avail.data(), avail.size(), fragment_len, 0,
+                            reinterpret_cast<char *>(rebuilt.data()));
+                    rec.Add(Clock::now() - pre);
+                    if (i == 0)
+                        ok = rc == 0 && 0 == memcmp(rebuilt.data(), all[0],
+                                                    fragment_len);
+                }
+                report->Add(name, k, m, size, "reconstruct", 1, fragment_len,
+                            ok, &rec);
+            }
+        }
+
+        liberasurecode_encode_cleanup(desc, frag_data, frag_parity);
+    }
+
+out:
+    liberasurecode_instance_destroy(desc);
+}
+
+int main(int argc, char **argv) {
+    gflags::ParseCommandLineFlags(&argc, &argv, true);
+    google::InitGoogleLogging(argv[0]);
+    FLAGS_logtostderr = true;
+
+    // The same random payload is used by all the measures
+    FragmentBuffer payload;
+    if (!pool.Acquire(FLAGS_bench_max_size, &payload)) {
+        LOG(ERROR) << "Allocation failure";
+        return 1;
+    }
+    std::mt19937 gen(0);
+    for (size_t i = 0; i < payload.size(); ++i)
+        payload.data()[i] = static_cast<uint8_t>(gen());
+
+    Report report;
+    for (const auto &backend : TheBackends) {
+        if (!selected(backend.first))
+            continue;
+        if (!liberasurecode_backend_available(backend.second)) {
+            LOG(INFO) << "Backend not available: " << backend.first;
+            continue;
+        }
+        for (const auto &scheme : TheSchemes)
+            bench_scheme(&report, backend.first, backend.second,
+                         scheme.first, scheme.second, payload);
+    }
+
+    const auto json = report.Finish();
+    if (FLAGS_bench_output.empty()) {
+        std::cout << json << std::endl;
+    } else {
+        FILE *out = ::fopen(FLAGS_bench_output.c_str(), "w");
+        if (!out) {
+            LOG(ERROR) << "Failed to open " << FLAGS_bench_output;
+            return 1;
+        }
+        ::fwrite(json.data(), 1, json.size(), out);
+        ::fclose(out);
+    }
+    return 0;
+}
@@ -20,13 +20,20 @@
 #include <gflags/gflags.h>
 #include <glog/logging.h>
 
+#include <algorithm>
 #include <array>
+#include <climits>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include "utils/macros.h"
 #include "utils/utils.hpp"
 #include "oio/api/blob.hpp"
 #include "oio/blob/kinetic/coro/ClientInterface.h"
 #include "oio/blob/kinetic/coro/CoroutineClientFactory.h"
+#include "oio/blob/kinetic/coro/Simulator.h"
 #include "oio/blob/kinetic/coro/blob.hpp"
 #include "tests/common/BlobTestSuite.h"
 
@@ -38,17 +45,21 @@ using oio::kinetic::blob::UploadBuilder;
 using oio::kinetic::blob::RemovalBuilder;
 using oio::kinetic::blob::ListingBuilder;
 using oio::kinetic::blob::DownloadBuilder;
+using oio::kinetic::blob::CopyBuilder;
+using oio::kinetic::sim::Simulator;
 
 namespace blob = ::oio::api::blob;
 using blob::Upload;
 using blob::Download;
 using blob::Removal;
 
-// The default address used for the target RAWX is an address typically
-// generated by the oio-reset.sh tool applied on the "SINGLE" preset.
+DECLARE_uint32(kinetic_removal_page);
+DECLARE_uint32(kinetic_p2p_batch);
+
+// When no device is given, an in-process simulator is started.
 DEFINE_string(
         URL_DEVICE,
-        "127.0.0.1:8123",
+        "",
         "URL of the test kinetic device");
 
 using SocketFactory =
@@ -71,6 +82,9 @@ class KineticBlobOpsFactory : public BlobOpsFactory {
         UploadBuilder op(socketFactory_);
         op.Name(name_);
         op.Target(FLAGS_URL_DEVICE);
+        // A tight window, so that the back-pressure is exercised
+        op.BlockSize(4096);
+        op.Window(2, 8192);
         return op.Build();
     }
 
@@ -116,11 +130,308 @@ class KineticBlobTestSuite : public BlobTestSuite {
 
 DECLARE_BLOBTESTSUITE(KineticBlobTestSuite);
 
+// Simulated drives dedicated to the checks of the layout, started by main()
+static std::vector<std::unique_ptr<Simulator>> drives;
+
+class KineticLayoutTest : public ::testing::Test {
+ protected:
+    SocketFactory factory_;
+    std::string name_;
+    std::string data_;
+
+    void SetUp() override {
+        factory_.reset(new CoroutineClientFactory);
+        name_ = generate_string_random(16, random_hex);
+        append_string_random(&data_, 64 * 1024, random_chars);
+    }
+
+    /* Target the first 'count' drives, all of them if 0 */
+    template <typename Builder>
+    void targets(Builder *b, size_t count = 0) {
+        for (size_t i = 0; i < drives.size(); ++i) {
+            if (count == 0 || i < count)
+                b->Target(drives[i]->Url());
+        }
+    }
+
+    void upload(uint32_t block_size, size_t count = 0) {
+        UploadBuilder builder(factory_);
+        builder.Name(name_);
+        builder.BlockSize(block_size);
+        targets(&builder, count);
+        auto op = builder.Build();
+        ASSERT_TRUE(op->Prepare().Ok());
+        op->Write(data_);
+        ASSERT_TRUE(op->Commit().Ok());
+    }
+
+    void download(std::string *out) {
+        DownloadBuilder builder(factory_);
+        builder.Name(name_);
+        targets(&builder);
+        auto op = builder.Build();
+        ASSERT_TRUE(op->Prepare().Ok());
+        while (!op->IsEof()) {
+            std::vector<uint8_t> buf;
+            ASSERT_GE(op->Read(&buf), 0);
+            out->append(buf.begin(), buf.end());
+        }
+    }
+
+    Cause remove() {
+        RemovalBuilder builder(factory_);
+        builder.Name(name_);
+        targets(&builder);
+        auto op = builder.Build();
+        auto rc = op->Prepare();
+        if (rc.Ok())
+            rc = op->Commit();
+        return rc.Why();
+    }
+
+    /* Count the keys of the chunk, on all the drives */
+    size_t keys() {
+        size_t total{0};
+        for (const auto &d : drives) {
+            std::vector<std::string> out;
+            d->Backend()->Range(name_ + "-", false, name_ + "-X", false,
+                                UINT_MAX, &out);
+            total += out.size();
+        }
+        return total;
+    }
+
+    /* Tell if a manifest with a layout has been written */
+    bool layout() {
+        for (const auto &d : drives) {
+            std::string value, version, tag;
+            if (d->Backend()->Get(name_ + "-#", &value, &version, &tag))
+                return value.find("\"blocks\"") != std::string::npos;
+        }
+        return false;
+    }
+
+    void dropManifest() {
+        for (const auto &d : drives)
+            d->Backend()->Delete(name_ + "-#");
+    }
+
+    /* @return the index of the first drive without the manifest */
+    size_t notManifest() {
+        size_t i{0};
+        std::string value, version, tag;
+        while (i < drives.size() &&
+               drives[i]->Backend()->Get(name_ + "-#", &value, &version,
+                                         &tag))
+            i++;
+        return i;
+    }
+};
+
+TEST_F(KineticLayoutTest, Manifest) {
+    upload(4096);
+    ASSERT_TRUE(layout());
+    std::string got;
+    download(&got);
+    ASSERT_EQ(data_, got);
+    ASSERT_EQ(Cause::OK, remove());
+    ASSERT_EQ(0U, keys());
+}
+
+// Test the window bounds the blocks held by the drives in open batches
+TEST_F(KineticLayoutTest, UploadWindow) {
+    const std::vector<std::pair<uint32_t, uint64_t>> windows{
+        {16, 8192}, {2, 1024 * 1024}};
+    for (const auto &w : windows) {
+        for (const auto &d : drives)
+            (void) d->PeakBatchBytes();
+        UploadBuilder builder(factory_);
+        builder.Name(name_);
+        builder.BlockSize(4096);
+        builder.Window(w.first, w.second);
+        targets(&builder);
+        auto op = builder.Build();
+        ASSERT_TRUE(op->Prepare().Ok());
+        op->Write(data_);
+        ASSERT_TRUE(op->Commit().Ok());
+
+        const uint64_t bound = std::min<uint64_t>(w.second, w.first * 4096);
+        uint64_t peak{0};
+        for (const auto &d : drives) {
+            const auto p = d->PeakBatchBytes();
+            ASSERT_LE(p, bound);
+            peak = std::max(peak, p);
+        }
+        ASSERT_GT(peak, 0U);
+        ASSERT_EQ(Cause::OK, remove());
+        ASSERT_EQ(0U, keys());
+    }
+}
+
+TEST_F(KineticLayoutTest, ListingFallback) {
+    upload(4096);
+    dropManifest();
+    std::string got;
+    download(&got);
+    ASSERT_EQ(data_, got);
+    ASSERT_EQ(Cause::OK, remove());
+    ASSERT_EQ(0U, keys());
+}
+
+TEST_F(KineticLayoutTest, ManifestTooLarge) {
+    // So many blocks that the layout exceeds the largest value
+    upload(64);
+    ASSERT_FALSE(layout());
+    std::string got;
+    download(&got);
+    ASSERT_EQ(data_, got);
+    ASSERT_EQ(Cause::OK, remove());
+    ASSERT_EQ(0U, keys());
+}
+
+TEST_F(KineticLayoutTest, RemovalPagination) {
+    // The drives return less keys than the page asks for, and have more
+    // keys than that to delete.
+    const auto page = FLAGS_kinetic_removal_page;
+    FLAGS_kinetic_removal_page = 500;
+    upload(64);
+    ASSERT_FALSE(layout());
+    ASSERT_GT(keys(), 600U);
+    const auto rc = remove();
+    FLAGS_kinetic_removal_page = page;
+    ASSERT_EQ(Cause::OK, rc);
+    ASSERT_EQ(0U, keys());
+}
+
+TEST_F(KineticLayoutTest, RemovalFailure) {
+    upload(4096);
+    const auto locked = notManifest();
+    ASSERT_LT(locked, drives.size());
+
+    drives[locked]->ReadOnly(true);
+    const auto rc = remove();
+    drives[locked]->ReadOnly(false);
+    ASSERT_NE(Cause::OK, rc);
+    // The manifest is kept as long as a drive holds a block
+    ASSERT_TRUE(layout());
+
+    ASSERT_EQ(Cause::OK, remove());
+    ASSERT_EQ(0U, keys());
+}
+
+TEST_F(KineticLayoutTest, Copy) {
+    upload(4096, 2);
+    // A PEER2PEERPUSH per key
+    const auto per_push = FLAGS_kinetic_p2p_batch;
+    FLAGS_kinetic_p2p_batch = 0;
+    CopyBuilder builder(factory_);
+    builder.Name(name_);
+    targets(&builder, 2);
+    builder.Destination(drives[2]->Url());
+    builder.Destination(drives[3]->Url());
+    auto op = builder.Build();
+    ASSERT_TRUE(op->Prepare().Ok());
+    const auto rc = op->Commit();
+    FLAGS_kinetic_p2p_batch = per_push;
+    ASSERT_TRUE(rc.Ok());
+
+    // Each destination holds the manifest of the copy
+    for (int i = 2; i < 4; ++i) {
+        DownloadBuilder dl(factory_);
+        dl.Name(name_);
+        dl.Target(drives[i]->Url());
+        auto op = dl.Build();
+        ASSERT_TRUE(op->Prepare().Ok());
+        std::string got;
+        while (!op->IsEof()) {
+            std::vector<uint8_t> buf;
+            ASSERT_GE(op->Read(&buf), 0);
+            got.append(buf.begin(), buf.end());
+        }
+        ASSERT_EQ(data_, got);
+    }
+
+    // The source and the copy share their keys, list them all
+    dropManifest();
+    ASSERT_EQ(Cause::OK, remove());
+    ASSERT_EQ(0U, keys());
+}
+
+TEST_F(KineticLayoutTest, CopyOntoSource) {
+    upload(4096, 2);
+    const auto before = keys();
+    CopyBuilder builder(factory_);
+    builder.Name(name_);
+    targets(&builder, 2);
+    builder.Destination(drives[0]->Url());
+    auto op = builder.Build();
+    ASSERT_TRUE(op->Prepare().Ok());
+    ASSERT_EQ(Cause::Forbidden, op->Commit().Why());
+    ASSERT_EQ(before, keys());
+    ASSERT_EQ(Cause::OK, remove());
+    ASSERT_EQ(0U, keys());
+}
+
+TEST_F(KineticLayoutTest, CopyManifestTooLarge) {
+    upload(64, 2);
+    CopyBuilder builder(factory_);
+    builder.Name(name_);
+    targets(&builder, 2);
+    builder.Destination(drives[2]->Url());
+    builder.Destination(drives[3]->Url());
+    auto op = builder.Build();
+    ASSERT_TRUE(op->Prepare().Ok());
+    ASSERT_TRUE(op->Commit().Ok());
+
+    // The copy lost its layout, the readers list the blocks
+    std::string value, version, tag;
+    ASSERT_TRUE(drives[2]->Backend()->Get(name_ + "-#", &value, &version,
+                                          &tag));
+    ASSERT_EQ(std::string::npos, value.find("\"blocks\""));
+    DownloadBuilder dl(factory_);
+    dl.Name(name_);
+    dl.Target(drives[2]->Url());
+    dl.Target(drives[3]->Url());
+    auto down = dl.Build();
+    ASSERT_TRUE(down->Prepare().Ok());
+    std::string got;
+    while (!down->IsEof()) {
+        std::vector<uint8_t> buf;
+        ASSERT_GE(down->Read(&buf), 0);
+        got.append(buf.begin(), buf.end());
+    }
+    ASSERT_EQ(data_, got);
+
+    dropManifest();
+    ASSERT_EQ(Cause::OK, remove());
+    ASSERT_EQ(0U, keys());
+}
+
 int main(int argc, char **argv) {
     gflags::ParseCommandLineFlags(&argc, &argv, true);
     google::InitGoogleLogging(argv[0]);
     ::testing::InitGoogleTest(&argc, argv);
     FLAGS_logtostderr = true;
 
+    Simulator simulator;
+    if (FLAGS_URL_DEVICE.empty()) {
+        if (!simulator.Start("127.0.0.1:0")) {
+            LOG(ERROR) << "Simulator startup failed";
+            return -1;
+        }
+        // Tight batches, so that the uploads have to split them
+        simulator.Limits(1024 * 1024, 4, 16384, 16);
+        FLAGS_URL_DEVICE = simulator.Url();
+    }
+    for (int i = 0; i < 4; ++i) {
+        drives.emplace_back(new Simulator);
+        // Values small enough for the layout of a fine-grained chunk to
+        // exceed them
+        drives.back()->Limits(16384, 64, 1024 * 1024, 16);
+        if (!drives.back()->Start("127.0.0.1:0")) {
+            LOG(ERROR) << "Simulator startup failed";
+            return -1;
+        }
+    }
     return RUN_ALL_TESTS();
 }
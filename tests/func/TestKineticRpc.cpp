@@ -17,15 +17,19 @@
  */
 
 #include <gtest/gtest.h>
+#include <libmill.h>
 
+#include <algorithm>
 #include <vector>
 #include <memory>
+#include <string>
 #include <cassert>
 
 #include "utils/macros.h"
 #include "oio/blob/kinetic/coro/RPC.h"
 #include "oio/blob/kinetic/coro/CoroutineClient.h"
 #include "oio/blob/kinetic/coro/CoroutineClientFactory.h"
+#include "oio/blob/kinetic/coro/Simulator.h"
 
 using oio::kinetic::client::ClientInterface;
 using oio::kinetic::client::CoroutineClientFactory;
@@ -36,8 +40,18 @@ using oio::kinetic::client::Get;
 using oio::kinetic::client::GetKeyRange;
 using oio::kinetic::client::GetNext;
 using oio::kinetic::client::GetLog;
-
-DEFINE_string(url_device, "", "URL of the Kinetic device");
+using oio::kinetic::client::StartBatch;
+using oio::kinetic::client::EndBatch;
+using oio::kinetic::client::Priority;
+using oio::kinetic::client::P2PPush;
+using oio::kinetic::client::TagAlgorithm;
+using oio::kinetic::sim::Simulator;
+
+DEFINE_string(url_device, "",
+              "URL of the Kinetic device, a simulator is started if empty");
+DEFINE_string(url_peer, "",
+              "URL of a second Kinetic device, a simulator is started if "
+              "empty");
 
 class ClientWrapper;
 
@@ -98,6 +112,9 @@ class FactoryWrapperReset : public FactoryWrapper {
 
 std::unique_ptr<FactoryWrapper> factory(nullptr);
 
+// The simulator behind url_device, if started
+static Simulator *local = nullptr;
+
 TEST(Kinetic, Put) {
     auto client = factory->Get();
     Put put;
@@ -172,6 +189,192 @@ TEST(Kinetic, UploadArray) {
         assert(p->Ok());
 }
 
+TEST(Kinetic, UploadManyInFlight) {
+    auto client = factory->Get();
+
+    // Enough RPC to make any linear management of the pending list obvious
+    const int count = 10000;
+    std::vector<std::unique_ptr<Put>> puts;
+    puts.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        auto ex = new Put();
+        ex->Key("inflight-" + std::to_string(i));
+        ex->Value("v");
+        ex->PostVersion("0");
+        puts.emplace_back(ex);
+    }
+
+    std::vector<std::shared_ptr<Sync>> ops;
+    ops.reserve(count);
+    for (auto &p : puts)
+        ops.push_back((*client)->RPC(p.get()));
+    for (auto &op : ops)
+        op->Wait();
+    for (auto &p : puts)
+        ASSERT_TRUE(p->Ok());
+}
+
+TEST(Kinetic, UploadBatch) {
+    auto client = factory->Get();
+    const uint32_t id = (*client)->NewBatch();
+
+    StartBatch start;
+    start.Batch(id);
+    auto op_start = (*client)->RPC(&start);
+
+    std::vector<std::unique_ptr<Put>> puts;
+    std::vector<std::shared_ptr<Sync>> ops;
+    for (int i = 0; i < 8; ++i) {
+        auto ex = new Put();
+        ex->Key("batch-" + std::to_string(i));
+        ex->Value("v");
+        ex->Batch(id);
+        puts.emplace_back(ex);
+        ops.push_back((*client)->RPC(ex));
+    }
+
+    EndBatch end;
+    end.Batch(id);
+    end.Count(puts.size());
+    auto op_end = (*client)->RPC(&end);
+
+    op_start->Wait();
+    for (auto &op : ops)
+        op->Wait();
+    op_end->Wait();
+    ASSERT_TRUE(start.Ok());
+    for (auto &p : puts)
+        ASSERT_TRUE(p->Ok());
+    ASSERT_TRUE(end.Ok());
+}
+
+TEST(Kinetic, UploadBatchOverflow) {
+    auto client = factory->Get();
+    GetLog log;
+    (*client)->RPC(&log)->Wait();
+    ASSERT_TRUE(log.Ok());
+    ASSERT_GT(log.getMaxBatchOps(), 0U);
+
+    // One PUT more than the drive accepts in a batch
+    const uint32_t id = (*client)->NewBatch();
+    StartBatch start;
+    start.Batch(id);
+    auto op_start = (*client)->RPC(&start);
+    std::vector<std::unique_ptr<Put>> puts;
+    std::vector<std::shared_ptr<Sync>> ops;
+    for (uint32_t i = 0; i <= log.getMaxBatchOps(); ++i) {
+        auto ex = new Put();
+        ex->Key("overflow-" + std::to_string(i));
+        ex->Value("v");
+        ex->Batch(id);
+        puts.emplace_back(ex);
+        ops.push_back((*client)->RPC(ex));
+    }
+    EndBatch end;
+    end.Batch(id);
+    end.Count(puts.size());
+    auto op_end = (*client)->RPC(&end);
+
+    op_start->Wait();
+    for (auto &op : ops)
+        op->Wait();
+    op_end->Wait();
+    ASSERT_TRUE(start.Ok());
+    ASSERT_FALSE(end.Ok());
+
+    Get get;
+    get.Key("overflow-0");
+    (*client)->RPC(&get)->Wait();
+    ASSERT_FALSE(get.Ok());
+}
+
+static coroutine void waitAsync(std::shared_ptr<Sync> op, int idx,
+                                std::vector<int> *order, chan done) {
+    op->Wait();
+    order->push_back(idx);
+    chs(done, int, idx);
+}
+
+TEST(Kinetic, UploadPriorities) {
+    // The drive is slow enough for the RPC to queue in the client
+    if (local != nullptr) {
+        local->Latency(10);
+        local->Bandwidth(8 * 1024 * 1024);
+    }
+    auto client = factory->Get();
+    const std::string value(64 * 1024, 'v');
+
+    // A background flow first, then an urgent RPC that overtakes it
+    const int count = 32;
+    std::vector<std::unique_ptr<Put>> puts;
+    std::vector<std::shared_ptr<Sync>> ops;
+    for (int i = 0; i < count; ++i) {
+        auto ex = new Put();
+        ex->Key("prio-" + std::to_string(i));
+        ex->Value(value);
+        puts.emplace_back(ex);
+        ops.push_back((*client)->RPC(ex, Priority::Low));
+    }
+    Put urgent;
+    urgent.Key("prio-urgent");
+    urgent.Value(value);
+    ops.push_back((*client)->RPC(&urgent, Priority::High));
+    ASSERT_EQ(Priority::High, urgent.GetPriority());
+
+    std::vector<int> order;
+    chan done = chmake(int, ops.size());
+    for (size_t i = 0; i < ops.size(); ++i)
+        mill_go(waitAsync(ops[i], i, &order, done));
+    for (size_t i = 0; i < ops.size(); ++i)
+        (void) chr(done, int);
+    chclose(done);
+    if (local != nullptr) {
+        local->Latency(0);
+        local->Bandwidth(0);
+    }
+
+    ASSERT_TRUE(urgent.Ok());
+    for (auto &p : puts)
+        ASSERT_TRUE(p->Ok());
+    // Only the Low RPC already sent may complete before the High one
+    const auto pos = std::find(order.begin(), order.end(), count);
+    ASSERT_NE(order.end(), pos);
+    ASSERT_LT(pos - order.begin(), count / 4);
+}
+
+TEST(Kinetic, P2PPush) {
+    auto client = factory->Get();
+    for (int i = 0; i < 4; ++i) {
+        Put put;
+        put.Key("p2p-" + std::to_string(i));
+        put.Value("v" + std::to_string(i));
+        (*client)->RPC(&put)->Wait();
+        ASSERT_TRUE(put.Ok());
+    }
+
+    P2PPush push;
+    ASSERT_FALSE(push.Peer("no-port"));
+    ASSERT_TRUE(push.Peer(FLAGS_url_peer));
+    for (int i = 0; i < 4; ++i)
+        push.Add("p2p-" + std::to_string(i));
+    push.Add("p2p-0", "p2p-renamed");
+    push.Add("p2p-missing");
+    (*client)->RPC(&push)->Wait();
+    ASSERT_FALSE(push.Ok());
+    for (size_t i = 0; i < 5; ++i)
+        ASSERT_TRUE(push.Pushed(i));
+    ASSERT_FALSE(push.Pushed(5));
+
+    CoroutineClientFactory peers;
+    Get get;
+    get.Key("p2p-renamed");
+    peers.Get(FLAGS_url_peer)->RPC(&get)->Wait();
+    ASSERT_TRUE(get.Ok());
+    std::vector<uint8_t> v;
+    get.Steal(v);
+    ASSERT_EQ(std::string("v0"), std::string(v.begin(), v.end()));
+}
+
 TEST(Kinetic, GetSingle) {
     auto client = factory->Get();
     Get get;
@@ -183,6 +386,57 @@ TEST(Kinetic, GetSingle) {
     get.Steal(v);
 }
 
+TEST(Kinetic, GetVerify) {
+    auto client = factory->Get();
+    for (auto algo : {TagAlgorithm::SHA1, TagAlgorithm::SHA2,
+                      TagAlgorithm::CRC32C, TagAlgorithm::CRC64}) {
+        Put put;
+        put.Key("tagged");
+        put.Value("value");
+        put.Algorithm(algo);
+        (*client)->RPC(&put)->Wait();
+        ASSERT_TRUE(put.Ok());
+
+        Get get;
+        get.Key("tagged");
+        get.Verify(true);
+        (*client)->RPC(&get)->Wait();
+        ASSERT_TRUE(get.Ok());
+        std::vector<uint8_t> v;
+        get.Steal(v);
+        ASSERT_EQ(std::string("value"), std::string(v.begin(), v.end()));
+    }
+}
+
+TEST(Kinetic, GetVerifyCorrupted) {
+    // The value is corrupted behind the drive
+    if (local == nullptr)
+        return;
+    auto client = factory->Get();
+    Put put;
+    put.Key("corrupted");
+    put.Value("value");
+    (*client)->RPC(&put)->Wait();
+    ASSERT_TRUE(put.Ok());
+
+    std::string value, version, tag;
+    ASSERT_TRUE(local->Backend()->Get("corrupted", &value, &version, &tag));
+    ASSERT_FALSE(tag.empty());
+    value[0] ^= 0x01;
+    ASSERT_TRUE(local->Backend()->Put("corrupted", value, version, tag));
+
+    Get get;
+    get.Key("corrupted");
+    get.Verify(true);
+    (*client)->RPC(&get)->Wait();
+    ASSERT_FALSE(get.Ok());
+
+    Get plain;
+    plain.Key("corrupted");
+    (*client)->RPC(&plain)->Wait();
+    ASSERT_TRUE(plain.Ok());
+}
+
 TEST(Kinetic, GetKeyRange) {
     auto client = factory->Get();
     GetKeyRange op;
@@ -214,7 +468,9 @@ TEST(Kinetic, GetLog) {
             << " cpu=" << op.getCpu()
             << " io=" << op.getIo()
             << " space=" << op.getSpace()
-            << " temp=" << op.getTemp();
+            << " temp=" << op.getTemp()
+            << " value=" << op.getMaxValueSize()
+            << " batch=" << op.getMaxBatchOps();
 }
 
 int main(int argc, char **argv) {
@@ -223,9 +479,21 @@ int main(int argc, char **argv) {
     ::testing::InitGoogleTest(&argc, argv);
     FLAGS_logtostderr = true;
 
+    Simulator simulator, peer;
     if (FLAGS_url_device == "") {
-        LOG(ERROR) << "Missing \"-url_device\" flags";
-        return -1;
+        if (!simulator.Start("127.0.0.1:0")) {
+            LOG(ERROR) << "Simulator startup failed";
+            return -1;
+        }
+        FLAGS_url_device = simulator.Url();
+        local = &simulator;
+    }
+    if (FLAGS_url_peer == "") {
+        if (!peer.Start("127.0.0.1:0")) {
+            LOG(ERROR) << "Simulator startup failed";
+            return -1;
+        }
+        FLAGS_url_peer = peer.Url();
     }
 
     factory.reset(new FactoryWrapperReuse);
@@ -18,22 +18,40 @@
 
 #include <fcntl.h>
 
+#include <map>
+
 #include <gtest/gtest.h>
+#include <libmill.h>
+#include <rapidjson/document.h>
 
 #include "utils/macros.h"
 #include "utils/utils.hpp"
 #include "oio/blob/local/blob.hpp"
+#include "oio/blob/local/cache.hpp"
+#include "oio/blob/local/hash_tree.hpp"
+#include "oio/blob/local/volume.hpp"
 #include "tests/common/BlobTestSuite.h"
 
 using oio::local::blob::UploadBuilder;
 using oio::local::blob::DownloadBuilder;
 using oio::local::blob::RemovalBuilder;
+using oio::local::blob::Durability;
+using oio::local::blob::group_commit_stats;
+using oio::local::blob::XattrLayout;
+using oio::local::blob::HashTree;
+using oio::local::blob::ChunkCache;
+using oio::local::blob::Placement;
+using oio::local::blob::Volume;
+using oio::local::blob::VolumeOp;
+using oio::local::blob::VolumeSet;
 using oio::api::Cause;
 
 DEFINE_string(test_file_path,
               "/tmp/blob-",
               "Path of the random file");
 
+DECLARE_int32(local_group_commit_delay);
+
 #define ASSERT_ABSENT(path) do { \
     UploadBuilder builder; \
     builder.Path(path); \
@@ -175,6 +193,376 @@ TEST_F(LocalBlobTestSuite, UploadAlreadyFinal) {
     ::unlink(test_file_path.c_str());
 }
 
+// Test Commit() waits for the flush, whatever the durability
+TEST_F(LocalBlobTestSuite, UploadDurable) {
+    for (auto d : {Durability::None, Durability::Sync, Durability::Group}) {
+        UploadBuilder op;
+        op.Path(test_file_path);
+        op.SetDurability(d);
+        auto ul = op.Build();
+        ASSERT_TRUE(ul->Prepare().Ok());
+        ul->SetXattr("k", "v");
+        ul->Write(reinterpret_cast<const uint8_t *>("data"), 4);
+        ASSERT_TRUE(ul->Commit().Ok());
+        ASSERT_TRUE(isPresent(test_file_path));
+        ASSERT_FALSE(isPresent(PathPending()));
+        ::unlink(test_file_path.c_str());
+    }
+}
+
+static std::vector<uint64_t> groupBatches() {
+    std::string json;
+    group_commit_stats(&json);
+    rapidjson::Document doc;
+    doc.Parse(json.c_str());
+    std::vector<uint64_t> out;
+    const auto &batch = doc["batch"];
+    for (rapidjson::SizeType i = 0; i < batch.Size(); ++i)
+        out.push_back(batch[i].GetUint64());
+    return out;
+}
+
+static coroutine void commitAsync(oio::api::blob::Upload *ul, chan done) {
+    chs(done, bool, ul->Commit().Ok());
+}
+
+// Test the concurrent commits on a disk share a single flush
+TEST_F(LocalBlobTestSuite, UploadGroupCommit) {
+    const int count = 4;
+    std::vector<std::unique_ptr<oio::api::blob::Upload>> uls;
+    for (int i = 0; i < count; ++i) {
+        UploadBuilder op;
+        op.Path(test_file_path + "-" + std::to_string(i));
+        op.SetDurability(Durability::Group);
+        uls.push_back(op.Build());
+        ASSERT_TRUE(uls.back()->Prepare().Ok());
+        uls.back()->Write("data");
+    }
+
+    const auto delay = FLAGS_local_group_commit_delay;
+    FLAGS_local_group_commit_delay = 100;
+    const auto before = groupBatches();
+    chan done = chmake(bool, count);
+    for (auto &ul : uls)
+        mill_go(commitAsync(ul.get(), done));
+    for (int i = 0; i < count; ++i)
+        ASSERT_TRUE(chr(done, bool));
+    chclose(done);
+    FLAGS_local_group_commit_delay = delay;
+
+    // A single batch of 4 uploads, in the bucket [4,8)
+    const auto after = groupBatches();
+    ASSERT_EQ(before.size(), after.size());
+    for (size_t i = 0; i < after.size(); ++i)
+        ASSERT_EQ(before[i] + (i == 3 ? 1 : 0), after[i]);
+
+    for (int i = 0; i < count; ++i) {
+        const auto path = test_file_path + "-" + std::to_string(i);
+        ASSERT_TRUE(isPresent(path));
+        ::unlink(path.c_str());
+    }
+}
+
+// Test the O_DIRECT and preallocation modes keep the content intact
+TEST_F(LocalBlobTestSuite, UploadDirect) {
+    std::string data;
+    append_string_random(&data, 3 * 1024 * 1024 + 123, "0123456789ABCDEF");
+
+    UploadBuilder ub;
+    ub.Path(test_file_path);
+    ub.ExpectedSize(data.size() * 2);
+    ub.Preallocate(true);
+    ub.Direct(true);
+    auto ul = ub.Build();
+    ASSERT_TRUE(ul->Prepare().Ok());
+    ul->Write(data.substr(0, 1000));
+    ul->Write(data.substr(1000));
+    ASSERT_TRUE(ul->Commit().Ok());
+
+    struct stat64 st;
+    ASSERT_EQ(0, ::stat64(test_file_path.c_str(), &st));
+    ASSERT_EQ(data.size(), static_cast<size_t>(st.st_size));
+
+    DownloadBuilder db;
+    db.Path(test_file_path);
+    db.Direct(true);
+    auto dl = db.Build();
+    ASSERT_TRUE(dl->Prepare().Ok());
+    std::string out;
+    while (!dl->IsEof()) {
+        std::vector<uint8_t> buf;
+        if (dl->Read(&buf) <= 0)
+            break;
+        out.append(buf.begin(), buf.end());
+    }
+    ASSERT_EQ(data, out);
+    ::unlink(test_file_path.c_str());
+}
+
+// Test the read ahead returns the same bytes, for whole and range reads
+TEST_F(LocalBlobTestSuite, DownloadReadAhead) {
+    std::string data;
+    append_string_random(&data, 3 * 1024 * 1024 + 123, "0123456789ABCDEF");
+    UploadBuilder ub;
+    ub.Path(test_file_path);
+    auto ul = ub.Build();
+    ASSERT_TRUE(ul->Prepare().Ok());
+    ul->Write(data);
+    ASSERT_TRUE(ul->Commit().Ok());
+
+    auto read = [](oio::api::blob::Download *dl) -> std::string {
+        std::string out;
+        while (!dl->IsEof()) {
+            std::vector<uint8_t> buf;
+            if (dl->Read(&buf) <= 0)
+                break;
+            out.append(buf.begin(), buf.end());
+        }
+        return out;
+    };
+
+    for (bool direct : {false, true}) {
+        for (bool ahead : {false, true}) {
+            DownloadBuilder db;
+            db.Path(test_file_path);
+            db.Direct(direct);
+            db.ReadAhead(ahead);
+            db.DropCache(true);
+
+            auto dl = db.Build();
+            ASSERT_TRUE(dl->Prepare().Ok());
+            ASSERT_EQ(data, read(dl.get()));
+
+            dl = db.Build();
+            ASSERT_TRUE(dl->Prepare().Ok());
+            ASSERT_TRUE(dl->SetRange(1001, 2 * 1024 * 1024 + 7).Ok());
+            ASSERT_EQ(data.substr(1001, 2 * 1024 * 1024 + 7), read(dl.get()));
+
+            // Stopped early, the pages read are dropped at the destruction
+            dl = db.Build();
+            ASSERT_TRUE(dl->Prepare().Ok());
+            std::vector<uint8_t> buf;
+            ASSERT_GT(dl->Read(&buf), 0);
+            ASSERT_FALSE(dl->IsEof());
+            dl.reset();
+        }
+    }
+    ::unlink(test_file_path.c_str());
+}
+
+TEST(LocalXattr, PackUnpack) {
+    std::map<std::string, std::string> in{
+        {"chunk.id", "0123456789ABCDEF"}, {"chunk.size", "1024"},
+        {"custom", std::string(300, 'x')}, {"empty", ""}};
+    std::string packed;
+    oio::local::blob::xattr_pack(in, &packed);
+    std::map<std::string, std::string> out;
+    ASSERT_TRUE(oio::local::blob::xattr_unpack(packed, &out));
+    ASSERT_EQ(in, out);
+
+    // Truncated records are rejected
+    out.clear();
+    packed.resize(packed.size() - 1);
+    ASSERT_FALSE(oio::local::blob::xattr_unpack(packed, &out));
+}
+
+// Test both layouts are loaded the same way
+TEST_F(LocalBlobTestSuite, UploadXattr) {
+    for (auto l : {XattrLayout::Split, XattrLayout::Packed,
+                   XattrLayout::Both}) {
+        UploadBuilder op;
+        op.Path(test_file_path);
+        op.SetXattrLayout(l);
+        auto ul = op.Build();
+        ASSERT_TRUE(ul->Prepare().Ok());
+        ul->SetXattr("chunk.id", "0123");
+        ul->SetXattr("custom", "value");
+        ASSERT_TRUE(ul->Commit().Ok());
+
+        int fd = ::open(test_file_path.c_str(), O_RDONLY);
+        ASSERT_GE(fd, 0);
+        std::map<std::string, std::string> attrs;
+        ASSERT_EQ(0, oio::local::blob::xattr_load(fd, &attrs));
+        ::close(fd);
+        ASSERT_EQ(2U, attrs.size());
+        ASSERT_EQ("0123", attrs["chunk.id"]);
+        ASSERT_EQ("value", attrs["custom"]);
+        ::unlink(test_file_path.c_str());
+    }
+}
+
+TEST(LocalHashTree, Ensure) {
+    std::string base(FLAGS_test_file_path);
+    append_string_random(&base, 16, "0123456789ABCDEF");
+    HashTree tree(base, 2, 1);
+    ASSERT_EQ(base + "/A/B/AB01", tree.Path("AB01"));
+    ASSERT_EQ(base + "/a/b/ab01", tree.Path("ab01"));
+
+    // Missing parents are created, cached or not
+    ASSERT_EQ(0, tree.Ensure("AB01", 0755));
+    ASSERT_TRUE(isPresent(base + "/A/B"));
+    ASSERT_EQ(0, tree.Ensure("ab01", 0755));
+    ASSERT_TRUE(isPresent(base + "/a/b"));
+
+    // A directory removed behind the tree is created again once forgotten,
+    // the lowercase IDs do not alias the uppercase ones
+    ASSERT_EQ(0, ::rmdir((base + "/A/B").c_str()));
+    ASSERT_EQ(0, tree.Ensure("AB01", 0755));
+    ASSERT_FALSE(isPresent(base + "/A/B"));
+    tree.Forget("AB01");
+    ASSERT_EQ(0, tree.Ensure("AB01", 0755));
+    ASSERT_TRUE(isPresent(base + "/A/B"));
+    ASSERT_EQ(0, ::rmdir((base + "/a/b").c_str()));
+    ASSERT_EQ(0, tree.Ensure("ab01", 0755));
+    ASSERT_FALSE(isPresent(base + "/a/b"));
+    tree.Forget("ab01");
+    ASSERT_EQ(0, tree.Ensure("ab02", 0755));
+    ASSERT_TRUE(isPresent(base + "/a/b"));
+
+    ASSERT_TRUE(tree.Precreate(0755));
+    ASSERT_TRUE(isPresent(base + "/F/F"));
+    ASSERT_EQ(0, tree.Ensure("FF", 0755));
+
+    for (const char *d : {"0123456789ABCDEF", "ab"}) {
+        for (const char *p = d; *p; ++p) {
+            const std::string dir = base + "/" + std::string(1, *p);
+            for (const char *q = d; *q; ++q)
+                ::rmdir((dir + "/" + std::string(1, *q)).c_str());
+            ::rmdir(dir.c_str());
+        }
+    }
+    ASSERT_EQ(0, ::rmdir(base.c_str()));
+}
+
+// Test the chunks are spread, then found wherever they have been placed
+TEST(LocalVolumes, Placement) {
+    std::string base(FLAGS_test_file_path);
+    append_string_random(&base, 16, "0123456789ABCDEF");
+    ASSERT_EQ(0, ::mkdir(base.c_str(), 0755));
+
+    std::vector<std::string> roots;
+    VolumeSet hashed(Placement::Hash), spaced(Placement::Space);
+    for (int i = 0; i < 4; ++i) {
+        roots.push_back(base + "/" + std::to_string(i));
+        ASSERT_EQ(0, ::mkdir(roots.back().c_str(), 0755));
+        hashed.Add(std::make_shared<Volume>(roots.back(), 0, 0, 0));
+        spaced.Add(std::make_shared<Volume>(roots.back(), 0, 0, 0));
+    }
+
+    std::map<std::string, int> hits;
+    for (int i = 0; i < 400; ++i) {
+        std::string id;
+        append_string_random(&id, 32, "0123456789ABCDEF");
+        auto vol = hashed.Pick(id);
+        ASSERT_EQ(vol, hashed.Pick(id));
+        hits[vol->Root()]++;
+    }
+    ASSERT_EQ(4U, hits.size());
+    for (const auto &e : hits)
+        ASSERT_GT(e.second, 50);
+
+    // A chunk placed by the free space is found by the hash set too, once
+    // told the chunks are scattered
+    std::string id;
+    append_string_random(&id, 32, "0123456789ABCDEF");
+    auto vol = spaced.Pick(id);
+    const std::string path = vol->Tree().Path(id);
+    int fd = ::open(path.c_str(), O_CREAT | O_WRONLY, 0644);
+    ASSERT_GE(fd, 0);
+    ::close(fd);
+    ASSERT_EQ(vol->Root(), spaced.Locate(id)->Root());
+    if (vol->Root() != hashed.Pick(id)->Root()) {
+        ASSERT_EQ(nullptr, hashed.Locate(id));
+    }
+    hashed.SetScattered(true);
+    ASSERT_EQ(vol->Root(), hashed.Find(id)->Root());
+
+    vol->Acquire(VolumeOp::Download);
+    vol->Release();
+    std::string stats;
+    spaced.Stats(&stats);
+    ASSERT_NE(std::string::npos, stats.find("\"download\":1"));
+
+    ::unlink(path.c_str());
+    for (const auto &r : roots)
+        ASSERT_EQ(0, ::rmdir(r.c_str()));
+    ASSERT_EQ(0, ::rmdir(base.c_str()));
+}
+
+static std::string readAll(oio::api::blob::Download *dl,
+                           bool prepare = true) {
+    std::string out;
+    if (prepare && !dl->Prepare().Ok())
+        return "<error>";
+    while (!dl->IsEof()) {
+        std::vector<uint8_t> buf;
+        if (dl->Read(&buf) < 0)
+            return "<error>";
+        out.append(buf.begin(), buf.end());
+    }
+    return out;
+}
+
+// Test the chunks get in through a download, and out through a removal
+TEST_F(LocalBlobTestSuite, CacheFillInvalidate) {
+    ChunkCache cache(1024 * 1024, 64 * 1024);
+    const std::string id("chunk");
+    auto ul = cache.Invalidating(id, factory_->Upload());
+    ASSERT_TRUE(ul->Prepare().Ok());
+    ul->Write("0123456789");
+    ASSERT_TRUE(ul->Commit().Ok());
+
+    ASSERT_EQ(nullptr, cache.Lookup(id));
+    auto dl = cache.Fill(id, factory_->Download());
+    ASSERT_EQ("0123456789", readAll(dl.get()));
+    auto hit = cache.Lookup(id);
+    ASSERT_NE(nullptr, hit);
+    ASSERT_TRUE(hit->Prepare().Ok());
+    ASSERT_TRUE(hit->SetRange(2, 3).Ok());
+    std::vector<uint8_t> buf;
+    ASSERT_EQ(3, hit->Read(&buf));
+    ASSERT_TRUE(hit->IsEof());
+
+    // A fill started before an invalidation is dropped
+    dl = cache.Fill(id, factory_->Download());
+    ASSERT_TRUE(dl->Prepare().Ok());
+    auto rem = cache.Invalidating(id, factory_->Removal());
+    ASSERT_TRUE(rem->Prepare().Ok());
+    ASSERT_TRUE(rem->Commit().Ok());
+    ASSERT_EQ(nullptr, cache.Lookup(id));
+    ASSERT_EQ("0123456789", readAll(dl.get(), false));
+    ASSERT_EQ(nullptr, cache.Lookup(id));
+}
+
+// Test a scan of cold chunks doesn't flush the hot ones
+TEST(LocalChunkCache, Admission) {
+    ChunkCache cache(10 * 1000, 1000);
+    auto chunk = std::make_shared<const std::vector<uint8_t>>(1000, 'x');
+    for (int i = 0; i < 10; ++i) {
+        const std::string id = "hot-" + std::to_string(i);
+        for (int j = 0; j < 5; ++j)
+            cache.Lookup(id);
+        ASSERT_TRUE(cache.Insert(id, chunk, cache.Generation()));
+    }
+    for (int i = 0; i < 100; ++i) {
+        const std::string id = "cold-" + std::to_string(i);
+        ASSERT_EQ(nullptr, cache.Lookup(id));
+        ASSERT_FALSE(cache.Insert(id, chunk, cache.Generation()));
+    }
+    for (int i = 0; i < 10; ++i)
+        ASSERT_NE(nullptr, cache.Lookup("hot-" + std::to_string(i)));
+
+    // Too large for the cache
+    auto large = std::make_shared<const std::vector<uint8_t>>(1001, 'x');
+    ASSERT_FALSE(cache.Insert("large", large, cache.Generation()));
+
+    // Popular enough, a new chunk evicts the least recently used
+    for (int j = 0; j < 15; ++j)
+        cache.Lookup("new");
+    ASSERT_TRUE(cache.Insert("new", chunk, cache.Generation()));
+    ASSERT_EQ(nullptr, cache.Lookup("hot-0"));
+}
+
 int main(int argc, char **argv) {
     gflags::ParseCommandLineFlags(&argc, &argv, true);
     google::InitGoogleLogging(argv[0]);
@@ -0,0 +1,480 @@
+/**
+ * This file is part of the OpenIO client libraries
+ * Copyright (C) 2016 OpenIO SAS
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ */
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <glog/logging.h>
+#include <gflags/gflags.h>
+#include <gtest/gtest.h>
+#include <libmill.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "utils/macros.h"
+#include "utils/utils.hpp"
+#include "oio/blob/local/disk_io.hpp"
+#include "oio/blob/packed/blob.hpp"
+#include "tests/common/BlobTestSuite.h"
+
+using oio::api::Cause;
+using oio::local::blob::DiskIO;
+using oio::packed::blob::Store;
+using oio::packed::blob::UploadBuilder;
+using oio::packed::blob::RemovalBuilder;
+using oio::packed::blob::DownloadBuilder;
+
+DECLARE_uint64(packed_segment_size);
+
+DEFINE_string(test_dir_path,
+              "/tmp/packed-",
+              "Prefix of the directory of the segments");
+
+static std::string makeDir() {
+    std::string dir(FLAGS_test_dir_path);
+    append_string_random(&dir, 8, random_hex);
+    return dir;
+}
+
+static void removeDir(const std::string &dir) {
+    DIR *d = ::opendir(dir.c_str());
+    if (d == nullptr)
+        return;
+    while (struct dirent *de = ::readdir(d)) {
+        if (de->d_name[0] != '.')
+            ::unlink((dir + "/" + de->d_name).c_str());
+    }
+    ::closedir(d);
+    ::rmdir(dir.c_str());
+}
+
+static void put(std::shared_ptr<Store> store, const std::string &name,
+                const std::string &data) {
+    UploadBuilder builder(store);
+    builder.Name(name);
+    auto ul = builder.Build();
+    ASSERT_TRUE(ul->Prepare().Ok());
+    ul->SetXattr("chunk.id", name);
+    ul->Write(data);
+    ASSERT_TRUE(ul->Commit().Ok());
+}
+
+static std::string get(std::shared_ptr<Store> store, const std::string &name,
+                       uint32_t offset = 0, uint32_t size = 0) {
+    DownloadBuilder builder(store);
+    builder.Name(name);
+    auto dl = builder.Build();
+    if (!dl->Prepare().Ok())
+        return "<absent>";
+    if (size > 0 && !dl->SetRange(offset, size).Ok())
+        return "<range>";
+    std::string out;
+    while (!dl->IsEof()) {
+        std::vector<uint8_t> buf;
+        if (dl->Read(&buf) < 0)
+            return "<error>";
+        out.append(buf.begin(), buf.end());
+    }
+    return out;
+}
+
+static void del(std::shared_ptr<Store> store, const std::string &name) {
+    RemovalBuilder builder(store);
+    builder.Name(name);
+    auto rem = builder.Build();
+    ASSERT_TRUE(rem->Prepare().Ok());
+    ASSERT_TRUE(rem->Commit().Ok());
+}
+
+class PackedBlobOpsFactory : public BlobOpsFactory {
+ private:
+    std::shared_ptr<Store> store_;
+    std::string blobname;
+
+ public:
+    ~PackedBlobOpsFactory() override {}
+
+    PackedBlobOpsFactory(std::shared_ptr<Store> s, const std::string &n)
+            : store_(s), blobname(n) {}
+
+    std::unique_ptr<oio::api::blob::Upload> Upload() override {
+        UploadBuilder op(store_);
+        op.Name(blobname);
+        return op.Build();
+    }
+    std::unique_ptr<oio::api::blob::Download> Download() override {
+        DownloadBuilder op(store_);
+        op.Name(blobname);
+        return op.Build();
+    }
+    std::unique_ptr<oio::api::blob::Removal> Removal() override {
+        RemovalBuilder op(store_);
+        op.Name(blobname);
+        return op.Build();
+    }
+};
+
+class PackedBlobTestSuite : public BlobTestSuite {
+ protected:
+    std::string dir;
+
+    ~PackedBlobTestSuite() {}
+
+    PackedBlobTestSuite(): ::BlobTestSuite(), dir() {}
+
+    void SetUp() override {
+        dir = makeDir();
+        std::shared_ptr<Store> store(new Store(dir));
+        ASSERT_TRUE(store->Open().Ok());
+        std::string blobname("blob-");
+        append_string_random(&blobname, 8, random_chars);
+        this->factory_ = new PackedBlobOpsFactory(store, blobname);
+    }
+
+    void TearDown() override {
+        delete this->factory_;
+        this->factory_ = nullptr;
+        removeDir(dir);
+    }
+};
+
+DECLARE_BLOBTESTSUITE(PackedBlobTestSuite);
+
+// Test a pending upload forbids another one
+TEST_F(PackedBlobTestSuite, UploadAlreadyPending) {
+    auto ul0 = Upload();
+    ASSERT_TRUE(ul0->Prepare().Ok());
+    auto ul1 = Upload();
+    ASSERT_EQ(Cause::Already, ul1->Prepare().Why());
+    ASSERT_TRUE(ul0->Abort().Ok());
+    ASSERT_TRUE(ul1->Abort().Why() == Cause::InternalError);
+}
+
+// Test an upload beyond its maximum size fails and leaves the ID free
+TEST(PackedStore, UploadTooLarge) {
+    const auto dir = makeDir();
+    std::shared_ptr<Store> store(new Store(dir));
+    ASSERT_TRUE(store->Open().Ok());
+    UploadBuilder builder(store);
+    builder.Name("A");
+    builder.MaxSize(8);
+    auto ul = builder.Build();
+    ASSERT_TRUE(ul->Prepare().Ok());
+    ul->Write("0123");
+    ul->Write("45678");
+    ASSERT_EQ(Cause::Forbidden, ul->Commit().Why());
+
+    ul = builder.Build();
+    ASSERT_TRUE(ul->Prepare().Ok());
+    ul->Write("01234567");
+    ASSERT_TRUE(ul->Commit().Ok());
+    ASSERT_EQ("01234567", get(store, "A"));
+    removeDir(dir);
+}
+
+// Test the index is rebuilt from the segments, removals included
+TEST(PackedStore, Reopen) {
+    const auto dir = makeDir();
+    do {
+        std::shared_ptr<Store> store(new Store(dir));
+        ASSERT_TRUE(store->Open().Ok());
+        put(store, "A", "0123456789");
+        put(store, "B", "abcdef");
+        put(store, "C", "");
+        del(store, "B");
+        ASSERT_EQ("3456", get(store, "A", 3, 4));
+        ASSERT_EQ("<range>", get(store, "A", 8, 4));
+    } while (0);
+
+    std::shared_ptr<Store> store(new Store(dir));
+    ASSERT_TRUE(store->Open().Ok());
+    ASSERT_EQ("0123456789", get(store, "A"));
+    ASSERT_EQ("<absent>", get(store, "B"));
+    ASSERT_EQ("", get(store, "C"));
+    Store::Blob b;
+    ASSERT_TRUE(store->Lookup("A", &b).Ok());
+    ASSERT_EQ("A", b.attrs["chunk.id"]);
+
+    // Once removed, an ID may be uploaded again
+    put(store, "B", "ghi");
+    ASSERT_EQ("ghi", get(store, "B"));
+    removeDir(dir);
+}
+
+// Test a torn or corrupted tail of the index drops the last blob only, and
+// the blobs appended after the reopen are found at the next one
+TEST(PackedStore, ReopenDamagedIndex) {
+    for (bool corrupt : {false, true}) {
+        const auto dir = makeDir();
+        const std::string idx = dir + "/0000000000000001.idx";
+        do {
+            std::shared_ptr<Store> store(new Store(dir));
+            ASSERT_TRUE(store->Open().Ok());
+            put(store, "A", "0123456789");
+            put(store, "B", "abcdef");
+            put(store, "C", "ghijkl");
+        } while (0);
+
+        struct stat st;
+        ASSERT_EQ(0, ::stat(idx.c_str(), &st));
+        if (corrupt) {
+            int fd = ::open(idx.c_str(), O_WRONLY);
+            ASSERT_GE(fd, 0);
+            ASSERT_EQ(1, ::pwrite(fd, "X", 1, st.st_size - 8));
+            ::close(fd);
+        } else {
+            ASSERT_EQ(0, ::truncate(idx.c_str(), st.st_size - 3));
+        }
+
+        do {
+            std::shared_ptr<Store> store(new Store(dir));
+            ASSERT_TRUE(store->Open().Ok());
+            ASSERT_EQ("0123456789", get(store, "A"));
+            ASSERT_EQ("abcdef", get(store, "B"));
+            ASSERT_EQ("<absent>", get(store, "C"));
+            put(store, "D", "mnopqr");
+            del(store, "A");
+        } while (0);
+
+        std::shared_ptr<Store> store(new Store(dir));
+        ASSERT_TRUE(store->Open().Ok());
+        ASSERT_EQ("<absent>", get(store, "A"));
+        ASSERT_EQ("abcdef", get(store, "B"));
+        ASSERT_EQ("<absent>", get(store, "C"));
+        ASSERT_EQ("mnopqr", get(store, "D"));
+        removeDir(dir);
+    }
+}
+
+// Test the compaction keeps the live blobs, and the removed ones away
+TEST(PackedStore, Compact) {
+    const auto saved = FLAGS_packed_segment_size;
+    FLAGS_packed_segment_size = 4096;
+    const auto dir = makeDir();
+    std::vector<std::string> names, contents;
+    do {
+        std::shared_ptr<Store> store(new Store(dir));
+        ASSERT_TRUE(store->Open().Ok());
+        for (int i = 0; i < 64; ++i) {
+            std::string data;
+            append_string_random(&data, 1000, random_chars);
+            names.push_back("blob-" + std::to_string(i));
+            contents.push_back(data);
+            put(store, names.back(), data);
+        }
+        for (int i = 0; i < 64; ++i) {
+            if (i % 4 != 0)
+                del(store, names[i]);
+        }
+        DiskIO io;
+        ASSERT_TRUE(store->Compact(&io).Ok());
+        for (int i = 0; i < 64; i += 4)
+            ASSERT_EQ(contents[i], get(store, names[i]));
+    } while (0);
+
+    std::shared_ptr<Store> store(new Store(dir));
+    ASSERT_TRUE(store->Open().Ok());
+    for (int i = 0; i < 64; ++i) {
+        if (i % 4 == 0)
+            ASSERT_EQ(contents[i], get(store, names[i]));
+        else
+            ASSERT_EQ("<absent>", get(store, names[i]));
+    }
+    removeDir(dir);
+    FLAGS_packed_segment_size = saved;
+}
+
+static coroutine void compactAsync(std::shared_ptr<Store> store, chan done) {
+    DiskIO io;
+    chs(done, bool, store->Compact(&io).Ok());
+}
+
+static coroutine void eraseAsync(std::shared_ptr<Store> store,
+                                 std::string name, chan done) {
+    DiskIO io;
+    chs(done, bool, store->Erase(&io, name).Ok());
+}
+
+// Test a blob removed while its segment is compacted does not come back,
+// whether the tombstone targets the original or the copy
+TEST(PackedStore, EraseDuringCompaction) {
+    const auto saved = FLAGS_packed_segment_size;
+    FLAGS_packed_segment_size = 4096;
+    for (int delay = 0; delay < 16; ++delay) {
+        const auto dir = makeDir();
+        std::map<std::string, std::string> contents;
+        do {
+            std::shared_ptr<Store> store(new Store(dir));
+            ASSERT_TRUE(store->Open().Ok());
+            for (const char *name : {"x0", "x1", "x2", "x3", "x4", "y0"}) {
+                std::string data;
+                append_string_random(&data, 1000, random_chars);
+                contents[name] = data;
+                put(store, name, data);
+            }
+            for (const char *name : {"x0", "x1", "x2"})
+                del(store, name);
+
+            chan done = chmake(bool, 2);
+            mill_go(compactAsync(store, done));
+            for (int i = 0; i < delay; ++i)
+                yield();
+            mill_go(eraseAsync(store, "x3", done));
+            ASSERT_TRUE(chr(done, bool));
+            ASSERT_TRUE(chr(done, bool));
+            chclose(done);
+
+            ASSERT_EQ("<absent>", get(store, "x3"));
+            ASSERT_EQ(contents["x4"], get(store, "x4"));
+        } while (0);
+
+        std::shared_ptr<Store> store(new Store(dir));
+        ASSERT_TRUE(store->Open().Ok());
+        for (const char *name : {"x0", "x1", "x2", "x3"})
+            ASSERT_EQ("<absent>", get(store, name));
+        ASSERT_EQ(contents["x4"], get(store, "x4"));
+        ASSERT_EQ(contents["y0"], get(store, "y0"));
+        removeDir(dir);
+    }
+    FLAGS_packed_segment_size = saved;
+}
+
+// Test the tombstones survive the compaction of the segment holding them
+// before the one holding their target, then the compaction of the target
+TEST(PackedStore, CompactTombstonesOutOfOrder) {
+    const auto saved = FLAGS_packed_segment_size;
+    FLAGS_packed_segment_size = 4096;
+    const auto dir = makeDir();
+    std::map<std::string, std::string> contents;
+    auto check = [&dir, &contents]() {
+        std::shared_ptr<Store> store(new Store(dir));
+        ASSERT_TRUE(store->Open().Ok());
+        for (const auto &e : contents)
+            ASSERT_EQ(e.second, get(store, e.first)) << e.first;
+    };
+
+    std::shared_ptr<Store> store(new Store(dir));
+    ASSERT_TRUE(store->Open().Ok());
+    auto add = [&store, &contents](const std::string &name) {
+        std::string data;
+        append_string_random(&data, 1000, random_chars);
+        contents[name] = data;
+        put(store, name, data);
+    };
+    auto remove = [&store, &contents](const std::string &name) {
+        del(store, name);
+        contents[name] = "<absent>";
+    };
+    DiskIO io;
+
+    // 1: A0-A4, 2: B0-B4 and the tombstone of A0, 3: C0 and those of B*
+    for (int i = 0; i < 5; ++i)
+        add("A" + std::to_string(i));
+    add("B0");
+    remove("A0");
+    for (int i = 1; i < 5; ++i)
+        add("B" + std::to_string(i));
+    add("C0");
+    for (int i = 0; i < 5; ++i)
+        remove("B" + std::to_string(i));
+
+    // 2 goes first, the tombstone of A0 is carried to 3
+    ASSERT_TRUE(store->Compact(&io).Ok());
+    check();
+
+    // 3 goes before 1, the tombstone of A0 is carried again
+    for (int i = 1; i < 5; ++i)
+        add("C" + std::to_string(i));
+    add("D0");
+    for (int i = 0; i < 5; ++i)
+        remove("C" + std::to_string(i));
+    ASSERT_TRUE(store->Compact(&io).Ok());
+    check();
+
+    // Then 1 itself
+    for (int i = 1; i < 5; ++i)
+        remove("A" + std::to_string(i));
+    add("D1");
+    ASSERT_TRUE(store->Compact(&io).Ok());
+    check();
+
+    Store::Blob b;
+    ASSERT_TRUE(store->Lookup("D0", &b).Ok());
+    std::string stats;
+    store->Stats(&stats);
+    ASSERT_NE(std::string::npos, stats.find("\"blobs\":2"));
+    store.reset();
+    removeDir(dir);
+    FLAGS_packed_segment_size = saved;
+}
+
+static coroutine void putAsync(std::shared_ptr<Store> store,
+                               std::string name, std::string data, chan done) {
+    UploadBuilder builder(store);
+    builder.Name(name);
+    auto ul = builder.Build();
+    bool ok = ul->Prepare().Ok();
+    if (ok) {
+        ul->Write(data);
+        ok = ul->Commit().Ok();
+    }
+    chs(done, bool, ok);
+}
+
+// Test the concurrent appends of a durable store, flushed by groups, all
+// succeed then survive a reopen, across the rotations of the segment
+TEST(PackedStore, DurableGroup) {
+    const auto saved = FLAGS_packed_segment_size;
+    FLAGS_packed_segment_size = 4096;
+    const auto dir = makeDir();
+    std::map<std::string, std::string> contents;
+    do {
+        std::shared_ptr<Store> store(new Store(dir));
+        ASSERT_TRUE(store->Open().Ok());
+        store->SetDurability(oio::local::blob::Durability::Group);
+        chan done = chmake(bool, 16);
+        for (int i = 0; i < 16; ++i) {
+            const std::string name("g" + std::to_string(i));
+            append_string_random(&contents[name], 1000, random_chars);
+            mill_go(putAsync(store, name, contents[name], done));
+        }
+        for (int i = 0; i < 16; ++i)
+            ASSERT_TRUE(chr(done, bool));
+        chclose(done);
+    } while (0);
+
+    std::shared_ptr<Store> store(new Store(dir));
+    ASSERT_TRUE(store->Open().Ok());
+    for (const auto &e : contents)
+        ASSERT_EQ(e.second, get(store, e.first)) << e.first;
+    store.reset();
+    removeDir(dir);
+    FLAGS_packed_segment_size = saved;
+}
+
+int main(int argc, char **argv) {
+    gflags::ParseCommandLineFlags(&argc, &argv, true);
+    google::InitGoogleLogging(argv[0]);
+    ::testing::InitGoogleTest(&argc, argv);
+    FLAGS_logtostderr = true;
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,83 @@
+/**
+ * This file is part of the test tools for the OpenIO client libraries
+ * Copyright (C) 2016 OpenIO SAS
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <utility>
+
+#include "utils/macros.h"
+#include "oio/blob/ec/fragment_pool.hpp"
+
+using oio::blob::ec::FragmentBuffer;
+using oio::blob::ec::FragmentPool;
+
+TEST(FragmentPool, Alignment) {
+    FragmentPool pool;
+    for (size_t size : {1UL, 4095UL, 4097UL, 1000000UL, 100000000UL}) {
+        FragmentBuffer buf;
+        ASSERT_TRUE(pool.Acquire(size, &buf));
+        ASSERT_FALSE(buf.empty());
+        ASSERT_EQ(size, buf.size());
+        ASSERT_GE(buf.capacity(), size);
+        ASSERT_EQ(0U, reinterpret_cast<uintptr_t>(buf.data())
+                      % FragmentPool::Alignment);
+    }
+}
+
+TEST(FragmentPool, Reuse) {
+    FragmentPool pool;
+    FragmentBuffer buf;
+    ASSERT_TRUE(pool.Acquire(5000, &buf));
+    ASSERT_EQ(8192U, buf.capacity());
+    const uint8_t *first = buf.data();
+    buf.Reset();
+    ASSERT_TRUE(buf.empty());
+    ASSERT_EQ(8192U, pool.Cached());
+
+    // Same size class, same buffer
+    ASSERT_TRUE(pool.Acquire(6000, &buf));
+    ASSERT_EQ(first, buf.data());
+    ASSERT_EQ(0U, pool.Cached());
+
+    // Moving the handle doesn't release the buffer
+    FragmentBuffer other(std::move(buf));
+    ASSERT_TRUE(buf.empty());
+    ASSERT_EQ(first, other.data());
+    ASSERT_EQ(0U, pool.Cached());
+}
+
+TEST(FragmentPool, Bounded) {
+    FragmentPool pool(4096);
+    FragmentBuffer b0, b1;
+    ASSERT_TRUE(pool.Acquire(4096, &b0));
+    ASSERT_TRUE(pool.Acquire(4096, &b1));
+    b0.Reset();
+    b1.Reset();
+    ASSERT_EQ(4096U, pool.Cached());
+    pool.Purge();
+    ASSERT_EQ(0U, pool.Cached());
+}
+
+int main(int argc UNUSED, char **argv) {
+    gflags::ParseCommandLineFlags(&argc, &argv, true);
+    google::InitGoogleLogging(argv[0]);
+    ::testing::InitGoogleTest(&argc, argv);
+    FLAGS_logtostderr = true;
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,172 @@
+/**
+ * This file is part of the test tools for the OpenIO client libraries
+ * Copyright (C) 2016 OpenIO SAS
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ */
+
+#include <gtest/gtest.h>
+#include <libmill.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "utils/macros.h"
+#include "oio/blob/kinetic/coro/Placement.h"
+
+using oio::kinetic::client::ClientInterface;
+using oio::kinetic::client::DriveHealth;
+using oio::kinetic::client::Exchange;
+using oio::kinetic::client::RoundRobinPlacement;
+using oio::kinetic::client::Sync;
+using oio::kinetic::client::WeightedPlacement;
+
+DECLARE_uint32(kinetic_placement_refresh);
+
+// The RPC toward a fake drive are never replied
+class NoReply : public Sync {
+ public:
+    void Wait() override {}
+};
+
+class FakeClient : public ClientInterface {
+ public:
+    explicit FakeClient(const std::string &id) : id_{id}, outstanding{0},
+                                                 latency{0} {}
+
+    std::shared_ptr<Sync> RPC(Exchange *ex UNUSED) override {
+        return std::shared_ptr<Sync>(new NoReply);
+    }
+
+    uint32_t NewBatch() override { return 0; }
+
+    std::string Id() const override { return id_; }
+
+    size_t Outstanding() const override { return outstanding; }
+
+    double Latency() const override { return latency; }
+
+ private:
+    std::string id_;
+
+ public:
+    size_t outstanding;
+    double latency;
+};
+
+typedef std::vector<std::shared_ptr<ClientInterface>> Clients;
+
+static Clients _make(unsigned int count) {
+    Clients clients;
+    for (unsigned int i = 0; i < count; ++i)
+        clients.emplace_back(new FakeClient("drive-" + std::to_string(i)));
+    return clients;
+}
+
+static std::vector<unsigned int> _spread(WeightedPlacement *p,
+        const Clients &clients, unsigned int rounds) {
+    std::vector<unsigned int> hits(clients.size(), 0);
+    for (unsigned int i = 0; i < rounds; ++i)
+        hits[p->Next(clients)]++;
+    return hits;
+}
+
+// Avoids the background GETLOG toward the fake drives
+static void _feed(WeightedPlacement *p, const Clients &clients) {
+    for (const auto &c : clients)
+        p->Update(c->Id(), DriveHealth());
+}
+
+TEST(Placement, RoundRobin) {
+    auto clients = _make(3);
+    RoundRobinPlacement p;
+    for (unsigned int i = 0; i < 7; ++i)
+        ASSERT_EQ(i % 3, p.Next(clients));
+}
+
+TEST(Placement, WeightedEven) {
+    auto clients = _make(3);
+    WeightedPlacement p;
+    _feed(&p, clients);
+    auto hits = _spread(&p, clients, 300);
+    for (auto h : hits)
+        ASSERT_EQ(100U, h);
+}
+
+TEST(Placement, WeightedHealth) {
+    auto clients = _make(3);
+    WeightedPlacement p;
+    _feed(&p, clients);
+
+    DriveHealth half, full;
+    half.space = 50;
+    full.space = 1;
+    p.Update(clients[1]->Id(), half);
+    p.Update(clients[2]->Id(), full);
+    ASSERT_EQ(0.0, p.Weight(*clients[2]));
+
+    auto hits = _spread(&p, clients, 300);
+    ASSERT_EQ(0U, hits[2]);
+    ASSERT_NEAR(200, hits[0], 1);
+    ASSERT_NEAR(100, hits[1], 1);
+}
+
+TEST(Placement, WeightedLoad) {
+    auto clients = _make(2);
+    WeightedPlacement p;
+    _feed(&p, clients);
+
+    auto busy = static_cast<FakeClient *>(clients[1].get());
+    busy->outstanding = 3;
+    auto hits = _spread(&p, clients, 500);
+    ASSERT_NEAR(400, hits[0], 1);
+    ASSERT_NEAR(100, hits[1], 1);
+
+    // Only full drives: still placing, in turns
+    DriveHealth full;
+    full.space = 0;
+    p.Update(clients[0]->Id(), full);
+    p.Update(clients[1]->Id(), full);
+    ASSERT_EQ(0U, p.Next(clients));
+    ASSERT_EQ(1U, p.Next(clients));
+}
+
+TEST(Placement, WeightedNoStats) {
+    auto clients = _make(2);
+    WeightedPlacement p;
+    _feed(&p, clients);
+    DriveHealth full;
+    full.space = 0;
+    p.Update(clients[1]->Id(), full);
+    ASSERT_EQ(0.0, p.Weight(*clients[1]));
+
+    // The GETLOG fails, the outdated figures are dropped
+    const auto period = FLAGS_kinetic_placement_refresh;
+    FLAGS_kinetic_placement_refresh = 0;
+    msleep(mill_now() + 2);
+    p.Next(clients);
+    yield();
+    FLAGS_kinetic_placement_refresh = period;
+    ASSERT_GT(p.Weight(*clients[1]), 0.0);
+    ASSERT_EQ(p.Weight(*clients[0]), p.Weight(*clients[1]));
+}
+
+int main(int argc UNUSED, char **argv) {
+    gflags::ParseCommandLineFlags(&argc, &argv, true);
+    google::InitGoogleLogging(argv[0]);
+    ::testing::InitGoogleTest(&argc, argv);
+    FLAGS_logtostderr = true;
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,83 @@
+/**
+ * This file is part of the test tools for the OpenIO client libraries
+ * Copyright (C) 2016 OpenIO SAS
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "utils/macros.h"
+#include "oio/blob/kinetic/coro/TimerWheel.h"
+
+using oio::kinetic::client::TimerWheel;
+
+TEST(TimerWheel, Expiration) {
+    TimerWheel wheel(100, 8);
+    wheel.Reset(1000);
+    wheel.Add(1050, 1);
+    wheel.Add(1250, 2);
+    wheel.Add(5000, 3);  // several turns ahead
+    wheel.Add(500, 4);  // already late
+    ASSERT_EQ(4U, wheel.Size());
+
+    // Nothing expires within the current slot
+    std::vector<int64_t> out;
+    wheel.Expire(1099, &out);
+    ASSERT_TRUE(out.empty());
+
+    out.clear();
+    wheel.Expire(1100, &out);
+    std::sort(out.begin(), out.end());
+    ASSERT_EQ(std::vector<int64_t>({1, 4}), out);
+
+    out.clear();
+    wheel.Expire(2000, &out);
+    ASSERT_EQ(std::vector<int64_t>({2}), out);
+    ASSERT_EQ(1U, wheel.Size());
+
+    // Jump far after the last deadline
+    out.clear();
+    wheel.Expire(100000, &out);
+    ASSERT_EQ(std::vector<int64_t>({3}), out);
+    ASSERT_EQ(0U, wheel.Size());
+}
+
+TEST(TimerWheel, ManyInFlight) {
+    const int64_t count = 10000;
+    TimerWheel wheel(100, 512);
+    wheel.Reset(0);
+    for (int64_t i = 0; i < count; ++i)
+        wheel.Add(i % 20000, i);
+    ASSERT_EQ(static_cast<size_t>(count), wheel.Size());
+
+    std::vector<int64_t> out;
+    for (int64_t now = 0; now <= 20000; now += 37)
+        wheel.Expire(now, &out);
+    ASSERT_EQ(static_cast<size_t>(count), out.size());
+    std::sort(out.begin(), out.end());
+    for (int64_t i = 0; i < count; ++i)
+        ASSERT_EQ(i, out[i]);
+}
+
+int main(int argc UNUSED, char **argv) {
+    gflags::ParseCommandLineFlags(&argc, &argv, true);
+    google::InitGoogleLogging(argv[0]);
+    ::testing::InitGoogleTest(&argc, argv);
+    FLAGS_logtostderr = true;
+    return RUN_ALL_TESTS();
+}
@@ -19,6 +19,8 @@
 #include <gtest/gtest.h>
 
 #include <array>
+#include <memory>
+#include <string>
 
 #include "utils/macros.h"
 #include "utils/utils.hpp"
@@ -35,6 +37,16 @@ TEST(Utils, Checksum) {
     ASSERT_EQ("26d80754ef7129ffae60b3fe018ba53a", h);
 }
 
+TEST(Utils, Hmac) {
+    std::unique_ptr<Hmac> hmac(hmac_make_SHA1("key"));
+    std::string out;
+    for (const std::string v : {"", "JFS", "JFS", "another value"}) {
+        hmac->Compute(v.data(), v.size(), &out);
+        const auto ref = compute_sha1_hmac("key", v);
+        ASSERT_EQ(std::string(ref.begin(), ref.end()), out);
+    }
+}
+
 TEST(Utils, bin2hex) {
     std::array<uint8_t, 3> bin;
     bin.fill(0);
@@ -45,6 +57,23 @@ TEST(Utils, bin2hex) {
     ASSERT_EQ("ffffff", bin2hex(bin.data(), bin.size()));
 }
 
+TEST(Utils, Crc) {
+    const std::string v("123456789");
+    ASSERT_EQ(0xE3069283U, compute_crc32c(v.data(), v.size()));
+    ASSERT_EQ(0x995DC9BBDF1939FAULL, compute_crc64(v.data(), v.size()));
+
+    // Incremental and one-shot computations agree, whatever the alignment
+    const std::string big(4099, 'x');
+    for (unsigned int cut : {0U, 1U, 7U, 8U, 1000U, 4099U}) {
+        auto crc = compute_crc32c(big.data(), cut);
+        crc = compute_crc32c(big.data() + cut, big.size() - cut, crc);
+        ASSERT_EQ(compute_crc32c(big.data(), big.size()), crc);
+        auto crc64 = compute_crc64(big.data(), cut);
+        crc64 = compute_crc64(big.data() + cut, big.size() - cut, crc64);
+        ASSERT_EQ(compute_crc64(big.data(), big.size()), crc64);
+    }
+}
+
 Status _gen(int err) { return Errno(err); }
 
 TEST(Api, Status) {